@@ -0,0 +1,102 @@
+#include "Adaptive.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+float relativeError(float mean, float m2, float count) {
+    if(count < 2.0f)
+        return std::numeric_limits<float>::infinity();
+    float stdErr = std::sqrt(std::max(m2, 0.0f) / ((count - 1.0f) * count));
+    // avoid the explosion of the dark pixels
+    return stdErr / (std::fabs(mean) + 1e-3f);
+}
+
+float tileError(const float* errors, unsigned width, unsigned height,
+                unsigned tileSize, unsigned tileX, unsigned tileY) {
+    unsigned bx = tileX * tileSize, by = tileY * tileSize;
+    unsigned ex = std::min(bx + tileSize, width),
+             ey = std::min(by + tileSize, height);
+    double sum = 0.0;
+    for(unsigned y = by; y < ey; ++y)
+        for(unsigned x = bx; x < ex; ++x)
+            sum += errors[static_cast<size_t>(y) * width + x];
+    return static_cast<float>(sum / ((ex - bx) * (ey - by)));
+}
+
+AdaptiveScheduler::AdaptiveScheduler(unsigned width, unsigned height,
+                                     unsigned tileSize, unsigned minSPP,
+                                     unsigned maxSPP, unsigned samplePerLaunch,
+                                     float threshold)
+    : mWidth(width), mHeight(height), mTileSize(std::max(tileSize, 1U)),
+      mMaxSPP(maxSPP), mSamplePerLaunch(std::max(samplePerLaunch, 1U)),
+      mThreshold(threshold) {
+    // at least 2 samples are required by the variance
+    mMinSPP = std::min(std::max(minSPP, 2U), mMaxSPP);
+    mTileX = (width + mTileSize - 1) / mTileSize;
+    mTileY = (height + mTileSize - 1) / mTileSize;
+    mTileSPP.resize(mTileX * mTileY, 0);
+    if(mMaxSPP)
+        for(unsigned i = 0; i < mTileSPP.size(); ++i)
+            mActive.push_back(i);
+}
+
+std::vector<TileTask> AdaptiveScheduler::next() {
+    std::vector<TileTask> res;
+    res.reserve(mActive.size());
+    for(auto id : mActive) {
+        unsigned& spp = mTileSPP[id];
+        // don't cross the min SPP, the error is estimated there
+        unsigned limit = spp < mMinSPP ? mMinSPP : mMaxSPP;
+        TileTask task;
+        task.x = id % mTileX * mTileSize;
+        task.y = id / mTileX * mTileSize;
+        task.sampleIdxBeg = spp;
+        task.sampleIdxEnd = std::min(spp + mSamplePerLaunch, limit);
+        spp = task.sampleIdxEnd;
+        res.push_back(task);
+    }
+    mActive.erase(std::remove_if(mActive.begin(), mActive.end(),
+                                 [this](unsigned id) {
+                                     return mTileSPP[id] >= mMaxSPP;
+                                 }),
+                  mActive.end());
+    return res;
+}
+
+bool AdaptiveScheduler::needUpdate() const {
+    return std::any_of(mActive.begin(), mActive.end(), [this](unsigned id) {
+        return mTileSPP[id] >= mMinSPP;
+    });
+}
+
+void AdaptiveScheduler::update(const std::vector<TileTask>& tasks,
+                               const float* errors) {
+    // The active tiles are among the tasks.
+    std::vector<bool> converged(mTileSPP.size(), false);
+    for(size_t i = 0; i < tasks.size(); ++i) {
+        unsigned id =
+            tasks[i].y / mTileSize * mTileX + tasks[i].x / mTileSize;
+        converged[id] = mTileSPP[id] >= mMinSPP && errors[i] <= mThreshold;
+    }
+    mActive.erase(std::remove_if(mActive.begin(), mActive.end(),
+                                 [&](unsigned id) { return converged[id]; }),
+                  mActive.end());
+}
+
+unsigned AdaptiveScheduler::activeTileCount() const {
+    return static_cast<unsigned>(mActive.size());
+}
+
+unsigned AdaptiveScheduler::tileCount() const {
+    return static_cast<unsigned>(mTileSPP.size());
+}
+
+double AdaptiveScheduler::averageSPP() const {
+    double sum = 0.0;
+    for(unsigned id = 0; id < mTileSPP.size(); ++id) {
+        unsigned w = std::min(mTileSize, mWidth - id % mTileX * mTileSize);
+        unsigned h = std::min(mTileSize, mHeight - id / mTileX * mTileSize);
+        sum += static_cast<double>(mTileSPP[id]) * w * h;
+    }
+    return sum / (static_cast<double>(mWidth) * mHeight);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "Tile.hpp"
+#include <vector>
+
+// The host side logic of the AdaptiveSampler. The film is split into square
+// tiles and all pixels of a tile share the same sample count. No CUDA is
+// involved.
+
+// The relative standard error of the mean luminance of a pixel. The error of
+// a pixel with less than two samples is infinity.
+float relativeError(float mean, float m2, float count);
+// The average error of the pixels in the tile. errors is row major. It is
+// the host reference of the reduction of the adaptiveKernel.
+float tileError(const float* errors, unsigned width, unsigned height,
+                unsigned tileSize, unsigned tileX, unsigned tileY);
+
+class AdaptiveScheduler final {
+private:
+    unsigned mWidth, mHeight, mTileSize, mTileX, mTileY, mMinSPP, mMaxSPP,
+        mSamplePerLaunch;
+    float mThreshold;
+    std::vector<unsigned> mTileSPP, mActive;
+
+public:
+    // Every tile takes minSPP samples before its error is estimated.
+    AdaptiveScheduler(unsigned width, unsigned height, unsigned tileSize,
+                      unsigned minSPP, unsigned maxSPP,
+                      unsigned samplePerLaunch, float threshold);
+    // The tasks of the next launch, empty when all tiles converge or reach
+    // the max SPP.
+    std::vector<TileTask> next();
+    // Whether update should be called before the next call of next.
+    bool needUpdate() const;
+    // Deactivate the converged tiles. errors[i] is the tileError of
+    // tasks[i], tasks is the result of the last call of next.
+    void update(const std::vector<TileTask>& tasks, const float* errors);
+    unsigned activeTileCount() const;
+    unsigned tileCount() const;
+    double averageSPP() const;
+};
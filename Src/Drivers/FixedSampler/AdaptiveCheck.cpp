@@ -0,0 +1,207 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplingCheck.hpp"
+#include "Adaptive.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <cmath>
+#include <limits>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.AdaptiveCheck");
+
+// Drive the AdaptiveScheduler like the AdaptiveSampler with synthetic
+// errors. The error of a tile after n samples is sigma/sqrt(n), sigma is
+// chosen so that the tiles converge all over [MinSampleCount,
+// MaxSampleCount] and beyond. Fail if a task breaks the sample order or
+// the bounds, if a tile doesn't stop at the first update below the
+// threshold, at MaxSampleCount otherwise, or if the loop doesn't terminate.
+static int check(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("AdaptiveCheck", "FixedSampler::AdaptiveCheck");
+        opt.add_options()("w,width", "film width",
+                          cxxopts::value<unsigned>()->default_value("1000"))(
+            "h,height", "film height",
+            cxxopts::value<unsigned>()->default_value("600"))(
+            "t,tile", "tile size",
+            cxxopts::value<unsigned>()->default_value("16"))(
+            "min", "min sample count",
+            cxxopts::value<unsigned>()->default_value("16"))(
+            "max", "max sample count",
+            cxxopts::value<unsigned>()->default_value("1024"))(
+            "l,launch", "samples per launch",
+            cxxopts::value<unsigned>()->default_value("8"))(
+            "threshold", "relative error threshold",
+            cxxopts::value<float>()->default_value("0.01"))(
+            "s,seed", "random seed",
+            cxxopts::value<unsigned>()->default_value("0"));
+        auto res = opt.parse(argc, argv);
+        unsigned width = res["width"].as<unsigned>();
+        unsigned height = res["height"].as<unsigned>();
+        unsigned tileSize = res["tile"].as<unsigned>();
+        unsigned launch = res["launch"].as<unsigned>();
+        if(width == 0 || height == 0 || tileSize == 0 || launch == 0)
+            BUS_TRACE_THROW(std::invalid_argument("Need positive sizes"));
+
+        CheckLog log(reporter, BUS_DEFSRCLOC());
+
+        if(!std::isinf(relativeError(1.0f, 1.0f, 1.0f)))
+            log.fail("The error of a single sample is finite");
+        float err = relativeError(2.0f, 27.0f, 10.0f);
+        if(std::fabs(err - std::sqrt(0.3f) / 2.001f) > 1e-6f)
+            log.fail("Bad relative error " + std::to_string(err));
+        {
+            // The partial tiles at the right and the bottom edges.
+            unsigned w = 10, h = 7;
+            std::vector<float> errors(w * h);
+            for(unsigned y = 0; y < h; ++y)
+                for(unsigned x = 0; x < w; ++x)
+                    errors[y * w + x] = static_cast<float>(x + 100 * y);
+            // the mean of x in [8,10) and y in [4,7)
+            if(tileError(errors.data(), w, h, 4, 2, 1) != 508.5f)
+                log.fail("Bad error of the partial tile");
+        }
+
+        std::mt19937 eng(res["seed"].as<unsigned>());
+        std::uniform_real_distribution<float> dis;
+        std::stringstream ss;
+        // The tiles stop where they are expected to, tileSPP is tracked
+        // from the tasks instead of the scheduler.
+        auto run = [&](const char* name, unsigned minSPP, unsigned maxSPP,
+                       float threshold, float scale) {
+            AdaptiveScheduler scheduler(width, height, tileSize, minSPP,
+                                        maxSPP, launch, threshold);
+            unsigned tileX = (width + tileSize - 1) / tileSize;
+            unsigned tileY = (height + tileSize - 1) / tileSize;
+            unsigned tiles = tileX * tileY;
+            if(scheduler.tileCount() != tiles)
+                log.fail(std::string(name) + ": bad tile count");
+            // The tile stops at about (sigma/scale)^2 samples.
+            std::vector<float> sigma(tiles);
+            float range = std::log(2.0f * std::max(maxSPP, 1U));
+            for(auto& s : sigma)
+                s = scale * std::sqrt(std::exp(dis(eng) * range));
+
+            unsigned realMin = std::min(std::max(minSPP, 2U), maxSPP);
+            std::vector<unsigned> expected(tiles, 0);
+            for(unsigned i = 0; i < tiles && maxSPP; ++i) {
+                unsigned spp = 0;
+                while(true) {
+                    spp = std::min(spp + launch,
+                                   spp < realMin ? realMin : maxSPP);
+                    if(spp >= maxSPP ||
+                       (spp >= realMin &&
+                        sigma[i] / std::sqrt(static_cast<float>(spp)) <=
+                            threshold))
+                        break;
+                }
+                expected[i] = spp;
+            }
+
+            std::vector<unsigned> tileSPP(tiles, 0);
+            std::vector<bool> stopped(tiles, false);
+            std::vector<float> errors(static_cast<size_t>(width) * height);
+            unsigned launches = 0, bad = 0;
+            unsigned maxLaunches = (realMin + launch - 1) / launch +
+                (maxSPP + launch - 1) / launch + 1;
+            while(true) {
+                std::vector<TileTask> tasks = scheduler.next();
+                if(tasks.empty())
+                    break;
+                if(++launches > maxLaunches) {
+                    log.fail(std::string(name) +
+                             ": the loop doesn't terminate");
+                    break;
+                }
+                for(auto&& task : tasks) {
+                    unsigned id = task.y / tileSize * tileX + task.x / tileSize;
+                    if(task.x % tileSize || task.y % tileSize || id >= tiles ||
+                       stopped[id] || task.sampleIdxBeg != tileSPP[id] ||
+                       task.sampleIdxEnd <= task.sampleIdxBeg ||
+                       task.sampleIdxEnd > maxSPP ||
+                       (task.sampleIdxBeg < realMin &&
+                        task.sampleIdxEnd > realMin)) {
+                        ++bad;
+                        continue;
+                    }
+                    tileSPP[id] = task.sampleIdxEnd;
+                }
+                if(!scheduler.needUpdate())
+                    continue;
+                for(unsigned y = 0; y < height; ++y)
+                    for(unsigned x = 0; x < width; ++x) {
+                        unsigned id = y / tileSize * tileX + x / tileSize;
+                        float spp = static_cast<float>(tileSPP[id]);
+                        errors[static_cast<size_t>(y) * width + x] =
+                            spp < 2.0f ?
+                            std::numeric_limits<float>::infinity() :
+                            sigma[id] / std::sqrt(spp);
+                    }
+                // the reduction of the adaptiveKernel
+                std::vector<float> taskErrors(tasks.size());
+                for(size_t i = 0; i < tasks.size(); ++i)
+                    taskErrors[i] = tileError(
+                        errors.data(), width, height, tileSize,
+                        tasks[i].x / tileSize, tasks[i].y / tileSize);
+                scheduler.update(tasks, taskErrors.data());
+                // The converged tiles don't take more samples.
+                for(unsigned i = 0; i < tiles; ++i)
+                    stopped[i] = tileSPP[i] >= realMin &&
+                        errors[static_cast<size_t>(i / tileX * tileSize) *
+                                   width +
+                               i % tileX * tileSize] <= threshold;
+            }
+            if(bad)
+                log.fail(std::string(name) + ": " + std::to_string(bad) +
+                         " bad tasks");
+            if(scheduler.activeTileCount())
+                log.fail(std::string(name) + ": the active tiles are left");
+            unsigned wrong = 0;
+            double sum = 0.0;
+            for(unsigned i = 0; i < tiles; ++i) {
+                if(tileSPP[i] != expected[i])
+                    ++wrong;
+                unsigned w = std::min(tileSize, width - i % tileX * tileSize);
+                unsigned h = std::min(tileSize, height - i / tileX * tileSize);
+                sum += static_cast<double>(tileSPP[i]) * w * h;
+            }
+            if(wrong)
+                log.fail(std::string(name) + ": " + std::to_string(wrong) +
+                         " tiles stop at the wrong sample count");
+            double avg = sum / (static_cast<double>(width) * height);
+            if(std::fabs(scheduler.averageSPP() - avg) > 1e-6 * (avg + 1.0))
+                log.fail(std::string(name) + ": bad average SPP");
+            ss << (ss.tellp() ? "; " : "") << name << " " << launches
+               << " launches, " << avg << " SPP";
+        };
+        unsigned minSPP = res["min"].as<unsigned>();
+        unsigned maxSPP = res["max"].as<unsigned>();
+        float threshold = res["threshold"].as<float>();
+        run("adaptive", minSPP, maxSPP, threshold, threshold);
+        // Nothing converges, everything converges at MinSampleCount.
+        run("zero threshold", minSPP, maxSPP, 0.0f, threshold);
+        run("huge threshold", minSPP, maxSPP, 1e30f, threshold);
+        // MinSampleCount is clamped into [2,MaxSampleCount].
+        run("min over max", maxSPP + 1, maxSPP, threshold, threshold);
+        run("min below 2", 0, maxSPP, threshold, threshold);
+        run("no sample", minSPP, 0, threshold, threshold);
+
+        return log.finish(ss.str());
+    }
+    BUS_TRACE_END();
+}
+
+class AdaptiveCheck final : public Command {
+public:
+    explicit AdaptiveCheck(Bus::ModuleInstance& instance)
+        : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return check(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getAdaptiveCheck(Bus::ModuleInstance& instance) {
+    return std::make_shared<AdaptiveCheck>(instance);
+}
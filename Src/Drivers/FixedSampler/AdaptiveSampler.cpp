@@ -0,0 +1,124 @@
+#include "../../Shared/ConfigAPI.hpp"
+#include "Adaptive.hpp"
+#include "DataDesc.hpp"
+#include "DriverBase.hpp"
+#include "Film.hpp"
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.AdaptiveSampler");
+
+// Spend the samples on the tiles whose relative error is greater than the
+// threshold after MinSampleCount samples.
+class AdaptiveSampler final : public DriverBase {
+private:
+    fs::path mOutput;
+    unsigned mMaxSampleCount, mMinSampleCount, mSamplePerLaunch, mTileSize;
+    float mThreshold;
+
+public:
+    explicit AdaptiveSampler(Bus::ModuleInstance& instance)
+        : DriverBase(instance) {}
+    DriverData init(PluginHelper helper,
+                    std::shared_ptr<Config> config) override {
+        BUS_TRACE_BEG() {
+            mOutput =
+                helper->outputPath(config->attribute("Output")->asString());
+            mMaxSampleCount = config->attribute("MaxSampleCount")->asUint();
+            mMinSampleCount = config->getUint("MinSampleCount", 16);
+            mSamplePerLaunch = config->attribute("SamplePerLaunch")->asUint();
+            mTileSize = std::max(config->getUint("TileSize", 16), 1U);
+            mThreshold = config->getFloat("Threshold", 0.01f);
+            DriverData res =
+                initBase(helper, config, "__raygen__adaptiveKernel");
+            res.maxSPP = mMaxSampleCount;
+            return res;
+        }
+        BUS_TRACE_END();
+    }
+    void doRender(unsigned realSPP, DriverHelper helper) override {
+        BUS_TRACE_BEG() {
+            CUstream stream = helper->getStream();
+            AdaptiveDataDesc data;
+            data.filtBadColor = mFiltBadColor;
+            data.width = mFilmSize.x;
+            data.height = mFilmSize.y;
+            data.tileSize = mTileSize;
+            data.rankEnd = realSPP;
+            data.sampleOnePixel = mSampleOnePixel;
+            data.generateRay = mGenerateRay;
+            size_t filmSize = mFilmSize.x * mFilmSize.y;
+            Buffer output = allocBuffer(sizeof(Vec4) * filmSize, 16);
+            checkCudaError(
+                cuMemsetD16(asPtr(output), 0, sizeof(Vec4) / 16 * filmSize));
+            data.outputBuffer = static_cast<Vec4*>(output.get());
+            Buffer stat = allocBuffer(sizeof(Vec2) * filmSize, 16);
+            checkCudaError(
+                cuMemsetD32(asPtr(stat), 0, sizeof(Vec2) / 4 * filmSize));
+            data.statBuffer = static_cast<Vec2*>(stat.get());
+
+            uploadRecords(stream);
+
+            AdaptiveScheduler scheduler(mFilmSize.x, mFilmSize.y, mTileSize,
+                                        mMinSampleCount, realSPP,
+                                        mSamplePerLaunch, mThreshold);
+            // The tile errors are reduced on the device, only they are
+            // downloaded instead of the film.
+            Buffer tileErrors =
+                allocBuffer(sizeof(float) * scheduler.tileCount(), 16);
+            while(true) {
+                std::vector<TileTask> tasks = scheduler.next();
+                if(tasks.empty())
+                    break;
+                bool update = scheduler.needUpdate();
+                data.tileErrorBuffer = nullptr;
+                if(update) {
+                    checkCudaError(cuMemsetD32Async(asPtr(tileErrors), 0,
+                                                    tasks.size(), stream));
+                    data.tileErrorBuffer =
+                        static_cast<float*>(tileErrors.get());
+                }
+                Buffer taskBuf =
+                    uploadData(stream, tasks.data(), tasks.size());
+                data.tasks = static_cast<const TileTask*>(taskBuf.get());
+                Buffer rayGenSBT =
+                    uploadData(stream, packSBTRecord(mRayGen.get(), data));
+
+                helper->doRender(
+                    [&](OptixShaderBindingTable& table) {
+                        fillSBT(table, rayGenSBT);
+                    },
+                    Uint2{ mTileSize,
+                           mTileSize * static_cast<unsigned>(tasks.size()) });
+
+                if(update) {
+                    checkCudaError(cuStreamSynchronize(stream));
+                    std::vector<float> errors =
+                        downloadData<float>(tileErrors, 0, tasks.size());
+                    scheduler.update(tasks, errors.data());
+                }
+                {
+                    std::stringstream ss;
+                    ss.precision(2);
+                    ss << std::fixed << "Active tiles:"
+                       << scheduler.activeTileCount() << "/"
+                       << scheduler.tileCount()
+                       << " SPP:" << scheduler.averageSPP() << std::endl;
+                    reporter().apply(ReportLevel::Info, ss.str(),
+                                     BUS_DEFSRCLOC());
+                }
+            }
+            checkCudaError(cuStreamSynchronize(stream));
+            std::vector<Vec4> acc = downloadData<Vec4>(output, 0, filmSize);
+            saveEXR(mOutput, mFilmSize, acc, mOutputOptions, reporter());
+            if(!mLDROutput.empty())
+                saveLDR(mLDROutput, mFilmSize, acc.data(), mToneMap,
+                        mOutputOptions.threads, reporter());
+        }
+        BUS_TRACE_END();
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getAdaptiveSampler(Bus::ModuleInstance& instance) {
+    return std::make_shared<AdaptiveSampler>(instance);
+}
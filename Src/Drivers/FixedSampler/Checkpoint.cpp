@@ -0,0 +1,237 @@
+#include "Checkpoint.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#pragma warning(push, 0)
+#include <lz4.h>
+#pragma warning(pop)
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t checkpointMagic = 0x504B4350;  // PCKP
+// Bump it when the layout changes.
+constexpr uint32_t checkpointVersion = 2;
+constexpr uint32_t flagLZ4 = 1;
+// LZ4 works with int sizes, large films are processed in blocks.
+constexpr size_t blockSize = 64 << 20;
+
+struct CheckpointHeader final {
+    uint32_t magic, version, flags;
+    uint32_t width, height, sampleIdxFirst, sampleIdxBeg, sampleIdxEnd;
+    uint64_t fingerprint, payloadSize;
+};
+
+template <typename T>
+static void append(std::vector<char>& data, const T& val) {
+    const char* ptr = reinterpret_cast<const char*>(&val);
+    data.insert(data.end(), ptr, ptr + sizeof(T));
+}
+
+template <typename T>
+static T read(std::istream& in) {
+    T res;
+    if(!in.read(reinterpret_cast<char*>(&res), sizeof(T)))
+        throw std::runtime_error("Truncated checkpoint");
+    return res;
+}
+
+std::vector<char> serializeCheckpoint(const Checkpoint& checkpoint,
+                                      bool compress) {
+    CheckpointHeader header = {};
+    header.magic = checkpointMagic;
+    header.version = checkpointVersion;
+    header.flags = compress ? flagLZ4 : 0;
+    header.width = checkpoint.width;
+    header.height = checkpoint.height;
+    header.sampleIdxFirst = checkpoint.sampleIdxFirst;
+    header.sampleIdxBeg = checkpoint.sampleIdxBeg;
+    header.sampleIdxEnd = checkpoint.sampleIdxEnd;
+    header.fingerprint = checkpoint.fingerprint;
+    header.payloadSize = checkpoint.accumulation.size() * sizeof(float);
+    std::vector<char> res;
+    append(res, header);
+    const char* src =
+        reinterpret_cast<const char*>(checkpoint.accumulation.data());
+    if(!compress) {
+        res.insert(res.end(), src, src + header.payloadSize);
+        return res;
+    }
+    std::vector<char> block(LZ4_compressBound(static_cast<int>(blockSize)));
+    for(size_t beg = 0; beg < header.payloadSize; beg += blockSize) {
+        int size = static_cast<int>(
+            std::min(blockSize, static_cast<size_t>(header.payloadSize - beg)));
+        int compSize =
+            LZ4_compress_default(src + beg, block.data(), size,
+                                 static_cast<int>(block.size()));
+        if(compSize <= 0)
+            throw std::runtime_error("Failed to compress checkpoint");
+        append(res, static_cast<uint32_t>(compSize));
+        res.insert(res.end(), block.data(), block.data() + compSize);
+    }
+    return res;
+}
+
+CheckpointReader::CheckpointReader(std::istream& in) : mIn(in), mOffset(0) {
+    auto header = read<CheckpointHeader>(in);
+    if(header.magic != checkpointMagic)
+        throw std::runtime_error("Not a checkpoint");
+    if(header.version != checkpointVersion)
+        throw std::runtime_error("Unsupported checkpoint version " +
+                                 std::to_string(header.version));
+    if(header.payloadSize !=
+       static_cast<uint64_t>(header.width) * header.height * 4 *
+           sizeof(float))
+        throw std::runtime_error("Corrupted checkpoint");
+    mInfo.fingerprint = header.fingerprint;
+    mInfo.width = header.width;
+    mInfo.height = header.height;
+    mInfo.sampleIdxFirst = header.sampleIdxFirst;
+    mInfo.sampleIdxBeg = header.sampleIdxBeg;
+    mInfo.sampleIdxEnd = header.sampleIdxEnd;
+    mFlags = header.flags;
+    mSize = header.payloadSize;
+}
+
+const Checkpoint& CheckpointReader::info() const {
+    return mInfo;
+}
+
+bool CheckpointReader::next(std::vector<float>& block, size_t& offset) {
+    if(mOffset >= mSize)
+        return false;
+    size_t size = static_cast<size_t>(
+        std::min<uint64_t>(blockSize, mSize - mOffset));
+    block.resize(size / sizeof(float));
+    char* dst = reinterpret_cast<char*>(block.data());
+    if(mFlags & flagLZ4) {
+        auto compSize = read<uint32_t>(mIn);
+        mCompressed.resize(compSize);
+        if(!mIn.read(mCompressed.data(), compSize))
+            throw std::runtime_error("Truncated checkpoint");
+        if(LZ4_decompress_safe(mCompressed.data(), dst,
+                               static_cast<int>(compSize),
+                               static_cast<int>(size)) !=
+           static_cast<int>(size))
+            throw std::runtime_error("Corrupted checkpoint");
+    } else if(!mIn.read(dst, static_cast<std::streamsize>(size)))
+        throw std::runtime_error("Truncated checkpoint");
+    offset = static_cast<size_t>(mOffset / sizeof(float));
+    mOffset += size;
+    return true;
+}
+
+static Checkpoint readAll(std::istream& in) {
+    CheckpointReader reader(in);
+    Checkpoint res = reader.info();
+    res.accumulation.resize(static_cast<size_t>(res.width) * res.height * 4);
+    std::vector<float> block;
+    size_t offset;
+    while(reader.next(block, offset))
+        std::copy(block.begin(), block.end(),
+                  res.accumulation.begin() + offset);
+    if(in.peek() != std::char_traits<char>::eof())
+        throw std::runtime_error("Corrupted checkpoint");
+    return res;
+}
+
+Checkpoint deserializeCheckpoint(const std::vector<char>& data) {
+    std::istringstream in(std::string(data.begin(), data.end()));
+    return readAll(in);
+}
+
+void saveCheckpoint(const fs::path& path, const Checkpoint& checkpoint,
+                    bool compress) {
+    std::vector<char> data = serializeCheckpoint(checkpoint, compress);
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        out.flush();
+        if(!out)
+            throw std::runtime_error("Failed to write checkpoint " +
+                                     tmp.string());
+    }
+    fs::rename(tmp, path);
+}
+
+Checkpoint loadCheckpoint(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in)
+        throw std::runtime_error("Failed to open checkpoint " + path.string());
+    return readAll(in);
+}
+
+uint32_t resumeSampleIndex(const Checkpoint& checkpoint, uint64_t fingerprint,
+                           uint32_t width, uint32_t height,
+                           uint32_t sampleIdxFirst, uint32_t sampleIdxEnd) {
+    if(checkpoint.fingerprint != fingerprint)
+        throw std::runtime_error("The checkpoint belongs to another scene");
+    if(checkpoint.width != width || checkpoint.height != height)
+        throw std::runtime_error("The film size of the checkpoint mismatches");
+    if(checkpoint.sampleIdxFirst != sampleIdxFirst ||
+       checkpoint.sampleIdxEnd != sampleIdxEnd)
+        throw std::runtime_error("The sample range of the checkpoint "
+                                 "mismatches");
+    return std::clamp(checkpoint.sampleIdxBeg, sampleIdxFirst, sampleIdxEnd);
+}
+
+Checkpoint mergeCheckpoints(const std::vector<fs::path>& shards,
+                            unsigned threadNum) {
+    if(shards.empty())
+        throw std::invalid_argument("No shard to merge");
+    std::vector<Checkpoint> infos;
+    for(auto&& shard : shards) {
+        std::ifstream in(shard, std::ios::binary);
+        if(!in)
+            throw std::runtime_error("Failed to open shard " + shard.string());
+        infos.push_back(CheckpointReader(in).info());
+    }
+    Checkpoint res = infos.front();
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    uint32_t merged = 0;
+    for(size_t i = 0; i < infos.size(); ++i) {
+        const Checkpoint& info = infos[i];
+        if(info.fingerprint != res.fingerprint)
+            throw std::runtime_error(shards[i].string() +
+                                     " belongs to another scene");
+        if(info.width != res.width || info.height != res.height)
+            throw std::runtime_error("The film size of " + shards[i].string() +
+                                     " mismatches");
+        ranges.emplace_back(info.sampleIdxFirst, info.sampleIdxBeg);
+        merged += info.sampleIdxBeg - info.sampleIdxFirst;
+        res.sampleIdxFirst = std::min(res.sampleIdxFirst, info.sampleIdxFirst);
+        res.sampleIdxEnd = std::max(res.sampleIdxEnd, info.sampleIdxEnd);
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for(size_t i = 1; i < ranges.size(); ++i)
+        if(ranges[i].first < ranges[i - 1].second)
+            throw std::runtime_error("The sample ranges of the shards "
+                                     "overlap");
+    res.sampleIdxBeg = res.sampleIdxFirst + merged;
+
+    // Every shard is streamed by one worker and added to the result under
+    // the lock of the block, so the memory usage is the result plus one
+    // block per worker.
+    size_t size = static_cast<size_t>(res.width) * res.height * 4;
+    res.accumulation.assign(size, 0.0f);
+    size_t blockFloats = blockSize / sizeof(float);
+    std::vector<std::mutex> locks((size + blockFloats - 1) / blockFloats);
+    ThreadPool pool(threadNum);
+    parallelFor(pool, shards.size(), [&](size_t idx) {
+        std::ifstream in(shards[idx], std::ios::binary);
+        CheckpointReader reader(in);
+        std::vector<float> block;
+        size_t offset;
+        while(reader.next(block, offset)) {
+            std::lock_guard<std::mutex> guard(locks[offset / blockFloats]);
+            float* dst = res.accumulation.data() + offset;
+            for(size_t i = 0; i < block.size(); ++i)
+                dst[i] += block[i];
+        }
+    });
+    return res;
+}
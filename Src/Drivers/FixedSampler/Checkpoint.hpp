@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <vector>
+
+// The accumulation state of a FixedSampler render. It is used by both the
+// checkpoints and the shards of a distributed render. No CUDA is involved.
+struct Checkpoint final {
+    // The hash of the scene description.
+    uint64_t fingerprint;
+    uint32_t width, height;
+    // The samples [sampleIdxFirst,sampleIdxBeg) of the range
+    // [sampleIdxFirst,sampleIdxEnd) are accumulated. A finished shard has
+    // sampleIdxBeg==sampleIdxEnd.
+    uint32_t sampleIdxFirst, sampleIdxBeg, sampleIdxEnd;
+    // (sum of radiance,sample count) per pixel
+    std::vector<float> accumulation;
+};
+
+std::vector<char> serializeCheckpoint(const Checkpoint& checkpoint,
+                                      bool compress);
+// Throw std::runtime_error if the data is truncated or corrupted.
+Checkpoint deserializeCheckpoint(const std::vector<char>& data);
+
+// Read the accumulation block by block, so a large file isn't loaded at
+// once.
+class CheckpointReader final {
+private:
+    std::istream& mIn;
+    Checkpoint mInfo;
+    uint32_t mFlags;
+    uint64_t mOffset, mSize;
+    std::vector<char> mCompressed;
+
+public:
+    explicit CheckpointReader(std::istream& in);
+    // Everything except the accumulation.
+    const Checkpoint& info() const;
+    // Read the next block, return false at the end. offset is the index of
+    // the first float of the block in the accumulation.
+    bool next(std::vector<float>& block, size_t& offset);
+};
+
+// The file is replaced atomically, so a crash during writing keeps the last
+// complete checkpoint.
+void saveCheckpoint(const std::filesystem::path& path,
+                    const Checkpoint& checkpoint, bool compress);
+Checkpoint loadCheckpoint(const std::filesystem::path& path);
+
+// The sample index to continue from. Throw std::runtime_error if the
+// checkpoint doesn't belong to this render.
+uint32_t resumeSampleIndex(const Checkpoint& checkpoint, uint64_t fingerprint,
+                           uint32_t width, uint32_t height,
+                           uint32_t sampleIdxFirst, uint32_t sampleIdxEnd);
+
+// Sum the shards with threadNum threads(0 for all cores). The fingerprints
+// and the film sizes must match and the sample ranges must be disjoint. The
+// merged range is [min first,max end) and sampleIdxBeg is the number of
+// merged samples plus sampleIdxFirst, so gaps are visible.
+Checkpoint
+mergeCheckpoints(const std::vector<std::filesystem::path>& shards,
+                 unsigned threadNum);
@@ -0,0 +1,141 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplingCheck.hpp"
+#include "Checkpoint.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <cstring>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.CheckpointCheck");
+
+// Round-trip a random accumulation with and without LZ4 through the memory
+// and a file. The film spans several LZ4 blocks by default and half of the
+// pixels are empty like a partial render. Fail if the state differs, if a
+// truncated or corrupted checkpoint is accepted or if the resumed sample
+// index is wrong.
+static int check(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("CheckpointCheck",
+                             "FixedSampler::CheckpointCheck");
+        opt.add_options()("w,width", "film width",
+                          cxxopts::value<unsigned>()->default_value("2100"))(
+            "h,height", "film height",
+            cxxopts::value<unsigned>()->default_value("2100"))(
+            "s,seed", "random seed",
+            cxxopts::value<unsigned>()->default_value("0"));
+        auto res = opt.parse(argc, argv);
+
+        CheckLog log(reporter, BUS_DEFSRCLOC());
+
+        std::mt19937_64 eng(res["seed"].as<unsigned>());
+        std::uniform_real_distribution<float> dis;
+        Checkpoint ref;
+        ref.fingerprint = eng();
+        ref.width = res["width"].as<unsigned>();
+        ref.height = res["height"].as<unsigned>();
+        ref.sampleIdxFirst = 64;
+        ref.sampleIdxBeg = 1000;
+        ref.sampleIdxEnd = 4096;
+        ref.accumulation.resize(static_cast<size_t>(ref.width) * ref.height *
+                                4);
+        for(size_t i = 0; i < ref.accumulation.size(); i += 4)
+            if(dis(eng) < 0.5f)
+                for(size_t j = 0; j < 4; ++j)
+                    ref.accumulation[i + j] = 100.0f * dis(eng);
+
+        auto same = [&](const Checkpoint& cp) {
+            return cp.fingerprint == ref.fingerprint &&
+                cp.width == ref.width && cp.height == ref.height &&
+                cp.sampleIdxFirst == ref.sampleIdxFirst &&
+                cp.sampleIdxBeg == ref.sampleIdxBeg &&
+                cp.sampleIdxEnd == ref.sampleIdxEnd &&
+                cp.accumulation.size() == ref.accumulation.size() &&
+                std::memcmp(cp.accumulation.data(), ref.accumulation.data(),
+                            ref.accumulation.size() * sizeof(float)) == 0;
+        };
+        auto rejected = [&](const std::vector<char>& data) {
+            try {
+                deserializeCheckpoint(data);
+            } catch(const std::runtime_error&) {
+                return true;
+            }
+            return false;
+        };
+
+        std::stringstream ss;
+        fs::path path = fs::temp_directory_path() /
+            ("PiperCheckpointCheck" + std::to_string(ref.fingerprint) +
+             ".ckpt");
+        for(bool compress : { false, true }) {
+            std::string mode = compress ? "LZ4" : "raw";
+            std::vector<char> data = serializeCheckpoint(ref, compress);
+            ss << mode << " " << data.size() << " bytes, ";
+            if(!same(deserializeCheckpoint(data)))
+                log.fail("The " + mode + " checkpoint differs in the memory");
+            saveCheckpoint(path, ref, compress);
+            if(!same(loadCheckpoint(path)))
+                log.fail("The " + mode + " checkpoint differs in the file");
+
+            std::vector<char> truncated(data.begin(), data.end() - 1);
+            if(!rejected(truncated))
+                log.fail("The truncated " + mode + " checkpoint is accepted");
+            std::vector<char> padded = data;
+            padded.push_back(0);
+            if(!rejected(padded))
+                log.fail("The padded " + mode + " checkpoint is accepted");
+            std::vector<char> corrupted = data;
+            corrupted[0] ^= 1;
+            if(!rejected(corrupted))
+                log.fail("The corrupted " + mode + " checkpoint is accepted");
+        }
+        std::error_code ec;
+        fs::remove(path, ec);
+
+        // The render continues from sampleIdxBeg and refuses the
+        // checkpoints of other renders.
+        auto resume = [&](uint64_t fingerprint, uint32_t width,
+                          uint32_t first, uint32_t end, bool accepted,
+                          const std::string& msg) {
+            try {
+                uint32_t beg = resumeSampleIndex(ref, fingerprint, width,
+                                                 ref.height, first, end);
+                if(!accepted)
+                    log.fail("Resumed " + msg);
+                else if(beg != ref.sampleIdxBeg)
+                    log.fail("Resumed from " + std::to_string(beg) +
+                             " instead of " + std::to_string(ref.sampleIdxBeg));
+            } catch(const std::runtime_error&) {
+                if(accepted)
+                    log.fail("Failed to resume " + msg);
+            }
+        };
+        resume(ref.fingerprint, ref.width, ref.sampleIdxFirst,
+               ref.sampleIdxEnd, true, "the same render");
+        resume(ref.fingerprint + 1, ref.width, ref.sampleIdxFirst,
+               ref.sampleIdxEnd, false, "another scene");
+        resume(ref.fingerprint, ref.width + 1, ref.sampleIdxFirst,
+               ref.sampleIdxEnd, false, "another film size");
+        resume(ref.fingerprint, ref.width, 0, ref.sampleIdxEnd, false,
+               "another shard");
+
+        ss << ref.width << "x" << ref.height << " film";
+        return log.finish(ss.str());
+    }
+    BUS_TRACE_END();
+}
+
+class CheckpointCheck final : public Command {
+public:
+    explicit CheckpointCheck(Bus::ModuleInstance& instance)
+        : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return check(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getCheckpointCheck(Bus::ModuleInstance& instance) {
+    return std::make_shared<CheckpointCheck>(instance);
+}
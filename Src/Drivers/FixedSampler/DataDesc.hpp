@@ -1,9 +1,34 @@
 #pragma once
 #include "../../Shared/Shared.hpp"
+#include "Tile.hpp"
 
+// outputBuffer covers the launch region at (offsetX,offsetY) of the film.
 struct DataDesc final {
     Vec4* outputBuffer;
-    unsigned width, height, sampleIdxBeg, sampleIdxEnd, sampleOnePixel,
-        generateRay;
+    // The sum of the AOVs, nullptr disables them.
+    AOVSample* aovBuffer;
+    // The pregenerated samples [sampleIdxBeg,sampleIdxEnd) of the block
+    // mode, nullptr for the sampler callables.
+    const float* samples;
+    unsigned width, height, offsetX, offsetY, sampleIdxBeg, sampleIdxEnd,
+        sampleOnePixel, generateRay;
+    // The range permuted by rankSample. It is the range of the render unless
+    // the samples are pregenerated for the launch.
+    unsigned rankBeg, rankEnd;
+    bool filtBadColor;
+};
+
+// The launch size is (tileSize,tileSize*taskCount).
+struct AdaptiveDataDesc final {
+    Vec4* outputBuffer;
+    // (mean,M2) of the luminance
+    Vec2* statBuffer;
+    // The mean relative error of the pixels of every task, nullptr skips the
+    // reduction.
+    float* tileErrorBuffer;
+    const TileTask* tasks;
+    unsigned width, height, tileSize, sampleOnePixel, generateRay;
+    // The range [0,rankEnd) is permuted by rankSample.
+    unsigned rankEnd;
     bool filtBadColor;
 };
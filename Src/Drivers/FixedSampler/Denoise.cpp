@@ -0,0 +1,117 @@
+#include "Denoise.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Keep the pixels without albedo(e.g. the environment) filterable.
+static constexpr float albedoEps = 1e-2f;
+
+static float sqr(float x) {
+    return x * x;
+}
+
+// The weights of a row are accumulated for one window offset at a time, so
+// the inner loop over x reads contiguous planes and can be vectorized.
+static void denoiseRow(const FeatureBuffers& features,
+                       const float* const* demod, const float* demodVar,
+                       const DenoiseOptions& options, unsigned y,
+                       float* dst) {
+    unsigned width = features.width, height = features.height;
+    int radius = static_cast<int>(options.radius);
+    float k2 = sqr(options.strength);
+    float invSigmaA2 = 1.0f / sqr(options.sigmaAlbedo);
+    float invSigmaN2 = 1.0f / sqr(options.sigmaNormal);
+    float sigmaS = std::max(0.5f * radius, 1.0f);
+    float invTwoSigmaS2 = 0.5f / sqr(sigmaS);
+    std::vector<float> sum[3], weightSum(width, 0.0f);
+    for(auto&& plane : sum)
+        plane.assign(width, 0.0f);
+    const float *ar = features.albedo[0].data(),
+                *ag = features.albedo[1].data(),
+                *ab = features.albedo[2].data();
+    const float *nx = features.normal[0].data(),
+                *ny = features.normal[1].data(),
+                *nz = features.normal[2].data();
+    const float *cr = demod[0], *cg = demod[1], *cb = demod[2];
+    size_t p = static_cast<size_t>(y) * width;
+    float *sr = sum[0].data(), *sg = sum[1].data(), *sb = sum[2].data(),
+          *sw = weightSum.data();
+    for(int dy = -radius; dy <= radius; ++dy) {
+        int qy = static_cast<int>(y) + dy;
+        if(qy < 0 || qy >= static_cast<int>(height))
+            continue;
+        for(int dx = -radius; dx <= radius; ++dx) {
+            float spatial =
+                std::exp(-static_cast<float>(dx * dx + dy * dy) *
+                         invTwoSigmaS2);
+            int x0 = std::max(0, -dx);
+            int x1 = std::min(static_cast<int>(width),
+                              static_cast<int>(width) - dx);
+            size_t q = static_cast<size_t>(qy) * width + dx;
+            for(int x = x0; x < x1; ++x) {
+                size_t i = p + x, j = q + x;
+                float dc = sqr(cr[i] - cr[j]) + sqr(cg[i] - cg[j]) +
+                    sqr(cb[i] - cb[j]);
+                // NL-means style, the differences below the noise level
+                // are free.
+                float noise = 3.0f * k2 * (demodVar[i] + demodVar[j]) + 1e-4f;
+                dc = std::max(dc / noise - 1.0f, 0.0f);
+                float da = (sqr(ar[i] - ar[j]) + sqr(ag[i] - ag[j]) +
+                            sqr(ab[i] - ab[j])) *
+                    invSigmaA2;
+                float dn = (sqr(nx[i] - nx[j]) + sqr(ny[i] - ny[j]) +
+                            sqr(nz[i] - nz[j])) *
+                    invSigmaN2;
+                float w = spatial * std::exp(-(dc + da + dn));
+                sr[x] += w * cr[j];
+                sg[x] += w * cg[j];
+                sb[x] += w * cb[j];
+                sw[x] += w;
+            }
+        }
+    }
+    for(unsigned x = 0; x < width; ++x) {
+        // the weight of the pixel itself is 1
+        float inv = 1.0f / sw[x];
+        dst[x * 3 + 0] = sr[x] * inv * (ar[p + x] + albedoEps);
+        dst[x * 3 + 1] = sg[x] * inv * (ag[p + x] + albedoEps);
+        dst[x * 3 + 2] = sb[x] * inv * (ab[p + x] + albedoEps);
+    }
+}
+
+std::vector<float> denoise(const FeatureBuffers& features,
+                           const DenoiseOptions& options, ThreadPool* pool) {
+    size_t pixels = static_cast<size_t>(features.width) * features.height;
+    std::vector<float> demod[3], demodVar(pixels);
+    for(auto&& plane : demod)
+        plane.resize(pixels);
+    // Both passes are split by rows, the remodulation is done by denoiseRow.
+    auto forEachRow = [&](auto&& func) {
+        if(pool)
+            parallelFor(*pool, features.height, func, 4);
+        else
+            for(size_t y = 0; y < features.height; ++y)
+                func(y);
+    };
+    forEachRow([&](size_t y) {
+        size_t beg = y * features.width, end = beg + features.width;
+        for(size_t i = beg; i < end; ++i) {
+            float scale = 0.0f;
+            for(size_t c = 0; c < 3; ++c) {
+                float albedo = features.albedo[c][i] + albedoEps;
+                demod[c][i] = features.color[c][i] / albedo;
+                scale += albedo;
+            }
+            demodVar[i] = features.variance[i] / sqr(scale / 3.0f);
+        }
+    });
+    const float* demodPtr[3] = { demod[0].data(), demod[1].data(),
+                                 demod[2].data() };
+    std::vector<float> res(pixels * 3);
+    forEachRow([&](size_t y) {
+        denoiseRow(features, demodPtr, demodVar.data(), options,
+                   static_cast<unsigned>(y),
+                   res.data() + y * features.width * 3);
+    });
+    return res;
+}
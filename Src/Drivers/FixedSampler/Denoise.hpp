@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+
+// The host side denoiser. No CUDA is involved.
+
+class ThreadPool;
+
+// The planar images of the film in row major.
+struct FeatureBuffers final {
+    unsigned width, height;
+    // The RGB planes of the beauty, the albedo and the shading normal.
+    std::vector<float> color[3], albedo[3], normal[3];
+    // The variance of the mean luminance of each pixel.
+    std::vector<float> variance;
+};
+
+struct DenoiseOptions final {
+    // The radius of the search window.
+    unsigned radius = 8;
+    // Scale the colour distance by the noise level, larger is smoother.
+    float strength = 1.0f;
+    float sigmaAlbedo = 0.1f, sigmaNormal = 0.5f;
+};
+
+// A cross-bilateral filter guided by the albedo and the normal. The colour
+// is demodulated by the albedo and its distance is normalized by the
+// variance, so the flat regions of the noisy pixels are smoothed most.
+// Return the interleaved RGB. Run in serial if pool is nullptr.
+std::vector<float> denoise(const FeatureBuffers& features,
+                           const DenoiseOptions& options, ThreadPool* pool);
@@ -0,0 +1,147 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "Denoise.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.DenoiseBench");
+
+// A checkerboard of two albedos on two planes, lit by a horizontal gradient.
+// The noise level is the one of spp samples with the given per-sample
+// relative deviation.
+static FeatureBuffers makeScene(unsigned width, unsigned height,
+                                unsigned spp, float deviation,
+                                std::vector<float>& reference) {
+    FeatureBuffers res;
+    res.width = width;
+    res.height = height;
+    size_t pixels = static_cast<size_t>(width) * height;
+    for(size_t c = 0; c < 3; ++c) {
+        res.color[c].resize(pixels);
+        res.albedo[c].resize(pixels);
+        res.normal[c].resize(pixels);
+    }
+    res.variance.resize(pixels);
+    reference.resize(pixels * 3);
+    std::mt19937 eng(0);
+    std::normal_distribution<float> dis;
+    float sigma = deviation / std::sqrt(static_cast<float>(spp));
+    for(unsigned y = 0; y < height; ++y)
+        for(unsigned x = 0; x < width; ++x) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            bool odd = ((x / 32) + (y / 32)) & 1;
+            float albedo[3] = { odd ? 0.8f : 0.2f, 0.5f, odd ? 0.1f : 0.7f };
+            float normal[3] = { 0.0f, y < height / 2 ? 1.0f : 0.0f,
+                                y < height / 2 ? 0.0f : 1.0f };
+            float irradiance = 0.2f + 0.8f * x / width;
+            float lum = 0.0f;
+            for(size_t c = 0; c < 3; ++c) {
+                float val = albedo[c] * irradiance;
+                reference[i * 3 + c] = val;
+                res.albedo[c][i] = albedo[c];
+                res.normal[c][i] = normal[c];
+                res.color[c][i] = val * (1.0f + sigma * dis(eng));
+                lum += val / 3.0f;
+            }
+            res.variance[i] = lum * lum * sigma * sigma;
+        }
+    return res;
+}
+
+static double rmse(const std::vector<float>& image,
+                   const std::vector<float>& reference) {
+    double sum = 0.0;
+    for(size_t i = 0; i < image.size(); ++i) {
+        double diff = image[i] - reference[i];
+        sum += diff * diff;
+    }
+    return std::sqrt(sum / image.size());
+}
+
+static int bench(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("DenoiseBench", "FixedSampler::DenoiseBench");
+        opt.add_options()("w,width", "image width",
+                          cxxopts::value<unsigned>()->default_value("1920"))(
+            "h,height", "image height",
+            cxxopts::value<unsigned>()->default_value("1080"))(
+            "s,spp", "simulated sample count",
+            cxxopts::value<unsigned>()->default_value("16"))(
+            "d,deviation", "relative deviation of one sample",
+            cxxopts::value<float>()->default_value("1.0"))(
+            "radius", "search window radius",
+            cxxopts::value<unsigned>()->default_value("8"))(
+            "strength", "denoise strength",
+            cxxopts::value<float>()->default_value("1.0"))(
+            "t,threads", "worker threads(0 for all cores)",
+            cxxopts::value<unsigned>()->default_value("0"))(
+            "r,repeat", "repeat times",
+            cxxopts::value<unsigned>()->default_value("3"));
+        auto res = opt.parse(argc, argv);
+        unsigned width = res["width"].as<unsigned>();
+        unsigned height = res["height"].as<unsigned>();
+        unsigned spp = std::max(1U, res["spp"].as<unsigned>());
+        unsigned repeat = std::max(1U, res["repeat"].as<unsigned>());
+        DenoiseOptions options;
+        options.radius = res["radius"].as<unsigned>();
+        options.strength = res["strength"].as<float>();
+
+        std::vector<float> reference;
+        FeatureBuffers features = makeScene(
+            width, height, spp, res["deviation"].as<float>(), reference);
+        std::vector<float> noisy(reference.size());
+        for(size_t i = 0; i < noisy.size(); ++i)
+            noisy[i] = features.color[i % 3][i / 3];
+
+        std::vector<float> output;
+        auto run = [&](ThreadPool* pool) {
+            double best = 1e20;
+            for(unsigned i = 0; i < repeat; ++i) {
+                auto beg = std::chrono::high_resolution_clock::now();
+                output = denoise(features, options, pool);
+                auto end = std::chrono::high_resolution_clock::now();
+                best = std::min(
+                    best,
+                    std::chrono::duration<double, std::milli>(end - beg)
+                        .count());
+            }
+            return best;
+        };
+
+        double serial = run(nullptr);
+        ThreadPool pool(res["threads"].as<unsigned>());
+        double parallel = run(&pool);
+        double pixels = static_cast<double>(width) * height;
+        std::stringstream ss;
+        ss << width << "x" << height << " radius " << options.radius
+           << std::endl;
+        ss << "serial: " << serial << " ms (" << pixels / serial * 1e-3
+           << " MPixel/s)" << std::endl;
+        ss << pool.size() << " threads: " << parallel << " ms ("
+           << pixels / parallel * 1e-3 << " MPixel/s), speedup "
+           << serial / parallel << std::endl;
+        ss << "RMSE at " << spp << " spp: " << rmse(noisy, reference)
+           << " -> " << rmse(output, reference);
+        reporter.apply(ReportLevel::Info, ss.str(), BUS_DEFSRCLOC());
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
+class DenoiseBench final : public Command {
+public:
+    explicit DenoiseBench(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return bench(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getDenoiseBench(Bus::ModuleInstance& instance) {
+    return std::make_shared<DenoiseBench>(instance);
+}
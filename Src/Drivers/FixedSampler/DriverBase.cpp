@@ -0,0 +1,124 @@
+#include "DriverBase.hpp"
+#include "../../Shared/ConfigAPI.hpp"
+#pragma warning(push, 0)
+#include <optix_stubs.h>
+#pragma warning(pop)
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.DriverBase");
+
+DriverData DriverBase::initBase(PluginHelper helper,
+                                std::shared_ptr<Config> config,
+                                const char* rayGen) {
+    BUS_TRACE_BEG() {
+        mFilmSize = config->attribute("FilmSize")->asUint2();
+        mFiltBadColor = config->getBool("FiltBadColor", false);
+        mOutputOptions = parseOutputOptions(config);
+        // PNG/JPEG/BMP preview, disabled if empty
+        mLDROutput = config->getString("LDROutput", "");
+        if(!mLDROutput.empty())
+            mLDROutput = helper->outputPath(mLDROutput);
+        mToneMap = parseToneMapOptions(config);
+        const ModuleDesc& mod = helper->getModuleManager()->getModuleFromFile(
+            modulePath().parent_path() / "Kernel.ptx");
+        OptixProgramGroupDesc desc[3] = {};
+        desc[0].flags = 0;
+        desc[0].kind = OPTIX_PROGRAM_GROUP_KIND_RAYGEN;
+        desc[0].raygen.entryFunctionName = mod.map(rayGen);
+        desc[0].raygen.module = mod.handle.get();
+        desc[1].flags = 0;
+        desc[1].kind = OPTIX_PROGRAM_GROUP_KIND_EXCEPTION;
+        desc[1].exception.entryFunctionName =
+            mod.map(helper->isDebug() ? "__exception__default" :
+                                        "__exception__silence");
+        desc[1].exception.module = mod.handle.get();
+        desc[2].flags = 0;
+        desc[2].kind = OPTIX_PROGRAM_GROUP_KIND_MISS;
+        desc[2].miss.entryFunctionName = mod.map("__miss__occ");
+        desc[2].miss.module = mod.handle.get();
+        OptixProgramGroup groups[3] = {};
+        OptixProgramGroupOptions opt = {};
+        checkOptixError(optixProgramGroupCreate(
+            helper->getContext(), desc, 3, &opt, nullptr, nullptr, groups));
+        mRayGen.reset(groups[0]);
+        mException.reset(groups[1]);
+        mMissOcc.reset(groups[2]);
+
+        DriverData res;
+        OptixStackSizes size;
+        checkOptixError(optixProgramGroupGetStackSize(mRayGen.get(), &size));
+        res.cssRG = size.cssRG;
+        checkOptixError(optixProgramGroupGetStackSize(mMissOcc.get(), &size));
+        res.cssMSOcc = size.cssMS;
+        auto pgc = config->attribute("Photographer");
+        mPhotographer = system().instantiateByName<Photographer>(
+            pgc->attribute("Plugin")->asString());
+
+        CameraData cdata = mPhotographer->init(helper, pgc);
+        res.dss = cdata.dss;
+        mGenerateRay = helper->addCallable(
+            cdata.group, mPhotographer->prepareFrame(mFilmSize, 0));
+
+        auto igc = config->attribute("Integrator");
+        mIntegrator = system().instantiateByName<Integrator>(
+            igc->attribute("Plugin")->asString());
+        IntegratorData idata = mIntegrator->init(helper, igc);
+
+        auto egc = config->attribute("Environment");
+        mEnv = system().instantiateByName<EnvironmentLight>(
+            egc->attribute("Plugin")->asString());
+        LightData edata = mEnv->init(helper, egc);
+        mEnvData = edata.sbtData;
+
+        res.cssMSRad = edata.css;
+        res.cssRG += idata.css;
+        res.dss = std::max(edata.dss, std::max(res.dss, idata.dss));
+        mSampleOnePixel = helper->addCallable(idata.group, idata.sbtData);
+        res.maxTraceDepth = idata.maxTraceDepth;
+        // TODO:exact call graph like stack size
+        res.maxSampleDim =
+            cdata.maxSampleDim + idata.maxSampleDim + edata.maxSampleDim;
+        res.group.assign(groups, groups + 3);
+        res.group.push_back(edata.group);
+        res.size = mFilmSize;
+        // TODO:own Sampler
+        return res;
+    }
+    BUS_TRACE_END();
+}
+
+void DriverBase::uploadRecords(CUstream stream) {
+    BUS_TRACE_BEG() {
+        mExceptionSBT =
+            uploadData(stream, packEmptySBTRecord(mException.get()));
+        std::vector<Data> missSBT;
+        missSBT.emplace_back(mEnvData);
+        missSBT.emplace_back(packEmptySBTRecord(mMissOcc.get()));
+        mMissSBT = uploadSBTRecords(stream, missSBT, mMissBase, mMissStride,
+                                    mMissCount);
+    }
+    BUS_TRACE_END();
+}
+
+void DriverBase::fillSBT(OptixShaderBindingTable& table,
+                         const Buffer& rayGenSBT) const {
+    table.exceptionRecord = asPtr(mExceptionSBT);
+    table.raygenRecord = asPtr(rayGenSBT);
+    table.missRecordCount = mMissCount;
+    table.missRecordBase = mMissBase;
+    table.missRecordStrideInBytes = mMissStride;
+}
+
+void DriverBase::setStack(OptixPipeline pipeline, const StackSizeInfo& stack) {
+    BUS_TRACE_BEG() {
+        // TODO:other algorithms
+        unsigned css = stack.cssRG +
+            std::max(stack.maxCssGeoRad + stack.maxCssLight +
+                         std::max(stack.maxCssGeoOcc, stack.cssMSOcc),
+                     stack.cssMSRad);
+        reporter().apply(ReportLevel::Info, "css = " + std::to_string(css),
+                         BUS_DEFSRCLOC());
+        checkOptixError(optixPipelineSetStackSize(
+            pipeline, stack.maxDssT, stack.maxDssS, css, stack.graphHeight));
+    }
+    BUS_TRACE_END();
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "../../Shared/DriverAPI.hpp"
+#include "../../Shared/IntegratorAPI.hpp"
+#include "../../Shared/LightAPI.hpp"
+#include "../../Shared/PhotographerAPI.hpp"
+#include "Film.hpp"
+
+// The common part of the drivers in this module: the camera, the integrator,
+// the environment light and the SBT records except the ray generation one.
+class DriverBase : public Driver {
+protected:
+    unsigned mGenerateRay, mSampleOnePixel;
+    Uint2 mFilmSize;
+    bool mFiltBadColor;
+    OutputOptions mOutputOptions;
+    fs::path mLDROutput;
+    ToneMapOptions mToneMap;
+    ProgramGroup mMissOcc, mRayGen, mException;
+    std::shared_ptr<Photographer> mPhotographer;
+    std::shared_ptr<Integrator> mIntegrator;
+    std::shared_ptr<EnvironmentLight> mEnv;
+    Data mEnvData;
+    Buffer mExceptionSBT, mMissSBT;
+    CUdeviceptr mMissBase;
+    unsigned mMissCount, mMissStride;
+
+    explicit DriverBase(Bus::ModuleInstance& instance) : Driver(instance) {}
+    // rayGen is the entry function name in Kernel.ptx.
+    DriverData initBase(PluginHelper helper, std::shared_ptr<Config> config,
+                        const char* rayGen);
+    // Upload the records which are shared by all launches.
+    void uploadRecords(CUstream stream);
+    void fillSBT(OptixShaderBindingTable& table, const Buffer& rayGenSBT) const;
+
+public:
+    void setStack(OptixPipeline pipeline, const StackSizeInfo& stack) override;
+};
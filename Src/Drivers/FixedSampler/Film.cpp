@@ -0,0 +1,558 @@
+#include "Film.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include <chrono>
+#include <sstream>
+#pragma warning(push, 0)
+#define OPENEXR_DLL
+#include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfFrameBuffer.h>
+#include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/ImfInputFile.h>
+#include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfStringAttribute.h>
+#include <OpenEXR/ImfTiledOutputFile.h>
+#include <OpenEXR/half.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#pragma warning(pop)
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.Film");
+
+static Imf::Compression parseCompression(const std::string& name) {
+    static const std::pair<const char*, Imf::Compression> table[] = {
+        { "None", Imf::NO_COMPRESSION },    { "RLE", Imf::RLE_COMPRESSION },
+        { "ZIPS", Imf::ZIPS_COMPRESSION },  { "ZIP", Imf::ZIP_COMPRESSION },
+        { "PIZ", Imf::PIZ_COMPRESSION },    { "PXR24", Imf::PXR24_COMPRESSION },
+        { "B44", Imf::B44_COMPRESSION },    { "B44A", Imf::B44A_COMPRESSION },
+        { "DWAA", Imf::DWAA_COMPRESSION },  { "DWAB", Imf::DWAB_COMPRESSION }
+    };
+    for(auto&& item : table)
+        if(name == item.first)
+            return item.second;
+    throw std::invalid_argument("Unknown EXR compression " + name);
+}
+
+OutputOptions parseOutputOptions(std::shared_ptr<Config> config) {
+    OutputOptions res;
+    res.compression = config->getString("Compression", res.compression);
+    res.floatPixels = config->getBool("FloatOutput", res.floatPixels);
+    res.tiled = config->getBool("TiledOutput", res.tiled);
+    res.tileSize =
+        std::max(config->getUint("OutputTileSize", res.tileSize), 1U);
+    res.threads = config->getUint("OutputThreads", res.threads);
+    // fail before rendering
+    parseCompression(res.compression);
+    return res;
+}
+
+static unsigned threadCount(unsigned threads) {
+    return threads ? threads :
+                     std::max(1U, std::thread::hardware_concurrency());
+}
+
+struct AOVChannel final {
+    std::string name;
+    bool full;
+};
+
+// The channels of a resolved AOV pixel, in order.
+static const std::vector<AOVChannel>& aovChannels() {
+    static const std::vector<AOVChannel> channels = [] {
+        std::vector<AOVChannel> res;
+        for(auto name : { "albedo.R", "albedo.G", "albedo.B", "normal.X",
+                          "normal.Y", "normal.Z" })
+            res.push_back({ name, false });
+        res.push_back({ "depth.Z", true });
+        res.push_back({ "sampleCount.Y", true });
+        res.push_back({ "variance.Y", true });
+        for(unsigned i = 0; i < maxLightAOV; ++i)
+            for(auto channel : { ".R", ".G", ".B" })
+                res.push_back(
+                    { "light" + std::to_string(i) + channel, false });
+        return res;
+    }();
+    return channels;
+}
+
+// The data window is the region at offset, the display window is the film.
+static Imf::Header makeHeader(Uint2 filmSize, Uint2 offset, Uint2 size,
+                              const OutputOptions& options, bool withAOV) {
+    Imath::Box2i display(Imath::V2i(0, 0),
+                         Imath::V2i(static_cast<int>(filmSize.x) - 1,
+                                    static_cast<int>(filmSize.y) - 1));
+    Imath::Box2i data(
+        Imath::V2i(static_cast<int>(offset.x), static_cast<int>(offset.y)),
+        Imath::V2i(static_cast<int>(offset.x + size.x) - 1,
+                   static_cast<int>(offset.y + size.y) - 1));
+    Imf::Header header(display, data);
+    header.compression() = parseCompression(options.compression);
+    Imf::PixelType type = options.floatPixels ? Imf::FLOAT : Imf::HALF;
+    for(auto channel : { "R", "G", "B" })
+        header.channels().insert(channel, Imf::Channel(type));
+    if(withAOV)
+        for(auto&& channel : aovChannels())
+            header.channels().insert(
+                channel.name, Imf::Channel(channel.full ? Imf::FLOAT : type));
+    return header;
+}
+
+// The variance of the mean luminance, 0 for less than two samples.
+static float meanVariance(const Vec4& acc, float sqrLum) {
+    float count = acc.w;
+    if(count < 2.0f)
+        return 0.0f;
+    float sum = 0.212671f * acc.x + 0.715160f * acc.y + 0.072169f * acc.z;
+    float var = (sqrLum - sum * sum / count) / (count - 1.0f);
+    return std::max(var, 0.0f) / count;
+}
+
+// Average the AOVs of the pixels into interleaved float channels.
+static void resolveAOV(const Vec4* acc, const AOVSample* aov, size_t pixels,
+                       float* dst) {
+    for(size_t i = 0; i < pixels; ++i) {
+        const AOVSample& val = aov[i];
+        float count = acc[i].w;
+        float inv = count > 0.0f ? 1.0f / count : 0.0f;
+        Spectrum albedo = val.albedo * inv;
+        float len = glm::length(val.normal);
+        Vec3 normal = len > 0.0f ? val.normal / len : Vec3{ 0.0f };
+        *dst++ = albedo.x, *dst++ = albedo.y, *dst++ = albedo.z;
+        *dst++ = normal.x, *dst++ = normal.y, *dst++ = normal.z;
+        *dst++ = val.depth * inv;
+        *dst++ = count;
+        *dst++ = meanVariance(acc[i], val.sqrLum);
+        for(unsigned j = 0; j < maxLightAOV; ++j) {
+            Spectrum light = val.light[j] * inv;
+            *dst++ = light.x, *dst++ = light.y, *dst++ = light.z;
+        }
+    }
+}
+
+// Resolve the pixels into interleaved RGB. Return whether there is any bad
+// pixel.
+template <typename T>
+static bool resolve(const Vec4* acc, size_t pixels, T* dst) {
+    bool badColor = false;
+    for(size_t i = 0; i < pixels; ++i) {
+        Vec4 val = acc[i];
+        bool good = isfinite(val.x) & isfinite(val.y) & isfinite(val.z) &
+            isfinite(val.w);
+        float inv = val.w > 0.0f ? 1.0f / val.w : 0.0f;
+        dst[i * 3 + 0] = T(good ? val.x * inv : 1.0f);
+        dst[i * 3 + 1] = T(good ? val.y * inv : 0.0f);
+        dst[i * 3 + 2] = T(good ? val.z * inv : 1.0f);
+        badColor |= !good;
+    }
+    return badColor;
+}
+
+// The interleaved RGB pixels of a region at offset.
+struct ResolvedPixels final {
+    std::vector<char> data;
+    Imf::PixelType type;
+    size_t pixelSize;
+    bool badColor;
+    // The interleaved AOV channels, empty if there is no AOV.
+    std::vector<float> aov;
+
+    Imf::FrameBuffer frameBuffer(Uint2 offset, Uint2 size) const {
+        // OpenEXR addresses the pixel (x,y) at base+x*xStride+y*yStride
+        size_t yStride = pixelSize * size.x;
+        const char* base = data.data() - offset.x * pixelSize -
+            static_cast<ptrdiff_t>(offset.y) * yStride;
+        size_t channelSize = pixelSize / 3;
+        Imf::FrameBuffer res;
+        const char* names[] = { "R", "G", "B" };
+        for(size_t i = 0; i < 3; ++i)
+            res.insert(names[i],
+                       Imf::Slice(type,
+                                  const_cast<char*>(base + i * channelSize),
+                                  pixelSize, yStride));
+        if(aov.empty())
+            return res;
+        const auto& channels = aovChannels();
+        size_t aovPixelSize = sizeof(float) * channels.size();
+        size_t aovYStride = aovPixelSize * size.x;
+        const char* aovBase = reinterpret_cast<const char*>(aov.data()) -
+            offset.x * aovPixelSize -
+            static_cast<ptrdiff_t>(offset.y) * aovYStride;
+        // OpenEXR converts the float slices to half channels
+        for(size_t i = 0; i < channels.size(); ++i)
+            res.insert(channels[i].name,
+                       Imf::Slice(Imf::FLOAT,
+                                  const_cast<char*>(aovBase +
+                                                    i * sizeof(float)),
+                                  aovPixelSize, aovYStride));
+        return res;
+    }
+};
+
+// aov is empty or has the same size as acc.
+static ResolvedPixels resolvePixels(const std::vector<Vec4>& acc,
+                                    const std::vector<AOVSample>& aov,
+                                    Uint2 size, bool floatPixels,
+                                    ThreadPool* pool) {
+    ResolvedPixels res;
+    res.type = floatPixels ? Imf::FLOAT : Imf::HALF;
+    res.pixelSize = 3 * (floatPixels ? sizeof(float) : sizeof(half));
+    size_t pixels = static_cast<size_t>(size.x) * size.y;
+    res.data.resize(pixels * res.pixelSize);
+    size_t aovChannelCount = aovChannels().size();
+    if(!aov.empty())
+        res.aov.resize(pixels * aovChannelCount);
+    auto resolveRange = [&](size_t beg, size_t end) {
+        char* dst = res.data.data() + beg * res.pixelSize;
+        if(!aov.empty())
+            resolveAOV(acc.data() + beg, aov.data() + beg, end - beg,
+                       res.aov.data() + beg * aovChannelCount);
+        if(floatPixels)
+            return resolve(acc.data() + beg, end - beg,
+                           reinterpret_cast<float*>(dst));
+        return resolve(acc.data() + beg, end - beg,
+                       reinterpret_cast<half*>(dst));
+    };
+    if(!pool) {
+        res.badColor = resolveRange(0, pixels);
+        return res;
+    }
+    std::atomic_bool badColor{ false };
+    parallelFor(
+        *pool, size.y,
+        [&](size_t y) {
+            size_t beg = y * size.x;
+            if(resolveRange(beg, beg + size.x))
+                badColor = true;
+        },
+        16);
+    res.badColor = badColor;
+    return res;
+}
+
+void saveEXR(const fs::path& path, Uint2 size, const std::vector<Vec4>& acc,
+             const OutputOptions& options, Bus::Reporter& reporter) {
+    saveEXR(path, size, Uint2{ 0, 0 }, size, acc, {}, {}, options, reporter);
+}
+
+void saveEXR(const fs::path& path, Uint2 filmSize, Uint2 offset, Uint2 size,
+             const std::vector<Vec4>& acc, const std::vector<AOVSample>& aov,
+             const Metadata& metadata, const OutputOptions& options,
+             Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        if(acc.size() != static_cast<size_t>(size.x) * size.y ||
+           glm::any(glm::greaterThan(offset + size, filmSize)))
+            BUS_TRACE_THROW(std::logic_error("Bad output region"));
+        if(!aov.empty() && aov.size() != acc.size())
+            BUS_TRACE_THROW(std::logic_error("Mismatched AOV buffer"));
+        using Clock = std::chrono::high_resolution_clock;
+        unsigned threads = threadCount(options.threads);
+        auto beg = Clock::now();
+        ResolvedPixels pixels;
+        {
+            ThreadPool pool(threads);
+            pixels =
+                resolvePixels(acc, aov, size, options.floatPixels, &pool);
+        }
+        if(pixels.badColor)
+            reporter.apply(ReportLevel::Warning, "Bad color!!!",
+                           BUS_DEFSRCLOC());
+        auto mid = Clock::now();
+        try {
+            Imf::Header header =
+                makeHeader(filmSize, offset, size, options, !aov.empty());
+            for(auto&& item : metadata)
+                header.insert(item.first, Imf::StringAttribute(item.second));
+            Imf::FrameBuffer frameBuffer = pixels.frameBuffer(offset, size);
+            if(options.tiled) {
+                header.setTileDescription(Imf::TileDescription(
+                    options.tileSize, options.tileSize, Imf::ONE_LEVEL));
+                Imf::TiledOutputFile out(path.string().c_str(), header,
+                                         static_cast<int>(threads));
+                out.setFrameBuffer(frameBuffer);
+                out.writeTiles(0, out.numXTiles() - 1, 0, out.numYTiles() - 1);
+            } else {
+                Imf::OutputFile out(path.string().c_str(), header,
+                                    static_cast<int>(threads));
+                out.setFrameBuffer(frameBuffer);
+                out.writePixels(static_cast<int>(size.y));
+            }
+        } catch(...) {
+            std::throw_with_nested(std::runtime_error(
+                "Failed to save output file " + path.string()));
+        }
+        auto end = Clock::now();
+        std::stringstream ss;
+        ss << "Output resolved in "
+           << std::chrono::duration<double, std::milli>(mid - beg).count()
+           << " ms, written in "
+           << std::chrono::duration<double, std::milli>(end - mid).count()
+           << " ms(" << options.compression << ","
+           << (options.floatPixels ? "float" : "half") << ","
+           << (options.tiled ? "tiled" : "scanline")
+           << (aov.empty() ? "" : ",AOV") << ")";
+        reporter.apply(ReportLevel::Info, ss.str(), BUS_DEFSRCLOC());
+    }
+    BUS_TRACE_END();
+}
+
+static void checkFilmWindow(const Imf::Header& header, Uint2 filmSize) {
+    Imath::Box2i window = header.dataWindow();
+    if(window.min.x != 0 || window.min.y != 0 ||
+       window.max.x + 1 != static_cast<int>(filmSize.x) ||
+       window.max.y + 1 != static_cast<int>(filmSize.y))
+        throw std::logic_error("Mismatched film size");
+}
+
+bool checkCompositeBase(const fs::path& base, Uint2 filmSize) {
+    BUS_TRACE_BEG() {
+        if(!fs::exists(base))
+            return false;
+        try {
+            Imf::InputFile in(base.string().c_str());
+            checkFilmWindow(in.header(), filmSize);
+        } catch(...) {
+            std::throw_with_nested(
+                std::runtime_error("Bad composite base " + base.string()));
+        }
+        return true;
+    }
+    BUS_TRACE_END();
+}
+
+std::vector<Vec4> compositeRegion(const fs::path& base, Uint2 filmSize,
+                                  Uint2 offset, Uint2 size,
+                                  const std::vector<Vec4>& acc) {
+    BUS_TRACE_BEG() {
+        size_t pixels = static_cast<size_t>(filmSize.x) * filmSize.y;
+        std::vector<Vec4> res(pixels, Vec4{ 0.0f, 0.0f, 0.0f, 1.0f });
+        // The first crop of the film starts from a black film.
+        if(fs::exists(base)) {
+            try {
+                Imf::InputFile in(base.string().c_str());
+                checkFilmWindow(in.header(), filmSize);
+                Imath::Box2i window = in.header().dataWindow();
+                Imf::FrameBuffer frameBuffer;
+                char* data = reinterpret_cast<char*>(res.data());
+                const char* names[] = { "R", "G", "B" };
+                for(size_t i = 0; i < 3; ++i)
+                    frameBuffer.insert(names[i],
+                                       Imf::Slice(Imf::FLOAT,
+                                                  data + i * sizeof(float),
+                                                  sizeof(Vec4),
+                                                  sizeof(Vec4) * filmSize.x));
+                in.setFrameBuffer(frameBuffer);
+                in.readPixels(window.min.y, window.max.y);
+            } catch(...) {
+                std::throw_with_nested(
+                    std::runtime_error("Failed to load " + base.string()));
+            }
+        }
+        for(unsigned y = 0; y < size.y; ++y)
+            std::copy(acc.begin() + static_cast<size_t>(y) * size.x,
+                      acc.begin() + static_cast<size_t>(y + 1) * size.x,
+                      res.begin() +
+                          static_cast<size_t>(offset.y + y) * filmSize.x +
+                          offset.x);
+        return res;
+    }
+    BUS_TRACE_END();
+}
+
+DenoiseOptions parseDenoiseOptions(std::shared_ptr<Config> config) {
+    DenoiseOptions res;
+    res.radius = config->getUint("DenoiseRadius", res.radius);
+    res.strength = config->getFloat("DenoiseStrength", res.strength);
+    return res;
+}
+
+static FeatureBuffers makeFeatures(Uint2 size, const std::vector<Vec4>& acc,
+                                   const std::vector<AOVSample>& aov,
+                                   ThreadPool& pool) {
+    FeatureBuffers res;
+    res.width = size.x;
+    res.height = size.y;
+    size_t pixels = acc.size();
+    for(size_t c = 0; c < 3; ++c) {
+        res.color[c].resize(pixels);
+        res.albedo[c].resize(pixels);
+        res.normal[c].resize(pixels);
+    }
+    res.variance.resize(pixels);
+    parallelFor(
+        pool, pixels,
+        [&](size_t i) {
+            Vec4 val = acc[i];
+            const AOVSample& feature = aov[i];
+            float inv = val.w > 0.0f ? 1.0f / val.w : 0.0f;
+            bool good = isfinite(val.x) & isfinite(val.y) & isfinite(val.z);
+            float len = glm::length(feature.normal);
+            Vec3 normal = len > 0.0f ? feature.normal / len : Vec3{ 0.0f };
+            for(int c = 0; c < 3; ++c) {
+                res.color[c][i] = good ? val[c] * inv : 0.0f;
+                res.albedo[c][i] = feature.albedo[c] * inv;
+                res.normal[c][i] = normal[c];
+            }
+            res.variance[i] = good ? meanVariance(val, feature.sqrLum) : 0.0f;
+        },
+        4096);
+    return res;
+}
+
+void saveDenoisedEXR(const fs::path& path, Uint2 size,
+                     const std::vector<Vec4>& acc,
+                     const std::vector<AOVSample>& aov,
+                     const DenoiseOptions& denoiseOptions,
+                     const OutputOptions& options, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        if(aov.size() != acc.size())
+            BUS_TRACE_THROW(std::logic_error("Mismatched AOV buffer"));
+        auto beg = std::chrono::high_resolution_clock::now();
+        std::vector<float> pixels;
+        {
+            ThreadPool pool(threadCount(options.threads));
+            pixels = denoise(makeFeatures(size, acc, aov, pool),
+                             denoiseOptions, &pool);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        reporter.apply(
+            ReportLevel::Info,
+            "Denoised in " +
+                std::to_string(
+                    std::chrono::duration<double, std::milli>(end - beg)
+                        .count()) +
+                " ms",
+            BUS_DEFSRCLOC());
+        // one sample per pixel
+        std::vector<Vec4> res(acc.size());
+        for(size_t i = 0; i < res.size(); ++i)
+            res[i] = Vec4{ pixels[i * 3], pixels[i * 3 + 1],
+                           pixels[i * 3 + 2], 1.0f };
+        saveEXR(path, size, res, options, reporter);
+    }
+    BUS_TRACE_END();
+}
+
+ToneMapOptions parseToneMapOptions(std::shared_ptr<Config> config) {
+    ToneMapOptions res;
+    res.exposure = config->getFloat("Exposure", res.exposure);
+    res.aces = config->getBool("ACES", res.aces);
+    res.colorSpace = config->getString("ColorSpace", res.colorSpace);
+    res.dither = config->getBool("Dither", res.dither);
+    res.quality =
+        std::min(std::max(config->getUint("LDRQuality", res.quality), 1U),
+                 100U);
+    // fail before rendering
+    parseColorSpace(res.colorSpace);
+    return res;
+}
+
+void saveLDR(const fs::path& path, Uint2 size, const Vec4* acc,
+             const ToneMapOptions& options, unsigned threads,
+             Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        using Clock = std::chrono::high_resolution_clock;
+        auto beg = Clock::now();
+        std::vector<unsigned char> pixels;
+        {
+            ThreadPool pool(threadCount(threads));
+            pixels = toneMapImage(reinterpret_cast<const float*>(acc),
+                                  size.x, size.y, options, &pool);
+        }
+        auto mid = Clock::now();
+        std::string ext = path.extension().string();
+        std::string file = path.string();
+        int width = static_cast<int>(size.x), height = static_cast<int>(size.y);
+        int res = 0;
+        if(ext == ".png")
+            res = stbi_write_png(file.c_str(), width, height, 3, pixels.data(),
+                                 width * 3);
+        else if(ext == ".jpg" || ext == ".jpeg")
+            res = stbi_write_jpg(file.c_str(), width, height, 3, pixels.data(),
+                                 static_cast<int>(options.quality));
+        else if(ext == ".bmp")
+            res = stbi_write_bmp(file.c_str(), width, height, 3,
+                                 pixels.data());
+        else
+            BUS_TRACE_THROW(
+                std::invalid_argument("Unsupported LDR format " + ext));
+        if(!res)
+            BUS_TRACE_THROW(
+                std::runtime_error("Failed to save output file " + file));
+        auto end = Clock::now();
+        std::stringstream ss;
+        ss << "LDR output tone mapped in "
+           << std::chrono::duration<double, std::milli>(mid - beg).count()
+           << " ms, written in "
+           << std::chrono::duration<double, std::milli>(end - mid).count()
+           << " ms";
+        reporter.apply(ReportLevel::Info, ss.str(), BUS_DEFSRCLOC());
+    }
+    BUS_TRACE_END();
+}
+
+struct TileWriter::Impl final {
+    fs::path path;
+    Uint2 tileSize;
+    bool floatPixels;
+    std::unique_ptr<Imf::OutputFile> scanline;
+    std::unique_ptr<Imf::TiledOutputFile> tiled;
+    bool badColor = false;
+};
+
+TileWriter::TileWriter(const fs::path& path, Uint2 filmSize, Uint2 tileSize,
+                       bool scanline, const OutputOptions& options)
+    : mImpl(std::make_unique<Impl>()) {
+    BUS_TRACE_BEG() {
+        mImpl->path = path;
+        mImpl->tileSize = tileSize;
+        mImpl->floatPixels = options.floatPixels;
+        int threads = static_cast<int>(threadCount(options.threads));
+        try {
+            Imf::Header header =
+                makeHeader(filmSize, Uint2{ 0, 0 }, filmSize, options, false);
+            if(scanline)
+                mImpl->scanline = std::make_unique<Imf::OutputFile>(
+                    path.string().c_str(), header, threads);
+            else {
+                header.setTileDescription(Imf::TileDescription(
+                    tileSize.x, tileSize.y, Imf::ONE_LEVEL));
+                header.lineOrder() = Imf::RANDOM_Y;
+                mImpl->tiled = std::make_unique<Imf::TiledOutputFile>(
+                    path.string().c_str(), header, threads);
+            }
+        } catch(...) {
+            std::throw_with_nested(std::runtime_error(
+                "Failed to create output file " + path.string()));
+        }
+    }
+    BUS_TRACE_END();
+}
+
+TileWriter::~TileWriter() = default;
+
+void TileWriter::write(Uint2 offset, Uint2 size, const std::vector<Vec4>& acc) {
+    BUS_TRACE_BEG() {
+        ResolvedPixels pixels =
+            resolvePixels(acc, {}, size, mImpl->floatPixels, nullptr);
+        mImpl->badColor |= pixels.badColor;
+        try {
+            if(mImpl->scanline) {
+                mImpl->scanline->setFrameBuffer(
+                    pixels.frameBuffer(offset, size));
+                mImpl->scanline->writePixels(static_cast<int>(size.y));
+            } else {
+                mImpl->tiled->setFrameBuffer(pixels.frameBuffer(offset, size));
+                mImpl->tiled->writeTile(
+                    static_cast<int>(offset.x / mImpl->tileSize.x),
+                    static_cast<int>(offset.y / mImpl->tileSize.y));
+            }
+        } catch(...) {
+            std::throw_with_nested(std::runtime_error(
+                "Failed to write output file " + mImpl->path.string()));
+        }
+    }
+    BUS_TRACE_END();
+}
+
+bool TileWriter::hasBadColor() const {
+    return mImpl->badColor;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "../../Shared/ConfigAPI.hpp"
+#include "Denoise.hpp"
+#include "ToneMap.hpp"
+#include <map>
+
+struct OutputOptions final {
+    // None/RLE/ZIPS/ZIP/PIZ/PXR24/B44/B44A/DWAA/DWAB
+    std::string compression = "ZIP";
+    // float32 instead of half
+    bool floatPixels = false;
+    // tiled instead of scanline
+    bool tiled = false;
+    unsigned tileSize = 64;
+    // The threads of the resolve stage and OpenEXR, 0 for all cores.
+    unsigned threads = 0;
+};
+
+// Compression/FloatOutput/TiledOutput/OutputTileSize/OutputThreads
+OutputOptions parseOutputOptions(std::shared_ptr<Config> config);
+
+// Resolve the accumulation buffer(sum of radiance,sample count) and save it
+// as a RGB EXR file. Bad pixels are written as magenta.
+void saveEXR(const fs::path& path, Uint2 size, const std::vector<Vec4>& acc,
+             const OutputOptions& options, Bus::Reporter& reporter);
+
+// The string attributes of the EXR header.
+using Metadata = std::map<std::string, std::string>;
+
+// Save the region at offset of the film, acc and aov cover the region. The
+// data window is the region and the display window is the film.
+// The AOVs(sum of the samples) are saved as the layers albedo.RGB,normal.XYZ,
+// depth.Z,sampleCount.Y,variance.Y and light0-3.RGB if aov isn't empty.
+// variance is the variance of the mean luminance. depth, sampleCount and
+// variance are always float32.
+void saveEXR(const fs::path& path, Uint2 filmSize, Uint2 offset, Uint2 size,
+             const std::vector<Vec4>& acc, const std::vector<AOVSample>& aov,
+             const Metadata& metadata, const OutputOptions& options,
+             Bus::Reporter& reporter);
+
+// Check the base image of compositeRegion before the render. Throw if it
+// isn't an EXR file of the film size, return false if it doesn't exist.
+bool checkCompositeBase(const fs::path& base, Uint2 filmSize);
+
+// Paste the accumulation buffer of the region into the RGB of the EXR file
+// of the film size. The first crop of a film starts from a black film if the
+// base doesn't exist. The result is an accumulation buffer of the film.
+std::vector<Vec4> compositeRegion(const fs::path& base, Uint2 filmSize,
+                                  Uint2 offset, Uint2 size,
+                                  const std::vector<Vec4>& acc);
+
+// DenoiseRadius/DenoiseStrength
+DenoiseOptions parseDenoiseOptions(std::shared_ptr<Config> config);
+
+// Denoise the beauty guided by the AOVs and save it as a RGB EXR file.
+void saveDenoisedEXR(const fs::path& path, Uint2 size,
+                     const std::vector<Vec4>& acc,
+                     const std::vector<AOVSample>& aov,
+                     const DenoiseOptions& denoiseOptions,
+                     const OutputOptions& options, Bus::Reporter& reporter);
+
+// Exposure/ACES/ColorSpace/Dither/LDRQuality
+ToneMapOptions parseToneMapOptions(std::shared_ptr<Config> config);
+
+// Tone map the accumulation buffer and save it as a PNG/JPEG/BMP file
+// according to the extension. threads is the same as OutputOptions.
+void saveLDR(const fs::path& path, Uint2 size, const Vec4* acc,
+             const ToneMapOptions& options, unsigned threads,
+             Bus::Reporter& reporter);
+
+// Stream the resolved tiles to an EXR file, so only one tile is kept in
+// memory. Tiles of a tiled file can be written in any order. A scanline file
+// requires full width strips in increasing y.
+class TileWriter final : private Unmoveable {
+private:
+    struct Impl;
+    std::unique_ptr<Impl> mImpl;
+
+public:
+    // options.tiled and options.tileSize are ignored.
+    TileWriter(const fs::path& path, Uint2 filmSize, Uint2 tileSize,
+               bool scanline, const OutputOptions& options);
+    ~TileWriter();
+    // acc is the accumulation buffer of the tile at offset with the given
+    // size.
+    void write(Uint2 offset, Uint2 size, const std::vector<Vec4>& acc);
+    bool hasBadColor() const;
+};
@@ -6,21 +6,119 @@ DEVICE void __raygen__renderKernel() {
     uint3 pixelPos = optixGetLaunchIndex();
     Spectrum acc = {};
     unsigned count = 0;
-    for(unsigned id = data->sampleIdxBeg; id < data->sampleIdxEnd; ++id) {
-        SamplerInitResult initRes = initSampler(id, pixelPos.x, pixelPos.y);
+    AOVSample aovAcc = {}, aov;
+    AOVSample* aovPtr = data->aovBuffer ? &aov : nullptr;
+    const unsigned x = data->offsetX + pixelPos.x,
+                   y = data->offsetY + pixelPos.y;
+    const unsigned* keys = blueNoiseKeys(x, y);
+    for(unsigned i = data->sampleIdxBeg; i < data->sampleIdxEnd; ++i) {
+        const unsigned id =
+            rankSample(i, data->rankBeg, data->rankEnd, keys);
+        SamplerInitResult initRes = initSampler(id, x, y);
         SamplerContext sampler;
         sampler.dim = 0, sampler.index = initRes.index;
+        sampler.block = nullptr;
+        if(data->samples)
+            sampler.block = data->samples +
+                (id - data->sampleIdxBeg) * launchParam.sampleDims;
+        sampler.seed = hashUint(x ^ hashUint(y));
+        sampler.keys = keys;
         RaySample ray =
             generateRay(data->generateRay, initRes.px, initRes.py, sampler);
-        Spectrum res = sampleOnePixel(data->sampleOnePixel, ray, &sampler);
+        aov = {};
+        Spectrum res =
+            sampleOnePixel(data->sampleOnePixel, ray, &sampler, aovPtr);
         if(data->filtBadColor &
            !(isfinite(res.x) & isfinite(res.y) & isfinite(res.z)))
             continue;
         acc += res;
         ++count;
+        if(aovPtr) {
+            aovAcc.albedo += aov.albedo;
+            aovAcc.normal += aov.normal;
+            aovAcc.depth += aov.depth;
+            for(unsigned l = 0; l < maxLightAOV; ++l)
+                aovAcc.light[l] += aov.light[l];
+            float lum =
+                0.212671f * res.x + 0.715160f * res.y + 0.072169f * res.z;
+            aovAcc.sqrLum += lum * lum;
+        }
+    }
+    unsigned idx = data->width * pixelPos.y + pixelPos.x;
+    data->outputBuffer[idx] += Vec4(acc, static_cast<float>(count));
+    if(aovPtr) {
+        AOVSample& dst = data->aovBuffer[idx];
+        dst.albedo += aovAcc.albedo;
+        dst.normal += aovAcc.normal;
+        dst.depth += aovAcc.depth;
+        for(unsigned l = 0; l < maxLightAOV; ++l)
+            dst.light[l] += aovAcc.light[l];
+        dst.sqrLum += aovAcc.sqrLum;
+    }
+}
+
+// relativeError of Adaptive.cpp
+INLINEDEVICE float relativeError(float mean, float m2, float count) {
+    if(count < 2.0f)
+        return __int_as_float(0x7f800000);
+    float stdErr = sqrtf(fmaxf(m2, 0.0f) / ((count - 1.0f) * count));
+    return stdErr / (fabsf(mean) + 1e-3f);
+}
+
+DEVICE void __raygen__adaptiveKernel() {
+    auto data = getSBTData<AdaptiveDataDesc>();
+    uint3 launchIndex = optixGetLaunchIndex();
+    const unsigned taskIdx = launchIndex.y / data->tileSize;
+    const TileTask task = data->tasks[taskIdx];
+    unsigned px = task.x + launchIndex.x,
+             py = task.y + launchIndex.y % data->tileSize;
+    if(px >= data->width || py >= data->height)
+        return;
+    Spectrum acc = {};
+    unsigned count = 0;
+    // Welford's algorithm for the samples of this launch
+    float mean = 0.0f, m2 = 0.0f;
+    const unsigned* keys = blueNoiseKeys(px, py);
+    for(unsigned i = task.sampleIdxBeg; i < task.sampleIdxEnd; ++i) {
+        const unsigned id =
+            rankSample(i, 0, data->rankEnd, keys);
+        SamplerInitResult initRes = initSampler(id, px, py);
+        SamplerContext sampler;
+        sampler.dim = 0, sampler.index = initRes.index;
+        sampler.block = nullptr, sampler.seed = 0;
+        sampler.keys = keys;
+        RaySample ray =
+            generateRay(data->generateRay, initRes.px, initRes.py, sampler);
+        Spectrum res =
+            sampleOnePixel(data->sampleOnePixel, ray, &sampler, nullptr);
+        if(data->filtBadColor &
+           !(isfinite(res.x) & isfinite(res.y) & isfinite(res.z)))
+            continue;
+        acc += res;
+        ++count;
+        float lum = 0.212671f * res.x + 0.715160f * res.y + 0.072169f * res.z;
+        float delta = lum - mean;
+        mean += delta / count;
+        m2 += delta * (lum - mean);
+    }
+    unsigned idx = data->width * py + px;
+    float n = data->outputBuffer[idx].w, total = n + count;
+    Vec2 stat = data->statBuffer[idx];
+    if(count) {
+        // merge with the previous launches(Chan et al.)
+        float delta = mean - stat.x;
+        stat.x += delta * count / total;
+        stat.y += m2 + delta * delta * n * count / total;
+        data->statBuffer[idx] = stat;
+        data->outputBuffer[idx] += Vec4(acc, static_cast<float>(count));
+    }
+    // the mean over the pixels of the tile like tileError
+    if(data->tileErrorBuffer) {
+        unsigned w = min(data->tileSize, data->width - task.x),
+                 h = min(data->tileSize, data->height - task.y);
+        atomicAdd(data->tileErrorBuffer + taskIdx,
+                  relativeError(stat.x, stat.y, total) / (w * h));
     }
-    data->outputBuffer[data->width * pixelPos.y + pixelPos.x] +=
-        Vec4(acc, static_cast<float>(count));
 }
 
 DEVICE void __miss__occ() {
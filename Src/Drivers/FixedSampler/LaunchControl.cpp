@@ -0,0 +1,42 @@
+#include "LaunchControl.hpp"
+#include <algorithm>
+#include <cmath>
+
+LaunchController::LaunchController(double target, double budget,
+                                   unsigned initial, unsigned maxSamples)
+    : mTarget(target), mBudget(budget), mCost(0.0),
+      mLast(std::max(initial, 1U)), mMax(std::max(maxSamples, 1U)) {}
+
+unsigned LaunchController::next(double now, unsigned remaining) const {
+    double res = mLast;
+    if(mTarget > 0.0 && mCost > 0.0)
+        // Grow at most twice per launch, a bad estimation mustn't hit the
+        // watchdog.
+        res = std::min(mTarget / mCost, 2.0 * mLast);
+    if(mBudget > 0.0) {
+        double left = mBudget - now;
+        if(left <= 0.0)
+            return 0;
+        if(mCost > 0.0) {
+            double affordable = std::floor(left / mCost);
+            if(affordable < 1.0)
+                return 0;
+            res = std::min(res, affordable);
+        }
+    }
+    res = std::max(std::min(res, static_cast<double>(mMax)), 1.0);
+    return std::min(static_cast<unsigned>(res), remaining);
+}
+
+void LaunchController::update(unsigned samples, double duration) {
+    if(samples == 0)
+        return;
+    double cost = duration / samples;
+    // exponential moving average against the jitter
+    mCost = mCost > 0.0 ? 0.5 * (mCost + cost) : cost;
+    mLast = samples;
+}
+
+double LaunchController::costPerSample() const {
+    return mCost;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Choose the samples per launch from the measured launch times. The times
+// are in seconds and passed in by the caller, so the controller can be driven
+// by a simulated clock. No CUDA is involved.
+class LaunchController final {
+private:
+    double mTarget, mBudget, mCost;
+    unsigned mLast, mMax;
+
+public:
+    // target is the desired launch duration, 0 keeps initial samples per
+    // launch. budget is the wall-clock limit since the start, 0 for no limit.
+    LaunchController(double target, double budget, unsigned initial,
+                     unsigned maxSamples);
+    // The sample count of the next launch at now(seconds since the start).
+    // Return 0 if the remaining budget can't afford one sample.
+    unsigned next(double now, unsigned remaining) const;
+    // Report a finished launch.
+    void update(unsigned samples, double duration);
+    // The estimated duration of one sample, 0 before the first update.
+    double costPerSample() const;
+};
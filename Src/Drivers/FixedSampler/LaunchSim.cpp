@@ -0,0 +1,97 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "LaunchControl.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.LaunchSim");
+
+// Drive the LaunchController with a simulated clock. A launch takes
+// overhead+samples*cost with a uniform jitter, and the cost is scaled at the
+// middle of the budget to mimic a heavier part of the scene. Fail if the
+// deadline or the launch duration bound is broken.
+static int simulate(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("LaunchSim", "FixedSampler::LaunchSim");
+        opt.add_options()("target", "target launch time(s)",
+                          cxxopts::value<double>()->default_value("0.1"))(
+            "budget", "time budget(s)",
+            cxxopts::value<double>()->default_value("60"))(
+            "cost", "time of one sample(s)",
+            cxxopts::value<double>()->default_value("0.002"))(
+            "overhead", "time of one launch(s)",
+            cxxopts::value<double>()->default_value("0.001"))(
+            "jitter", "relative jitter of the launch time",
+            cxxopts::value<double>()->default_value("0.1"))(
+            "step", "cost scale at the middle of the budget",
+            cxxopts::value<double>()->default_value("4"))(
+            "s,spp", "max sample count",
+            cxxopts::value<unsigned>()->default_value("1000000"))(
+            "max", "max samples per launch",
+            cxxopts::value<unsigned>()->default_value("1024"));
+        auto res = opt.parse(argc, argv);
+        double target = res["target"].as<double>();
+        double budget = res["budget"].as<double>();
+        double cost = res["cost"].as<double>();
+        double overhead = res["overhead"].as<double>();
+        double jitter = res["jitter"].as<double>();
+        double step = res["step"].as<double>();
+        unsigned spp = res["spp"].as<unsigned>();
+
+        // the launch right after the step is longer than the target
+        double bound = 1e20;
+        if(target > 0.0)
+            bound = 2.0 * std::max(target, overhead + cost) * (1.0 + jitter) *
+                std::max(step, 1.0);
+
+        LaunchController controller(target, budget, 1,
+                                    res["max"].as<unsigned>());
+        std::mt19937 eng(0);
+        std::uniform_real_distribution<double> dis(1.0 - jitter, 1.0 + jitter);
+        double now = 0.0, longest = 0.0;
+        unsigned done = 0, launches = 0;
+        bool stepped = false;
+        while(done < spp) {
+            unsigned samples = controller.next(now, spp - done);
+            if(samples == 0)
+                break;
+            // The estimation is stale for one launch after the step.
+            if(!stepped && now >= 0.5 * budget) {
+                cost *= step;
+                stepped = true;
+            }
+            double duration = (overhead + samples * cost) * dis(eng);
+            now += duration;
+            done += samples;
+            ++launches;
+            longest = std::max(longest, duration);
+            controller.update(samples, duration);
+        }
+        // One launch may exceed the deadline by the estimation error.
+        double slack = budget > 0.0 ? now - budget : 0.0;
+        std::stringstream ss;
+        ss << launches << " launches, " << done << " spp in " << now
+           << " s, the longest launch " << longest << " s, deadline slack "
+           << slack << " s";
+        bool ok = longest <= bound && slack <= longest;
+        reporter.apply(ok ? ReportLevel::Info : ReportLevel::Error, ss.str(),
+                       BUS_DEFSRCLOC());
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    BUS_TRACE_END();
+}
+
+class LaunchSim final : public Command {
+public:
+    explicit LaunchSim(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return simulate(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getLaunchSim(Bus::ModuleInstance& instance) {
+    return std::make_shared<LaunchSim>(instance);
+}
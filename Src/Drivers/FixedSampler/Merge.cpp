@@ -0,0 +1,182 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "Checkpoint.hpp"
+#include "Film.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <thread>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.Merge");
+
+static Checkpoint timedMerge(const std::vector<fs::path>& shards,
+                             unsigned threads, double& time) {
+    auto beg = std::chrono::high_resolution_clock::now();
+    Checkpoint res = mergeCheckpoints(shards, threads);
+    auto end = std::chrono::high_resolution_clock::now();
+    time = std::chrono::duration<double, std::milli>(end - beg).count();
+    return res;
+}
+
+// Merge the shards of a distributed render into the final image.
+static int merge(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("Merge", "FixedSampler::Merge");
+        opt.add_options()("shards", "shard files",
+                          cxxopts::value<std::vector<std::string>>())(
+            "o,output", "output EXR file", cxxopts::value<fs::path>())(
+            "r,raw", "save the merged accumulation as a shard",
+            cxxopts::value<fs::path>())(
+            "t,threads", "worker threads(0 for all cores)",
+            cxxopts::value<unsigned>()->default_value("0"))(
+            "c,compress", "compress the merged shard")(
+            "compression", "EXR compression",
+            cxxopts::value<std::string>()->default_value("ZIP"))(
+            "float", "write float32 pixels")("tiled", "write a tiled EXR");
+        opt.parse_positional({ "shards" });
+        auto res = opt.parse(argc, argv);
+        if(!res.count("shards") ||
+           !(res.count("output") || res.count("raw"))) {
+            reporter.apply(ReportLevel::Error, "Need Arguments.",
+                           BUS_DEFSRCLOC());
+            reporter.apply(ReportLevel::Info, opt.help(), BUS_DEFSRCLOC());
+            return EXIT_FAILURE;
+        }
+        std::vector<fs::path> shards;
+        for(auto&& shard : res["shards"].as<std::vector<std::string>>())
+            shards.emplace_back(shard);
+        double time;
+        Checkpoint merged =
+            timedMerge(shards, res["threads"].as<unsigned>(), time);
+        {
+            std::stringstream ss;
+            ss << shards.size() << " shards merged in " << time
+               << " ms, samples [" << merged.sampleIdxFirst << ","
+               << merged.sampleIdxEnd << ")";
+            reporter.apply(ReportLevel::Info, ss.str(), BUS_DEFSRCLOC());
+        }
+        if(merged.sampleIdxBeg != merged.sampleIdxEnd)
+            reporter.apply(ReportLevel::Warning,
+                           "Missing " +
+                               std::to_string(merged.sampleIdxEnd -
+                                              merged.sampleIdxBeg) +
+                               " samples.",
+                           BUS_DEFSRCLOC());
+        if(res.count("raw"))
+            saveCheckpoint(res["raw"].as<fs::path>(), merged,
+                           res.count("compress") != 0);
+        if(res.count("output")) {
+            std::vector<Vec4> acc(merged.accumulation.size() / 4);
+            memcpy(acc.data(), merged.accumulation.data(),
+                   merged.accumulation.size() * sizeof(float));
+            OutputOptions options;
+            options.compression = res["compression"].as<std::string>();
+            options.floatPixels = res.count("float") != 0;
+            options.tiled = res.count("tiled") != 0;
+            options.threads = res["threads"].as<unsigned>();
+            saveEXR(res["output"].as<fs::path>(),
+                    Uint2{ merged.width, merged.height }, acc, options,
+                    reporter);
+        }
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
+// Measure the merge on synthetic shards. The GPU isn't involved.
+static int bench(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("MergeBench", "FixedSampler::MergeBench");
+        opt.add_options()("w,width", "film width",
+                          cxxopts::value<uint32_t>()->default_value("4096"))(
+            "h,height", "film height",
+            cxxopts::value<uint32_t>()->default_value("4096"))(
+            "s,shards", "shard count",
+            cxxopts::value<uint32_t>()->default_value("16"))(
+            "t,threads", "worker threads(0 for all cores)",
+            cxxopts::value<unsigned>()->default_value("0"))(
+            "c,compress", "compress the shards")(
+            "d,dir", "directory of the temporary shards",
+            cxxopts::value<fs::path>()->default_value(
+                (fs::temp_directory_path() / "PiperMergeBench").string()));
+        auto res = opt.parse(argc, argv);
+        uint32_t width = res["width"].as<uint32_t>();
+        uint32_t height = res["height"].as<uint32_t>();
+        uint32_t count = res["shards"].as<uint32_t>();
+        fs::path dir = res["dir"].as<fs::path>();
+        bool compress = res.count("compress") != 0;
+
+        reporter.apply(ReportLevel::Info, "Generating shards.",
+                       BUS_DEFSRCLOC());
+        fs::create_directories(dir);
+        std::vector<fs::path> shards;
+        {
+            Checkpoint shard;
+            shard.fingerprint = 0;
+            shard.width = width;
+            shard.height = height;
+            shard.accumulation.resize(static_cast<size_t>(width) * height * 4);
+            std::mt19937 eng(0);
+            std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+            for(uint32_t i = 0; i < count; ++i) {
+                shard.sampleIdxFirst = i * 16;
+                shard.sampleIdxBeg = shard.sampleIdxEnd = i * 16 + 16;
+                for(auto&& val : shard.accumulation)
+                    val = dis(eng);
+                shards.push_back(dir / (std::to_string(i) + ".shard"));
+                saveCheckpoint(shards.back(), shard, compress);
+            }
+        }
+
+        unsigned threads = res["threads"].as<unsigned>();
+        if(threads == 0)
+            threads = std::max(1U, std::thread::hardware_concurrency());
+        double serial, parallel;
+        timedMerge(shards, 1, serial);
+        timedMerge(shards, threads, parallel);
+        for(auto&& shard : shards)
+            fs::remove(shard);
+
+        double bytes = static_cast<double>(width) * height * 16 * count;
+        std::stringstream ss;
+        ss << count << " shards " << width << "x" << height
+           << (compress ? " compressed" : "") << std::endl;
+        ss << "1 thread: " << serial << " ms (" << bytes / serial * 1e-3
+           << " MB/s)" << std::endl;
+        ss << threads << " threads: " << parallel
+           << " ms (" << bytes / parallel * 1e-3 << " MB/s), speedup "
+           << serial / parallel;
+        reporter.apply(ReportLevel::Info, ss.str(), BUS_DEFSRCLOC());
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
+class Merge final : public Command {
+public:
+    explicit Merge(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return merge(argc, argv, sys.getReporter());
+    }
+};
+
+class MergeBench final : public Command {
+public:
+    explicit MergeBench(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return bench(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getMerge(Bus::ModuleInstance& instance) {
+    return std::make_shared<Merge>(instance);
+}
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getMergeBench(Bus::ModuleInstance& instance) {
+    return std::make_shared<MergeBench>(instance);
+}
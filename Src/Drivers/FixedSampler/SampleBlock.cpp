@@ -0,0 +1,58 @@
+#include "SampleBlock.hpp"
+#include <algorithm>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.SampleBlock");
+
+SampleBlockQueue::SampleBlockQueue(DriverHelper helper, unsigned maxSamples)
+    : mHelper(helper), mDims(helper->sampleDims()), mMaxSamples(maxSamples),
+      mSlot(0), mNextBeg(0), mNextEnd(0), mWorker(1) {
+    BUS_TRACE_BEG() {
+        size_t size = static_cast<size_t>(mDims) * maxSamples;
+        for(unsigned i = 0; i < 2; ++i) {
+            mDevice[i] = allocBuffer(sizeof(float) * std::max<size_t>(size, 1));
+            mHost[i].resize(size);
+        }
+    }
+    BUS_TRACE_END();
+}
+
+void SampleBlockQueue::generate(unsigned slot, unsigned beg, unsigned end) {
+    BUS_TRACE_BEG() {
+        if(!mHelper->generateSamples(beg, end, mHost[slot].data()))
+            BUS_TRACE_THROW(
+                std::logic_error("The sampler doesn't support the blocks"));
+    }
+    BUS_TRACE_END();
+}
+
+const float* SampleBlockQueue::acquire(unsigned beg, unsigned samples,
+                                       unsigned end) {
+    BUS_TRACE_BEG() {
+        if(samples > mMaxSamples)
+            BUS_TRACE_THROW(std::logic_error("Too many samples per launch"));
+        bool hit = mNext.valid() && mNextBeg == beg &&
+            mNextEnd >= beg + samples;
+        if(mNext.valid())
+            // A miss still waits, the worker writes into mHost[mSlot].
+            mNext.get();
+        if(!hit)
+            generate(mSlot, beg, beg + samples);
+        unsigned slot = mSlot;
+        // The pageable memory is staged before the call returns, so the
+        // worker may refill it right after.
+        checkCudaError(cuMemcpyHtoDAsync(
+            asPtr(mDevice[slot]), mHost[slot].data(),
+            sizeof(float) * mDims * samples, mHelper->getStream()));
+
+        mSlot ^= 1;
+        mNextBeg = beg + samples;
+        mNextEnd = std::min(end, mNextBeg + mMaxSamples);
+        if(mNextBeg < mNextEnd)
+            mNext = mWorker.submit(
+                [this, slot = mSlot, nextBeg = mNextBeg, nextEnd = mNextEnd] {
+                    generate(slot, nextBeg, nextEnd);
+                });
+        return static_cast<const float*>(mDevice[slot].get());
+    }
+    BUS_TRACE_END();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "../../Shared/DriverAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
+
+// The sample blocks of the block mode. While a launch runs, the block of the
+// next launch is generated on a worker thread, starting where the current
+// one ends. The start is always known, but the sample count isn't, so the
+// worker generates up to maxSamples samples. The blocks are uploaded into two
+// device buffers alternately. A block is never overwritten while a launch
+// on the render stream may still read it.
+class SampleBlockQueue final : private Unmoveable {
+private:
+    DriverHelper mHelper;
+    unsigned mDims, mMaxSamples;
+    Buffer mDevice[2];
+    std::vector<float> mHost[2];
+    unsigned mSlot;
+    // the samples [mNextBeg,mNextEnd) generated into mHost[mSlot]
+    unsigned mNextBeg, mNextEnd;
+    std::future<void> mNext;
+    // The last member, the worker is joined before the buffers are freed.
+    ThreadPool mWorker;
+
+    void generate(unsigned slot, unsigned beg, unsigned end);
+
+public:
+    SampleBlockQueue(DriverHelper helper, unsigned maxSamples);
+    // Upload the samples [beg,beg+samples) on the render stream and start
+    // generating the next block, which ends at end at most. samples mustn't
+    // exceed maxSamples.
+    const float* acquire(unsigned beg, unsigned samples, unsigned end);
+};
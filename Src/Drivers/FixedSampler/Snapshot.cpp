@@ -0,0 +1,99 @@
+#include "Snapshot.hpp"
+#include "../../Shared/ThreadPool.hpp"
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.Snapshot");
+
+SnapshotQueue::SnapshotQueue(size_t pixels, Bus::Reporter& reporter)
+    : mPixels(pixels), mStream(nullptr), mCopied(nullptr), mReadBack(nullptr),
+      mReading(false), mReporter(reporter) {
+    BUS_TRACE_BEG() {
+        mDevice = allocBuffer(sizeof(Vec4) * pixels, 16);
+        void* ptr;
+        checkCudaError(cuMemAllocHost(&ptr, sizeof(Vec4) * pixels));
+        mHost.reset(static_cast<Vec4*>(ptr));
+        // A blocking stream would be serialized with the legacy default
+        // stream used by the launches.
+        checkCudaError(cuStreamCreate(&mStream, CU_STREAM_NON_BLOCKING));
+        checkCudaError(cuEventCreate(&mCopied, CU_EVENT_DISABLE_TIMING));
+        checkCudaError(cuEventCreate(&mReadBack, CU_EVENT_DISABLE_TIMING));
+    }
+    BUS_TRACE_END();
+}
+
+SnapshotQueue::~SnapshotQueue() {
+    // The consumer may still read the pinned memory.
+    if(mConsuming.valid())
+        mConsuming.wait();
+    if(mStream)
+        cuStreamSynchronize(mStream);
+    if(mCopied)
+        cuEventDestroy(mCopied);
+    if(mReadBack)
+        cuEventDestroy(mReadBack);
+    if(mStream)
+        cuStreamDestroy(mStream);
+}
+
+bool SnapshotQueue::take(CUstream renderStream, const Buffer& acc) {
+    BUS_TRACE_BEG() {
+        if(mReading ||
+           (mConsuming.valid() &&
+            mConsuming.wait_for(std::chrono::seconds(0)) !=
+                std::future_status::ready))
+            return false;
+        waitConsumer();
+        size_t size = sizeof(Vec4) * mPixels;
+        checkCudaError(
+            cuMemcpyDtoDAsync(asPtr(mDevice), asPtr(acc), size, renderStream));
+        checkCudaError(cuEventRecord(mCopied, renderStream));
+        checkCudaError(cuStreamWaitEvent(mStream, mCopied, 0));
+        checkCudaError(
+            cuMemcpyDtoHAsync(mHost.get(), asPtr(mDevice), size, mStream));
+        checkCudaError(cuEventRecord(mReadBack, mStream));
+        mReading = true;
+        return true;
+    }
+    BUS_TRACE_END();
+}
+
+void SnapshotQueue::consume(ThreadPool& writer, Consumer consumer) {
+    mReading = false;
+    mConsuming = writer.submit(
+        [this, consumer = std::move(consumer)] { consumer(mHost.get()); });
+}
+
+void SnapshotQueue::waitConsumer() {
+    if(!mConsuming.valid())
+        return;
+    try {
+        mConsuming.get();
+    } catch(const std::exception& ex) {
+        mReporter.apply(ReportLevel::Warning,
+                        std::string("Failed to save snapshot:") + ex.what(),
+                        BUS_DEFSRCLOC());
+    }
+}
+
+void SnapshotQueue::poll(ThreadPool& writer, const Consumer& consumer) {
+    BUS_TRACE_BEG() {
+        if(!mReading)
+            return;
+        CUresult res = cuEventQuery(mReadBack);
+        if(res == CUDA_ERROR_NOT_READY)
+            return;
+        checkCudaError(res);
+        consume(writer, consumer);
+    }
+    BUS_TRACE_END();
+}
+
+void SnapshotQueue::flush(ThreadPool& writer, const Consumer& consumer) {
+    BUS_TRACE_BEG() {
+        if(mReading) {
+            checkCudaError(cuEventSynchronize(mReadBack));
+            consume(writer, consumer);
+        }
+        waitConsumer();
+    }
+    BUS_TRACE_END();
+}
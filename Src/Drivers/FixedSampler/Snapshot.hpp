@@ -0,0 +1,45 @@
+#pragma once
+#include "../../Shared/PluginShared.hpp"
+#include <functional>
+#include <future>
+
+class ThreadPool;
+
+// Progressive snapshots of the accumulation buffer which don't stall the
+// launches. The buffer is copied on the render stream, which is cheap and
+// ordered before the next launch. The copy is read back into pinned memory
+// on a non-blocking stream and handed to a consumer on the writer thread.
+// Only one snapshot is in flight.
+class SnapshotQueue final : private Unmoveable {
+public:
+    using Consumer = std::function<void(const Vec4* acc)>;
+
+private:
+    struct PinnedDeleter final {
+        void operator()(Vec4* ptr) const {
+            checkCudaError(cuMemFreeHost(ptr));
+        }
+    };
+
+    size_t mPixels;
+    Buffer mDevice;
+    std::unique_ptr<Vec4, PinnedDeleter> mHost;
+    CUstream mStream;
+    CUevent mCopied, mReadBack;
+    bool mReading;
+    std::future<void> mConsuming;
+    Bus::Reporter& mReporter;
+
+    void consume(ThreadPool& writer, Consumer consumer);
+    void waitConsumer();
+
+public:
+    SnapshotQueue(size_t pixels, Bus::Reporter& reporter);
+    ~SnapshotQueue();
+    // Return false and do nothing if the previous snapshot is in flight.
+    bool take(CUstream renderStream, const Buffer& acc);
+    // Hand the finished readback to the consumer, call it between launches.
+    void poll(ThreadPool& writer, const Consumer& consumer);
+    // Wait for the snapshot in flight and its consumer.
+    void flush(ThreadPool& writer, const Consumer& consumer);
+};
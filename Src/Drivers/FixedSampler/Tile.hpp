@@ -0,0 +1,7 @@
+#pragma once
+
+// A square block of pixels at (x,y) and the sample indices [beg,end) to be
+// taken by each of its pixels in one launch.
+struct TileTask final {
+    unsigned x, y, sampleIdxBeg, sampleIdxEnd;
+};
@@ -0,0 +1,94 @@
+#include "TileOrder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+TileOrder parseTileOrder(const std::string& name) {
+    if(name == "Scanline")
+        return TileOrder::Scanline;
+    if(name == "Spiral")
+        return TileOrder::Spiral;
+    if(name == "Hilbert")
+        return TileOrder::Hilbert;
+    throw std::invalid_argument("Unknown tile order " + name);
+}
+
+unsigned tileSizeFromBudget(size_t budget, size_t bytesPerPixel) {
+    size_t pixels = budget / std::max<size_t>(bytesPerPixel, 1);
+    size_t side =
+        static_cast<size_t>(std::sqrt(static_cast<double>(pixels)));
+    if(side >= 16)
+        side &= ~static_cast<size_t>(15);
+    return static_cast<unsigned>(std::clamp<size_t>(side, 1, 1U << 15));
+}
+
+static std::vector<TileCoord> spiral(unsigned countX, unsigned countY) {
+    std::vector<TileCoord> res;
+    size_t total = static_cast<size_t>(countX) * countY;
+    res.reserve(total);
+    int x = static_cast<int>(countX - 1) / 2,
+        y = static_cast<int>(countY - 1) / 2;
+    const int dx[4] = { 1, 0, -1, 0 }, dy[4] = { 0, 1, 0, -1 };
+    auto visit = [&] {
+        if(x >= 0 && y >= 0 && x < static_cast<int>(countX) &&
+           y < static_cast<int>(countY))
+            res.push_back({ static_cast<unsigned>(x),
+                            static_cast<unsigned>(y) });
+    };
+    visit();
+    // step lengths 1,1,2,2,3,3...
+    for(int step = 1, dir = 0; res.size() < total; ++dir) {
+        for(int i = 0; i < step && res.size() < total; ++i) {
+            x += dx[dir & 3], y += dy[dir & 3];
+            visit();
+        }
+        if(dir & 1)
+            ++step;
+    }
+    return res;
+}
+
+static std::vector<TileCoord> hilbert(unsigned countX, unsigned countY) {
+    std::vector<TileCoord> res;
+    res.reserve(static_cast<size_t>(countX) * countY);
+    unsigned n = 1;
+    while(n < countX || n < countY)
+        n <<= 1;
+    // map the distance along the curve to the coordinate
+    for(size_t d = 0; d < static_cast<size_t>(n) * n; ++d) {
+        unsigned x = 0, y = 0;
+        size_t t = d;
+        for(unsigned s = 1; s < n; s <<= 1) {
+            unsigned rx = 1 & static_cast<unsigned>(t / 2);
+            unsigned ry = 1 & static_cast<unsigned>(t ^ rx);
+            if(ry == 0) {
+                if(rx == 1)
+                    x = s - 1 - x, y = s - 1 - y;
+                std::swap(x, y);
+            }
+            x += s * rx, y += s * ry;
+            t /= 4;
+        }
+        if(x < countX && y < countY)
+            res.push_back({ x, y });
+    }
+    return res;
+}
+
+std::vector<TileCoord> tileOrder(unsigned countX, unsigned countY,
+                                 TileOrder order) {
+    switch(order) {
+        case TileOrder::Spiral:
+            return spiral(countX, countY);
+        case TileOrder::Hilbert:
+            return hilbert(countX, countY);
+        default: {
+            std::vector<TileCoord> res;
+            res.reserve(static_cast<size_t>(countX) * countY);
+            for(unsigned y = 0; y < countY; ++y)
+                for(unsigned x = 0; x < countX; ++x)
+                    res.push_back({ x, y });
+            return res;
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The host side tile scheduling of the TileSampler. No CUDA is involved.
+
+enum class TileOrder { Scanline, Spiral, Hilbert };
+
+// Scanline/Spiral/Hilbert
+TileOrder parseTileOrder(const std::string& name);
+
+struct TileCoord final {
+    unsigned x, y;
+};
+
+// The side length of the square tiles which fit the memory budget, rounded
+// down to a multiple of 16 unless it is smaller than 16.
+unsigned tileSizeFromBudget(size_t budget, size_t bytesPerPixel);
+
+// The order of the countX*countY tiles. Every tile appears exactly once.
+// Spiral starts from the center tile, Hilbert walks the curve which covers
+// the grid.
+std::vector<TileCoord> tileOrder(unsigned countX, unsigned countY,
+                                 TileOrder order);
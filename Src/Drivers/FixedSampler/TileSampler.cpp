@@ -0,0 +1,146 @@
+#include "../../Shared/ConfigAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "DataDesc.hpp"
+#include "DriverBase.hpp"
+#include "Film.hpp"
+#include "TileOrder.hpp"
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler.TileSampler");
+
+// Render the film tile by tile and stream the finished tiles to the output,
+// so the memory usage is bounded by the tile size instead of the film size.
+class TileSampler final : public DriverBase {
+private:
+    fs::path mOutput;
+    unsigned mSampleCount, mSamplePerLaunch, mTileSize;
+    size_t mMemoryBudget;
+    TileOrder mOrder;
+
+public:
+    explicit TileSampler(Bus::ModuleInstance& instance)
+        : DriverBase(instance) {}
+    DriverData init(PluginHelper helper,
+                    std::shared_ptr<Config> config) override {
+        BUS_TRACE_BEG() {
+            mOutput =
+                helper->outputPath(config->attribute("Output")->asString());
+            mSampleCount = config->attribute("SampleCount")->asUint();
+            mSamplePerLaunch = config->attribute("SamplePerLaunch")->asUint();
+            // in MB
+            mMemoryBudget =
+                static_cast<size_t>(config->getUint("MemoryBudget", 256))
+                << 20;
+            // 0 means deciding by the memory budget
+            mTileSize = config->getUint("TileSize", 0);
+            mOrder = parseTileOrder(config->getString("Order", "Spiral"));
+            DriverData res =
+                initBase(helper, config, "__raygen__renderKernel");
+            res.maxSPP = mSampleCount;
+            return res;
+        }
+        BUS_TRACE_END();
+    }
+    void doRender(unsigned realSPP, DriverHelper helper) override {
+        BUS_TRACE_BEG() {
+            CUstream stream = helper->getStream();
+            // device accumulation+two host copies(rendering and writing)+half
+            constexpr size_t bytesPerPixel = sizeof(Vec4) * 3 + 8;
+            Uint2 tileSize;
+            if(mOrder == TileOrder::Scanline) {
+                size_t rows =
+                    mMemoryBudget / (bytesPerPixel * mFilmSize.x);
+                tileSize = Uint2{ mFilmSize.x,
+                                  static_cast<unsigned>(std::clamp<size_t>(
+                                      rows, 1, mFilmSize.y)) };
+            } else {
+                unsigned side = mTileSize ?
+                    mTileSize :
+                    tileSizeFromBudget(mMemoryBudget, bytesPerPixel);
+                tileSize = glm::min(Uint2{ side }, mFilmSize);
+            }
+            unsigned countX = (mFilmSize.x + tileSize.x - 1) / tileSize.x;
+            unsigned countY = (mFilmSize.y + tileSize.y - 1) / tileSize.y;
+            std::vector<TileCoord> tiles = tileOrder(countX, countY, mOrder);
+            {
+                std::stringstream ss;
+                ss << "Tile size:" << tileSize.x << "x" << tileSize.y
+                   << " Tile count:" << tiles.size();
+                reporter().apply(ReportLevel::Info, ss.str(), BUS_DEFSRCLOC());
+            }
+
+            size_t tilePixels = static_cast<size_t>(tileSize.x) * tileSize.y;
+            Buffer output = allocBuffer(sizeof(Vec4) * tilePixels, 16);
+            DataDesc data;
+            data.filtBadColor = mFiltBadColor;
+            data.sampleOnePixel = mSampleOnePixel;
+            data.generateRay = mGenerateRay;
+            data.outputBuffer = static_cast<Vec4*>(output.get());
+            data.aovBuffer = nullptr;
+            data.samples = nullptr;
+            data.rankBeg = 0;
+            data.rankEnd = realSPP;
+
+            uploadRecords(stream);
+
+            TileWriter writer(mOutput, mFilmSize, tileSize,
+                              mOrder == TileOrder::Scanline, mOutputOptions);
+            // The previous tile is written while the current one is rendered.
+            ThreadPool writerThread(1);
+            std::future<void> pending;
+            for(size_t i = 0; i < tiles.size(); ++i) {
+                Uint2 offset{ tiles[i].x * tileSize.x,
+                              tiles[i].y * tileSize.y };
+                Uint2 size = glm::min(tileSize, mFilmSize - offset);
+                size_t pixels = static_cast<size_t>(size.x) * size.y;
+                checkCudaError(cuMemsetD32Async(
+                    asPtr(output), 0, sizeof(Vec4) / 4 * pixels, stream));
+                data.width = size.x;
+                data.height = size.y;
+                data.offsetX = offset.x;
+                data.offsetY = offset.y;
+                for(unsigned beg = 0; beg < realSPP;
+                    beg += mSamplePerLaunch) {
+                    data.sampleIdxBeg = beg;
+                    data.sampleIdxEnd =
+                        std::min(beg + mSamplePerLaunch, realSPP);
+                    Buffer rayGenSBT =
+                        uploadData(stream, packSBTRecord(mRayGen.get(), data));
+                    helper->doRender(
+                        [&](OptixShaderBindingTable& table) {
+                            fillSBT(table, rayGenSBT);
+                        },
+                        size);
+                }
+                checkCudaError(cuStreamSynchronize(stream));
+                std::vector<Vec4> acc = downloadData<Vec4>(output, 0, pixels);
+                if(pending.valid())
+                    pending.get();
+                pending = writerThread.submit(
+                    [&writer, offset, size, acc = std::move(acc)] {
+                        writer.write(offset, size, acc);
+                    });
+                {
+                    std::stringstream ss;
+                    ss.precision(2);
+                    ss << std::fixed
+                       << "Process:" << (i + 1) * 100.0 / tiles.size() << "%"
+                       << std::endl;
+                    reporter().apply(ReportLevel::Info, ss.str(),
+                                     BUS_DEFSRCLOC());
+                }
+            }
+            if(pending.valid())
+                pending.get();
+            if(writer.hasBadColor())
+                reporter().apply(ReportLevel::Warning, "Bad color!!!",
+                                 BUS_DEFSRCLOC());
+        }
+        BUS_TRACE_END();
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getTileSampler(Bus::ModuleInstance& instance) {
+    return std::make_shared<TileSampler>(instance);
+}
@@ -0,0 +1,128 @@
+#include "ToneMap.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// The ACES fit is ported from Src/_Deprecated/TexConverter/ACES.cpp.
+// https://github.com/TheRealMJP/BakingLab/blob/master/BakingLab/ACES.hlsl
+
+// sRGB => XYZ => D65_2_D60 => AP1 => RRT_SAT
+static const float acesInput[3][3] = { { 0.59719f, 0.35458f, 0.04823f },
+                                       { 0.07600f, 0.90834f, 0.01566f },
+                                       { 0.02840f, 0.13383f, 0.83777f } };
+
+// ODT_SAT => XYZ => D60_2_D65 => sRGB
+static const float acesOutput[3][3] = { { 1.60475f, -0.53108f, -0.07367f },
+                                        { -0.10208f, 1.10813f, -0.00605f },
+                                        { -0.00327f, -0.07276f, 1.07602f } };
+
+ColorTransform parseColorSpace(const std::string& name) {
+    // linear sRGB(D65) to the linear target primaries
+    static const std::pair<const char*, ColorTransform> table[] = {
+        { "sRGB",
+          { { { 1.0f, 0.0f, 0.0f },
+              { 0.0f, 1.0f, 0.0f },
+              { 0.0f, 0.0f, 1.0f } },
+            0.0f } },
+        { "AdobeRGB",
+          { { { 0.715127f, 0.284868f, 0.000005f },
+              { 0.000001f, 0.999999f, 0.0f },
+              { -0.000003f, 0.041155f, 0.958848f } },
+            563.0f / 256.0f } },
+        { "DisplayP3",
+          { { { 0.822462f, 0.177538f, 0.0f },
+              { 0.033194f, 0.966806f, 0.0f },
+              { 0.017083f, 0.072397f, 0.910520f } },
+            0.0f } },
+        { "Rec2020",
+          { { { 0.627404f, 0.329283f, 0.043313f },
+              { 0.069097f, 0.919540f, 0.011362f },
+              { 0.016391f, 0.088013f, 0.895595f } },
+            2.4f } }
+    };
+    for(auto&& item : table)
+        if(name == item.first)
+            return item.second;
+    throw std::invalid_argument("Unknown colour space " + name);
+}
+
+static unsigned hashPixel(size_t idx) {
+    // Thomas Wang's integer hash
+    unsigned x = static_cast<unsigned>(idx);
+    x = (x ^ 61U) ^ (x >> 16);
+    x *= 9U;
+    x ^= x >> 4;
+    x *= 0x27d4eb2dU;
+    x ^= x >> 15;
+    return x;
+}
+
+void toneMap(const float* acc, size_t pixels, size_t firstPixel,
+             const ToneMapOptions& options, const ColorTransform& transform,
+             unsigned char* dst) {
+    const float scale = std::exp2(options.exposure);
+    const bool aces = options.aces, dither = options.dither;
+    const float invGamma = transform.gamma > 0.0f ? 1.0f / transform.gamma :
+                                                    1.0f / 2.4f;
+    const bool srgbCurve = transform.gamma <= 0.0f;
+    const auto& mat = transform.matrix;
+    // The branches above are uniform, the loop body only has selects.
+    for(size_t i = 0; i < pixels; ++i) {
+        const float* src = acc + i * 4;
+        float inv = src[3] > 0.0f ? scale / src[3] : 0.0f;
+        float c[3] = { src[0] * inv, src[1] * inv, src[2] * inv };
+        if(aces) {
+            float t[3];
+            for(int j = 0; j < 3; ++j)
+                t[j] = acesInput[j][0] * c[0] + acesInput[j][1] * c[1] +
+                    acesInput[j][2] * c[2];
+            for(int j = 0; j < 3; ++j) {
+                float v = t[j];
+                float a = v * (v + 0.0245786f) - 0.000090537f;
+                float b = v * (0.983729f * v + 0.4329510f) + 0.238081f;
+                t[j] = a / b;
+            }
+            for(int j = 0; j < 3; ++j)
+                c[j] = acesOutput[j][0] * t[0] + acesOutput[j][1] * t[1] +
+                    acesOutput[j][2] * t[2];
+        }
+        unsigned noise0 = hashPixel(firstPixel + i);
+        unsigned noise1 = hashPixel(noise0 ^ 0x9e3779b9U);
+        for(int j = 0; j < 3; ++j) {
+            float v = mat[j][0] * c[0] + mat[j][1] * c[1] + mat[j][2] * c[2];
+            // NaN is mapped to 0
+            v = std::min(std::max(0.0f, v), 1.0f);
+            float p = std::pow(v, invGamma);
+            float encoded = srgbCurve ?
+                (v <= 0.0031308f ? 12.92f * v : 1.055f * p - 0.055f) :
+                p;
+            // the sum of two uniform numbers is triangular
+            float u0 = static_cast<float>((noise0 >> (j * 8)) & 255U);
+            float u1 = static_cast<float>((noise1 >> (j * 8)) & 255U);
+            float offset = dither ? (u0 + u1) / 255.0f - 1.0f : 0.0f;
+            float q = encoded * 255.0f + 0.5f + offset;
+            dst[i * 3 + j] = static_cast<unsigned char>(
+                std::min(std::max(q, 0.0f), 255.0f));
+        }
+    }
+}
+
+std::vector<unsigned char> toneMapImage(const float* acc, unsigned width,
+                                        unsigned height,
+                                        const ToneMapOptions& options,
+                                        ThreadPool* pool) {
+    ColorTransform transform = parseColorSpace(options.colorSpace);
+    std::vector<unsigned char> res(static_cast<size_t>(width) * height * 3);
+    auto convert = [&](size_t y) {
+        size_t beg = y * width;
+        toneMap(acc + beg * 4, width, beg, options, transform,
+                res.data() + beg * 3);
+    };
+    if(pool)
+        parallelFor(*pool, height, convert, 16);
+    else
+        for(size_t y = 0; y < height; ++y)
+            convert(y);
+    return res;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// The host side LDR conversion. No CUDA is involved.
+
+class ThreadPool;
+
+struct ToneMapOptions final {
+    // in stops
+    float exposure = 0.0f;
+    // the ACES filmic curve fitted by Stephen Hill, clamp only if false
+    bool aces = true;
+    // sRGB/AdobeRGB/DisplayP3/Rec2020
+    std::string colorSpace = "sRGB";
+    // triangular noise of one LSB against the banding
+    bool dither = true;
+    // of the JPEG encoder
+    unsigned quality = 90;
+};
+
+// The linear sRGB to the target primaries and the transfer function.
+struct ColorTransform final {
+    float matrix[3][3];
+    // 0 for the sRGB curve
+    float gamma;
+};
+
+// Throw std::invalid_argument for an unknown colour space.
+ColorTransform parseColorSpace(const std::string& name);
+
+// Resolve, expose, tone map, convert, encode, dither and quantize the pixels
+// in one pass. acc is the accumulation buffer(sum of radiance,sample count)
+// and dst is 8-bit RGB. firstPixel is the index of acc[0] in the film, it
+// seeds the dither.
+void toneMap(const float* acc, size_t pixels, size_t firstPixel,
+             const ToneMapOptions& options, const ColorTransform& transform,
+             unsigned char* dst);
+
+// Convert the film row by row on the pool, or in serial if it is nullptr.
+std::vector<unsigned char> toneMapImage(const float* acc, unsigned width,
+                                        unsigned height,
+                                        const ToneMapOptions& options,
+                                        ThreadPool* pool);
@@ -1,214 +1,482 @@
+#include "../../Shared/CommandAPI.hpp"
 #include "../../Shared/ConfigAPI.hpp"
-#include "../../Shared/DriverAPI.hpp"
-#include "../../Shared/IntegratorAPI.hpp"
-#include "../../Shared/LightAPI.hpp"
-#include "../../Shared/PhotographerAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "Checkpoint.hpp"
 #include "DataDesc.hpp"
+#include "DriverBase.hpp"
+#include "Film.hpp"
+#include "LaunchControl.hpp"
+#include "SampleBlock.hpp"
+#include "Snapshot.hpp"
+#include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #pragma warning(push, 0)
 #include <optix_function_table_definition.h>
 #include <optix_stubs.h>
-#define OPENEXR_DLL
-#include <OpenEXR/ImfRgbaFile.h>
 #pragma warning(pop)
 
 BUS_MODULE_NAME("Piper.BuiltinDriver.FixedSampler");
 
-class FixedSampler final : public Driver {
+// image.exr -> image.0012.exr
+static fs::path numberedPath(const fs::path& path, unsigned frame) {
+    std::stringstream ss;
+    ss << "." << std::setw(4) << std::setfill('0') << frame
+       << path.extension().string();
+    fs::path res = path;
+    res.replace_extension(ss.str());
+    return res;
+}
+
+class FixedSampler final : public DriverBase {
 private:
-    fs::path mOutput;
-    unsigned mSampleCount, mSamplePerLaunch, mGenerateRay, mSampleOnePixel;
-    Uint2 mFilmSize;
-    bool mFiltBadColor;
-    ProgramGroup mMissOcc, mRayGen, mException;
-    std::shared_ptr<Photographer> mPhotographer;
-    std::shared_ptr<Integrator> mIntegrator;
-    std::shared_ptr<EnvironmentLight> mEnv;
-    Data mEnvData;
+    fs::path mOutput, mCheckpoint;
+    unsigned mSampleCount, mSamplePerLaunch, mMaxSamplePerLaunch,
+        mCheckpointInterval, mPreviewInterval;
+    float mTimeBudget, mTargetLaunchTime;
+    Uint2 mCropOffset, mCropSize, mFrameRange;
+    bool mComposite;
+    fs::path mCompositeBase;
+    bool mCompressCheckpoint, mAOV, mDenoise, mSampleBlock;
+    DenoiseOptions mDenoiseOptions;
 
 public:
-    explicit FixedSampler(Bus::ModuleInstance& instance) : Driver(instance) {}
+    explicit FixedSampler(Bus::ModuleInstance& instance)
+        : DriverBase(instance) {}
     DriverData init(PluginHelper helper,
                     std::shared_ptr<Config> config) override {
         BUS_TRACE_BEG() {
-            mOutput = config->attribute("Output")->asString();
+            mOutput =
+                helper->outputPath(config->attribute("Output")->asString());
             mSampleCount = config->attribute("SampleCount")->asUint();
             mSamplePerLaunch = config->attribute("SamplePerLaunch")->asUint();
-            mFilmSize = config->attribute("FilmSize")->asUint2();
-            mFiltBadColor = config->getBool("FiltBadColor", false);
-            const ModuleDesc& mod =
-                helper->getModuleManager()->getModuleFromFile(
-                    modulePath().parent_path() / "Kernel.ptx");
-            OptixProgramGroupDesc desc[3] = {};
-            desc[0].flags = 0;
-            desc[0].kind = OPTIX_PROGRAM_GROUP_KIND_RAYGEN;
-            desc[0].raygen.entryFunctionName =
-                mod.map("__raygen__renderKernel");
-            desc[0].raygen.module = mod.handle.get();
-            desc[1].flags = 0;
-            desc[1].kind = OPTIX_PROGRAM_GROUP_KIND_EXCEPTION;
-            desc[1].exception.entryFunctionName =
-                mod.map(helper->isDebug() ? "__exception__default" :
-                                            "__exception__silence");
-            desc[1].exception.module = mod.handle.get();
-            desc[2].flags = 0;
-            desc[2].kind = OPTIX_PROGRAM_GROUP_KIND_MISS;
-            desc[2].miss.entryFunctionName = mod.map("__miss__occ");
-            desc[2].miss.module = mod.handle.get();
-            OptixProgramGroup groups[3] = {};
-            OptixProgramGroupOptions opt = {};
-            checkOptixError(optixProgramGroupCreate(
-                helper->getContext(), desc, 3, &opt, nullptr, nullptr, groups));
-            mRayGen.reset(groups[0]);
-            mException.reset(groups[1]);
-            mMissOcc.reset(groups[2]);
-
-            DriverData res;
-            OptixStackSizes size;
-            checkOptixError(
-                optixProgramGroupGetStackSize(mRayGen.get(), &size));
-            res.cssRG = size.cssRG;
-            checkOptixError(
-                optixProgramGroupGetStackSize(mMissOcc.get(), &size));
-            res.cssMSOcc = size.cssMS;
-            auto pgc = config->attribute("Photographer");
-            mPhotographer = system().instantiateByName<Photographer>(
-                pgc->attribute("Plugin")->asString());
-
-            CameraData cdata = mPhotographer->init(helper, pgc);
-            res.dss = cdata.dss;
-            mGenerateRay = helper->addCallable(
-                cdata.group, mPhotographer->prepareFrame(mFilmSize));
-
-            auto igc = config->attribute("Integrator");
-            mIntegrator = system().instantiateByName<Integrator>(
-                igc->attribute("Plugin")->asString());
-            IntegratorData idata = mIntegrator->init(helper, igc);
-
-            auto egc = config->attribute("Environment");
-            mEnv = system().instantiateByName<EnvironmentLight>(
-                egc->attribute("Plugin")->asString());
-            LightData edata = mEnv->init(helper, egc);
-            mEnvData = edata.sbtData;
-
-            res.cssMSRad = edata.css;
-            res.cssRG += idata.css;
-            res.dss = std::max(edata.dss, std::max(res.dss, idata.dss));
-            mSampleOnePixel = helper->addCallable(idata.group, idata.sbtData);
-            res.maxTraceDepth = idata.maxTraceDepth;
-            // TODO:exact call graph like stack size
-            res.maxSampleDim =
-                cdata.maxSampleDim + idata.maxSampleDim + edata.maxSampleDim;
-            res.group.assign(groups, groups + 3);
-            res.group.push_back(edata.group);
-            res.size = mFilmSize;
+            // in seconds, 0 disables the limit
+            mTimeBudget = config->getFloat("TimeBudget", 0.0f);
+            // in seconds, SamplePerLaunch is tuned to it unless it is 0
+            mTargetLaunchTime = config->getFloat("TargetLaunchTime", 0.0f);
+            mMaxSamplePerLaunch = std::max(
+                config->getUint("MaxSamplePerLaunch", 1024), mSamplePerLaunch);
+            // in seconds, 0 disables the checkpoints
+            mCheckpointInterval = config->getUint("CheckpointInterval", 0);
+            fs::path checkpoint = mOutput;
+            checkpoint.replace_extension(".ckpt");
+            mCheckpoint = helper->outputPath(
+                config->getString("Checkpoint", checkpoint.string()));
+            mCompressCheckpoint = config->getBool("CompressCheckpoint", true);
+            // albedo/normal/depth/sample count/per-light layers
+            mAOV = config->getBool("AOV", false);
+            // The denoiser is guided by the AOVs.
+            mDenoise = config->getBool("Denoise", false);
+            mAOV |= mDenoise;
+            mDenoiseOptions = parseDenoiseOptions(config);
+            // in seconds, 0 disables the snapshots. The snapshots are
+            // written to LDROutput or <Output>.preview.exr.
+            mPreviewInterval = config->getUint("PreviewInterval", 0);
+            // Read the samples pregenerated on the host instead of calling
+            // the sampler for every dimension.
+            mSampleBlock = config->getBool("SampleBlock", false);
+            DriverData res =
+                initBase(helper, config, "__raygen__renderKernel");
             res.maxSPP = mSampleCount;
-            // TODO:own Sampler
+            // The crop window is the whole film by default.
+            mCropOffset = config->getUint2("CropOffset", Uint2{ 0, 0 });
+            if(glm::any(glm::greaterThanEqual(mCropOffset, mFilmSize)))
+                BUS_TRACE_THROW(std::logic_error("Bad crop window"));
+            mCropSize = config->getUint2("CropSize", mFilmSize - mCropOffset);
+            if(mCropSize.x == 0 || mCropSize.y == 0 ||
+               glm::any(glm::greaterThan(mCropOffset + mCropSize, mFilmSize)))
+                BUS_TRACE_THROW(std::logic_error("Bad crop window"));
+            // Crop writes the window as the data window of Output, Composite
+            // pastes it into the image CompositeBase(Output by default). The
+            // first crop of a film starts from a black film.
+            std::string cropMode = config->getString("CropMode", "Crop");
+            if(cropMode != "Crop" && cropMode != "Composite")
+                BUS_TRACE_THROW(
+                    std::logic_error("Unknown crop mode " + cropMode));
+            mComposite = cropMode == "Composite";
+            mCompositeBase = helper->outputPath(
+                config->getString("CompositeBase", mOutput.string()));
+            // The frames [x,y) of a camera animation. Every frame is written
+            // to <Output stem>.<frame><Output extension>.
+            mFrameRange = config->getUint2(
+                "FrameRange", Uint2{ 0, std::numeric_limits<unsigned>::max() });
             return res;
         }
         BUS_TRACE_END();
     }
-    void setStack(OptixPipeline pipeline, const StackSizeInfo& stack) override {
-        BUS_TRACE_BEG() {
-            // TODO:other algorithms
-            unsigned css = stack.cssRG +
-                std::max(stack.maxCssGeoRad + stack.maxCssLight +
-                             std::max(stack.maxCssGeoOcc, stack.cssMSOcc),
-                         stack.cssMSRad);
-            reporter().apply(ReportLevel::Info, "css = " + std::to_string(css),
-                             BUS_DEFSRCLOC());
-            checkOptixError(optixPipelineSetStackSize(pipeline, stack.maxDssT,
-                                                      stack.maxDssS, css,
-                                                      stack.graphHeight));
-        }
-        BUS_TRACE_END();
+
+private:
+    struct FramePaths final {
+        fs::path output, checkpoint, ldrOutput, compositeBase;
+    };
+
+    FramePaths framePaths(unsigned frame) const {
+        FramePaths res{ numberedPath(mOutput, frame),
+                        numberedPath(mCheckpoint, frame), mLDROutput,
+                        numberedPath(mCompositeBase, frame) };
+        if(!mLDROutput.empty())
+            res.ldrOutput = numberedPath(mLDROutput, frame);
+        return res;
     }
-    void doRender(unsigned realSPP, DriverHelper helper) override {
+
+    // Render the current frame of the camera.
+    void renderFrame(unsigned realSPP, DriverHelper helper, unsigned frame,
+                     const FramePaths& paths) {
         BUS_TRACE_BEG() {
+            const fs::path &output = paths.output,
+                           &checkpoint = paths.checkpoint,
+                           &ldrOutput = paths.ldrOutput;
+            // A shard renders [firstIdx,endIdx) and saves the raw
+            // accumulation for the Merge command.
+            Uint2 shard = helper->shard();
+            bool sharded = shard.x < shard.y;
+            unsigned firstIdx = sharded ? std::min(shard.x, realSPP) : 0;
+            unsigned endIdx = sharded ? std::min(shard.y, realSPP) : realSPP;
+            fs::path checkpointPath = checkpoint;
+            if(sharded) {
+                std::string range = "." + std::to_string(firstIdx) + "-" +
+                    std::to_string(endIdx);
+                checkpointPath.replace_extension(
+                    range + checkpoint.extension().string());
+            }
+
+            if(sharded && mCropSize != mFilmSize)
+                BUS_TRACE_THROW(
+                    std::logic_error("Shards don't support the crop window"));
+            // A bad base fails before the render instead of after it.
+            if(mComposite && !sharded &&
+               !checkCompositeBase(paths.compositeBase, mFilmSize))
+                reporter().apply(ReportLevel::Info,
+                                 paths.compositeBase.string() +
+                                     " doesn't exist, composite into a "
+                                     "black film",
+                                 BUS_DEFSRCLOC());
+
+            // Don't resume from the checkpoint of another crop window with
+            // the same size or another frame.
+            uint64_t fingerprint = helper->fingerprint() ^
+                ((static_cast<uint64_t>(mCropOffset.x) << 32 | mCropOffset.y) *
+                 0x9E3779B97F4A7C15ULL) ^
+                (frame * 0xC2B2AE3D27D4EB4FULL);
+
+            // The launch covers the crop window only, the sample indices and
+            // the camera mapping are the same as the full film.
             DataDesc data;
             data.filtBadColor = mFiltBadColor;
-            data.width = mFilmSize.x;
-            data.height = mFilmSize.y;
+            data.width = mCropSize.x;
+            data.height = mCropSize.y;
+            data.offsetX = mCropOffset.x;
+            data.offsetY = mCropOffset.y;
             data.sampleOnePixel = mSampleOnePixel;
             data.generateRay = mGenerateRay;
-            size_t filmSize = mFilmSize.x * mFilmSize.y;
-            Buffer output = allocBuffer(sizeof(Vec4) * filmSize, 16);
-            checkCudaError(
-                cuMemsetD16(asPtr(output), 0, sizeof(Vec4) / 16 * filmSize));
-            data.outputBuffer = static_cast<Vec4*>(output.get());
-
-            Buffer exceptionSBT = uploadData(
-                helper->getStream(), packEmptySBTRecord(mException.get()));
-            Data missOccSBT = packEmptySBTRecord(mMissOcc.get());
-            std::vector<Data> missSBT;
-            missSBT.emplace_back(mEnvData);
-            missSBT.emplace_back(missOccSBT);
-            unsigned count, stride;
-            CUdeviceptr ptr;
-            Buffer buf = uploadSBTRecords(helper->getStream(), missSBT, ptr,
-                                          stride, count);
-
-            for(unsigned beg = 0; beg < realSPP; beg += mSamplePerLaunch) {
+            data.samples = nullptr;
+            size_t pixelCount = static_cast<size_t>(mCropSize.x) * mCropSize.y;
+            Buffer accBuffer = allocBuffer(sizeof(Vec4) * pixelCount, 16);
+            checkCudaError(cuMemsetD16(asPtr(accBuffer), 0,
+                                       sizeof(Vec4) / 16 * pixelCount));
+            data.outputBuffer = static_cast<Vec4*>(accBuffer.get());
+
+            uploadRecords(helper->getStream());
+
+            auto makeCheckpoint = [&](unsigned beg, unsigned end) {
+                Checkpoint res;
+                res.fingerprint = fingerprint;
+                res.width = mCropSize.x;
+                res.height = mCropSize.y;
+                res.sampleIdxFirst = firstIdx;
+                res.sampleIdxBeg = beg;
+                res.sampleIdxEnd = end;
+                checkCudaError(cuStreamSynchronize(helper->getStream()));
+                res.accumulation =
+                    downloadData<float>(accBuffer, 0, pixelCount * 4);
+                return res;
+            };
+
+            unsigned begIdx = firstIdx;
+            bool aov = mAOV && !sharded;
+            if(mAOV && sharded)
+                reporter().apply(ReportLevel::Warning,
+                                 "AOVs are not supported by shards",
+                                 BUS_DEFSRCLOC());
+            if(helper->resume()) {
+                if(fs::exists(checkpointPath)) {
+                    Checkpoint saved = loadCheckpoint(checkpointPath);
+                    begIdx = resumeSampleIndex(saved, fingerprint, mCropSize.x,
+                                               mCropSize.y, firstIdx, endIdx);
+                    checkCudaError(cuMemcpyHtoD(
+                        asPtr(accBuffer), saved.accumulation.data(),
+                        sizeof(Vec4) * pixelCount));
+                    reporter().apply(ReportLevel::Info,
+                                     "Resume from sample " +
+                                         std::to_string(begIdx),
+                                     BUS_DEFSRCLOC());
+                    // The checkpoint doesn't contain the AOVs.
+                    if(aov && begIdx != firstIdx) {
+                        aov = false;
+                        reporter().apply(ReportLevel::Warning,
+                                         "AOVs are disabled after resuming",
+                                         BUS_DEFSRCLOC());
+                    }
+                } else
+                    reporter().apply(ReportLevel::Warning,
+                                     "No checkpoint " + checkpointPath.string(),
+                                     BUS_DEFSRCLOC());
+            }
+
+            Buffer aovBuffer;
+            data.aovBuffer = nullptr;
+            if(aov) {
+                aovBuffer = allocBuffer(sizeof(AOVSample) * pixelCount, 16);
+                checkCudaError(cuMemsetD8(asPtr(aovBuffer), 0,
+                                          sizeof(AOVSample) * pixelCount));
+                data.aovBuffer = static_cast<AOVSample*>(aovBuffer.get());
+            }
+
+            using Clock = std::chrono::steady_clock;
+            auto lastCheckpoint = Clock::now(), lastPreview = lastCheckpoint;
+            // Checkpoints and images are written in background, a failed
+            // one doesn't stop the render.
+            ThreadPool writer(1);
+            std::future<void> pending, ldr;
+            auto wait = [&](std::future<void>& task, const char* what) {
+                if(!task.valid())
+                    return;
+                try {
+                    task.get();
+                } catch(const std::exception& ex) {
+                    reporter().apply(ReportLevel::Warning,
+                                     std::string("Failed to save ") + what +
+                                         ":" + ex.what(),
+                                     BUS_DEFSRCLOC());
+                }
+            };
+            auto waitPending = [&] { wait(pending, "checkpoint"); };
+            fs::path previewPath = output;
+            previewPath.replace_extension(".preview.exr");
+            auto savePreview = [this, previewPath, ldrOutput,
+                                pixelCount](const Vec4* acc) {
+                if(!ldrOutput.empty())
+                    saveLDR(ldrOutput, mCropSize, acc, mToneMap,
+                            mOutputOptions.threads, reporter());
+                else
+                    saveEXR(previewPath, mCropSize,
+                            std::vector<Vec4>(acc, acc + pixelCount),
+                            mOutputOptions, reporter());
+            };
+            std::unique_ptr<SnapshotQueue> snapshots;
+            if(mPreviewInterval && !sharded)
+                snapshots =
+                    std::make_unique<SnapshotQueue>(pixelCount, reporter());
+
+            std::unique_ptr<SampleBlockQueue> blocks;
+            if(mSampleBlock) {
+                if(helper->generateSamples(0, 0, nullptr))
+                    blocks = std::make_unique<SampleBlockQueue>(
+                        helper, mMaxSamplePerLaunch);
+                else
+                    reporter().apply(
+                        ReportLevel::Warning,
+                        "The sampler doesn't support the block mode",
+                        BUS_DEFSRCLOC());
+            }
+
+            LaunchController controller(mTargetLaunchTime, mTimeBudget,
+                                        mSamplePerLaunch, mMaxSamplePerLaunch);
+            auto seconds = [](Clock::duration duration) {
+                return std::chrono::duration<double>(duration).count();
+            };
+            auto renderBeg = Clock::now();
+            unsigned beg = begIdx;
+            // The range of the render, endIdx is cut by the time budget.
+            const unsigned rangeEnd = endIdx;
+            while(beg < endIdx) {
+                unsigned samples = controller.next(
+                    seconds(Clock::now() - renderBeg), endIdx - beg);
+                if(samples == 0) {
+                    // The film is consistent, stop at [firstIdx,beg).
+                    reporter().apply(ReportLevel::Info,
+                                     "The time budget is used up at sample " +
+                                         std::to_string(beg),
+                                     BUS_DEFSRCLOC());
+                    endIdx = beg;
+                    break;
+                }
                 data.sampleIdxBeg = beg;
-                data.sampleIdxEnd = std::min(beg + mSamplePerLaunch, realSPP);
+                data.sampleIdxEnd = beg + samples;
+                // The pregenerated samples are indexed in the launch.
+                data.rankBeg = blocks ? beg : firstIdx;
+                data.rankEnd = blocks ? beg + samples : rangeEnd;
+                if(blocks)
+                    data.samples = blocks->acquire(beg, samples, endIdx);
                 Buffer rayGenSBT = uploadData(
                     helper->getStream(), packSBTRecord(mRayGen.get(), data));
 
-                helper->doRender([&](OptixShaderBindingTable& table) {
-                    table.exceptionRecord = asPtr(exceptionSBT);
-                    table.raygenRecord = asPtr(rayGenSBT);
-                    table.missRecordCount = count;
-                    table.missRecordBase = ptr;
-                    table.missRecordStrideInBytes = stride;
-                });
+                // doRender returns after the launch is finished
+                auto launchBeg = Clock::now();
+                helper->doRender(
+                    [&](OptixShaderBindingTable& table) {
+                        fillSBT(table, rayGenSBT);
+                    },
+                    mCropSize);
+                controller.update(samples, seconds(Clock::now() - launchBeg));
+                beg = data.sampleIdxEnd;
                 {
                     std::stringstream ss;
                     ss.precision(2);
-                    ss << std::fixed
-                       << "Process:" << data.sampleIdxEnd * 100.0 / realSPP
+                    ss << std::fixed << "Process:"
+                       << (data.sampleIdxEnd - firstIdx) * 100.0 /
+                            (endIdx - firstIdx)
                        << "%" << std::endl;
                     reporter().apply(ReportLevel::Info, ss.str(),
                                      BUS_DEFSRCLOC());
                 }
-            }
-            {
-                checkCudaError(cuStreamSynchronize(helper->getStream()));
-                std::vector<Vec4> arr = downloadData<Vec4>(output, 0, filmSize);
-                std::vector<Imf::Rgba> rgba(filmSize);
-                bool badColor = false;
-                for(size_t i = 0; i < filmSize; ++i) {
-                    if(isfinite(arr[i].x) && isfinite(arr[i].y) &&
-                       isfinite(arr[i].z) && isfinite(arr[i].w)) {
-                        if(arr[i].w > 0.0f)
-                            rgba[i] = Imf::Rgba(arr[i].x / arr[i].w,
-                                                arr[i].y / arr[i].w,
-                                                arr[i].z / arr[i].w);
-                        else
-                            rgba[i] = Imf::Rgba(0.0f, 0.0f, 0.0f);
-                    } else
-                        rgba[i] = Imf::Rgba(1.0f, 0.0f, 1.0f), badColor = true;
+                auto now = Clock::now();
+                if(mCheckpointInterval && data.sampleIdxEnd < endIdx &&
+                   now - lastCheckpoint >=
+                       std::chrono::seconds(mCheckpointInterval)) {
+                    lastCheckpoint = now;
+                    Checkpoint state =
+                        makeCheckpoint(data.sampleIdxEnd, endIdx);
+                    waitPending();
+                    pending =
+                        writer.submit([this, checkpointPath,
+                                       state = std::move(state)] {
+                            saveCheckpoint(checkpointPath, state,
+                                           mCompressCheckpoint);
+                        });
                 }
-                if(badColor)
-                    reporter().apply(
-                        ReportLevel::Warning, "Bad color!!!",
-                        BUS_SRCLOC("Piper.BuiltinDriver.FixedSampler"));
-                try {
-                    Imf::RgbaOutputFile out(mOutput.string().c_str(),
-                                            mFilmSize.x, mFilmSize.y,
-                                            Imf::WRITE_RGB);
-                    out.setFrameBuffer(rgba.data(), 1, mFilmSize.x);
-                    out.writePixels(mFilmSize.y);
-                } catch(...) {
-                    std::throw_with_nested(std::runtime_error(
-                        "Failed to save output file " + mOutput.string()));
+                if(snapshots) {
+                    snapshots->poll(writer, savePreview);
+                    // A snapshot is skipped if the last one is in flight.
+                    if(data.sampleIdxEnd < endIdx &&
+                       now - lastPreview >=
+                           std::chrono::seconds(mPreviewInterval) &&
+                       snapshots->take(helper->getStream(), accBuffer))
+                        lastPreview = now;
                 }
             }
+            // The final output supersedes the snapshot in flight.
+            snapshots.reset();
+            waitPending();
+            checkCudaError(cuStreamSynchronize(helper->getStream()));
+            // The render stopped by the time budget continues from here.
+            if(endIdx < rangeEnd) {
+                saveCheckpoint(checkpointPath,
+                               makeCheckpoint(endIdx, rangeEnd),
+                               mCompressCheckpoint);
+                reporter().apply(ReportLevel::Info,
+                                 "Checkpoint saved to " +
+                                     checkpointPath.string() +
+                                     ", continue with --resume",
+                                 BUS_DEFSRCLOC());
+            }
+            if(sharded) {
+                fs::path shardPath = output;
+                shardPath.replace_extension("." + std::to_string(firstIdx) +
+                                            "-" + std::to_string(endIdx) +
+                                            ".shard");
+                saveCheckpoint(shardPath, makeCheckpoint(endIdx, endIdx),
+                               mCompressCheckpoint);
+                reporter().apply(ReportLevel::Info,
+                                 "Shard saved to " + shardPath.string(),
+                                 BUS_DEFSRCLOC());
+            } else {
+                std::vector<Vec4> acc =
+                    downloadData<Vec4>(accBuffer, 0, pixelCount);
+                // overlap the LDR output with the EXR output and denoising
+                if(!ldrOutput.empty())
+                    ldr = writer.submit([this, acc, ldrOutput] {
+                        saveLDR(ldrOutput, mCropSize, acc.data(), mToneMap,
+                                mOutputOptions.threads, reporter());
+                    });
+                std::vector<AOVSample> aovData;
+                if(aov)
+                    aovData =
+                        downloadData<AOVSample>(aovBuffer, 0, pixelCount);
+                Metadata metadata;
+                metadata["spp"] = std::to_string(endIdx);
+                metadata["renderTime"] =
+                    std::to_string(seconds(Clock::now() - renderBeg));
+                if(mComposite) {
+                    if(aov)
+                        reporter().apply(ReportLevel::Warning,
+                                         "AOVs aren't composited",
+                                         BUS_DEFSRCLOC());
+                    saveEXR(output, mFilmSize, Uint2{ 0, 0 }, mFilmSize,
+                            compositeRegion(paths.compositeBase, mFilmSize,
+                                            mCropOffset, mCropSize, acc),
+                            {}, metadata, mOutputOptions, reporter());
+                } else
+                    saveEXR(output, mFilmSize, mCropOffset, mCropSize, acc,
+                            aovData, metadata, mOutputOptions, reporter());
+                if(mDenoise && aov) {
+                    fs::path denoised = output;
+                    denoised.replace_extension(
+                        ".denoised" + output.extension().string());
+                    saveDenoisedEXR(denoised, mCropSize, acc, aovData,
+                                    mDenoiseOptions, mOutputOptions,
+                                    reporter());
+                } else if(mDenoise)
+                    reporter().apply(ReportLevel::Warning,
+                                     "Denoising is skipped without AOVs",
+                                     BUS_DEFSRCLOC());
+                wait(ldr, "LDR output");
+            }
+            // The render is finished, don't resume from it again.
+            if(endIdx == rangeEnd && fs::exists(checkpointPath))
+                fs::remove(checkpointPath);
+        }
+        BUS_TRACE_END();
+    }
+
+public:
+    void doRender(unsigned realSPP, DriverHelper helper) override {
+        BUS_TRACE_BEG() {
+            unsigned frames = mPhotographer->frameCount();
+            if(frames == 1) {
+                renderFrame(realSPP, helper, 0,
+                            { mOutput, mCheckpoint, mLDROutput,
+                              mCompositeBase });
+                return;
+            }
+            // The pipeline, the SBT and the traversable are shared by the
+            // frames, only the camera record is replaced.
+            unsigned first = std::min(mFrameRange.x, frames);
+            unsigned end = std::min(mFrameRange.y, frames);
+            for(unsigned frame = first; frame < end; ++frame) {
+                reporter().apply(ReportLevel::Info,
+                                 "Frame " + std::to_string(frame) + "/" +
+                                     std::to_string(frames),
+                                 BUS_DEFSRCLOC());
+                helper->updateCallable(mGenerateRay,
+                                       mPhotographer->prepareFrame(mFilmSize,
+                                                                   frame));
+                renderFrame(realSPP, helper, frame, framePaths(frame));
+            }
         }
         BUS_TRACE_END();
     }
 };
 
+std::shared_ptr<Bus::ModuleFunctionBase>
+getAdaptiveSampler(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getTileSampler(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getMerge(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getMergeBench(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getDenoiseBench(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getLaunchSim(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getCheckpointCheck(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getAdaptiveCheck(Bus::ModuleInstance& instance);
+
 class Instance final : public Bus::ModuleInstance {
 public:
     Instance(const fs::path& path, Bus::ModuleSystem& sys)
@@ -228,12 +496,31 @@ public:
     }
     std::vector<Bus::Name> list(Bus::Name api) const override {
         if(api == Driver::getInterface())
-            return { "FixedSampler" };
+            return { "FixedSampler", "AdaptiveSampler", "TileSampler" };
+        if(api == Command::getInterface())
+            return { "Merge", "MergeBench", "DenoiseBench", "LaunchSim",
+                     "CheckpointCheck", "AdaptiveCheck" };
         return {};
     }
     std::shared_ptr<Bus::ModuleFunctionBase> instantiate(Name name) override {
         if(name == "FixedSampler")
             return std::make_shared<FixedSampler>(*this);
+        if(name == "AdaptiveSampler")
+            return getAdaptiveSampler(*this);
+        if(name == "TileSampler")
+            return getTileSampler(*this);
+        if(name == "Merge")
+            return getMerge(*this);
+        if(name == "MergeBench")
+            return getMergeBench(*this);
+        if(name == "DenoiseBench")
+            return getDenoiseBench(*this);
+        if(name == "LaunchSim")
+            return getLaunchSim(*this);
+        if(name == "CheckpointCheck")
+            return getCheckpointCheck(*this);
+        if(name == "AdaptiveCheck")
+            return getAdaptiveCheck(*this);
         return nullptr;
     }
 };
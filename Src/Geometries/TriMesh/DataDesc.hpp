@@ -7,4 +7,16 @@ struct DataDesc final {
     const Vec3* normal;
     const Vec2* texCoord;
     unsigned material;
+    // The radiance of the front faces, zero for the other meshes.
+    Spectrum emission;
+};
+
+// The triangles are picked by area with the alias table.
+struct MeshLightData final {
+    const Vec3* vertex;
+    const Uint3* index;
+    const AliasEntry* table;
+    unsigned triangleNum;
+    float area;
+    Spectrum lum;
 };
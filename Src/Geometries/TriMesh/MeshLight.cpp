@@ -0,0 +1,94 @@
+#include "MeshLight.hpp"
+#include "../../Shared/AliasTable.hpp"
+#include <limits>
+#include <stdexcept>
+
+struct MeshLightBlock final {
+    double area;
+    // the sum of the area-weighted normals
+    Vec3 normal, pMin, pMax;
+    float cosTheta;
+};
+
+MeshLightGeometry buildMeshLight(const std::vector<Vec3>& vertex,
+                                 const std::vector<Uint3>& index,
+                                 ThreadPool* pool) {
+    size_t n = index.size();
+    // The blocks don't depend on the thread count like buildAliasTable.
+    constexpr size_t blockSize = 1 << 16;
+    size_t blocks = (n + blockSize - 1) / blockSize;
+    std::vector<float> areas(n);
+    std::vector<Vec3> normals(n);
+    std::vector<MeshLightBlock> res(blocks);
+    forEachAliasBlock(blocks, pool, [&](size_t b) {
+        MeshLightBlock& block = res[b];
+        block.area = 0.0;
+        block.normal = Vec3{ 0.0f };
+        block.pMin = Vec3{ std::numeric_limits<float>::max() };
+        block.pMax = Vec3{ std::numeric_limits<float>::lowest() };
+        size_t end = std::min(n, (b + 1) * blockSize);
+        for(size_t i = b * blockSize; i < end; ++i) {
+            Uint3 idx = index[i];
+            if(std::max(idx.x, std::max(idx.y, idx.z)) >= vertex.size())
+                throw std::out_of_range("Bad vertex index");
+            Vec3 p0 = vertex[idx.x], p1 = vertex[idx.y], p2 = vertex[idx.z];
+            Vec3 ng = glm::cross(p1 - p0, p2 - p0);
+            float len = glm::length(ng);
+            areas[i] = 0.5f * len;
+            normals[i] = len > 0.0f ? ng / len : Vec3{ 0.0f };
+            block.area += areas[i];
+            block.normal += 0.5f * ng;
+            for(auto&& p : { p0, p1, p2 }) {
+                block.pMin = glm::min(block.pMin, p);
+                block.pMax = glm::max(block.pMax, p);
+            }
+        }
+    });
+
+    MeshLightGeometry geo;
+    geo.area = 0.0;
+    Vec3 normal{ 0.0f };
+    LightBounds& bounds = geo.bounds;
+    bounds.pMin = Vec3{ std::numeric_limits<float>::max() };
+    bounds.pMax = Vec3{ std::numeric_limits<float>::lowest() };
+    for(auto&& block : res) {
+        geo.area += block.area;
+        normal += block.normal;
+        bounds.pMin = glm::min(bounds.pMin, block.pMin);
+        bounds.pMax = glm::max(bounds.pMax, block.pMax);
+    }
+    geo.table = buildAliasTable(areas, pool);
+    bounds.phi = 0.0f;
+    // The one-sided Lambertian emitters fall off to zero at 90 degrees.
+    bounds.cosThetaE = 0.0f;
+
+    // The closed meshes emit in all directions.
+    float len = glm::length(normal);
+    if(len <= 1e-4f * static_cast<float>(geo.area)) {
+        bounds.dir = Vec3{ 0.0f, 0.0f, 1.0f };
+        bounds.cosThetaO = -1.0f;
+        return geo;
+    }
+    bounds.dir = normal / len;
+    forEachAliasBlock(blocks, pool, [&](size_t b) {
+        float cosTheta = 1.0f;
+        size_t end = std::min(n, (b + 1) * blockSize);
+        for(size_t i = b * blockSize; i < end; ++i)
+            if(areas[i] > 0.0f)
+                cosTheta =
+                    std::min(cosTheta, glm::dot(normals[i], bounds.dir));
+        res[b].cosTheta = cosTheta;
+    });
+    bounds.cosThetaO = 1.0f;
+    for(auto&& block : res)
+        bounds.cosThetaO = std::min(bounds.cosThetaO, block.cosTheta);
+    bounds.cosThetaO = std::max(bounds.cosThetaO, -1.0f);
+    return geo;
+}
+
+Vec3 sampleTriangle(const Vec3& p0, const Vec3& p1, const Vec3& p2, float u,
+                    float v) {
+    float su = std::sqrt(u);
+    float b0 = 1.0f - su, b1 = v * su;
+    return p0 * b0 + p1 * b1 + p2 * (1.0f - b0 - b1);
+}
@@ -0,0 +1,48 @@
+#include "../../Shared/KernelShared.hpp"
+#include "DataDesc.hpp"
+
+// The shadow ray stops short of the sampled point, which is on the emitter.
+constexpr float shadowTMax = 0.999f;
+
+DEVICE LightSample __continuation_callable__sample(const Vec3& pos,
+                                                   float rayTime,
+                                                   SamplerContext& sampler) {
+    auto light = getSBTData<MeshLightData>();
+    // sampleAliasTable
+    unsigned num = light->triangleNum;
+    unsigned id = static_cast<unsigned>(num * sampler());
+    id = glm::clamp(id, 0U, num - 1U);
+    const AliasEntry& bucket = light->table[id];
+    if(sampler() >= bucket.prob)
+        id = bucket.alias;
+    Uint3 idx = light->index[id];
+    Vec3 p0 = light->vertex[idx.x], p1 = light->vertex[idx.y],
+         p2 = light->vertex[idx.z];
+    // sampleTriangle
+    float su = sqrtf(sampler()), v = sampler();
+    float b0 = 1.0f - su, b1 = v * su;
+    Vec3 p = p0 * b0 + p1 * b1 + p2 * (1.0f - b0 - b1);
+
+    Vec3 diff = p - pos;
+    float sqrDis = glm::dot(diff, diff);
+    Vec3 ng = glm::cross(p1 - p0, p2 - p0);
+    float dis = sqrtf(sqrDis);
+    // The pdf is 1/area by area and d^2/(area*cos) by solid angle.
+    float cosLight = -glm::dot(ng, diff) / (glm::length(ng) * dis);
+    LightSample res;
+    res.wi = diff / dis;
+    res.rad = Spectrum{ 0.0f };
+    if(!(cosLight > 0.0f))
+        return res;
+    unsigned noHit = 0;
+    optixTrace(
+        launchParam.root, v2f(pos), v2f(diff), eps, shadowTMax, rayTime, 255,
+        OPTIX_RAY_FLAG_DISABLE_ANYHIT | OPTIX_RAY_FLAG_TERMINATE_ON_FIRST_HIT |
+            OPTIX_RAY_FLAG_DISABLE_CLOSESTHIT,
+        occlusionOffset, traceSBTStride, occlusionMiss, noHit);
+    if(noHit)
+        res.rad = light->lum * (cosLight * light->area / sqrDis);
+    return res;
+}
+
+void check(LightSampleFunction = __continuation_callable__sample);
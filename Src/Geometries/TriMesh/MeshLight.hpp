@@ -0,0 +1,26 @@
+#pragma once
+#include "../../Shared/Shared.hpp"
+#include <vector>
+
+// The host side of the emissive meshes. MeshLight.cu mirrors sampleTriangle.
+
+class ThreadPool;
+
+struct MeshLightGeometry final {
+    // The triangles are picked in proportion to their areas.
+    std::vector<AliasEntry> table;
+    double area;
+    // The vertex box and the normal cone of the mesh, phi is left to the
+    // caller.
+    LightBounds bounds;
+};
+
+// The areas, the table and the bounds are reduced over the blocks of the
+// triangles in parallel, in serial if pool is nullptr. The result doesn't
+// depend on the thread count.
+MeshLightGeometry buildMeshLight(const std::vector<Vec3>& vertex,
+                                 const std::vector<Uint3>& index,
+                                 ThreadPool* pool);
+// The point of the triangle uniform by area, u and v are uniform in [0,1).
+Vec3 sampleTriangle(const Vec3& p0, const Vec3& p1, const Vec3& p2, float u,
+                    float v);
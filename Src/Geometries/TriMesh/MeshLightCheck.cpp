@@ -0,0 +1,191 @@
+#include "../../Shared/AliasTable.hpp"
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplingCheck.hpp"
+#include "MeshLight.hpp"
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <cmath>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinGeometry.TriMesh.MeshLightCheck");
+
+// The irradiance of a Lambertian rectangle with the radiance 1 at the
+// distance h below its corner, the rectangle is parallel to the receiver.
+static double cornerIrradiance(double a, double b, double h) {
+    double x = a / h, y = b / h;
+    double sx = std::sqrt(1.0 + x * x), sy = std::sqrt(1.0 + y * y);
+    return 0.5 * (x / sx * std::atan(y / sx) + y / sy * std::atan(x / sy));
+}
+
+// Check the emissive meshes on a square light facing down, split into the
+// triangles of random sizes with a few degenerate ones: the serial and the
+// parallel builds agree, the area and the bounds are exact, the triangles
+// are picked by area and the points are uniform over the square. The
+// irradiance below the center matches the analytic value and the variance
+// is compared with the cosine-weighted BSDF sampling.
+static int check(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("MeshLightCheck", "TriMesh::MeshLightCheck");
+        opt.add_options()("g,grid", "grid size of the square",
+                          cxxopts::value<unsigned>()->default_value("300"))(
+            "n,samples", "sample count",
+            cxxopts::value<unsigned>()->default_value("4000000"))(
+            "s,seed", "random seed",
+            cxxopts::value<unsigned>()->default_value("0"));
+        auto res = opt.parse(argc, argv);
+        unsigned grid = res["grid"].as<unsigned>();
+        unsigned samples = res["samples"].as<unsigned>();
+        if(grid == 0)
+            BUS_TRACE_THROW(std::invalid_argument("Need grid>0"));
+
+        CheckLog log(reporter, BUS_DEFSRCLOC());
+
+        // The square [-1,1]^2 at the height h, the cells have random sizes.
+        constexpr float h = 4.0f;
+        std::mt19937 eng(res["seed"].as<unsigned>());
+        std::uniform_real_distribution<float> dis;
+        auto cuts = [&] {
+            std::vector<float> res(grid + 1);
+            for(unsigned i = 1; i < grid; ++i)
+                res[i] = dis(eng);
+            res.back() = 1.0f;
+            std::sort(res.begin(), res.end());
+            for(auto& x : res)
+                x = 2.0f * x - 1.0f;
+            return res;
+        };
+        std::vector<float> xs = cuts(), ys = cuts();
+        std::vector<Vec3> vertex;
+        for(float y : ys)
+            for(float x : xs)
+                vertex.push_back(Vec3{ x, y, h });
+        std::vector<Uint3> index;
+        for(unsigned i = 0; i < grid; ++i)
+            for(unsigned j = 0; j < grid; ++j) {
+                unsigned p0 = i * (grid + 1) + j, p1 = p0 + 1,
+                         p2 = p0 + grid + 1, p3 = p2 + 1;
+                // clockwise seen from below, the normals point down
+                index.push_back(Uint3{ p0, p2, p1 });
+                index.push_back(Uint3{ p1, p2, p3 });
+                if(dis(eng) < 0.01f)
+                    index.push_back(Uint3{ p0, p0, p3 });
+            }
+
+        ThreadPool pool;
+        auto builds = buildSerialParallel(pool, [&](ThreadPool* p) {
+            return buildMeshLight(vertex, index, p);
+        });
+        const MeshLightGeometry& serial = builds.serial;
+        const MeshLightGeometry& geo = builds.parallel;
+
+        const LightBounds &a = serial.bounds, &b = geo.bounds;
+        bool same = serial.area == geo.area && a.pMin == b.pMin &&
+            a.pMax == b.pMax && a.dir == b.dir &&
+            a.cosThetaO == b.cosThetaO && a.cosThetaE == b.cosThetaE;
+        for(size_t i = 0; i < index.size() && same; ++i)
+            same = serial.table[i].prob == geo.table[i].prob &&
+                serial.table[i].alias == geo.table[i].alias;
+        if(!same)
+            log.fail("The serial and the parallel builds differ");
+        if(std::fabs(geo.area / 4.0 - 1.0) > 1e-5)
+            log.fail("Bad area " + std::to_string(geo.area));
+        if(b.pMin != Vec3{ -1.0f, -1.0f, h } || b.pMax != Vec3{ 1.0f, 1.0f, h })
+            log.fail("Bad box");
+        if(b.dir != Vec3{ 0.0f, 0.0f, -1.0f } || b.cosThetaO < 0.9999f)
+            log.fail("Bad normal cone");
+
+        // A closed tetrahedron emits in all directions.
+        MeshLightGeometry tet = buildMeshLight(
+            { Vec3{ 0.0f }, Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f },
+              Vec3{ 0.0f, 0.0f, 1.0f } },
+            { Uint3{ 0, 2, 1 }, Uint3{ 0, 1, 3 }, Uint3{ 0, 3, 2 },
+              Uint3{ 1, 2, 3 } },
+            &pool);
+        if(tet.bounds.cosThetaO != -1.0f)
+            log.fail("The closed mesh has a bad normal cone");
+
+        // The count of a triangle or a cell is about N(n*p,n*p).
+        constexpr unsigned cells = 16;
+        std::vector<unsigned> triCount(index.size()), cellCount(cells * cells);
+        // the irradiance at the origin with the normal +z, Le=1
+        double sum = 0.0, sqrSum = 0.0;
+        unsigned outside = 0;
+        for(unsigned i = 0; i < samples; ++i) {
+            unsigned id = sampleAliasTable(geo.table, dis(eng), dis(eng));
+            ++triCount[id];
+            Uint3 idx = index[id];
+            Vec3 p = sampleTriangle(vertex[idx.x], vertex[idx.y],
+                                    vertex[idx.z], dis(eng), dis(eng));
+            int cx = static_cast<int>((p.x + 1.0f) * 0.5f * cells);
+            int cy = static_cast<int>((p.y + 1.0f) * 0.5f * cells);
+            if(cx < 0 || cy < 0 || cx > static_cast<int>(cells) ||
+               cy > static_cast<int>(cells) || p.z != h) {
+                ++outside;
+                continue;
+            }
+            ++cellCount[std::min(cy, static_cast<int>(cells) - 1) * cells +
+                        std::min(cx, static_cast<int>(cells) - 1)];
+            // cos at the receiver = cos at the light = h/d
+            double sqrDis = glm::dot(p, p);
+            double f = h * h / (sqrDis * sqrDis) * geo.area;
+            sum += f;
+            sqrSum += f * f;
+        }
+        if(outside)
+            log.fail(std::to_string(outside) +
+                     " points are outside the square");
+        std::vector<double> triExpected(index.size());
+        for(size_t i = 0; i < index.size(); ++i) {
+            Uint3 idx = index[i];
+            triExpected[i] = samples * 0.5 *
+                glm::length(glm::cross(vertex[idx.y] - vertex[idx.x],
+                                       vertex[idx.z] - vertex[idx.x])) /
+                geo.area;
+            if(triExpected[i] == 0.0 && triCount[i])
+                log.fail("Degenerate triangle " + std::to_string(i) +
+                         " is picked");
+        }
+        double cellExpected = static_cast<double>(samples) / (cells * cells);
+        double worst = std::max(
+            maxDeviation(triCount, [&](size_t i) { return triExpected[i]; }),
+            maxDeviation(cellCount, [&](size_t) { return cellExpected; }));
+        checkDeviation(log, worst, "area");
+
+        double exact = 4.0 * cornerIrradiance(1.0, 1.0, h);
+        double mean = sum / samples;
+        double var = std::max(sqrSum / samples - mean * mean, 0.0);
+        double sigma = std::sqrt(var / samples);
+        if(std::fabs(mean - exact) > 6.0 * sigma + 1e-6 * exact)
+            log.fail("The irradiance is " + std::to_string(mean) +
+                     " instead of " + std::to_string(exact));
+        // The BSDF sampling hits the light with the probability p=E/pi and
+        // the estimator pi*hit has the relative variance (1-p)/p.
+        double p = exact / glm::pi<double>();
+        double bsdfVar = (1.0 - p) / p;
+
+        std::stringstream ss;
+        ss << index.size() << " triangles, " << builds.summary()
+           << ", irradiance " << mean << "(exact " << exact
+           << "), relative variance " << var / (mean * mean) << "(area) "
+           << bsdfVar << "(BSDF), max deviation " << worst;
+        return log.finish(ss.str());
+    }
+    BUS_TRACE_END();
+}
+
+class MeshLightCheck final : public Command {
+public:
+    explicit MeshLightCheck(Bus::ModuleInstance& instance)
+        : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return check(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getMeshLightCheck(Bus::ModuleInstance& instance) {
+    return std::make_shared<MeshLightCheck>(instance);
+}
@@ -31,6 +31,9 @@ DEVICE void __closesthit__RCH() {
     Vec3 hit = ori + optixGetRayTmax() * dir;
     builtinMaterialSample(data->material, payload, dir, hit, ng, ns, texCoord,
                           optixGetRayTime(), front);
+    // The emitters are sampled by the lights after the other bounces.
+    if(front && payload->emission)
+        payload->rad += data->emission;
 }
 
 // TODO:cut-out
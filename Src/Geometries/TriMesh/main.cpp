@@ -1,8 +1,11 @@
 #include "../../Shared/CommandAPI.hpp"
 #include "../../Shared/GeometryAPI.hpp"
+#include "../../Shared/LightAPI.hpp"
 #include "../../Shared/MaterialAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
 #include "DataDesc.hpp"
 #include "MeshAPI.hpp"
+#include "MeshLight.hpp"
 #pragma warning(push, 0)
 #define NOMINMAX
 #include <optix_function_table_definition.h>
@@ -13,6 +16,8 @@ std::shared_ptr<Bus::ModuleFunctionBase>
 getRawMeshLoader(Bus::ModuleInstance& instance);
 std::shared_ptr<Bus::ModuleFunctionBase>
 getMesh2Raw(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getMeshLightCheck(Bus::ModuleInstance& instance);
 
 BUS_MODULE_NAME("Piper.BuiltinGeometry.TriMesh");
 
@@ -20,6 +25,7 @@ struct TriMeshAccelData final {
     OptixTraversableHandle handle;
     OptixProgramGroup radGroup, occGroup;
     DataDesc accelData;
+    MeshData mesh;
     OptixAabb aabb;
     unsigned cssRad, cssOcc;
 };
@@ -40,6 +46,7 @@ public:
         BUS_TRACE_BEG() {
             mMesh = helper->instantiateAsset<Mesh>(config->attribute("Mesh"));
             MeshData meshData = mMesh->getData();
+            mData.mesh = meshData;
             DataDesc& data = mData.accelData;
             data.vertex = static_cast<Vec3*>(meshData.vertex);
             data.index = static_cast<Uint3*>(meshData.index);
@@ -146,10 +153,128 @@ public:
     }
 };
 
+static float luminance(const Spectrum& lum) {
+    return glm::dot(lum, Spectrum{ 0.2126f, 0.7152f, 0.0722f });
+}
+
+// The area light of an instance of an emissive TriMesh. The points are
+// sampled uniformly by area, so the radiance is scaled by cos*area/d^2. Only
+// the front faces emit like the hit group. The mesh is copied into the world
+// space unless the transform is the identity.
+class MeshLight final : public Light {
+private:
+    MeshData mMesh;
+    Mat4 mTransform;
+    Buffer mVertex, mIndex, mTable;
+    ProgramGroup mProgramGroup;
+    LightData mData;
+    float mPower;
+    LightBounds mBounds;
+
+public:
+    MeshLight(Bus::ModuleInstance& instance, const MeshData& mesh,
+              const Mat4& transform)
+        : Light(instance), mMesh(mesh), mTransform(transform) {}
+    void init(PluginHelper helper, std::shared_ptr<Config> cfg) override {
+        BUS_TRACE_BEG() {
+            std::vector<Vec3> vertex(mMesh.vertexSize);
+            std::vector<Uint3> index(mMesh.indexSize);
+            checkCudaError(
+                cuMemcpyDtoH(vertex.data(),
+                             reinterpret_cast<CUdeviceptr>(mMesh.vertex),
+                             sizeof(Vec3) * vertex.size()));
+            checkCudaError(
+                cuMemcpyDtoH(index.data(),
+                             reinterpret_cast<CUdeviceptr>(mMesh.index),
+                             sizeof(Uint3) * index.size()));
+            MeshLightData data;
+            data.vertex = static_cast<const Vec3*>(mMesh.vertex);
+            data.index = static_cast<const Uint3*>(mMesh.index);
+            if(mTransform != glm::identity<Mat4>()) {
+                // The areas, the bounds and the normals follow the vertices.
+                for(auto& p : vertex)
+                    p = Vec3{ Vec4{ p, 1.0f } * mTransform };
+                mVertex = uploadData(0, vertex.data(), vertex.size());
+                data.vertex = static_cast<const Vec3*>(mVertex.get());
+                // The mirrors flip the winding, swap it back so that the
+                // front faces still emit.
+                if(glm::determinant(Mat3{ mTransform }) < 0.0f) {
+                    for(auto& idx : index)
+                        std::swap(idx.y, idx.z);
+                    mIndex = uploadData(0, index.data(), index.size());
+                    data.index = static_cast<const Uint3*>(mIndex.get());
+                }
+            }
+            MeshLightGeometry geo;
+            {
+                ThreadPool pool;
+                geo = buildMeshLight(vertex, index, &pool);
+            }
+            if(!(geo.area > 0.0))
+                BUS_TRACE_THROW(
+                    std::runtime_error("The emissive mesh has no area"));
+            reporter().apply(ReportLevel::Debug,
+                             std::to_string(index.size()) +
+                                 " emissive triangles, area=" +
+                                 std::to_string(geo.area),
+                             BUS_DEFSRCLOC());
+
+            mTable = uploadData(0, geo.table.data(), geo.table.size());
+            data.table = static_cast<const AliasEntry*>(mTable.get());
+            data.triangleNum = static_cast<unsigned>(geo.table.size());
+            data.area = static_cast<float>(geo.area);
+            data.lum = cfg->getVec3("Emission", Spectrum{ 0.0f });
+            // The Lambertian emitter radiates pi*L*A, its intensity is at
+            // most L*A along the normals.
+            float lum = luminance(data.lum);
+            mPower = glm::pi<float>() * lum * data.area;
+            mBounds = geo.bounds;
+            mBounds.phi = 4.0f * glm::pi<float>() * lum * data.area;
+
+            const ModuleDesc& mod =
+                helper->getModuleManager()->getModuleFromFile(
+                    modulePath().parent_path() / "MeshLight.ptx");
+            OptixProgramGroupDesc desc = {};
+            desc.kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+            desc.callables.moduleCC = mod.handle.get();
+            desc.callables.entryFunctionNameCC =
+                mod.map("__continuation_callable__sample");
+            OptixProgramGroupOptions opt = {};
+            OptixProgramGroup group;
+            checkOptixError(optixProgramGroupCreate(helper->getContext(), &desc,
+                                                    1, &opt, nullptr, nullptr,
+                                                    &group));
+            mProgramGroup.reset(group);
+            mData.sbtData = packSBTRecord(mProgramGroup.get(), data);
+            // the triangle and the point
+            mData.maxSampleDim = 4;
+            mData.group = group;
+            OptixStackSizes size;
+            checkOptixError(optixProgramGroupGetStackSize(group, &size));
+            mData.css = size.cssCC;
+            mData.dss = 0;
+        }
+        BUS_TRACE_END();
+    }
+    LightData getData() override {
+        return mData;
+    }
+    float power() const override {
+        return mPower;
+    }
+    bool bounds(LightBounds& res) const override {
+        res = mBounds;
+        return true;
+    }
+};
+
 class TriMesh final : public Geometry {
 private:
     std::shared_ptr<TriMeshAccel> mAccel;
     std::shared_ptr<Material> mMat;
+    std::shared_ptr<Config> mConfig;
+    MeshData mMesh;
+    bool mEmissive;
     GeometryData mData;
     Buffer mAccelBuffer, mInstance;
 
@@ -166,6 +291,10 @@ public:
             MaterialData matData = mMat->getData();
             data.material = helper->addCallable(matData.group, matData.radData);
             mData.maxSampleDim = matData.maxSampleDim;
+            data.emission = config->getVec3("Emission", Spectrum{ 0.0f });
+            mEmissive = glm::dot(data.emission, data.emission) > 0.0f;
+            mConfig = config;
+            mMesh = accelData.mesh;
 
             unsigned sbtID = helper->addHitGroup(
                 accelData.radGroup, packSBTRecord(accelData.radGroup, data),
@@ -223,6 +352,19 @@ public:
     GeometryData getData() override {
         return mData;
     }
+    void addLights(PluginHelper helper) override {
+        BUS_TRACE_BEG() {
+            if(!mEmissive)
+                return;
+            // mInstance of TriMesh is the instance buffer.
+            auto light = std::make_shared<MeshLight>(
+                Bus::ModuleFunctionBase::mInstance, mMesh,
+                helper->getTransform());
+            light->init(helper, mConfig);
+            helper->addLight(light);
+        }
+        BUS_TRACE_END();
+    }
 };
 
 class Instance final : public Bus::ModuleInstance {
@@ -248,7 +390,7 @@ public:
         if(api == Geometry::getInterface())
             return { "TriMesh" };
         if(api == Command::getInterface())
-            return { "MeshConverter" };
+            return { "MeshConverter", "MeshLightCheck" };
         if(api == TriMeshAccel::getInterface())
             return { "TriMeshAccel" };
         return {};
@@ -262,6 +404,8 @@ public:
             return std::make_shared<TriMesh>(*this);
         if(name == "MeshConverter")
             return getMesh2Raw(*this);
+        if(name == "MeshLightCheck")
+            return getMeshLightCheck(*this);
         return nullptr;
     }
 };
@@ -2,18 +2,26 @@
 #include "DataDesc.hpp"
 
 DEVICE Spectrum __continuation_callable__traceKernel(RaySample ray,
-                                                     SamplerContext* sampler) {
+                                                     SamplerContext* sampler,
+                                                     AOVSample* aov) {
     Spectrum res{ 0.0f };
     auto data = getSBTData<DataDesc>();
     Payload payload;
     payload.sampler = sampler;
+    payload.aov = aov;
     uint32_t p0, p1;
     packPointer(&payload, p0, p1);
     Spectrum att{ 1.0f };
+    // There is no MIS, so the emitters hit after the other bounces are left
+    // to the light sampling of the materials.
+    payload.specular = true;
     for(unsigned i = 0; i < data->maxDepth; ++i) {
         payload.hit = false;
         payload.f = Spectrum{ 0.0f };
         payload.rad = Spectrum{ 0.0f };
+        payload.lightId = invalidLightId;
+        payload.emission = payload.specular;
+        payload.specular = false;
         // Russian roulette
         if(i > 3) {
             float q = fmax(0.05f,
@@ -29,8 +37,15 @@ DEVICE Spectrum __continuation_callable__traceKernel(RaySample ray,
                    0.0f, 255, OPTIX_RAY_FLAG_NONE, radianceOffset,
                    traceSBTStride, radianceMiss, p0, p1);
         res += att * payload.rad;
+        if(aov) {
+            if(payload.lightId < maxLightAOV)
+                aov->light[payload.lightId] += att * payload.rad;
+            if(i == 0 && payload.hit)
+                aov->depth = glm::length(payload.ori - ray.ori);
+        }
         if(!payload.hit)
             break;
+        payload.aov = nullptr;
         att *= payload.f;
         ray.ori = payload.ori;
         ray.dir = payload.wi;
@@ -0,0 +1,18 @@
+#pragma once
+#include "../../Shared/Shared.hpp"
+
+// The nodes are in the depth-first order. The first child of an interior
+// node follows it and child is the second one. child of a leaf is the light
+// id.
+struct LightBVHNode final {
+    LightBounds bounds;
+    unsigned child, leaf;
+};
+
+// The infinite lights are picked uniformly, the BVH takes the share of one
+// infinite light.
+struct DataDesc final {
+    const LightBVHNode* nodes;
+    const unsigned* infinite;
+    unsigned nodeNum, infiniteNum;
+};
@@ -0,0 +1,94 @@
+#include "../../Shared/KernelShared.hpp"
+#include "DataDesc.hpp"
+
+// boundsImportance
+INLINEDEVICE float importance(const LightBounds& bounds, const Vec3& pos) {
+    Vec3 pc = 0.5f * (bounds.pMin + bounds.pMax);
+    Vec3 diff = pos - pc;
+    float sqrDis = dot(diff, diff);
+    Vec3 diag = bounds.pMax - bounds.pMin;
+    float sqrRadius = 0.25f * dot(diag, diag);
+    float sqrDisClamped = fmaxf(fmaxf(sqrDis, 0.5f * length(diag)), 1e-12f);
+    if(sqrDis <= sqrRadius)
+        return bounds.phi / sqrDisClamped;
+    float sinThetaB2 = sqrRadius / sqrDis;
+    float cosThetaB = sqrtf(fmaxf(1.0f - sinThetaB2, 0.0f));
+    float sinThetaB = sqrtf(sinThetaB2);
+    Vec3 wi = diff / sqrtf(sqrDis);
+    float cosThetaW = dot(bounds.dir, wi);
+    float sinThetaW = sqrtf(fmaxf(1.0f - cosThetaW * cosThetaW, 0.0f));
+    float sinThetaO =
+        sqrtf(fmaxf(1.0f - bounds.cosThetaO * bounds.cosThetaO, 0.0f));
+    float cosThetaX = 1.0f, sinThetaX = 0.0f;
+    if(cosThetaW <= bounds.cosThetaO) {
+        cosThetaX = cosThetaW * bounds.cosThetaO + sinThetaW * sinThetaO;
+        sinThetaX = sinThetaW * bounds.cosThetaO - cosThetaW * sinThetaO;
+    }
+    float cosThetaP = cosThetaX > cosThetaB ?
+        1.0f :
+        cosThetaX * cosThetaB + sinThetaX * sinThetaB;
+    if(cosThetaP <= bounds.cosThetaE)
+        return 0.0f;
+    return bounds.phi * cosThetaP / sqrDisClamped;
+}
+
+// sampleLightBVH
+INLINEDEVICE unsigned sampleBVH(const LightBVHNode* nodes, const Vec3& pos,
+                                float u, float& pmf) {
+    unsigned cur = 0;
+    while(!nodes[cur].leaf) {
+        float lhs = importance(nodes[cur + 1].bounds, pos);
+        float rhs = importance(nodes[nodes[cur].child].bounds, pos);
+        if(lhs <= 0.0f && rhs <= 0.0f)
+            return invalidLightId;
+        float p = lhs / (lhs + rhs);
+        if(u < p) {
+            cur = cur + 1;
+            u = fminf(u / p, oneMinusEps);
+            pmf *= p;
+        } else {
+            cur = nodes[cur].child;
+            u = fminf((u - p) / (1.0f - p), oneMinusEps);
+            pmf *= 1.0f - p;
+        }
+    }
+    if(cur == 0 && importance(nodes[0].bounds, pos) <= 0.0f)
+        return invalidLightId;
+    return nodes[cur].child;
+}
+
+DEVICE LightSample __continuation_callable__sample(const Vec3& pos,
+                                                   float rayTime,
+                                                   SamplerContext& sampler) {
+    auto data = getSBTData<DataDesc>();
+    LightSample res;
+    res.rad = Spectrum{ 0.0f };
+    res.lightId = invalidLightId;
+    unsigned bvh = data->nodeNum ? 1U : 0U;
+    if(data->infiniteNum + bvh == 0)
+        return res;
+    float u = sampler();
+    float pmf = 1.0f;
+    unsigned id = invalidLightId;
+    float pInfinite = static_cast<float>(data->infiniteNum) /
+        static_cast<float>(data->infiniteNum + bvh);
+    if(u < pInfinite) {
+        u /= pInfinite;
+        unsigned idx = static_cast<unsigned>(u * data->infiniteNum);
+        id = data->infinite[glm::min(idx, data->infiniteNum - 1U)];
+        pmf = 1.0f / static_cast<float>(data->infiniteNum + bvh);
+    } else {
+        u = fminf((u - pInfinite) / (1.0f - pInfinite), oneMinusEps);
+        pmf = 1.0f - pInfinite;
+        id = sampleBVH(data->nodes, pos, u, pmf);
+    }
+    if(id == invalidLightId || pmf <= 0.0f)
+        return res;
+    res = sampleOneLightImpl(launchParam.lightSbtOffset + id, pos, rayTime,
+                             sampler);
+    res.rad /= pmf;
+    res.lightId = id;
+    return res;
+}
+
+void check(LightSampleFunction = __continuation_callable__sample);
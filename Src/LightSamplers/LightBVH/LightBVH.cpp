@@ -0,0 +1,304 @@
+#include "LightBVH.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+constexpr float pi = 3.14159265358979f;
+constexpr unsigned bucketNum = 12;
+
+static float safeSqrt(float x) {
+    return std::sqrt(std::max(x, 0.0f));
+}
+
+static float safeAcos(float x) {
+    return std::acos(std::min(std::max(x, -1.0f), 1.0f));
+}
+
+LightBounds unionBounds(const LightBounds& lhs, const LightBounds& rhs) {
+    if(lhs.phi <= 0.0f)
+        return rhs;
+    if(rhs.phi <= 0.0f)
+        return lhs;
+    LightBounds res;
+    res.pMin = glm::min(lhs.pMin, rhs.pMin);
+    res.pMax = glm::max(lhs.pMax, rhs.pMax);
+    res.phi = lhs.phi + rhs.phi;
+    res.cosThetaE = std::min(lhs.cosThetaE, rhs.cosThetaE);
+    res.dir = lhs.dir;
+    res.cosThetaO = lhs.cosThetaO;
+
+    float thetaA = safeAcos(lhs.cosThetaO), thetaB = safeAcos(rhs.cosThetaO);
+    float thetaD = safeAcos(glm::dot(lhs.dir, rhs.dir));
+    // One cone contains the other.
+    if(std::min(thetaD + thetaB, pi) <= thetaA)
+        return res;
+    if(std::min(thetaD + thetaA, pi) <= thetaB) {
+        res.dir = rhs.dir;
+        res.cosThetaO = rhs.cosThetaO;
+        return res;
+    }
+    float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+    Vec3 axis = glm::cross(lhs.dir, rhs.dir);
+    float len = glm::length(axis);
+    if(thetaO >= pi || len < 1e-6f) {
+        res.cosThetaO = -1.0f;
+        return res;
+    }
+    // Rotate lhs.dir towards rhs.dir by thetaO-thetaA.
+    axis /= len;
+    float thetaR = thetaO - thetaA;
+    res.dir = glm::normalize(lhs.dir * std::cos(thetaR) +
+                             glm::cross(axis, lhs.dir) * std::sin(thetaR));
+    res.cosThetaO = std::cos(thetaO);
+    return res;
+}
+
+// The surface area orientation heuristic of Conty Estevez and Kulla. Kr
+// penalizes the thin boxes split along the short axes.
+static float splitCost(const LightBounds& bounds, float kr) {
+    float thetaO = safeAcos(bounds.cosThetaO);
+    float thetaE = safeAcos(bounds.cosThetaE);
+    float thetaW = std::min(thetaO + thetaE, pi);
+    float sinThetaO = safeSqrt(1.0f - bounds.cosThetaO * bounds.cosThetaO);
+    float orientation = 2.0f * pi * (1.0f - bounds.cosThetaO) +
+        0.5f * pi *
+            (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) -
+             2.0f * thetaO * sinThetaO + bounds.cosThetaO);
+    Vec3 d = bounds.pMax - bounds.pMin;
+    float area = 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    return bounds.phi * orientation * area * kr;
+}
+
+static Vec3 centroid(const LightBounds& bounds) {
+    return 0.5f * (bounds.pMin + bounds.pMax);
+}
+
+struct BuildTask final {
+    unsigned beg, end, node;
+};
+
+// Split order[beg,end) by the buckets of the centroids and return the
+// middle.
+static unsigned splitLights(const std::vector<BoundedLight>& lights,
+                            std::vector<unsigned>& order, unsigned beg,
+                            unsigned end) {
+    Vec3 pMin = lights[order[beg]].bounds.pMin;
+    Vec3 pMax = lights[order[beg]].bounds.pMax;
+    Vec3 cMin = centroid(lights[order[beg]].bounds), cMax = cMin;
+    for(unsigned i = beg + 1; i < end; ++i) {
+        const LightBounds& bounds = lights[order[i]].bounds;
+        pMin = glm::min(pMin, bounds.pMin);
+        pMax = glm::max(pMax, bounds.pMax);
+        Vec3 c = centroid(bounds);
+        cMin = glm::min(cMin, c);
+        cMax = glm::max(cMax, c);
+    }
+    Vec3 diag = pMax - pMin;
+    float maxExtent = std::max(diag.x, std::max(diag.y, diag.z));
+
+    auto bucketOf = [&](unsigned id, int dim) {
+        float c = centroid(lights[id].bounds)[dim];
+        unsigned b = static_cast<unsigned>(bucketNum * (c - cMin[dim]) /
+                                           (cMax[dim] - cMin[dim]));
+        return std::min(b, bucketNum - 1);
+    };
+    float minCost = std::numeric_limits<float>::max();
+    int bestDim = -1;
+    unsigned bestBucket = 0;
+    for(int dim = 0; dim < 3; ++dim) {
+        if(cMax[dim] <= cMin[dim])
+            continue;
+        LightBounds buckets[bucketNum] = {};
+        unsigned count[bucketNum] = {};
+        for(unsigned i = beg; i < end; ++i) {
+            unsigned b = bucketOf(order[i], dim);
+            buckets[b] = unionBounds(buckets[b], lights[order[i]].bounds);
+            ++count[b];
+        }
+        float kr = maxExtent / diag[dim];
+        // suffix[b] is the union of the buckets [b,bucketNum).
+        LightBounds suffix[bucketNum];
+        suffix[bucketNum - 1] = buckets[bucketNum - 1];
+        for(unsigned b = bucketNum - 1; b > 0; --b)
+            suffix[b - 1] = unionBounds(buckets[b - 1], suffix[b]);
+        LightBounds below = {};
+        unsigned belowCount = 0;
+        for(unsigned b = 0; b + 1 < bucketNum; ++b) {
+            below = unionBounds(below, buckets[b]);
+            belowCount += count[b];
+            if(belowCount == 0 || belowCount == end - beg)
+                continue;
+            float cost =
+                splitCost(below, kr) + splitCost(suffix[b + 1], kr);
+            if(cost < minCost) {
+                minCost = cost;
+                bestDim = dim;
+                bestBucket = b;
+            }
+        }
+    }
+    if(bestDim == -1)
+        return beg + (end - beg) / 2;
+    auto mid = std::partition(
+        order.begin() + beg, order.begin() + end,
+        [&](unsigned id) { return bucketOf(id, bestDim) <= bestBucket; });
+    return static_cast<unsigned>(mid - order.begin());
+}
+
+// The subtree of n lights takes the 2n-1 nodes from task.node, so the
+// subtrees can be built independently. The subtrees of at most deferSize
+// lights are appended to deferred if it isn't nullptr.
+static void buildSubtree(const std::vector<BoundedLight>& lights,
+                         std::vector<unsigned>& order,
+                         std::vector<LightBVHNode>& nodes, BuildTask task,
+                         std::vector<BuildTask>* deferred,
+                         unsigned deferSize) {
+    LightBVHNode& node = nodes[task.node];
+    if(task.end - task.beg == 1) {
+        node.bounds = lights[order[task.beg]].bounds;
+        node.child = lights[order[task.beg]].id;
+        node.leaf = 1;
+        return;
+    }
+    unsigned mid = splitLights(lights, order, task.beg, task.end);
+    node.child = task.node + 2 * (mid - task.beg);
+    node.leaf = 0;
+    BuildTask children[2] = { { task.beg, mid, task.node + 1 },
+                              { mid, task.end, node.child } };
+    for(auto&& child : children)
+        if(deferred && child.end - child.beg <= deferSize)
+            deferred->push_back(child);
+        else
+            buildSubtree(lights, order, nodes, child, deferred, deferSize);
+}
+
+std::vector<LightBVHNode> buildLightBVH(const std::vector<BoundedLight>& lights,
+                                        ThreadPool* pool) {
+    std::vector<BoundedLight> emitters;
+    for(auto&& light : lights)
+        if(light.bounds.phi > 0.0f)
+            emitters.push_back(light);
+    unsigned n = static_cast<unsigned>(emitters.size());
+    if(n == 0)
+        return {};
+    std::vector<unsigned> order(n);
+    for(unsigned i = 0; i < n; ++i)
+        order[i] = i;
+    std::vector<LightBVHNode> nodes(2 * n - 1);
+    BuildTask root{ 0, n, 0 };
+    if(pool) {
+        std::vector<BuildTask> deferred;
+        unsigned deferSize = std::max(n / (4 * pool->size()), 1U);
+        if(n <= deferSize)
+            deferred.push_back(root);
+        else
+            buildSubtree(emitters, order, nodes, root, &deferred, deferSize);
+        parallelFor(*pool, deferred.size(), [&](size_t i) {
+            buildSubtree(emitters, order, nodes, deferred[i], nullptr, 0);
+        });
+    } else
+        buildSubtree(emitters, order, nodes, root, nullptr, 0);
+
+    // The children follow their parents.
+    for(size_t i = nodes.size(); i-- > 0;)
+        if(!nodes[i].leaf)
+            nodes[i].bounds =
+                unionBounds(nodes[i + 1].bounds, nodes[nodes[i].child].bounds);
+    return nodes;
+}
+
+float boundsImportance(const LightBounds& bounds, const Vec3& pos) {
+    Vec3 pc = centroid(bounds);
+    Vec3 diff = pos - pc;
+    float sqrDis = glm::dot(diff, diff);
+    Vec3 diag = bounds.pMax - bounds.pMin;
+    float sqrRadius = 0.25f * glm::dot(diag, diag);
+    // Keep the importance finite near the lights.
+    float sqrDisClamped =
+        std::max(std::max(sqrDis, 0.5f * glm::length(diag)), 1e-12f);
+    // pos is inside the bounding sphere.
+    if(sqrDis <= sqrRadius)
+        return bounds.phi / sqrDisClamped;
+    // The directions from the box to pos are within thetaB of wi.
+    float sinThetaB2 = sqrRadius / sqrDis;
+    float cosThetaB = safeSqrt(1.0f - sinThetaB2);
+    float sinThetaB = std::sqrt(sinThetaB2);
+    Vec3 wi = diff / std::sqrt(sqrDis);
+    float cosThetaW = glm::dot(bounds.dir, wi);
+    float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+    float sinThetaO = safeSqrt(1.0f - bounds.cosThetaO * bounds.cosThetaO);
+    // thetaX=max(0,thetaW-thetaO), thetaP=max(0,thetaX-thetaB)
+    float cosThetaX = 1.0f, sinThetaX = 0.0f;
+    if(cosThetaW <= bounds.cosThetaO) {
+        cosThetaX = cosThetaW * bounds.cosThetaO + sinThetaW * sinThetaO;
+        sinThetaX = sinThetaW * bounds.cosThetaO - cosThetaW * sinThetaO;
+    }
+    float cosThetaP = cosThetaX > cosThetaB ?
+        1.0f :
+        cosThetaX * cosThetaB + sinThetaX * sinThetaB;
+    if(cosThetaP <= bounds.cosThetaE)
+        return 0.0f;
+    return bounds.phi * cosThetaP / sqrDisClamped;
+}
+
+unsigned sampleLightBVH(const std::vector<LightBVHNode>& nodes,
+                        const Vec3& pos, float u, float& pmf) {
+    constexpr float oneMinusEps = 0x1.fffffep-1f;
+    pmf = 1.0f;
+    if(nodes.empty())
+        return ~0U;
+    unsigned cur = 0;
+    while(!nodes[cur].leaf) {
+        float lhs = boundsImportance(nodes[cur + 1].bounds, pos);
+        float rhs = boundsImportance(nodes[nodes[cur].child].bounds, pos);
+        if(lhs <= 0.0f && rhs <= 0.0f)
+            return ~0U;
+        float p = lhs / (lhs + rhs);
+        if(u < p) {
+            cur = cur + 1;
+            u = std::min(u / p, oneMinusEps);
+            pmf *= p;
+        } else {
+            cur = nodes[cur].child;
+            u = std::min((u - p) / (1.0f - p), oneMinusEps);
+            pmf *= 1.0f - p;
+        }
+    }
+    // The other leaves are reached with a positive importance.
+    if(cur == 0 && boundsImportance(nodes[0].bounds, pos) <= 0.0f)
+        return ~0U;
+    return nodes[cur].child;
+}
+
+std::vector<double> lightBVHPmf(const std::vector<LightBVHNode>& nodes,
+                                const Vec3& pos, unsigned lightNum) {
+    std::vector<double> res(lightNum);
+    if(nodes.empty())
+        return res;
+    if(nodes[0].leaf) {
+        if(boundsImportance(nodes[0].bounds, pos) > 0.0f)
+            res[nodes[0].child] = 1.0;
+        return res;
+    }
+    std::vector<std::pair<unsigned, double>> stack{ { 0U, 1.0 } };
+    while(!stack.empty()) {
+        unsigned cur = stack.back().first;
+        double prob = stack.back().second;
+        stack.pop_back();
+        if(nodes[cur].leaf) {
+            res[nodes[cur].child] += prob;
+            continue;
+        }
+        float lhs = boundsImportance(nodes[cur + 1].bounds, pos);
+        float rhs = boundsImportance(nodes[nodes[cur].child].bounds, pos);
+        if(lhs <= 0.0f && rhs <= 0.0f)
+            continue;
+        float p = lhs / (lhs + rhs);
+        if(p > 0.0f)
+            stack.emplace_back(cur + 1, prob * p);
+        if(p < 1.0f)
+            stack.emplace_back(nodes[cur].child, prob * (1.0f - p));
+    }
+    return res;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "DataDesc.hpp"
+#include <vector>
+
+// The host side of the light BVH. Kernel.cu mirrors boundsImportance and
+// sampleLightBVH. No CUDA is involved.
+
+class ThreadPool;
+
+struct BoundedLight final {
+    LightBounds bounds;
+    unsigned id;
+};
+
+// The smallest bounds containing both, the cone of the directions is the
+// union of the cones.
+LightBounds unionBounds(const LightBounds& lhs, const LightBounds& rhs);
+
+// Build the BVH with one light per leaf by the surface area orientation
+// heuristic. The top levels are split in serial and the subtrees are built
+// in parallel, in serial if pool is nullptr. The lights without power are
+// skipped.
+std::vector<LightBVHNode> buildLightBVH(const std::vector<BoundedLight>& lights,
+                                        ThreadPool* pool);
+
+// The conservative estimate of the contribution of the lights to pos.
+float boundsImportance(const LightBounds& bounds, const Vec3& pos);
+// Descend the BVH by the importance of the children with u uniform in [0,1).
+// Return ~0U if no light contributes to pos.
+unsigned sampleLightBVH(const std::vector<LightBVHNode>& nodes,
+                        const Vec3& pos, float u, float& pmf);
+// The probability of sampleLightBVH to pick every light.
+std::vector<double> lightBVHPmf(const std::vector<LightBVHNode>& nodes,
+                                const Vec3& pos, unsigned lightNum);
@@ -0,0 +1,240 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplingCheck.hpp"
+#include "LightBVH.hpp"
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <cmath>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinLightSampler.LightBVH.LightBVHCheck");
+
+// The point lights and the spot lights of the scene, cosOuter is -1 for the
+// point lights.
+struct TestLight final {
+    Vec3 pos, dir;
+    float intensity, cosInner, cosOuter;
+};
+
+// The unoccluded irradiance of the light like the kernels of SimpleLight.
+static double contribution(const TestLight& light, const Vec3& pos) {
+    Vec3 diff = pos - light.pos;
+    double sqrDis = glm::dot(diff, diff);
+    if(light.cosOuter <= -1.0f)
+        return light.intensity / sqrDis;
+    double angle = glm::dot(diff, light.dir) / std::sqrt(sqrDis);
+    if(angle <= light.cosOuter)
+        return 0.0;
+    double falloff = std::min(
+        1.0, (angle - light.cosOuter) / (light.cosInner - light.cosOuter));
+    return light.intensity * falloff / sqrDis;
+}
+
+static LightBounds lightBounds(const TestLight& light) {
+    LightBounds res;
+    res.pMin = res.pMax = light.pos;
+    res.phi = 4.0f * 3.14159265f * light.intensity;
+    if(light.cosOuter <= -1.0f) {
+        res.dir = Vec3{ 0.0f, 0.0f, 1.0f };
+        res.cosThetaO = -1.0f;
+        res.cosThetaE = 0.0f;
+    } else {
+        res.dir = light.dir;
+        res.cosThetaO = light.cosInner;
+        res.cosThetaE =
+            std::cos(std::acos(light.cosOuter) - std::acos(light.cosInner));
+    }
+    return res;
+}
+
+static bool contains(const LightBounds& parent, const LightBounds& child) {
+    constexpr float eps = 1e-3f;
+    for(int i = 0; i < 3; ++i)
+        if(child.pMin[i] < parent.pMin[i] || child.pMax[i] > parent.pMax[i])
+            return false;
+    if(child.phi > parent.phi * (1.0f + eps) ||
+       child.cosThetaE < parent.cosThetaE)
+        return false;
+    if(parent.cosThetaO <= -1.0f)
+        return true;
+    float thetaD = std::acos(
+        std::min(std::max(glm::dot(parent.dir, child.dir), -1.0f), 1.0f));
+    return thetaD + std::acos(child.cosThetaO) <=
+        std::acos(parent.cosThetaO) + eps;
+}
+
+// Check the light BVH on a night street of point lights and spot lights:
+// the serial and the parallel builds agree, every interior node bounds its
+// children, the pmf covers every light which lits the shading point, and the
+// sampled frequencies follow the pmf. The pmf sums to less than one if no
+// light of a subtree lits the point. The variance of the one light
+// estimator is compared with the power sampler.
+static int check(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("LightBVHCheck", "LightBVH::LightBVHCheck");
+        opt.add_options()("l,lights", "light count",
+                          cxxopts::value<unsigned>()->default_value("4096"))(
+            "p,points", "shading points",
+            cxxopts::value<unsigned>()->default_value("16"))(
+            "n,samples", "samples per shading point",
+            cxxopts::value<unsigned>()->default_value("200000"))(
+            "s,seed", "random seed",
+            cxxopts::value<unsigned>()->default_value("0"));
+        auto res = opt.parse(argc, argv);
+        unsigned lightNum = res["lights"].as<unsigned>();
+        unsigned points = res["points"].as<unsigned>();
+        unsigned samples = res["samples"].as<unsigned>();
+        if(lightNum == 0)
+            BUS_TRACE_THROW(std::invalid_argument("Need lights>0"));
+
+        CheckLog log(reporter, BUS_DEFSRCLOC());
+
+        // The street is 200x10x20, the spot lights point down.
+        std::mt19937 eng(res["seed"].as<unsigned>());
+        std::uniform_real_distribution<float> dis;
+        auto street = [&] {
+            return Vec3{ 200.0f * dis(eng), 10.0f * dis(eng),
+                         20.0f * dis(eng) };
+        };
+        std::vector<TestLight> scene(lightNum);
+        std::vector<BoundedLight> lights(lightNum);
+        for(unsigned i = 0; i < lightNum; ++i) {
+            TestLight& light = scene[i];
+            light.pos = street();
+            light.intensity = dis(eng) < 0.01f ? 100.0f : dis(eng);
+            if(dis(eng) < 0.3f) {
+                light.dir = glm::normalize(Vec3{ dis(eng) - 0.5f, -1.0f,
+                                                 dis(eng) - 0.5f });
+                float inner = 0.2f + 0.5f * dis(eng);
+                light.cosInner = std::cos(inner);
+                light.cosOuter = std::cos(inner + 0.3f * dis(eng));
+            } else {
+                light.dir = Vec3{ 0.0f, 0.0f, 1.0f };
+                light.cosInner = light.cosOuter = -1.0f;
+            }
+            // a few lights are off
+            if(dis(eng) < 0.02f)
+                light.intensity = 0.0f;
+            lights[i].bounds = lightBounds(light);
+            lights[i].id = i;
+        }
+
+        ThreadPool pool;
+        auto builds = buildSerialParallel(
+            pool, [&](ThreadPool* p) { return buildLightBVH(lights, p); });
+        const std::vector<LightBVHNode>& serial = builds.serial;
+        const std::vector<LightBVHNode>& nodes = builds.parallel;
+
+        auto same = [](const LightBVHNode& lhs, const LightBVHNode& rhs) {
+            const LightBounds &a = lhs.bounds, &b = rhs.bounds;
+            return lhs.child == rhs.child && lhs.leaf == rhs.leaf &&
+                a.pMin == b.pMin && a.pMax == b.pMax && a.dir == b.dir &&
+                a.phi == b.phi && a.cosThetaO == b.cosThetaO &&
+                a.cosThetaE == b.cosThetaE;
+        };
+        if(serial.size() != nodes.size() ||
+           !std::equal(serial.begin(), serial.end(), nodes.begin(), same))
+            log.fail("The serial and the parallel builds differ");
+
+        unsigned emitters = 0;
+        for(auto&& light : scene)
+            emitters += light.intensity > 0.0f;
+        if(nodes.size() != (emitters ? 2 * emitters - 1 : 0))
+            log.fail("Bad node count " + std::to_string(nodes.size()));
+        std::vector<unsigned> leafCount(lightNum);
+        unsigned bad = 0;
+        for(size_t i = 0; i < nodes.size(); ++i) {
+            const LightBVHNode& node = nodes[i];
+            if(node.leaf) {
+                if(node.child >= lightNum || ++leafCount[node.child] > 1 ||
+                   scene[node.child].intensity <= 0.0f)
+                    ++bad;
+                continue;
+            }
+            if(node.child <= i + 1 || node.child >= nodes.size() ||
+               !contains(node.bounds, nodes[i + 1].bounds) ||
+               !contains(node.bounds, nodes[node.child].bounds))
+                ++bad;
+        }
+        if(bad)
+            log.fail(std::to_string(bad) + " bad nodes");
+
+        double worst = 0.0, bvhVar = 0.0, powerVar = 0.0;
+        double totalPower = 0.0;
+        for(auto&& light : lights)
+            totalPower += light.bounds.phi;
+        for(unsigned k = 0; k < points && !nodes.empty(); ++k) {
+            Vec3 pos = street();
+            std::vector<double> pmf = lightBVHPmf(nodes, pos, lightNum);
+            double sum = 0.0, exact = 0.0, bvhMoment = 0.0, powerMoment = 0.0;
+            unsigned missed = 0;
+            for(unsigned i = 0; i < lightNum; ++i) {
+                sum += pmf[i];
+                double f = contribution(scene[i], pos);
+                exact += f;
+                if(f <= 0.0)
+                    continue;
+                if(pmf[i] <= 0.0)
+                    ++missed;
+                else
+                    bvhMoment += f * f / pmf[i];
+                powerMoment += f * f * totalPower / lights[i].bounds.phi;
+            }
+            if(sum > 1.0 + 1e-4 || sum <= 0.0)
+                log.fail("The pmf sums to " + std::to_string(sum));
+            if(missed)
+                log.fail(std::to_string(missed) +
+                         " lights lit the point but aren't sampled");
+            // the relative variances of the estimators
+            bvhVar += bvhMoment / (exact * exact) - 1.0;
+            powerVar += powerMoment / (exact * exact) - 1.0;
+
+            // The count of a light is about N(n*pmf,n*pmf), the last one
+            // counts the samples without a light.
+            std::vector<unsigned> count(lightNum + 1);
+            pmf.push_back(std::max(1.0 - sum, 0.0));
+            for(unsigned i = 0; i < samples; ++i) {
+                float prob;
+                unsigned id = sampleLightBVH(nodes, pos, dis(eng), prob);
+                if(id == ~0U) {
+                    ++count[lightNum];
+                    continue;
+                }
+                if(id >= lightNum || pmf[id] <= 0.0 ||
+                   std::fabs(prob / pmf[id] - 1.0) > 1e-3) {
+                    log.fail("Bad sample " + std::to_string(id));
+                    break;
+                }
+                ++count[id];
+            }
+            double deviation = maxDeviation(
+                count, [&](size_t i) { return pmf[i] * samples; });
+            worst = std::max(worst, deviation);
+        }
+        checkDeviation(log, worst, "pmf");
+
+        std::stringstream ss;
+        ss << lightNum << " lights, " << builds.summary()
+           << ", max deviation " << worst << ", relative variance "
+           << bvhVar / std::max(points, 1U) << "(BVH) "
+           << powerVar / std::max(points, 1U) << "(power)";
+        return log.finish(ss.str());
+    }
+    BUS_TRACE_END();
+}
+
+class LightBVHCheck final : public Command {
+public:
+    explicit LightBVHCheck(Bus::ModuleInstance& instance)
+        : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return check(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getLightBVHCheck(Bus::ModuleInstance& instance) {
+    return std::make_shared<LightBVHCheck>(instance);
+}
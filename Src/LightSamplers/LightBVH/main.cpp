@@ -0,0 +1,126 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/LightSamplerAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "DataDesc.hpp"
+#include "LightBVH.hpp"
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <optix_function_table_definition.h>
+#include <optix_stubs.h>
+#pragma warning(pop)
+
+BUS_MODULE_NAME("Piper.BuiltinLightSampler.LightBVH");
+
+// Pick the lights by their power, distance and orientation to the shading
+// point with a light BVH. The lights without bounds are picked uniformly.
+class LightBVHSampler final : public LightSampler {
+private:
+    ProgramGroup mProgramGroup;
+    Buffer mNodes, mInfinite;
+
+public:
+    explicit LightBVHSampler(Bus::ModuleInstance& instance)
+        : LightSampler(instance) {}
+    LightSamplerData
+    init(PluginHelper helper, std::shared_ptr<Config> cfg,
+         const std::vector<std::shared_ptr<Light>>& lights) override {
+        BUS_TRACE_BEG() {
+            std::vector<BoundedLight> bounded;
+            std::vector<unsigned> infinite;
+            for(size_t i = 0; i < lights.size(); ++i) {
+                BoundedLight light;
+                light.id = static_cast<unsigned>(i);
+                if(lights[i]->bounds(light.bounds))
+                    bounded.push_back(light);
+                else
+                    infinite.push_back(light.id);
+            }
+            std::vector<LightBVHNode> nodes;
+            {
+                ThreadPool pool;
+                nodes = buildLightBVH(bounded, &pool);
+            }
+            reporter().apply(ReportLevel::Debug,
+                             std::to_string(nodes.size()) + " nodes, " +
+                                 std::to_string(infinite.size()) +
+                                 " infinite lights",
+                             BUS_DEFSRCLOC());
+            DataDesc data;
+            data.nodeNum = static_cast<unsigned>(nodes.size());
+            data.infiniteNum = static_cast<unsigned>(infinite.size());
+            // keep the pointers valid for the empty buffers
+            nodes.emplace_back();
+            infinite.push_back(0);
+            mNodes = uploadData(0, nodes.data(), nodes.size());
+            mInfinite = uploadData(0, infinite.data(), infinite.size());
+            data.nodes = static_cast<const LightBVHNode*>(mNodes.get());
+            data.infinite = static_cast<const unsigned*>(mInfinite.get());
+
+            const ModuleDesc& mod =
+                helper->getModuleManager()->getModuleFromFile(
+                    modulePath().parent_path() / "Kernel.ptx");
+            OptixProgramGroupDesc desc = {};
+            desc.kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+            desc.callables.moduleCC = mod.handle.get();
+            desc.callables.entryFunctionNameCC =
+                mod.map("__continuation_callable__sample");
+            OptixProgramGroupOptions opt = {};
+            OptixProgramGroup group;
+            checkOptixError(optixProgramGroupCreate(helper->getContext(), &desc,
+                                                    1, &opt, nullptr, nullptr,
+                                                    &group));
+            mProgramGroup.reset(group);
+            LightSamplerData res;
+            res.sbtData = packSBTRecord(group, data);
+            res.maxSampleDim = 1;
+            res.group = group;
+            OptixStackSizes size;
+            checkOptixError(optixProgramGroupGetStackSize(group, &size));
+            res.css = size.cssCC;
+            res.dss = 0;
+            return res;
+        }
+        BUS_TRACE_END();
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getLightBVHCheck(Bus::ModuleInstance& instance);
+
+class Instance final : public Bus::ModuleInstance {
+public:
+    Instance(const fs::path& path, Bus::ModuleSystem& sys)
+        : Bus::ModuleInstance(path, sys) {
+        checkOptixError(optixInit());
+    }
+    Bus::ModuleInfo info() const override {
+        Bus::ModuleInfo res;
+        res.name = BUS_DEFAULT_MODULE_NAME;
+        res.guid = Bus::str2GUID("{A4F0C3D8-6B21-4E97-8D5A-31C7E9B20F46}");
+        res.busVersion = BUS_VERSION;
+        res.version = "0.0.1";
+        res.description = "Light BVH Sampler";
+        res.copyright = "Copyright (c) 2019 Zheng Yingwei";
+        res.modulePath = getModulePath();
+        return res;
+    }
+    std::vector<Bus::Name> list(Bus::Name api) const override {
+        if(api == LightSampler::getInterface())
+            return { "LightBVH" };
+        if(api == Command::getInterface())
+            return { "LightBVHCheck" };
+        return {};
+    }
+    std::shared_ptr<Bus::ModuleFunctionBase> instantiate(Name name) override {
+        if(name == "LightBVH")
+            return std::make_shared<LightBVHSampler>(*this);
+        if(name == "LightBVHCheck")
+            return getLightBVHCheck(*this);
+        return nullptr;
+    }
+};
+
+BUS_API void busInitModule(const Bus::fs::path& path, Bus::ModuleSystem& system,
+                           std::shared_ptr<Bus::ModuleInstance>& instance) {
+    instance = std::make_shared<Instance>(path, system);
+}
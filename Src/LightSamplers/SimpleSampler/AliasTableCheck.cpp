@@ -0,0 +1,138 @@
+#include "../../Shared/AliasTable.hpp"
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplingCheck.hpp"
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <cmath>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinLightSampler.SimpleSampler.AliasTableCheck");
+
+// The probability of every light in the table.
+static std::vector<double> tablePdf(const std::vector<AliasEntry>& table) {
+    std::vector<double> res(table.size());
+    for(size_t i = 0; i < table.size(); ++i) {
+        res[i] += table[i].prob;
+        res[table[i].alias] += 1.0 - table[i].prob;
+    }
+    for(auto& pdf : res)
+        pdf /= static_cast<double>(table.size());
+    return res;
+}
+
+// Check the alias table on a few strong lights among many dim ones: the pdf
+// of the table and invPdf match the weights, the lights without power are
+// never picked, the serial and the parallel builds agree and the sampled
+// frequencies follow the pdf. The build and the sampling are timed.
+static int check(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("AliasTableCheck",
+                             "SimpleSampler::AliasTableCheck");
+        opt.add_options()("l,lights", "light count",
+                          cxxopts::value<unsigned>()->default_value("1000000"))(
+            "n,samples", "sample count",
+            cxxopts::value<unsigned>()->default_value("10000000"))(
+            "s,seed", "random seed",
+            cxxopts::value<unsigned>()->default_value("0"));
+        auto res = opt.parse(argc, argv);
+        unsigned lightNum = res["lights"].as<unsigned>();
+        unsigned samples = res["samples"].as<unsigned>();
+        if(lightNum == 0)
+            BUS_TRACE_THROW(std::invalid_argument("Need lights>0"));
+
+        CheckLog log(reporter, BUS_DEFSRCLOC());
+
+        // 0.1% strong lights, 5% lights without power
+        std::mt19937 eng(res["seed"].as<unsigned>());
+        std::uniform_real_distribution<float> dis;
+        std::vector<float> weights(lightNum);
+        double total = 0.0;
+        for(auto& w : weights) {
+            float u = dis(eng);
+            w = u < 0.001f ? 1000.0f * (1.0f + dis(eng)) :
+                             (u < 0.051f ? 0.0f : dis(eng));
+            total += w;
+        }
+
+        ThreadPool pool;
+        auto builds = buildSerialParallel(pool, [&](ThreadPool* p) {
+            return buildAliasTable(weights, p);
+        });
+        const std::vector<AliasEntry>& serial = builds.serial;
+        const std::vector<AliasEntry>& table = builds.parallel;
+
+        size_t diff = 0;
+        for(size_t i = 0; i < lightNum; ++i)
+            if(serial[i].prob != table[i].prob ||
+               serial[i].alias != table[i].alias ||
+               serial[i].invPdf != table[i].invPdf)
+                ++diff;
+        if(diff)
+            log.fail(std::to_string(diff) + " entries of the builds differ");
+
+        std::vector<double> pdf = tablePdf(table);
+        double maxError = 0.0;
+        for(size_t i = 0; i < lightNum; ++i) {
+            double expected = weights[i] / total;
+            if(weights[i] == 0.0f) {
+                if(pdf[i] != 0.0)
+                    log.fail("Light " + std::to_string(i) +
+                             " without power is picked");
+                continue;
+            }
+            maxError = std::max(maxError, std::fabs(pdf[i] / expected - 1.0));
+            if(std::fabs(table[i].invPdf * expected - 1.0) > 1e-5)
+                log.fail("Bad invPdf of light " + std::to_string(i));
+        }
+        if(maxError > 1e-5)
+            log.fail("The relative error of the pdf is " +
+                     std::to_string(maxError));
+
+        // The count of a light is about N(n*pdf,n*pdf).
+        std::vector<unsigned> count(lightNum);
+        double sampleTime = elapsedMs([&] {
+            for(unsigned i = 0; i < samples; ++i)
+                ++count[sampleAliasTable(table, dis(eng), dis(eng))];
+        });
+        for(size_t i = 0; i < lightNum; ++i)
+            if(pdf[i] == 0.0 && count[i])
+                log.fail("Light " + std::to_string(i) + " isn't in the pdf");
+        double worst =
+            maxDeviation(count, [&](size_t i) { return pdf[i] * samples; });
+        checkDeviation(log, worst, "pdf");
+
+        // The lights are picked uniformly without power.
+        std::vector<AliasEntry> dark =
+            buildAliasTable(std::vector<float>(16, 0.0f), &pool);
+        for(auto&& entry : dark)
+            if(entry.prob != 1.0f || entry.invPdf != 16.0f) {
+                log.fail("The table without power isn't uniform");
+                break;
+            }
+
+        std::stringstream ss;
+        ss << lightNum << " lights, " << builds.summary() << ", "
+           << samples / std::max(sampleTime, 1e-3) * 1e-3
+           << "M samples/s, max pdf error " << maxError << ", max deviation "
+           << worst;
+        return log.finish(ss.str());
+    }
+    BUS_TRACE_END();
+}
+
+class AliasTableCheck final : public Command {
+public:
+    explicit AliasTableCheck(Bus::ModuleInstance& instance)
+        : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return check(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getAliasTableCheck(Bus::ModuleInstance& instance) {
+    return std::make_shared<AliasTableCheck>(instance);
+}
@@ -5,3 +5,8 @@ struct DataDesc final {
     unsigned lightNum;
     float invPdf;
 };
+
+struct PowerDataDesc final {
+    const AliasEntry* table;
+    unsigned lightNum;
+};
@@ -0,0 +1,28 @@
+#include "../../Shared/KernelShared.hpp"
+#include "DataDesc.hpp"
+
+DEVICE LightSample __continuation_callable__sample(const Vec3& pos,
+                                                   float rayTime,
+                                                   SamplerContext& sampler) {
+    auto data = getSBTData<PowerDataDesc>();
+    unsigned num = data->lightNum;
+    if(num == 0) {
+        LightSample res;
+        res.rad = Spectrum{ 0.0f };
+        res.lightId = invalidLightId;
+        return res;
+    }
+    // sampleAliasTable
+    unsigned id = static_cast<unsigned>(num * sampler());
+    id = glm::clamp(id, 0U, num - 1U);
+    const AliasEntry& bucket = data->table[id];
+    if(sampler() >= bucket.prob)
+        id = bucket.alias;
+    LightSample res = sampleOneLightImpl(launchParam.lightSbtOffset + id, pos,
+                                         rayTime, sampler);
+    res.rad *= data->table[id].invPdf;
+    res.lightId = id;
+    return res;
+}
+
+void check(LightSampleFunction = __continuation_callable__sample);
@@ -9,6 +9,7 @@ DEVICE LightSample __continuation_callable__sample(const Vec3& pos,
     if(num == 0) {
         LightSample res;
         res.rad = Spectrum{ 0.0f };
+        res.lightId = invalidLightId;
         return res;
     }
     unsigned id = static_cast<unsigned>(num * sampler());
@@ -16,6 +17,7 @@ DEVICE LightSample __continuation_callable__sample(const Vec3& pos,
     LightSample res = sampleOneLightImpl(launchParam.lightSbtOffset + id, pos,
                                          rayTime, sampler);
     res.rad *= data->invPdf;
+    res.lightId = id;
     return res;
 }
 
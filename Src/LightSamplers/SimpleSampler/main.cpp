@@ -1,6 +1,10 @@
+#include "../../Shared/AliasTable.hpp"
+#include "../../Shared/CommandAPI.hpp"
 #include "../../Shared/LightSamplerAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
 #include "DataDesc.hpp"
 #pragma warning(push, 0)
+#define NOMINMAX
 #include <optix_function_table_definition.h>
 #include <optix_stubs.h>
 #pragma warning(pop)
@@ -14,9 +18,11 @@ private:
 public:
     explicit UniformSampler(Bus::ModuleInstance& instance)
         : LightSampler(instance) {}
-    LightSamplerData init(PluginHelper helper, std::shared_ptr<Config> cfg,
-                          size_t lightNum) override {
+    LightSamplerData
+    init(PluginHelper helper, std::shared_ptr<Config> cfg,
+         const std::vector<std::shared_ptr<Light>>& lights) override {
         BUS_TRACE_BEG() {
+            size_t lightNum = lights.size();
             DataDesc data;
             data.lightNum = static_cast<unsigned>(lightNum);
             data.invPdf = static_cast<float>(lightNum);
@@ -48,6 +54,66 @@ public:
     }
 };
 
+// Pick the lights proportional to their power by an alias table, so the
+// dim lights don't take the shadow rays of the strong ones.
+class PowerSampler final : public LightSampler {
+private:
+    ProgramGroup mProgramGroup;
+    Buffer mTable;
+
+public:
+    explicit PowerSampler(Bus::ModuleInstance& instance)
+        : LightSampler(instance) {}
+    LightSamplerData
+    init(PluginHelper helper, std::shared_ptr<Config> cfg,
+         const std::vector<std::shared_ptr<Light>>& lights) override {
+        BUS_TRACE_BEG() {
+            std::vector<float> power(lights.size());
+            for(size_t i = 0; i < lights.size(); ++i)
+                power[i] = lights[i]->power();
+            std::vector<AliasEntry> table;
+            {
+                ThreadPool pool;
+                table = buildAliasTable(power, &pool);
+            }
+            // keep the pointer valid without lights
+            if(table.empty())
+                table.push_back({ 1.0f, 0U, 0.0f });
+            mTable = uploadData(0, table.data(), table.size());
+            PowerDataDesc data;
+            data.table = static_cast<const AliasEntry*>(mTable.get());
+            data.lightNum = static_cast<unsigned>(lights.size());
+            const ModuleDesc& mod =
+                helper->getModuleManager()->getModuleFromFile(
+                    modulePath().parent_path() / "Power.ptx");
+            OptixProgramGroupDesc desc = {};
+            desc.kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+            desc.callables.moduleCC = mod.handle.get();
+            desc.callables.entryFunctionNameCC =
+                mod.map("__continuation_callable__sample");
+            OptixProgramGroupOptions opt = {};
+            OptixProgramGroup group;
+            checkOptixError(optixProgramGroupCreate(helper->getContext(), &desc,
+                                                    1, &opt, nullptr, nullptr,
+                                                    &group));
+            mProgramGroup.reset(group);
+            LightSamplerData res;
+            res.sbtData = packSBTRecord(group, data);
+            res.maxSampleDim = 2;
+            res.group = group;
+            OptixStackSizes size;
+            checkOptixError(optixProgramGroupGetStackSize(group, &size));
+            res.css = size.cssCC;
+            res.dss = 0;
+            return res;
+        }
+        BUS_TRACE_END();
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getAliasTableCheck(Bus::ModuleInstance& instance);
+
 class Instance final : public Bus::ModuleInstance {
 public:
     Instance(const fs::path& path, Bus::ModuleSystem& sys)
@@ -67,12 +133,18 @@ public:
     }
     std::vector<Bus::Name> list(Bus::Name api) const override {
         if(api == LightSampler::getInterface())
-            return { "UniformSampler" };
+            return { "UniformSampler", "PowerSampler" };
+        if(api == Command::getInterface())
+            return { "AliasTableCheck" };
         return {};
     }
     std::shared_ptr<Bus::ModuleFunctionBase> instantiate(Name name) override {
         if(name == "UniformSampler")
             return std::make_shared<UniformSampler>(*this);
+        if(name == "PowerSampler")
+            return std::make_shared<PowerSampler>(*this);
+        if(name == "AliasTableCheck")
+            return getAliasTableCheck(*this);
         return nullptr;
     }
 };
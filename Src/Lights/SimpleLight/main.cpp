@@ -8,10 +8,15 @@
 
 BUS_MODULE_NAME("Piper.BuiltinLight.SimpleLight");
 
+static float luminance(const Spectrum& lum) {
+    return glm::dot(lum, Spectrum{ 0.2126f, 0.7152f, 0.0722f });
+}
+
 class DirectionalLight final : public Light {
 private:
     ProgramGroup mProgramGroup;
     LightData mData;
+    float mPower;
 
 public:
     explicit DirectionalLight(Bus::ModuleInstance& instance)
@@ -22,6 +27,9 @@ public:
             data.lum = cfg->attribute("Lum")->asVec3();
             data.negDir =
                 glm::normalize(-cfg->attribute("Direction")->asVec3());
+            // The power through a disk of the scene radius.
+            float radius = cfg->getFloat("Radius", 1.0f);
+            mPower = glm::pi<float>() * radius * radius * luminance(data.lum);
             const ModuleDesc& mod =
                 helper->getModuleManager()->getModuleFromFile(
                     modulePath().parent_path() / "DirLight.ptx");
@@ -49,12 +57,20 @@ public:
     LightData getData() override {
         return mData;
     }
+    float power() const override {
+        return mPower;
+    }
+    bool bounds(LightBounds&) const override {
+        return false;
+    }
 };
 
 class PointLight final : public Light {
 private:
     ProgramGroup mProgramGroup;
     LightData mData;
+    float mPower;
+    LightBounds mBounds;
 
 public:
     explicit PointLight(Bus::ModuleInstance& instance) : Light(instance) {}
@@ -63,6 +79,12 @@ public:
             PointLightData data;
             data.lum = cfg->attribute("Lum")->asVec3();
             data.pos = cfg->attribute("Position")->asVec3();
+            mPower = 4.0f * glm::pi<float>() * luminance(data.lum);
+            mBounds.pMin = mBounds.pMax = data.pos;
+            mBounds.dir = Vec3{ 0.0f, 0.0f, 1.0f };
+            mBounds.phi = mPower;
+            mBounds.cosThetaO = -1.0f;
+            mBounds.cosThetaE = 0.0f;
             const ModuleDesc& mod =
                 helper->getModuleManager()->getModuleFromFile(
                     modulePath().parent_path() / "PointLight.ptx");
@@ -90,12 +112,21 @@ public:
     LightData getData() override {
         return mData;
     }
+    float power() const override {
+        return mPower;
+    }
+    bool bounds(LightBounds& res) const override {
+        res = mBounds;
+        return true;
+    }
 };
 
 class SpotLight final : public Light {
 private:
     ProgramGroup mProgramGroup;
     LightData mData;
+    float mPower;
+    LightBounds mBounds;
 
 public:
     explicit SpotLight(Bus::ModuleInstance& instance) : Light(instance) {}
@@ -116,6 +147,15 @@ public:
                 data.invDelta = 0.0f;
             else
                 data.invDelta = 1.0f / (cutOff - data.outerCutOff);
+            // The falloff is taken as the midpoint of the cone angles.
+            mPower = 2.0f * glm::pi<float>() * luminance(data.lum) *
+                (1.0f - 0.5f * (cutOff + data.outerCutOff));
+            mBounds.pMin = mBounds.pMax = data.pos;
+            mBounds.dir = -data.negSpotDir;
+            mBounds.phi = 4.0f * glm::pi<float>() * luminance(data.lum);
+            mBounds.cosThetaO = cutOff;
+            mBounds.cosThetaE =
+                cosf(acosf(data.outerCutOff) - acosf(cutOff));
             const ModuleDesc& mod =
                 helper->getModuleManager()->getModuleFromFile(
                     modulePath().parent_path() / "SpotLight.ptx");
@@ -143,6 +183,13 @@ public:
     LightData getData() override {
         return mData;
     }
+    float power() const override {
+        return mPower;
+    }
+    bool bounds(LightBounds& res) const override {
+        res = mBounds;
+        return true;
+    }
 };
 
 class ConstantEnvironment final : public EnvironmentLight {
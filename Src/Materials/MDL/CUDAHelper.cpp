@@ -5,8 +5,14 @@
 
 // Code shared by CUDA MDL SDK examples
 
+#include "../../Shared/ConfigAPI.hpp"
 #include "../../Shared/PluginShared.hpp"
-#include "MDLShared.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "MDLCache.hpp"
+#include "TextureConvert.hpp"
+#include <algorithm>
+#include <fstream>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -215,8 +221,6 @@ struct Resource_deleter<Target_code_data> {
     void operator()(Target_code_data& res) {
         if(res.textures)
             checkCudaError(cuMemFree(res.textures));
-        if(res.ro_data_segment)
-            checkCudaError(cuMemFree(res.ro_data_segment));
     }
 };
 
@@ -228,6 +232,22 @@ struct Resource_deleter<CUdeviceptr> {
     }
 };
 
+template <>
+struct Resource_deleter<CUstream> {
+    void operator()(CUstream res) {
+        if(res)
+            checkCudaError(cuStreamDestroy(res));
+    }
+};
+
+// Page-locked host memory for the asynchronous uploads.
+struct PinnedDeleter final {
+    void operator()(float* ptr) const {
+        checkCudaError(cuMemFreeHost(ptr));
+    }
+};
+using PinnedBuffer = std::unique_ptr<float, PinnedDeleter>;
+
 /// Holds one resource, not copyable.
 template <typename T, typename D = Resource_deleter<T>>
 struct Resource_handle {
@@ -336,18 +356,22 @@ CUdeviceptr gpu_mem_dup(Resource_container<T, C> const& cont) {
 class Material_gpu_context {
 public:
     Material_gpu_context(bool enable_derivatives)
-        : m_enable_derivatives(enable_derivatives),
+        : m_enable_derivatives(enable_derivatives), m_device_ro_data(0),
           m_device_target_code_data_list(0),
           m_device_target_argument_block_list(0) {
         // Use first entry as "not-used" block
         m_target_argument_block_list->push_back(0);
     }
 
-    // Prepare the needed data of the given target code.
+    // Prepare the needed data of the given compiled material. The textures
+    // are converted on pool. The leading resources and the read-only data of
+    // shared are reused, shared must outlive this context.
     void prepare_target_code_data(MDL::ITransaction* transaction,
                                   MDL::IImage_api* image_api,
-                                  MDL::ITarget_code const* target_code,
-                                  std::vector<size_t> const& arg_block_indices);
+                                  ThreadPool& pool,
+                                  CompiledMaterial const& material,
+                                  std::vector<size_t> const& arg_block_indices,
+                                  Material_gpu_context const* shared = nullptr);
 
     // Get a device pointer to the target code data list.
     CUdeviceptr get_device_target_code_data_list();
@@ -365,7 +389,7 @@ public:
 
     // Get the number of target argument blocks.
     size_t get_argument_block_count() const {
-        return m_own_arg_blocks.size();
+        return m_target_argument_block_list->size() - 1;
     }
 
     // Get the argument block of the i'th BSDF.
@@ -376,54 +400,47 @@ public:
         return m_bsdf_arg_block_indices[i];
     }
 
-    // Get a writable copy of the i'th target argument block.
-    Handle<MDL::ITarget_argument_block> get_argument_block(size_t i) {
-        if(i >= m_own_arg_blocks.size())
-            return Handle<MDL::ITarget_argument_block>();
-        return m_own_arg_blocks[i];
-    }
-
-    // Get the layout of the i'th target argument block.
-    Handle<MDL::ITarget_value_layout const>
-    get_argument_block_layout(size_t i) {
-        if(i >= m_arg_block_layouts.size())
-            return Handle<MDL::ITarget_value_layout const>();
-        return m_arg_block_layouts[i];
-    }
-
-    // Update the i'th target argument block on the device with the data from
-    // the corresponding block returned by get_argument_block().
-    void update_device_argument_block(size_t i);
-
 private:
-    // Copy the image data of a canvas to a CUDA array.
-    void copy_canvas_to_cuda_array(CUarray device_array,
-                                   MDL::ICanvas const* canvas);
-
-    // Prepare the texture identified by the texture_index for use by the
-    // texture access functions on the GPU.
-    void prepare_texture(MDL::ITransaction* transaction,
-                         MDL::IImage_api* image_api,
-                         MDL::ITarget_code const* code_ptx,
-                         mi::Size texture_index,
-                         std::vector<Texture>& textures);
+    // Prepare the textures for use by the texture access functions on the
+    // GPU. The canvases are converted on the pool into pinned staging
+    // buffers and uploaded asynchronously in order.
+    void prepare_textures(
+        MDL::ITransaction* transaction, MDL::IImage_api* image_api,
+        ThreadPool& pool,
+        std::vector<CompiledMaterial::TextureInfo> const& infos,
+        std::vector<Texture>& textures);
+
+    // Create the CUDA array and the texture objects of a converted texture
+    // and enqueue the upload of the staging buffer.
+    Texture upload_texture(CUstream stream,
+                           MDL::ITarget_code::Texture_shape texture_shape,
+                           Uint3 size, mi::Uint32 levels,
+                           float const* staging);
 
     // Prepare the mbsdf identified by the mbsdf_index for use by the bsdf
     // measurement access functions on the GPU.
     void prepare_mbsdf(MDL::ITransaction* transaction,
-                       MDL::ITarget_code const* code_ptx, mi::Size mbsdf_index,
+                       CompiledMaterial::ResourceInfo const& info,
                        std::vector<Mbsdf>& mbsdfs);
 
     // Prepare the mbsdf identified by the mbsdf_index for use by the bsdf
     // measurement access functions on the GPU.
     void prepare_lightprofile(MDL::ITransaction* transaction,
-                              MDL::ITarget_code const* code_ptx,
-                              mi::Size lightprofile_index,
+                              CompiledMaterial::ResourceInfo const& info,
                               std::vector<Lightprofile>& lightprofiles);
 
     // If true, mipmaps will be generated for all 2D textures.
     bool m_enable_derivatives;
 
+    // The resource tables without the invalid resources, the handles are
+    // owned by the context which prepared them.
+    std::vector<Texture> m_textures;
+    std::vector<Mbsdf> m_mbsdfs;
+    std::vector<Lightprofile> m_lightprofiles;
+
+    // The read-only data segment, owned by the context which prepared it.
+    Resource_handle<CUdeviceptr> m_device_ro_data;
+
     // The device pointer of the target code data list.
     Resource_handle<CUdeviceptr> m_device_target_code_data_list;
 
@@ -436,15 +453,9 @@ private:
     // List of all target argument blocks owned by this context.
     Resource_container<CUdeviceptr> m_target_argument_block_list;
 
-    // List of all local, writable copies of the target argument blocks.
-    std::vector<Handle<MDL::ITarget_argument_block>> m_own_arg_blocks;
-
     // List of argument block indices per material BSDF.
     std::vector<size_t> m_bsdf_arg_block_indices;
 
-    // List of all target argument block layouts.
-    std::vector<Handle<MDL::ITarget_value_layout const>> m_arg_block_layouts;
-
     // List of all Texture objects owned by this context.
     Resource_container<Texture> m_all_textures;
 
@@ -477,96 +488,169 @@ CUdeviceptr Material_gpu_context::get_device_target_argument_block_list() {
     return m_device_target_argument_block_list.get();
 }
 
-// TODO:asynchronous and RAII
-
-// Copy the image data of a canvas to a CUDA array.
-void Material_gpu_context::copy_canvas_to_cuda_array(
-    CUarray device_array, MDL::ICanvas const* canvas) {
-    BUS_TRACE_BEG() {
-        Handle<const MDL::ITile> tile(canvas->get_tile(0, 0));
-        mi::Float32 const* data =
-            static_cast<mi::Float32 const*>(tile->get_data());
-        CUDA_MEMCPY2D copyParam = {};
-        copyParam.WidthInBytes = canvas->get_resolution_x() * 4 * sizeof(float);
-        copyParam.Height = canvas->get_resolution_y();
-        copyParam.srcHost = data;
-        copyParam.srcMemoryType = CU_MEMORYTYPE_HOST;
-        copyParam.dstArray = device_array;
-        copyParam.dstMemoryType = CU_MEMORYTYPE_ARRAY;
-        checkCudaError(cuMemcpy2D(&copyParam));
-    }
-    BUS_TRACE_END();
-}
+// The pinned staging buffers alive at once are limited to this size. A
+// larger texture is converted alone.
+static constexpr size_t stagingBudget = 256ULL << 20;
+
+// The state of a texture between the conversion and the upload.
+struct Texture_job final {
+    Handle<const MDL::ICanvas> canvas;
+    MDL::ITarget_code::Texture_shape shape;
+    float gamma;
+    mi::Uint32 width, height, layers, levels;
+    size_t size;  // in floats
+    PinnedBuffer staging;
+    std::future<void> converted;
+};
 
-// Prepare the texture identified by the texture_index for use by the texture
-// access functions on the GPU.
-void Material_gpu_context::prepare_texture(MDL::ITransaction* transaction,
-                                           MDL::IImage_api* image_api,
-                                           MDL::ITarget_code const* code_ptx,
-                                           mi::Size texture_index,
-                                           std::vector<Texture>& textures) {
+// Prepare the textures for use by the texture access functions on the GPU.
+void Material_gpu_context::prepare_textures(
+    MDL::ITransaction* transaction, MDL::IImage_api* image_api,
+    ThreadPool& pool, std::vector<CompiledMaterial::TextureInfo> const& infos,
+    std::vector<Texture>& textures) {
     BUS_TRACE_BEG() {
-        // Get access to the texture data by the texture database name from the
-        // target code.
-        Handle<const MDL::ITexture> texture(transaction->access<MDL::ITexture>(
-            code_ptx->get_texture(texture_index)));
-        Handle<const MDL::IImage> image(
-            transaction->access<MDL::IImage>(texture->get_image()));
-        Handle<const MDL::ICanvas> canvas(image->get_canvas());
-        mi::Uint32 tex_width = canvas->get_resolution_x();
-        mi::Uint32 tex_height = canvas->get_resolution_y();
-        mi::Uint32 tex_layers = canvas->get_layers_size();
-        char const* image_type = image->get_type();
-
-        if(image->is_uvtile()) {
-            BUS_TRACE_THROW(
-                std::logic_error("Unimplemented feature:uvtile texture"));
+        // The database is only accessed by this thread.
+        std::vector<Texture_job> jobs(infos.size());
+        for(size_t i = 0; i < infos.size(); ++i) {
+            Texture_job& job = jobs[i];
+            Handle<const MDL::ITexture> texture(
+                transaction->access<MDL::ITexture>(infos[i].dbName.c_str()));
+            Handle<const MDL::IImage> image(
+                transaction->access<MDL::IImage>(texture->get_image()));
+            if(image->is_uvtile()) {
+                BUS_TRACE_THROW(
+                    std::logic_error("Unimplemented feature:uvtile texture"));
+            }
+            job.canvas = image->get_canvas();
+            if(job.canvas->get_tiles_size_x() != 1 ||
+               job.canvas->get_tiles_size_y() != 1) {
+                BUS_TRACE_THROW(
+                    std::logic_error("Unimplemented feature:tiled images"));
+            }
+            job.shape = static_cast<MDL::ITarget_code::Texture_shape>(
+                infos[i].shape);
+            job.gamma = texture->get_effective_gamma();
+            job.width = job.canvas->get_resolution_x();
+            job.height = job.canvas->get_resolution_y();
+            job.layers = job.canvas->get_layers_size();
+            if(job.shape == MDL::ITarget_code::Texture_shape_cube &&
+               job.layers != 6) {
+                BUS_TRACE_THROW(std::logic_error(
+                    "Invalid number of layers (" + std::to_string(job.layers) +
+                    "), cubemaps must have 6 layers!"));
+            }
+            bool is2D = job.shape != MDL::ITarget_code::Texture_shape_cube &&
+                job.shape != MDL::ITarget_code::Texture_shape_3d;
+            job.levels = (is2D && m_enable_derivatives) ?
+                mipLevelCount(job.width, job.height) :
+                1;
+            job.size =
+                stagingSize(job.width, job.height, job.layers, job.levels);
         }
 
-        if(canvas->get_tiles_size_x() != 1 || canvas->get_tiles_size_y() != 1) {
-            BUS_TRACE_THROW(
-                std::logic_error("Unimplemented feature:tiled images"));
-        }
+        CUcontext context;
+        checkCudaError(cuCtxGetCurrent(&context));
+        auto convert = [&pool, image_api, context](Texture_job& job) {
+            job.converted = pool.submit([&job, image_api, context] {
+                BUS_TRACE_BEG() {
+                    checkCudaError(cuCtxSetCurrent(context));
+                    // For simplicity, the texture access functions are only
+                    // implemented for float4 and gamma is pre-applied here
+                    // (all images are converted to linear space).
+                    Handle<const MDL::ICanvas> canvas = job.canvas;
+                    char const* image_type = canvas->get_type();
+                    if(strcmp(image_type, "Color") != 0 &&
+                       strcmp(image_type, "Float32<4>") != 0)
+                        canvas = image_api->convert(canvas.get(), "Color");
+
+                    std::vector<Handle<const MDL::ITile>> tiles;
+                    std::vector<float const*> layers;
+                    for(mi::Uint32 layer = 0; layer < job.layers; ++layer) {
+                        tiles.emplace_back(canvas->get_tile(0, 0, layer));
+                        layers.push_back(static_cast<float const*>(
+                            tiles.back()->get_data()));
+                    }
+
+                    void* ptr;
+                    checkCudaError(
+                        cuMemAllocHost(&ptr, job.size * sizeof(float)));
+                    job.staging.reset(static_cast<float*>(ptr));
+                    convertTexture(layers.data(), job.layers, job.width,
+                                   job.height, job.gamma, job.levels,
+                                   job.staging.get());
+                }
+                BUS_TRACE_END();
+            });
+        };
 
-        // For simplicity, the texture access functions are only implemented for
-        // float4 and gamma is pre-applied here (all images are converted to
-        // linear space).
-
-        // Convert to linear color space if necessary
-        if(texture->get_effective_gamma() != 1.0f) {
-            // Copy/convert to float4 canvas and adjust gamma from "effective
-            // gamma" to 1.
-            Handle<MDL::ICanvas> gamma_canvas(
-                image_api->convert(canvas.get(), "Color"));
-            gamma_canvas->set_gamma(texture->get_effective_gamma());
-            image_api->adjust_gamma(gamma_canvas.get(), 1.0f);
-            canvas = gamma_canvas;
-        } else if(strcmp(image_type, "Color") != 0 &&
-                  strcmp(image_type, "Float32<4>") != 0) {
-            // Convert to expected format
-            canvas = image_api->convert(canvas.get(), "Color");
+        Resource_handle<CUstream> stream(nullptr);
+        checkCudaError(cuStreamCreate(&stream.get(), CU_STREAM_NON_BLOCKING));
+        // The staging buffers are released after the uploads are finished.
+        std::vector<PinnedBuffer> uploading;
+        size_t uploadingSize = 0;
+        // The bytes of the staging buffers which are allocated or uploading.
+        size_t held = 0;
+        auto waitUpload = [&] {
+            checkCudaError(cuStreamSynchronize(stream.get()));
+            uploading.clear();
+            held -= uploadingSize;
+            uploadingSize = 0;
+        };
+        // The conversions are admitted in order by this thread, so the
+        // workers never wait for the budget and an admitted texture always
+        // finishes.
+        size_t next = 0;
+        try {
+            // Keep the order of the textures, they are referenced by index.
+            for(size_t i = 0; i < jobs.size(); ++i) {
+                while(next < jobs.size()) {
+                    size_t size = jobs[next].size * sizeof(float);
+                    if(held != 0 && held + size > stagingBudget) {
+                        if(next > i || uploading.empty())
+                            break;
+                        waitUpload();
+                        continue;
+                    }
+                    held += size;
+                    convert(jobs[next++]);
+                }
+                Texture_job& job = jobs[i];
+                job.converted.get();
+                textures.push_back(upload_texture(
+                    stream.get(), job.shape,
+                    { job.width, job.height, job.layers }, job.levels,
+                    job.staging.get()));
+                m_all_textures->push_back(textures.back());
+                job.canvas.reset();
+                uploadingSize += job.size * sizeof(float);
+                uploading.push_back(std::move(job.staging));
+            }
+            waitUpload();
+        } catch(...) {
+            // The enqueued uploads may still read the staging buffers and
+            // the admitted conversions still write the jobs.
+            for(size_t i = 0; i < next; ++i)
+                if(jobs[i].converted.valid())
+                    jobs[i].converted.wait();
+            cuStreamSynchronize(stream.get());
+            throw;
         }
+    }
+    BUS_TRACE_END();
+}
 
-        BUS_TRACE_POINT();
-
+Texture Material_gpu_context::upload_texture(
+    CUstream stream, MDL::ITarget_code::Texture_shape texture_shape,
+    Uint3 size, mi::Uint32 levels, float const* staging) {
+    BUS_TRACE_BEG() {
+        mi::Uint32 tex_width = size.x, tex_height = size.y, tex_layers = size.z;
         CUDA_RESOURCE_DESC res_desc = {};
         memset(&res_desc, 0, sizeof(res_desc));
 
         // Copy image data to GPU array depending on texture shape
-        MDL::ITarget_code::Texture_shape texture_shape =
-            code_ptx->get_texture_shape(texture_index);
         if(texture_shape == MDL::ITarget_code::Texture_shape_cube ||
            texture_shape == MDL::ITarget_code::Texture_shape_3d) {
             // Cubemap and 3D texture objects require 3D CUDA arrays
-
-            if(texture_shape == MDL::ITarget_code::Texture_shape_cube &&
-               tex_layers != 6) {
-                BUS_TRACE_THROW(std::logic_error(
-                    "Invalid number of layers (" + std::to_string(tex_layers) +
-                    "), cubemaps must have 6 layers!"));
-            }
-
-            // Allocate a 3D array on the GPU
             CUDA_ARRAY3D_DESCRIPTOR arrayDesc = {};
             arrayDesc.Width = tex_width;
             arrayDesc.Height = tex_height;
@@ -579,44 +663,28 @@ void Material_gpu_context::prepare_texture(MDL::ITransaction* transaction,
             arrayDesc.NumChannels = 4;
             CUarray device_tex_array;
             checkCudaError(cuArray3DCreate(&device_tex_array, &arrayDesc));
+            m_all_texture_arrays->push_back(device_tex_array);
 
             BUS_TRACE_POINT();
 
-            // Prepare the memcpy parameter structure
+            // The layers are consecutive in the staging buffer.
             CUDA_MEMCPY3D copy_params = {};
             memset(&copy_params, 0, sizeof(copy_params));
+            copy_params.srcMemoryType = CU_MEMORYTYPE_HOST;
+            copy_params.srcHost = staging;
+            copy_params.srcPitch = tex_width * sizeof(float) * 4;
+            copy_params.srcHeight = tex_height;
+            copy_params.dstMemoryType = CU_MEMORYTYPE_ARRAY;
             copy_params.dstArray = device_tex_array;
             copy_params.WidthInBytes = tex_width * 4 * sizeof(float);
             copy_params.Height = tex_height;
-            copy_params.Depth = 1;
-            copy_params.srcMemoryType = CU_MEMORYTYPE_HOST;
-            copy_params.dstMemoryType = CU_MEMORYTYPE_ARRAY;
-
-            // Copy the image data of all layers (the layers are not
-            // consecutive in memory)
-            for(mi::Uint32 layer = 0; layer < tex_layers; ++layer) {
-                Handle<const MDL::ITile> tile(canvas->get_tile(0, 0, layer));
-                float const* data = static_cast<float const*>(tile->get_data());
-
-                /*
-                copy_params.srcPtr = make_cudaPitchedPtr(
-                    const_cast<float*>(data), tex_width * sizeof(float) * 4,
-                    tex_width, tex_height);
-                    */
-                copy_params.srcHost = data;
-                copy_params.srcPitch = tex_width * sizeof(float) * 4;
-                copy_params.dstHeight = layer;
-
-                checkCudaError(cuMemcpy3D(&copy_params));
-            }
+            copy_params.Depth = tex_layers;
+            checkCudaError(cuMemcpy3DAsync(&copy_params, stream));
 
             res_desc.resType = CU_RESOURCE_TYPE_ARRAY;
             res_desc.res.array.hArray = device_tex_array;
-
-            m_all_texture_arrays->push_back(device_tex_array);
         } else if(m_enable_derivatives) {
             // mipmapped textures use CUDA mipmapped arrays
-            mi::Uint32 num_levels = image->get_levels();
             CUDA_ARRAY3D_DESCRIPTOR arrayDesc = {};
             arrayDesc.Width = tex_width;
             arrayDesc.Height = tex_height;
@@ -626,35 +694,33 @@ void Material_gpu_context::prepare_texture(MDL::ITransaction* transaction,
             arrayDesc.NumChannels = 4;
             CUmipmappedArray device_tex_miparray;
             checkCudaError(cuMipmappedArrayCreate(&device_tex_miparray,
-                                                  &arrayDesc, num_levels));
+                                                  &arrayDesc, levels));
+            m_all_texture_mipmapped_arrays->push_back(device_tex_miparray);
             BUS_TRACE_POINT();
-            // create all mipmap levels and copy them to the CUDA arrays in the
-            // mipmapped array
-            Handle<mi::IArray> mipmaps(
-                image_api->create_mipmaps(canvas.get(), 1.0f));
-
-            for(mi::Uint32 level = 0; level < num_levels; ++level) {
-                Handle<MDL::ICanvas const> level_canvas;
-                if(level == 0)
-                    level_canvas = canvas;
-                else {
-                    Handle<mi::IPointer> mipmap_ptr(
-                        mipmaps->get_element<mi::IPointer>(level - 1));
-                    level_canvas = mipmap_ptr->get_pointer<MDL::ICanvas>();
-                }
+            // The levels were generated by the conversion stage.
+            mi::Uint32 width = tex_width, height = tex_height;
+            for(mi::Uint32 level = 0; level < levels; ++level) {
                 CUarray device_level_array;
                 checkCudaError(cuMipmappedArrayGetLevel(
                     &device_level_array, device_tex_miparray, level));
-                copy_canvas_to_cuda_array(device_level_array,
-                                          level_canvas.get());
+                CUDA_MEMCPY2D copyParam = {};
+                copyParam.WidthInBytes = width * 4 * sizeof(float);
+                copyParam.Height = height;
+                copyParam.srcHost = staging;
+                copyParam.srcPitch = width * 4 * sizeof(float);
+                copyParam.srcMemoryType = CU_MEMORYTYPE_HOST;
+                copyParam.dstArray = device_level_array;
+                copyParam.dstMemoryType = CU_MEMORYTYPE_ARRAY;
+                checkCudaError(cuMemcpy2DAsync(&copyParam, stream));
+                staging += static_cast<size_t>(width) * height * 4;
+                width = std::max(width >> 1, 1U);
+                height = std::max(height >> 1, 1U);
             }
 
             BUS_TRACE_POINT();
 
             res_desc.resType = CU_RESOURCE_TYPE_MIPMAPPED_ARRAY;
             res_desc.res.mipmap.hMipmappedArray = device_tex_miparray;
-
-            m_all_texture_mipmapped_arrays->push_back(device_tex_miparray);
         } else {
             // 2D texture objects use CUDA arrays
             CUDA_ARRAY_DESCRIPTOR arrayDesc = {};
@@ -664,15 +730,22 @@ void Material_gpu_context::prepare_texture(MDL::ITransaction* transaction,
             arrayDesc.Format = CU_AD_FORMAT_FLOAT;
             CUarray device_tex_array;
             checkCudaError(cuArrayCreate(&device_tex_array, &arrayDesc));
+            m_all_texture_arrays->push_back(device_tex_array);
 
             BUS_TRACE_POINT();
 
-            copy_canvas_to_cuda_array(device_tex_array, canvas.get());
+            CUDA_MEMCPY2D copyParam = {};
+            copyParam.WidthInBytes = tex_width * 4 * sizeof(float);
+            copyParam.Height = tex_height;
+            copyParam.srcHost = staging;
+            copyParam.srcPitch = tex_width * 4 * sizeof(float);
+            copyParam.srcMemoryType = CU_MEMORYTYPE_HOST;
+            copyParam.dstArray = device_tex_array;
+            copyParam.dstMemoryType = CU_MEMORYTYPE_ARRAY;
+            checkCudaError(cuMemcpy2DAsync(&copyParam, stream));
 
             res_desc.resType = CU_RESOURCE_TYPE_ARRAY;
             res_desc.res.array.hArray = device_tex_array;
-
-            m_all_texture_arrays->push_back(device_tex_array);
         }
 
         BUS_TRACE_POINT();
@@ -721,12 +794,7 @@ void Material_gpu_context::prepare_texture(MDL::ITransaction* transaction,
                                              &tex_desc, nullptr));
         }
 
-        BUS_TRACE_POINT();
-
-        // Store texture infos in result vector
-        textures.push_back(Texture(tex_obj, tex_obj_unfilt,
-                                   { tex_width, tex_height, tex_layers }));
-        m_all_textures->push_back(textures.back());
+        return Texture(tex_obj, tex_obj_unfilt, size);
     }
     BUS_TRACE_END();
 }
@@ -958,16 +1026,14 @@ prepare_mbsdfs_part(MDL::Mbsdf_part part, Mbsdf& mbsdf_cuda_representation,
     return true;
 }
 
-void Material_gpu_context::prepare_mbsdf(MDL::ITransaction* transaction,
-                                         MDL::ITarget_code const* code_ptx,
-                                         mi::Size mbsdf_index,
-                                         std::vector<Mbsdf>& mbsdfs) {
+void Material_gpu_context::prepare_mbsdf(
+    MDL::ITransaction* transaction, CompiledMaterial::ResourceInfo const& info,
+    std::vector<Mbsdf>& mbsdfs) {
     BUS_TRACE_BEG() {
         // Get access to the texture data by the texture database name from the
-        // target code.
+        // compiled material.
         Handle<const MDL::IBsdf_measurement> mbsdf(
-            transaction->access<MDL::IBsdf_measurement>(
-                code_ptx->get_bsdf_measurement(mbsdf_index)));
+            transaction->access<MDL::IBsdf_measurement>(info.dbName.c_str()));
 
         Mbsdf mbsdf_cuda;
 
@@ -984,15 +1050,14 @@ void Material_gpu_context::prepare_mbsdf(MDL::ITransaction* transaction,
 }
 
 void Material_gpu_context::prepare_lightprofile(
-    MDL::ITransaction* transaction, MDL::ITarget_code const* code_ptx,
-    mi::Size lightprofile_index, std::vector<Lightprofile>& lightprofiles) {
+    MDL::ITransaction* transaction, CompiledMaterial::ResourceInfo const& info,
+    std::vector<Lightprofile>& lightprofiles) {
     BUS_TRACE_BEG() {
 
         // Get access to the texture data by the texture database name from the
-        // target code.
+        // compiled material.
         Handle<const MDL::ILightprofile> lprof_nr(
-            transaction->access<MDL::ILightprofile>(
-                code_ptx->get_light_profile(lightprofile_index)));
+            transaction->access<MDL::ILightprofile>(info.dbName.c_str()));
 
         Uint2 res = { lprof_nr->get_resolution_theta(),
                       lprof_nr->get_resolution_phi() };
@@ -1125,11 +1190,12 @@ void Material_gpu_context::prepare_lightprofile(
     BUS_TRACE_END();
 }
 
-// Prepare the needed target code data of the given target code.
+// Prepare the needed target code data of the given compiled material.
 void Material_gpu_context::prepare_target_code_data(
     MDL::ITransaction* transaction, MDL::IImage_api* image_api,
-    MDL::ITarget_code const* target_code,
-    std::vector<size_t> const& arg_block_indices) {
+    ThreadPool& pool, CompiledMaterial const& material,
+    std::vector<size_t> const& arg_block_indices,
+    Material_gpu_context const* shared) {
     BUS_TRACE_BEG() {
         // Target code data list may not have been retrieved already
         check_success(m_device_target_code_data_list.get() == 0);
@@ -1138,62 +1204,65 @@ void Material_gpu_context::prepare_target_code_data(
         // They are only created, if the "enable_ro_segment" backend option was
         // set to "on".
         CUdeviceptr device_ro_data = 0;
-        if(target_code->get_ro_data_segment_count() > 0) {
-            device_ro_data =
-                gpu_mem_dup(target_code->get_ro_data_segment_data(0),
-                            target_code->get_ro_data_segment_size(0));
+        if(shared)
+            device_ro_data = shared->m_device_ro_data.get();
+        else if(!material.roData.empty()) {
+            device_ro_data = gpu_mem_dup(material.roData);
+            m_device_ro_data.set(device_ro_data);
+        }
+
+        // The tables of the instance start with the tables of the class.
+        if(shared) {
+            check_success(
+                shared->m_textures.size() <= material.textures.size() &&
+                shared->m_mbsdfs.size() <= material.mbsdfs.size() &&
+                shared->m_lightprofiles.size() <=
+                    material.lightProfiles.size());
+            m_textures = shared->m_textures;
+            m_mbsdfs = shared->m_mbsdfs;
+            m_lightprofiles = shared->m_lightprofiles;
         }
 
         // Copy textures to GPU if the code has more than just the invalid
         // texture
         CUdeviceptr device_textures = 0;
-        mi::Size num_textures = target_code->get_texture_count();
+        mi::Size num_textures = material.textures.size() + 1;
         if(num_textures > 1) {
-            std::vector<Texture> textures;
-
-            // Loop over all textures skipping the first texture,
-            // which is always the invalid texture
-            for(mi::Size i = 1; i < num_textures; ++i) {
-                prepare_texture(transaction, image_api, target_code, i,
-                                textures);
-            }
+            // The first texture is always the invalid texture, which isn't
+            // stored in the compiled material.
+            std::vector<CompiledMaterial::TextureInfo> infos(
+                material.textures.begin() + m_textures.size(),
+                material.textures.end());
+            prepare_textures(transaction, image_api, pool, infos,
+                             m_textures);
 
             // Copy texture list to GPU
-            device_textures = gpu_mem_dup(textures);
+            device_textures = gpu_mem_dup(m_textures);
         }
 
         // Copy MBSDFs to GPU if the code has more than just the invalid mbsdf
         CUdeviceptr device_mbsdfs = 0;
-        mi::Size num_mbsdfs = target_code->get_bsdf_measurement_count();
+        mi::Size num_mbsdfs = material.mbsdfs.size() + 1;
         if(num_mbsdfs > 1) {
-            std::vector<Mbsdf> mbsdfs;
-
-            // Loop over all mbsdfs skipping the first mbsdf,
-            // which is always the invalid mbsdf
-            for(mi::Size i = 1; i < num_mbsdfs; ++i) {
-                prepare_mbsdf(transaction, target_code, i, mbsdfs);
-            }
+            for(size_t i = m_mbsdfs.size(); i < material.mbsdfs.size(); ++i)
+                prepare_mbsdf(transaction, material.mbsdfs[i], m_mbsdfs);
 
             // Copy mbsdf list to GPU
-            device_mbsdfs = gpu_mem_dup(mbsdfs);
+            device_mbsdfs = gpu_mem_dup(m_mbsdfs);
         }
 
         // Copy light profiles to GPU if the code has more than just the invalid
         // light profile
         CUdeviceptr device_lightprofiles = 0;
-        mi::Size num_lightprofiles = target_code->get_light_profile_count();
+        mi::Size num_lightprofiles = material.lightProfiles.size() + 1;
         if(num_lightprofiles > 1) {
-            std::vector<Lightprofile> lightprofiles;
-
-            // Loop over all profiles skipping the first profile,
-            // which is always the invalid profile
-            for(mi::Size i = 1; i < num_lightprofiles; ++i) {
-                prepare_lightprofile(transaction, target_code, i,
-                                     lightprofiles);
-            }
+            for(size_t i = m_lightprofiles.size();
+                i < material.lightProfiles.size(); ++i)
+                prepare_lightprofile(transaction, material.lightProfiles[i],
+                                     m_lightprofiles);
 
             // Copy light profile list to GPU
-            device_lightprofiles = gpu_mem_dup(lightprofiles);
+            device_lightprofiles = gpu_mem_dup(m_lightprofiles);
         }
 
         (*m_target_code_data_list)
@@ -1201,17 +1270,9 @@ void Material_gpu_context::prepare_target_code_data(
                 num_textures, device_textures, num_mbsdfs, device_mbsdfs,
                 num_lightprofiles, device_lightprofiles, device_ro_data));
 
-        for(mi::Size i = 0, num = target_code->get_argument_block_count();
-            i < num; ++i) {
-            Handle<MDL::ITarget_argument_block const> arg_block(
-                target_code->get_argument_block(i));
-            CUdeviceptr dev_block =
-                gpu_mem_dup(arg_block->get_data(), arg_block->get_size());
+        for(auto&& block : material.argBlocks) {
+            CUdeviceptr dev_block = gpu_mem_dup(block.data(), block.size());
             m_target_argument_block_list->push_back(dev_block);
-            m_own_arg_blocks.push_back(
-                mi::base::make_handle(arg_block->clone()));
-            m_arg_block_layouts.push_back(mi::base::make_handle(
-                target_code->get_argument_block_layout(i)));
         }
 
         for(size_t arg_block_index : arg_block_indices) {
@@ -1221,18 +1282,6 @@ void Material_gpu_context::prepare_target_code_data(
     BUS_TRACE_END();
 }
 
-// Update the i'th target argument block on the device with the data from the
-// corresponding block returned by get_argument_block().
-void Material_gpu_context::update_device_argument_block(size_t i) {
-    CUdeviceptr device_ptr = get_device_target_argument_block(i);
-    if(device_ptr == 0)
-        return;
-
-    Handle<MDL::ITarget_argument_block> arg_block(get_argument_block(i));
-    checkCudaError(
-        cuMemcpyHtoD(device_ptr, arg_block->get_data(), arg_block->get_size()));
-}
-
 //------------------------------------------------------------------------------
 //
 // MDL material compilation code
@@ -1279,6 +1328,12 @@ public:
                          const char* base_fname,
                          bool class_compilation = false);
 
+    // Add a distribution function of a compiled material to the link unit.
+    // path is the path of the sub-expression.
+    // fname is the function name in the generated code.
+    bool add_material_df(const MDL::ICompiled_material* compiled_material,
+                         const char* path, const char* base_fname);
+
     // Add (multiple) MDL distribution function and expressions of a material to
     // this link unit. For each distribution function it results in four
     // functions, suffixed with \c "_init", \c "_sample", \c "_evaluate", and \c
@@ -1571,6 +1626,19 @@ bool Material_compiler::add_material_df(const std::string& material_name,
     return desc.return_code == 0;
 }
 
+// Add a distribution function of a compiled material to the link unit.
+bool Material_compiler::add_material_df(
+    const MDL::ICompiled_material* compiled_material, const char* path,
+    const char* base_fname) {
+    MDL::Target_function_description desc;
+    desc.path = path;
+    desc.base_fname = base_fname;
+    m_link_unit->add_material(compiled_material, &desc, 1, m_context.get());
+    m_arg_block_indexes.push_back(desc.argument_block_index);
+    return m_context->get_error_messages_count() == 0 &&
+        desc.return_code == 0;
+}
+
 // Add (multiple) MDL distribution function and expressions of a material to
 // this link unit. For each distribution function it results in four functions,
 // suffixed with \c "_init", \c "_sample", \c "_evaluate", and \c "_pdf".
@@ -1614,55 +1682,575 @@ public:
     virtual std::string genPTX() = 0;
     virtual DataDesc getData() = 0;
     virtual mi::Uint32 getUsage() = 0;
+    virtual ProgramGroup& getGroup() = 0;
+};
+
+// TODO:num_texture_results,  enable_derivatives, fold_ternary_on_df
+static constexpr unsigned numTextureResults = 0;
+static constexpr bool enableDerivatives = false;
+static constexpr bool foldTernaryOnDF = false;
+
+// The generated code and resources shared by all instances of the same
+// material definition. The material is class-compiled, so the instances only
+// differ in the argument blocks.
+class MDLClass final : private Unmoveable {
+public:
+    CompiledMaterial material;
+    Material_gpu_context gpuContext;
+    // Created by the first MDLMaterial which uses this class.
+    ProgramGroup group;
+    MDLClass() : gpuContext(enableDerivatives) {}
 };
 
+// Fold the sources of the module and of all modules it imports into key, in
+// the order of the database names. Return false if a source can't be read.
+static bool hashModules(Context& context, const std::string& module,
+                        uint64_t& key) {
+    BUS_TRACE_BEG() {
+        checkMDLErrorNNG(context.compiler->load_module(
+            context.transaction, module.c_str(), context.execContext.get()));
+        const char* dbName = context.compiler->get_module_db_name(
+            context.transaction, module.c_str(), context.execContext.get());
+        check_success(dbName);
+        std::set<std::string> modules;
+        std::vector<std::string> stack{ dbName };
+        while(!stack.empty()) {
+            std::string name = std::move(stack.back());
+            stack.pop_back();
+            if(!modules.insert(name).second)
+                continue;
+            Handle<const MDL::IModule> mod(
+                context.transaction->access<MDL::IModule>(name.c_str()));
+            check_success(mod);
+            for(mi::Size i = 0; i < mod->get_import_count(); ++i)
+                stack.push_back(mod->get_import(i));
+        }
+        for(auto&& name : modules) {
+            Handle<const MDL::IModule> mod(
+                context.transaction->access<MDL::IModule>(name.c_str()));
+            key = hashString(name, key);
+            // The builtin modules have no file, they are shipped with the
+            // SDK.
+            const char* file = mod->get_filename();
+            if(file && !hashFile(file, key))
+                return false;
+        }
+        return true;
+    }
+    BUS_TRACE_END();
+}
+
+// Return false if the key can't be computed, it is treated as a cache miss.
+static bool getKey(Context& context, const std::string& module,
+                   const std::string& mat, uint64_t& key) {
+    BUS_TRACE_BEG() {
+        key = hashString(mat);
+        if(!hashModules(context, module, key))
+            return false;
+        // The arguments are stored in the argument blocks, so they don't
+        // affect the generated code.
+        std::stringstream options;
+        options << "num_texture_spaces=1;tex_lookup_call_mode=direct_call;"
+                << "num_texture_results=" << numTextureResults
+                << ";texture_runtime_with_derivs=" << enableDerivatives
+                << ";fold_ternary_on_df=" << foldTernaryOnDF
+                << ";experimental=1;class_compilation=1;df=surface.scattering";
+        key = hashString(options.str(), key);
+        key = hashString(MI_NEURAYLIB_PRODUCT_VERSION_STRING, key);
+        return true;
+    }
+    BUS_TRACE_END();
+}
+
+// The hash of a class-compiled material covers the body and the
+// temporaries but not the arguments, so it identifies the material class.
+static std::string className(const std::string& mat,
+                             const mi::base::Uuid& hash) {
+    std::stringstream ss;
+    ss << mat << '#' << std::hex << std::uppercase << hash.m_id1 << '-'
+       << hash.m_id2 << '-' << hash.m_id3 << '-' << hash.m_id4;
+    return ss.str();
+}
+
+// Generate the code of the class of the compiled material, it is shared by
+// the instances with the same class.
+static std::shared_ptr<MDLClass>
+getClass(Context& context, const std::string& module, const std::string& mat,
+         const MDL::ICompiled_material* compiled, bool useCache) {
+    BUS_TRACE_BEG() {
+        std::string name = className(mat, compiled->get_hash());
+        std::weak_ptr<MDLClass>& ref = context.classes[name];
+        if(auto res = ref.lock())
+            return res;
+        auto res = std::make_shared<MDLClass>();
+        CompiledMaterial& material = res->material;
+        uint64_t key = 0;
+        fs::path cacheFile;
+        bool hit = false;
+        if(useCache && !getKey(context, module, name, key)) {
+            context.reporter.apply(ReportLevel::Warning,
+                                   "Can't read the sources of " + mat +
+                                       ", skip the cache.",
+                                   BUS_DEFSRCLOC());
+            useCache = false;
+        }
+        if(useCache) {
+            std::stringstream ss;
+            ss << std::hex << std::uppercase << key << ".mdlc";
+            cacheFile = context.cachePath / ss.str();
+            hit = loadCompiledMaterial(cacheFile, key, material);
+        }
+        if(hit) {
+            context.reporter.apply(ReportLevel::Debug,
+                                   "Load " + mat + " from the cache.",
+                                   BUS_DEFSRCLOC());
+            resolveResources(context.transaction, material);
+        } else {
+            Material_compiler compiler(context.compiler, context.factory,
+                                       context.transaction, numTextureResults,
+                                       enableDerivatives, foldTernaryOnDF);
+            check_success(compiler.add_material_df(
+                compiled, "surface.scattering", "bsdf"));
+            Handle<const MDL::ITarget_code> code = compiler.generate_cuda_ptx();
+            check_success(code.is_valid_interface());
+            material = extractCompiledMaterial(context.transaction, code.get());
+            if(useCache) {
+                if(isCacheable(material))
+                    saveCompiledMaterial(cacheFile, key, material);
+                else
+                    context.reporter.apply(
+                        ReportLevel::Warning,
+                        mat + " uses in-memory resources and can't be cached.",
+                        BUS_DEFSRCLOC());
+            }
+        }
+        Handle<MDL::IImage_api> image_api(
+            context.neuary->get_api_component<MDL::IImage_api>());
+        std::vector<size_t> data;
+        if(material.argBlockIndex != ~mi::Size(0))
+            data.push_back(material.argBlockIndex);
+        res->gpuContext.prepare_target_code_data(
+            context.transaction, image_api.get(), context.pool, material, data);
+        ref = res;
+        return res;
+    }
+    BUS_TRACE_END();
+}
+
+static MDL::ITarget_code::Texture_shape
+getTextureShape(const MDL::IType_texture* type) {
+    switch(type->get_shape()) {
+        case MDL::IType_texture::TS_2D:
+            return MDL::ITarget_code::Texture_shape_2d;
+        case MDL::IType_texture::TS_3D:
+            return MDL::ITarget_code::Texture_shape_3d;
+        case MDL::IType_texture::TS_CUBE:
+            return MDL::ITarget_code::Texture_shape_cube;
+        case MDL::IType_texture::TS_PTEX:
+            return MDL::ITarget_code::Texture_shape_ptex;
+        default:
+            return MDL::ITarget_code::Texture_shape_invalid;
+    }
+}
+
+// Convert the argument in the config to a MDL value of the parameter type.
+static Handle<MDL::IValue> createValue(MDL::ITransaction* transaction,
+                                       MDL::IValue_factory* factory,
+                                       const MDL::IType* type,
+                                       const Config& config) {
+    BUS_TRACE_BEG() {
+        Handle<const MDL::IType> base(type->skip_all_type_aliases());
+        auto asInt = [&] {
+            return config.getType() == DataType::Float ?
+                static_cast<mi::Sint32>(config.asFloat()) :
+                static_cast<mi::Sint32>(config.asUint());
+        };
+        switch(base->get_kind()) {
+            case MDL::IType::TK_BOOL:
+                return Handle<MDL::IValue>(
+                    factory->create_bool(config.asBool()));
+            case MDL::IType::TK_INT:
+                return Handle<MDL::IValue>(factory->create_int(asInt()));
+            case MDL::IType::TK_FLOAT:
+                return Handle<MDL::IValue>(
+                    factory->create_float(config.asFloat()));
+            case MDL::IType::TK_DOUBLE:
+                return Handle<MDL::IValue>(
+                    factory->create_double(config.asFloat()));
+            case MDL::IType::TK_STRING:
+                return Handle<MDL::IValue>(
+                    factory->create_string(config.asString().c_str()));
+            case MDL::IType::TK_ENUM: {
+                Handle<const MDL::IType_enum> enumType(
+                    base->get_interface<MDL::IType_enum>());
+                mi::Size index = config.getType() == DataType::String ?
+                    enumType->find_value(config.asString().c_str()) :
+                    enumType->find_value(asInt());
+                if(index == mi::Size(-1))
+                    BUS_TRACE_THROW(std::runtime_error(
+                        "Unknown enum value " + config.path()));
+                return Handle<MDL::IValue>(
+                    factory->create_enum(enumType.get(), index));
+            }
+            case MDL::IType::TK_COLOR: {
+                Vec3 col = config.asVec3();
+                return Handle<MDL::IValue>(
+                    factory->create_color(col.x, col.y, col.z));
+            }
+            case MDL::IType::TK_VECTOR:
+            case MDL::IType::TK_MATRIX:
+            case MDL::IType::TK_ARRAY:
+            case MDL::IType::TK_STRUCT: {
+                Handle<const MDL::IType_compound> compoundType(
+                    base->get_interface<MDL::IType_compound>());
+                Handle<MDL::IValue_compound> res(
+                    factory->create<MDL::IValue_compound>(compoundType.get()));
+                auto elements = config.expand();
+                if(elements.size() != static_cast<size_t>(res->get_size()))
+                    BUS_TRACE_THROW(std::runtime_error(
+                        "Mismatched number of elements " + config.path()));
+                for(mi::Size i = 0; i < res->get_size(); ++i) {
+                    Handle<const MDL::IType> elementType(
+                        compoundType->get_component_type(i));
+                    Handle<MDL::IValue> element =
+                        createValue(transaction, factory, elementType.get(),
+                                    *elements[i]);
+                    checkMDLErrorEQ(res->set_value(i, element.get()));
+                }
+                return Handle<MDL::IValue>(
+                    res->get_interface<MDL::IValue>());
+            }
+            case MDL::IType::TK_TEXTURE: {
+                Handle<const MDL::IType_texture> texType(
+                    base->get_interface<MDL::IType_texture>());
+                // A file name or {"File":...,"Gamma":...}, the gamma 0 takes
+                // the gamma of the image file.
+                bool object = config.getType() == DataType::Object;
+                std::string file = object ?
+                    config.attribute("File")->asString() :
+                    config.asString();
+                float gamma = object ? config.getFloat("Gamma", 0.0f) : 0.0f;
+                if(!(gamma >= 0.0f))
+                    BUS_TRACE_THROW(std::runtime_error(
+                        "Need Gamma>=0 " + config.path()));
+                auto name = importTexture(transaction, file, gamma);
+                return Handle<MDL::IValue>(
+                    factory->create_texture(texType.get(), name.c_str()));
+            }
+            case MDL::IType::TK_LIGHT_PROFILE: {
+                auto name = importLightProfile(transaction, config.asString());
+                return Handle<MDL::IValue>(
+                    factory->create_light_profile(name.c_str()));
+            }
+            case MDL::IType::TK_BSDF_MEASUREMENT: {
+                auto name = importMbsdf(transaction, config.asString());
+                return Handle<MDL::IValue>(
+                    factory->create_bsdf_measurement(name.c_str()));
+            }
+            default:
+                BUS_TRACE_THROW(std::logic_error(
+                    "Unsupported argument type " + config.path()));
+        }
+    }
+    BUS_TRACE_END();
+}
+
+// Class-compile an instance with the arguments in the config, nullptr uses
+// the default arguments. Only the frontend is involved.
+static Handle<const MDL::ICompiled_material>
+compileInstance(Context& context, const std::string& mat,
+                const Config* arguments) {
+    BUS_TRACE_BEG() {
+        std::string moduleName = Material_compiler::get_module_name(mat);
+        checkMDLErrorNNG(context.compiler->load_module(
+            context.transaction, moduleName.c_str(),
+            context.execContext.get()));
+        const char* moduleDBName = context.compiler->get_module_db_name(
+            context.transaction, moduleName.c_str(),
+            context.execContext.get());
+        std::string materialDBName = std::string(moduleDBName) +
+            "::" + Material_compiler::get_material_name(mat);
+        Handle<const MDL::IMaterial_definition> definition(
+            context.transaction->access<MDL::IMaterial_definition>(
+                materialDBName.c_str()));
+        check_success(definition);
+
+        Handle<MDL::IValue_factory> valueFactory(
+            context.factory->create_value_factory(context.transaction));
+        Handle<MDL::IExpression_factory> exprFactory(
+            context.factory->create_expression_factory(context.transaction));
+        Handle<MDL::IExpression_list> args(
+            exprFactory->create_expression_list());
+        Handle<const MDL::IType_list> types(
+            definition->get_parameter_types());
+        for(mi::Size i = 0; i < definition->get_parameter_count(); ++i) {
+            const char* name = definition->get_parameter_name(i);
+            if(!arguments || !arguments->hasAttr(name))
+                continue;
+            Handle<const MDL::IType> type(types->get_type(i));
+            Handle<MDL::IValue> value =
+                createValue(context.transaction, valueFactory.get(),
+                            type.get(), *arguments->attribute(name));
+            Handle<MDL::IExpression> expr(
+                exprFactory->create_constant(value.get()));
+            checkMDLErrorEQ(args->add_expression(name, expr.get()));
+        }
+
+        mi::Sint32 result;
+        Handle<MDL::IMaterial_instance> instance(
+            definition->create_material_instance(args.get(), &result));
+        checkMDLErrorEQ(result);
+        Handle<const MDL::ICompiled_material> compiled(
+            instance->create_compiled_material(
+                MDL::IMaterial_instance::CLASS_COMPILATION,
+                context.execContext.get()));
+        check_success(compiled);
+        return compiled;
+    }
+    BUS_TRACE_END();
+}
+
+// Find the index of the resource in the resource table. The resources which
+// are not used by the class are appended to the table.
+template <typename T, typename Info>
+static mi::Uint32 findResource(std::vector<Info>& table, const char* dbName,
+                               T&& createInfo) {
+    if(!dbName)
+        return 0;
+    for(size_t i = 0; i < table.size(); ++i)
+        if(table[i].dbName == dbName)
+            return static_cast<mi::Uint32>(i + 1);
+    Info info = createInfo();
+    for(size_t i = 0; i < table.size(); ++i)
+        if(!info.file.empty() && table[i].file == info.file)
+            return static_cast<mi::Uint32>(i + 1);
+    table.push_back(info);
+    return static_cast<mi::Uint32>(table.size());
+}
+
+// Write the value into the argument block. The leaves of the layout are
+// visited in the same order as the flattened value.
+static void writeArgument(Context& context, const MDL::IValue* value,
+                          const std::vector<CompiledMaterial::ArgLeaf>& leaves,
+                          size_t& leafIdx, Data& block,
+                          CompiledMaterial& table) {
+    BUS_TRACE_BEG() {
+        MDL::IValue::Kind kind = value->get_kind();
+        switch(kind) {
+            case MDL::IValue::VK_VECTOR:
+            case MDL::IValue::VK_MATRIX:
+            case MDL::IValue::VK_COLOR:
+            case MDL::IValue::VK_ARRAY:
+            case MDL::IValue::VK_STRUCT: {
+                Handle<const MDL::IValue_compound> compound(
+                    value->get_interface<MDL::IValue_compound>());
+                for(mi::Size i = 0; i < compound->get_size(); ++i) {
+                    Handle<const MDL::IValue> element(compound->get_value(i));
+                    writeArgument(context, element.get(), leaves, leafIdx,
+                                  block, table);
+                }
+                return;
+            }
+            default:
+                break;
+        }
+        check_success(leafIdx < leaves.size());
+        const CompiledMaterial::ArgLeaf& leaf = leaves[leafIdx++];
+        check_success(leaf.kind == static_cast<mi::Uint32>(kind));
+        auto put = [&](auto val) {
+            check_success(leaf.offset + sizeof(val) <= block.size());
+            memcpy(block.data() + leaf.offset, &val, sizeof(val));
+        };
+        switch(kind) {
+            case MDL::IValue::VK_BOOL: {
+                Handle<const MDL::IValue_bool> val(
+                    value->get_interface<MDL::IValue_bool>());
+                put(static_cast<bool>(val->get_value()));
+            } break;
+            case MDL::IValue::VK_INT: {
+                Handle<const MDL::IValue_int> val(
+                    value->get_interface<MDL::IValue_int>());
+                put(val->get_value());
+            } break;
+            case MDL::IValue::VK_ENUM: {
+                Handle<const MDL::IValue_enum> val(
+                    value->get_interface<MDL::IValue_enum>());
+                put(val->get_value());
+            } break;
+            case MDL::IValue::VK_FLOAT: {
+                Handle<const MDL::IValue_float> val(
+                    value->get_interface<MDL::IValue_float>());
+                put(val->get_value());
+            } break;
+            case MDL::IValue::VK_DOUBLE: {
+                Handle<const MDL::IValue_double> val(
+                    value->get_interface<MDL::IValue_double>());
+                put(val->get_value());
+            } break;
+            case MDL::IValue::VK_TEXTURE: {
+                Handle<const MDL::IValue_texture> val(
+                    value->get_interface<MDL::IValue_texture>());
+                Handle<const MDL::IType_texture> type(val->get_type());
+                put(findResource(table.textures, val->get_value(), [&] {
+                    CompiledMaterial::TextureInfo info;
+                    info.dbName = val->get_value();
+                    Handle<const MDL::ITexture> texture(
+                        context.transaction->access<MDL::ITexture>(
+                            info.dbName.c_str()));
+                    info.gamma = texture->get_effective_gamma();
+                    Handle<const MDL::IImage> image(
+                        context.transaction->access<MDL::IImage>(
+                            texture->get_image()));
+                    const char* file = image->get_filename();
+                    info.file = file ? file : "";
+                    info.shape = getTextureShape(type.get());
+                    return info;
+                }));
+            } break;
+            case MDL::IValue::VK_LIGHT_PROFILE: {
+                Handle<const MDL::IValue_light_profile> val(
+                    value->get_interface<MDL::IValue_light_profile>());
+                put(findResource(table.lightProfiles, val->get_value(), [&] {
+                    CompiledMaterial::ResourceInfo info;
+                    info.dbName = val->get_value();
+                    Handle<const MDL::ILightprofile> profile(
+                        context.transaction->access<MDL::ILightprofile>(
+                            info.dbName.c_str()));
+                    const char* file = profile->get_filename();
+                    info.file = file ? file : "";
+                    return info;
+                }));
+            } break;
+            case MDL::IValue::VK_BSDF_MEASUREMENT: {
+                Handle<const MDL::IValue_bsdf_measurement> val(
+                    value->get_interface<MDL::IValue_bsdf_measurement>());
+                put(findResource(table.mbsdfs, val->get_value(), [&] {
+                    CompiledMaterial::ResourceInfo info;
+                    info.dbName = val->get_value();
+                    Handle<const MDL::IBsdf_measurement> mbsdf(
+                        context.transaction->access<MDL::IBsdf_measurement>(
+                            info.dbName.c_str()));
+                    const char* file = mbsdf->get_filename();
+                    info.file = file ? file : "";
+                    return info;
+                }));
+            } break;
+            case MDL::IValue::VK_STRING: {
+                // The generated code only knows the strings of the class,
+                // the index 0 is the invalid string.
+                Handle<const MDL::IValue_string> val(
+                    value->get_interface<MDL::IValue_string>());
+                std::string str = val->get_value();
+                auto beg = table.strings.begin() +
+                    std::min<size_t>(1, table.strings.size());
+                auto iter = std::find(beg, table.strings.end(), str);
+                if(iter == table.strings.end())
+                    BUS_TRACE_THROW(std::runtime_error(
+                        "The string argument \"" + str +
+                        "\" isn't a string constant of the material class."));
+                put(static_cast<mi::Uint32>(iter - table.strings.begin()));
+            } break;
+            default:
+                BUS_TRACE_THROW(std::logic_error("Unsupported argument kind " +
+                                                 std::to_string(kind)));
+        }
+    }
+    BUS_TRACE_END();
+}
+
 class MDLCUDAHelperImpl : public MDLCUDAHelper {
 private:
-    Material_compiler mCompiler;
-    Material_gpu_context mContext;
-    Handle<const MDL::ITarget_code> mCode;
+    std::shared_ptr<MDLClass> mClass;
+    // Only used by the instances which have their own arguments.
+    Buffer mArgBlock;
+    // Only used by the instances whose arguments reference resources that
+    // are not in the resource table of the class.
+    std::unique_ptr<Material_gpu_context> mContext;
 
 public:
     MDLCUDAHelperImpl(Context& context, const std::string& module,
-                      const std::string& mat)
-        // TODO:num_texture_results,  enable_derivatives, fold_ternary_on_df
-        : mCompiler(context.compiler, context.factory, context.transaction, 0,
-                    false, false),
-          mContext(false) {
+                      const std::string& mat, bool useCache,
+                      std::shared_ptr<Config> arguments) {
         BUS_TRACE_BEG() {
-            check_success(
-                mCompiler.add_material_df(mat, "surface.scattering", "bsdf"));
-            mCode = mCompiler.generate_cuda_ptx();
-            check_success(mCode.is_valid_interface());
+            // The arguments may change the class, e.g. a constant replaces
+            // a call in the defaults, so the instance is compiled first.
+            Handle<const MDL::ICompiled_material> compiled =
+                compileInstance(context, mat, arguments.get());
+            mClass = getClass(context, module, mat, compiled.get(), useCache);
+            const CompiledMaterial& material = mClass->material;
+            if(!arguments || material.argBlockIndex == ~mi::Size(0))
+                return;
+            check_success(compiled->get_parameter_count() ==
+                          material.argLayout.size());
+
+            // Only the resource tables are modified.
+            CompiledMaterial table;
+            table.textures = material.textures;
+            table.mbsdfs = material.mbsdfs;
+            table.lightProfiles = material.lightProfiles;
+            table.strings = material.strings;
+            Data block = material.argBlocks[material.argBlockIndex];
+            for(mi::Size i = 0; i < compiled->get_parameter_count(); ++i) {
+                Handle<const MDL::IValue> value(compiled->get_argument(i));
+                size_t leafIdx = 0;
+                const auto& leaves = material.argLayout[i];
+                writeArgument(context, value.get(), leaves, leafIdx, block,
+                              table);
+                check_success(leafIdx == leaves.size());
+            }
+
+            if(table.textures.size() == material.textures.size() &&
+               table.mbsdfs.size() == material.mbsdfs.size() &&
+               table.lightProfiles.size() == material.lightProfiles.size()) {
+                mArgBlock = uploadData(0, block);
+                return;
+            }
+            // Only the appended resources are prepared, the resources and
+            // the read-only data of the class are shared. mClass outlives
+            // mContext.
+            table.argBlocks.push_back(std::move(block));
+            mContext =
+                std::make_unique<Material_gpu_context>(enableDerivatives);
             Handle<MDL::IImage_api> image_api(
                 context.neuary->get_api_component<MDL::IImage_api>());
-            std::vector<size_t> data;
-            mi::Size argID =
-                mCode->get_callable_function_argument_block_index(0);
-            if(argID != ~mi::Size(0))
-                data.push_back(argID);
-            mContext.prepare_target_code_data(
-                context.transaction, image_api.get(), mCode.get(), data);
+            mContext->prepare_target_code_data(
+                context.transaction, image_api.get(), context.pool, table,
+                { 0 }, &mClass->gpuContext);
         }
         BUS_TRACE_END();
     }
     std::string genPTX() override {
-        return mCode->get_code();
+        return mClass->material.ptx;
     }
     DataDesc getData() override {
         DataDesc res;
-        // TODO:Context Singleton
-        res.argData = reinterpret_cast<char*>(
-            mContext.get_device_target_argument_block(0));
-        res.resource = mContext.get_device_target_code_data_list();
+        if(mContext) {
+            res.argData = reinterpret_cast<char*>(
+                mContext->get_device_target_argument_block(0));
+            res.resource = mContext->get_device_target_code_data_list();
+        } else {
+            res.argData = mArgBlock ?
+                reinterpret_cast<char*>(asPtr(mArgBlock)) :
+                reinterpret_cast<char*>(
+                    mClass->gpuContext.get_device_target_argument_block(
+                        mClass->material.argBlockIndex));
+            res.resource =
+                mClass->gpuContext.get_device_target_code_data_list();
+        }
         return res;
     }
     mi::Uint32 getUsage() override {
-        return mCode->get_render_state_usage();
+        return mClass->material.usage;
+    }
+    ProgramGroup& getGroup() override {
+        return mClass->group;
     }
 };
 
-std::shared_ptr<MDLCUDAHelper>
-getHelper(Context& context, const std::string& module, const std::string& mat) {
-    return std::make_shared<MDLCUDAHelperImpl>(context, module, mat);
+std::shared_ptr<MDLCUDAHelper> getHelper(Context& context,
+                                         const std::string& module,
+                                         const std::string& mat, bool useCache,
+                                         std::shared_ptr<Config> arguments) {
+    return std::make_shared<MDLCUDAHelperImpl>(context, module, mat, useCache,
+                                               arguments);
 }
@@ -1134,6 +1134,13 @@ DEVICE void __continuation_callable__sample(Payload* payload, Vec3 dir,
             (sampleF.event_type & MDL::BSDF_EVENT_TRANSMISSION ? -offset :
                                                                  offset);
         payload->hit = true;
+        // The light sampling below evaluates the diffuse lobes only.
+        payload->specular = !(sampleF.event_type & MDL::BSDF_EVENT_DIFFUSE);
+        // bsdf_over_pdf is an one sample estimation of the albedo
+        if(payload->aov) {
+            payload->aov->albedo = payload->f;
+            payload->aov->normal = ns;
+        }
     }
     // sample light
     {
@@ -1152,6 +1159,7 @@ DEVICE void __continuation_callable__sample(Payload* payload, Vec3 dir,
         bsdf_evaluate(&evalF, &mat, &resData, nullptr, data->argData);
         payload->rad =
             ls.rad * (f2vmdl(evalF.bsdf_diffuse) /*+ f2vmdl(evalF.bsdf_glossy)*/);
+        payload->lightId = ls.lightId;
         // TODO:light importance sampling
     }
 }
@@ -0,0 +1,365 @@
+#include "MDLCache.hpp"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinMaterial.MDL.Cache");
+
+// Bump it when the layout of CompiledMaterial changes.
+constexpr uint32_t cacheVersion = 3;
+
+static void flattenLayout(const MDL::ITarget_value_layout* layout,
+                          MDL::Target_value_layout_state state,
+                          std::vector<CompiledMaterial::ArgLeaf>& leaves) {
+    MDL::IValue::Kind kind;
+    mi::Size size;
+    mi::Size offset = layout->get_layout(kind, size, state);
+    switch(kind) {
+        case MDL::IValue::VK_VECTOR:
+        case MDL::IValue::VK_MATRIX:
+        case MDL::IValue::VK_COLOR:
+        case MDL::IValue::VK_ARRAY:
+        case MDL::IValue::VK_STRUCT: {
+            for(mi::Size i = 0, num = layout->get_num_elements(state); i < num;
+                ++i)
+                flattenLayout(layout, layout->get_nested_state(i, state),
+                              leaves);
+        } break;
+        default: {
+            CompiledMaterial::ArgLeaf leaf;
+            leaf.kind = static_cast<mi::Uint32>(kind);
+            leaf.offset = static_cast<mi::Uint32>(offset);
+            leaves.push_back(leaf);
+        } break;
+    }
+}
+
+CompiledMaterial extractCompiledMaterial(MDL::ITransaction* transaction,
+                                         const MDL::ITarget_code* code) {
+    BUS_TRACE_BEG() {
+        CompiledMaterial res;
+        res.ptx.assign(code->get_code(), code->get_code_size());
+        res.usage = code->get_render_state_usage();
+        res.argBlockIndex = code->get_callable_function_argument_block_index(0);
+        if(code->get_ro_data_segment_count() > 0) {
+            auto beg = reinterpret_cast<const std::byte*>(
+                code->get_ro_data_segment_data(0));
+            res.roData.assign(beg, beg + code->get_ro_data_segment_size(0));
+        }
+        for(mi::Size i = 0, num = code->get_argument_block_count(); i < num;
+            ++i) {
+            Handle<const MDL::ITarget_argument_block> block(
+                code->get_argument_block(i));
+            auto beg = reinterpret_cast<const std::byte*>(block->get_data());
+            res.argBlocks.emplace_back(beg, beg + block->get_size());
+        }
+        if(res.argBlockIndex != ~mi::Size(0)) {
+            Handle<const MDL::ITarget_value_layout> layout(
+                code->get_argument_block_layout(res.argBlockIndex));
+            for(mi::Size i = 0, num = layout->get_num_elements(); i < num;
+                ++i) {
+                res.argLayout.emplace_back();
+                flattenLayout(layout.get(), layout->get_nested_state(i),
+                              res.argLayout.back());
+            }
+        }
+        for(mi::Size i = 1; i < code->get_texture_count(); ++i) {
+            CompiledMaterial::TextureInfo info;
+            info.dbName = code->get_texture(i);
+            info.shape = code->get_texture_shape(i);
+            Handle<const MDL::ITexture> texture(
+                transaction->access<MDL::ITexture>(info.dbName.c_str()));
+            info.gamma = texture->get_effective_gamma();
+            Handle<const MDL::IImage> image(
+                transaction->access<MDL::IImage>(texture->get_image()));
+            const char* file = image->get_filename();
+            info.file = file ? file : "";
+            res.textures.push_back(info);
+        }
+        for(mi::Size i = 1; i < code->get_bsdf_measurement_count(); ++i) {
+            CompiledMaterial::ResourceInfo info;
+            info.dbName = code->get_bsdf_measurement(i);
+            Handle<const MDL::IBsdf_measurement> mbsdf(
+                transaction->access<MDL::IBsdf_measurement>(
+                    info.dbName.c_str()));
+            const char* file = mbsdf->get_filename();
+            info.file = file ? file : "";
+            res.mbsdfs.push_back(info);
+        }
+        for(mi::Size i = 1; i < code->get_light_profile_count(); ++i) {
+            CompiledMaterial::ResourceInfo info;
+            info.dbName = code->get_light_profile(i);
+            Handle<const MDL::ILightprofile> profile(
+                transaction->access<MDL::ILightprofile>(info.dbName.c_str()));
+            const char* file = profile->get_filename();
+            info.file = file ? file : "";
+            res.lightProfiles.push_back(info);
+        }
+        for(mi::Size i = 0; i < code->get_string_constant_count(); ++i) {
+            const char* str = code->get_string_constant(i);
+            res.strings.push_back(str ? str : "");
+        }
+        return res;
+    }
+    BUS_TRACE_END();
+}
+
+bool isCacheable(const CompiledMaterial& material) {
+    for(auto&& tex : material.textures)
+        if(tex.file.empty())
+            return false;
+    for(auto&& mbsdf : material.mbsdfs)
+        if(mbsdf.file.empty())
+            return false;
+    for(auto&& profile : material.lightProfiles)
+        if(profile.file.empty())
+            return false;
+    return true;
+}
+
+static std::string resourceName(const char* pre, const std::string& file,
+                                uint64_t extra = 0) {
+    std::stringstream ss;
+    ss << pre << std::hex << std::uppercase << hashString(file, extra);
+    return ss.str();
+}
+
+std::string importTexture(MDL::ITransaction* transaction,
+                          const std::string& file, float gamma) {
+    BUS_TRACE_BEG() {
+        uint64_t gammaBits = 0;
+        memcpy(&gammaBits, &gamma, sizeof(float));
+        std::string imageName = resourceName("piper_image_", file);
+        std::string texName = resourceName(
+            "piper_texture_", file, hashBytes(&gammaBits, sizeof(gammaBits)));
+        Handle<const MDL::ITexture> exist(
+            transaction->access<MDL::ITexture>(texName.c_str()));
+        if(exist)
+            return texName;
+        Handle<const MDL::IImage> existImage(
+            transaction->access<MDL::IImage>(imageName.c_str()));
+        if(!existImage) {
+            Handle<MDL::IImage> image(
+                transaction->create<MDL::IImage>("Image"));
+            checkMDLErrorEQ(image->reset_file(file.c_str()));
+            checkMDLErrorNNG(
+                transaction->store(image.get(), imageName.c_str()));
+        }
+        Handle<MDL::ITexture> texture(
+            transaction->create<MDL::ITexture>("Texture"));
+        checkMDLErrorEQ(texture->set_image(imageName.c_str()));
+        texture->set_gamma(gamma);
+        checkMDLErrorNNG(transaction->store(texture.get(), texName.c_str()));
+        return texName;
+    }
+    BUS_TRACE_END();
+}
+
+std::string importMbsdf(MDL::ITransaction* transaction,
+                        const std::string& file) {
+    BUS_TRACE_BEG() {
+        std::string name = resourceName("piper_mbsdf_", file);
+        Handle<const MDL::IBsdf_measurement> exist(
+            transaction->access<MDL::IBsdf_measurement>(name.c_str()));
+        if(!exist) {
+            Handle<MDL::IBsdf_measurement> mbsdf(
+                transaction->create<MDL::IBsdf_measurement>(
+                    "Bsdf_measurement"));
+            checkMDLErrorEQ(mbsdf->reset_file(file.c_str()));
+            checkMDLErrorNNG(transaction->store(mbsdf.get(), name.c_str()));
+        }
+        return name;
+    }
+    BUS_TRACE_END();
+}
+
+std::string importLightProfile(MDL::ITransaction* transaction,
+                               const std::string& file) {
+    BUS_TRACE_BEG() {
+        std::string name = resourceName("piper_lightprofile_", file);
+        Handle<const MDL::ILightprofile> exist(
+            transaction->access<MDL::ILightprofile>(name.c_str()));
+        if(!exist) {
+            Handle<MDL::ILightprofile> profile(
+                transaction->create<MDL::ILightprofile>("Lightprofile"));
+            checkMDLErrorEQ(profile->reset_file(file.c_str()));
+            checkMDLErrorNNG(transaction->store(profile.get(), name.c_str()));
+        }
+        return name;
+    }
+    BUS_TRACE_END();
+}
+
+void resolveResources(MDL::ITransaction* transaction,
+                      CompiledMaterial& material) {
+    BUS_TRACE_BEG() {
+        for(auto&& tex : material.textures)
+            if(tex.dbName.empty())
+                tex.dbName = importTexture(transaction, tex.file, tex.gamma);
+        for(auto&& res : material.mbsdfs)
+            if(res.dbName.empty())
+                res.dbName = importMbsdf(transaction, res.file);
+        for(auto&& res : material.lightProfiles)
+            if(res.dbName.empty())
+                res.dbName = importLightProfile(transaction, res.file);
+    }
+    BUS_TRACE_END();
+}
+
+using Stream = std::vector<std::byte>;
+
+template <typename T>
+static void write(Stream& stream, const T& val) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    auto beg = reinterpret_cast<const std::byte*>(&val);
+    stream.insert(stream.end(), beg, beg + sizeof(T));
+}
+
+static void writeBytes(Stream& stream, const void* data, size_t size) {
+    write(stream, static_cast<uint64_t>(size));
+    auto beg = static_cast<const std::byte*>(data);
+    stream.insert(stream.end(), beg, beg + size);
+}
+
+template <typename T>
+static bool read(const Stream& stream, uint64_t& offset, T& val) {
+    if(offset + sizeof(T) > stream.size())
+        return false;
+    memcpy(&val, stream.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+template <typename Container>
+static bool readBytes(const Stream& stream, uint64_t& offset, Container& res) {
+    using T = typename Container::value_type;
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint64_t size;
+    if(!read(stream, offset, size) || offset + size > stream.size() ||
+       size % sizeof(T))
+        return false;
+    res.resize(size / sizeof(T));
+    if(size)
+        memcpy(res.data(), stream.data() + offset, size);
+    offset += size;
+    return true;
+}
+
+bool loadCompiledMaterial(const fs::path& path, uint64_t key,
+                          CompiledMaterial& material) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if(!in)
+        return false;
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if(ec)
+        return false;
+    Stream stream(static_cast<size_t>(size));
+    in.read(reinterpret_cast<char*>(stream.data()), stream.size());
+    if(!in)
+        return false;
+    uint64_t offset = 0;
+    uint32_t magic, version;
+    uint64_t storedKey;
+    if(!read(stream, offset, magic) || magic != 0x434C444D ||  // MDLC
+       !read(stream, offset, version) || version != cacheVersion ||
+       !read(stream, offset, storedKey) || storedKey != key)
+        return false;
+    CompiledMaterial res;
+    uint64_t argBlockIndex, count;
+    if(!readBytes(stream, offset, res.ptx) ||
+       !read(stream, offset, res.usage) ||
+       !read(stream, offset, argBlockIndex) ||
+       !readBytes(stream, offset, res.roData) ||
+       !read(stream, offset, count))
+        return false;
+    res.argBlockIndex = static_cast<mi::Size>(argBlockIndex);
+    res.argBlocks.resize(count);
+    for(auto&& block : res.argBlocks)
+        if(!readBytes(stream, offset, block))
+            return false;
+    if(!read(stream, offset, count))
+        return false;
+    res.argLayout.resize(count);
+    for(auto&& leaves : res.argLayout)
+        if(!readBytes(stream, offset, leaves))
+            return false;
+    if(!read(stream, offset, count))
+        return false;
+    res.textures.resize(count);
+    for(auto&& tex : res.textures)
+        if(!readBytes(stream, offset, tex.file) ||
+           !read(stream, offset, tex.gamma) || !read(stream, offset, tex.shape))
+            return false;
+    for(auto* list : { &res.mbsdfs, &res.lightProfiles }) {
+        if(!read(stream, offset, count))
+            return false;
+        list->resize(count);
+        for(auto&& info : *list)
+            if(!readBytes(stream, offset, info.file))
+                return false;
+    }
+    if(!read(stream, offset, count))
+        return false;
+    res.strings.resize(count);
+    for(auto&& str : res.strings)
+        if(!readBytes(stream, offset, str))
+            return false;
+    if(offset != stream.size())
+        return false;
+    material = std::move(res);
+    return true;
+}
+
+void saveCompiledMaterial(const fs::path& path, uint64_t key,
+                          const CompiledMaterial& material) {
+    BUS_TRACE_BEG() {
+        Stream stream;
+        write(stream, static_cast<uint32_t>(0x434C444D));
+        write(stream, cacheVersion);
+        write(stream, key);
+        writeBytes(stream, material.ptx.data(), material.ptx.size());
+        write(stream, material.usage);
+        write(stream, static_cast<uint64_t>(material.argBlockIndex));
+        writeBytes(stream, material.roData.data(), material.roData.size());
+        write(stream, static_cast<uint64_t>(material.argBlocks.size()));
+        for(auto&& block : material.argBlocks)
+            writeBytes(stream, block.data(), block.size());
+        write(stream, static_cast<uint64_t>(material.argLayout.size()));
+        for(auto&& leaves : material.argLayout)
+            writeBytes(stream, leaves.data(),
+                       leaves.size() * sizeof(CompiledMaterial::ArgLeaf));
+        write(stream, static_cast<uint64_t>(material.textures.size()));
+        for(auto&& tex : material.textures) {
+            writeBytes(stream, tex.file.data(), tex.file.size());
+            write(stream, tex.gamma);
+            write(stream, tex.shape);
+        }
+        for(auto* list : { &material.mbsdfs, &material.lightProfiles }) {
+            write(stream, static_cast<uint64_t>(list->size()));
+            for(auto&& info : *list)
+                writeBytes(stream, info.file.data(), info.file.size());
+        }
+        write(stream, static_cast<uint64_t>(material.strings.size()));
+        for(auto&& str : material.strings)
+            writeBytes(stream, str.data(), str.size());
+        fs::create_directories(path.parent_path());
+        // Write to a temporary file first so that a crashed or concurrent
+        // renderer never observes a half-written entry.
+        fs::path tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::out | std::ios::binary);
+            if(!out)
+                BUS_TRACE_THROW(
+                    std::runtime_error("Failed to open " + tmp.string()));
+            out.write(reinterpret_cast<const char*>(stream.data()),
+                      stream.size());
+            if(!out)
+                BUS_TRACE_THROW(
+                    std::runtime_error("Failed to write " + tmp.string()));
+        }
+        fs::rename(tmp, path);
+    }
+    BUS_TRACE_END();
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "../../Shared/Hash.hpp"
+#include "MDLShared.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Everything the renderer needs from a generated MDL target code. It can be
+// rebuilt from a MDL::ITarget_code or loaded from the compiled-material cache,
+// so that a warm start doesn't touch the MDL backend at all.
+struct CompiledMaterial final {
+    struct TextureInfo final {
+        // Database name in the current transaction. Empty if the resource was
+        // loaded from the cache and hasn't been resolved yet.
+        std::string dbName;
+        std::string file;
+        float gamma;
+        mi::Uint32 shape;
+    };
+    struct ResourceInfo final {
+        std::string dbName;
+        std::string file;
+    };
+    // A scalar element of the argument block.
+    struct ArgLeaf final {
+        mi::Uint32 kind;  // MDL::IValue::Kind
+        mi::Uint32 offset;
+    };
+
+    std::string ptx;
+    mi::Uint32 usage;
+    // Argument block index of the first callable function.
+    mi::Size argBlockIndex;
+    std::vector<std::vector<std::byte>> argBlocks;
+    // The flattened layout of each parameter in the argument block of the
+    // callable function. Used to write the arguments of other instances of
+    // the same material class.
+    std::vector<std::vector<ArgLeaf>> argLayout;
+    std::vector<std::byte> roData;
+    // The invalid resources (index 0) are not stored.
+    std::vector<TextureInfo> textures;
+    std::vector<ResourceInfo> mbsdfs, lightProfiles;
+    // The string constants of the target code, the string arguments are
+    // stored as the indices in the argument blocks.
+    std::vector<std::string> strings;
+
+    CompiledMaterial() : usage(0), argBlockIndex(~mi::Size(0)) {}
+};
+
+// Collect the generated code and resource tables from the target code.
+CompiledMaterial extractCompiledMaterial(MDL::ITransaction* transaction,
+                                         const MDL::ITarget_code* code);
+// Resources loaded from the cache are imported into the transaction again.
+void resolveResources(MDL::ITransaction* transaction,
+                      CompiledMaterial& material);
+// Import the resource files into the transaction and return the database
+// names. The elements are reused if they have been imported.
+std::string importTexture(MDL::ITransaction* transaction,
+                          const std::string& file, float gamma);
+std::string importMbsdf(MDL::ITransaction* transaction,
+                        const std::string& file);
+std::string importLightProfile(MDL::ITransaction* transaction,
+                               const std::string& file);
+// All resources have a file name so that the material can be reloaded.
+bool isCacheable(const CompiledMaterial& material);
+
+bool loadCompiledMaterial(const fs::path& path, uint64_t key,
+                          CompiledMaterial& material);
+void saveCompiledMaterial(const fs::path& path, uint64_t key,
+                          const CompiledMaterial& material);
@@ -4,6 +4,8 @@
 #include <mi/mdl_sdk.h>
 #pragma warning(pop)
 #include <filesystem>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -37,6 +39,9 @@ MDL::INeuray* MDLInit(HMODULE& handle, const fs::path& path,
                       Bus::Reporter& reporter);
 void MDLUninit(HMODULE handle, Bus::Reporter& reporter);
 
+class MDLClass;
+class ThreadPool;
+
 struct Context final {
     Bus::Reporter& reporter;
     MDL::INeuray* neuary;
@@ -44,13 +49,22 @@ struct Context final {
     MDL::ITransaction* transaction;
     MDL::IMdl_factory* factory;
     Handle<MDL::IMdl_execution_context> execContext;
+    fs::path cachePath;
+    // Material classes shared by the instances of the same class, keyed by
+    // the material name and the hash of the class.
+    std::map<std::string, std::weak_ptr<MDLClass>>& classes;
+    // Converts the textures, shared by all materials of the plugin.
+    ThreadPool& pool;
     Context(Bus::Reporter& reporter, MDL::INeuray* neuary,
             MDL::IMdl_compiler* compiler, MDL::ITransaction* transaction,
             MDL::IMdl_factory* factory,
-            MDL::IMdl_execution_context* execContext)
+            MDL::IMdl_execution_context* execContext,
+            const fs::path& cachePath,
+            std::map<std::string, std::weak_ptr<MDLClass>>& classes,
+            ThreadPool& pool)
         : reporter(reporter), neuary(neuary), compiler(compiler),
-          transaction(transaction), factory(factory), execContext(execContext) {
-    }
+          transaction(transaction), factory(factory), execContext(execContext),
+          cachePath(cachePath), classes(classes), pool(pool) {}
     ~Context() {
         printMessages(reporter, execContext.get());
     }
@@ -0,0 +1,107 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "TextureConvert.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <chrono>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinMaterial.MDL.TextureBench");
+
+// Measure the host side conversion stage of the texture preparation. The GPU
+// and the MDL SDK are not involved.
+static int bench(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("MDLTextureBench", "MDL::MDLTextureBench");
+        opt.add_options()("w,width", "texture width",
+                          cxxopts::value<uint32_t>()->default_value("2048"))(
+            "h,height", "texture height",
+            cxxopts::value<uint32_t>()->default_value("2048"))(
+            "c,count", "texture count",
+            cxxopts::value<uint32_t>()->default_value("16"))(
+            "t,threads", "worker threads(0 for all cores)",
+            cxxopts::value<unsigned>()->default_value("0"))(
+            "g,gamma", "gamma", cxxopts::value<float>()->default_value("2.2"))(
+            "m,mipmap", "generate mipmaps")(
+            "r,repeat", "repeat times",
+            cxxopts::value<unsigned>()->default_value("3"));
+        auto res = opt.parse(argc, argv);
+        uint32_t width = res["width"].as<uint32_t>();
+        uint32_t height = res["height"].as<uint32_t>();
+        uint32_t count = res["count"].as<uint32_t>();
+        unsigned threads = res["threads"].as<unsigned>();
+        float gamma = res["gamma"].as<float>();
+        unsigned repeat = std::max(1U, res["repeat"].as<unsigned>());
+        uint32_t levels = res.count("mipmap") ? mipLevelCount(width, height) : 1;
+
+        reporter.apply(ReportLevel::Info, "Generating textures.",
+                       BUS_DEFSRCLOC());
+        std::vector<std::vector<float>> images(count);
+        {
+            std::mt19937 eng(0);
+            std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+            for(auto&& image : images) {
+                image.resize(static_cast<size_t>(width) * height * 4);
+                for(auto&& val : image)
+                    val = dis(eng);
+            }
+        }
+        size_t size = stagingSize(width, height, 1, levels);
+        std::vector<std::vector<float>> staging(count,
+                                                std::vector<float>(size));
+
+        auto run = [&](ThreadPool* pool) {
+            double best = 1e20;
+            for(unsigned i = 0; i < repeat; ++i) {
+                auto beg = std::chrono::high_resolution_clock::now();
+                auto convert = [&](size_t idx) {
+                    const float* layer = images[idx].data();
+                    convertTexture(&layer, 1, width, height, gamma, levels,
+                                   staging[idx].data());
+                };
+                if(pool)
+                    parallelFor(*pool, count, convert);
+                else
+                    for(size_t idx = 0; idx < count; ++idx)
+                        convert(idx);
+                auto end = std::chrono::high_resolution_clock::now();
+                best = std::min(
+                    best,
+                    std::chrono::duration<double, std::milli>(end - beg)
+                        .count());
+            }
+            return best;
+        };
+
+        double serial = run(nullptr);
+        ThreadPool pool(threads);
+        double parallel = run(&pool);
+        double pixels = static_cast<double>(width) * height * count;
+        std::stringstream ss;
+        ss << count << " textures " << width << "x" << height
+           << (levels > 1 ? " with mipmaps" : "") << std::endl;
+        ss << "serial: " << serial << " ms (" << pixels / serial * 1e-3
+           << " MPixel/s)" << std::endl;
+        ss << pool.size() << " threads: " << parallel << " ms ("
+           << pixels / parallel * 1e-3 << " MPixel/s), speedup "
+           << serial / parallel;
+        reporter.apply(ReportLevel::Info, ss.str(), BUS_DEFSRCLOC());
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
+class TextureBench final : public Command {
+public:
+    explicit TextureBench(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return bench(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getTextureBench(Bus::ModuleInstance& instance) {
+    return std::make_shared<TextureBench>(instance);
+}
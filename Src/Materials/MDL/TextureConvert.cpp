@@ -0,0 +1,81 @@
+#include "TextureConvert.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t size = std::max(width, height), res = 1;
+    while(size > 1) {
+        size >>= 1;
+        ++res;
+    }
+    return res;
+}
+
+size_t stagingSize(uint32_t width, uint32_t height, uint32_t layers,
+                   uint32_t levels) {
+    size_t res = static_cast<size_t>(width) * height * layers * 4;
+    for(uint32_t i = 1; i < levels; ++i) {
+        width = std::max(width >> 1, 1U);
+        height = std::max(height >> 1, 1U);
+        res += static_cast<size_t>(width) * height * 4;
+    }
+    return res;
+}
+
+void applyGamma(float* pixels, size_t pixelCount, float gamma) {
+    if(gamma == 1.0f)
+        return;
+    if(gamma == 2.0f) {
+        for(size_t i = 0; i < pixelCount; ++i)
+            for(size_t j = 0; j < 3; ++j)
+                pixels[i * 4 + j] *= pixels[i * 4 + j];
+        return;
+    }
+    for(size_t i = 0; i < pixelCount; ++i)
+        for(size_t j = 0; j < 3; ++j) {
+            float& val = pixels[i * 4 + j];
+            val = val > 0.0f ? std::pow(val, gamma) : 0.0f;
+        }
+}
+
+void downsample(const float* src, uint32_t width, uint32_t height,
+                float* dst) {
+    uint32_t dstWidth = std::max(width >> 1, 1U);
+    uint32_t dstHeight = std::max(height >> 1, 1U);
+    for(uint32_t y = 0; y < dstHeight; ++y) {
+        uint32_t y0 = std::min(y * 2, height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, height - 1);
+        const float* row0 = src + static_cast<size_t>(y0) * width * 4;
+        const float* row1 = src + static_cast<size_t>(y1) * width * 4;
+        float* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+        for(uint32_t x = 0; x < dstWidth; ++x) {
+            uint32_t x0 = std::min(x * 2, width - 1) * 4;
+            uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+            for(uint32_t c = 0; c < 4; ++c)
+                out[x * 4 + c] = 0.25f *
+                    (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] +
+                     row1[x1 + c]);
+        }
+    }
+}
+
+void convertTexture(const float* const* layers, uint32_t layerCount,
+                    uint32_t width, uint32_t height, float gamma,
+                    uint32_t levels, float* staging) {
+    size_t layerSize = static_cast<size_t>(width) * height * 4;
+    for(uint32_t i = 0; i < layerCount; ++i)
+        memcpy(staging + i * layerSize, layers[i], layerSize * sizeof(float));
+    applyGamma(staging, layerSize / 4 * layerCount, gamma);
+    if(layerCount != 1)
+        return;
+    const float* src = staging;
+    float* dst = staging + layerSize;
+    for(uint32_t i = 1; i < levels; ++i) {
+        downsample(src, width, height, dst);
+        width = std::max(width >> 1, 1U);
+        height = std::max(height >> 1, 1U);
+        src = dst;
+        dst += static_cast<size_t>(width) * height * 4;
+    }
+}
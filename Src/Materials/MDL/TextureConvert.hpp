@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// The host side conversion stage of the MDL texture preparation. All images
+// are RGBA float32, layers and mipmap levels are stored contiguously in the
+// staging buffer: [layer 0 ... layer n-1][level 1][level 2]...
+
+// floor(log2(max(width,height)))+1
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+// The number of floats in the staging buffer.
+size_t stagingSize(uint32_t width, uint32_t height, uint32_t layers,
+                   uint32_t levels);
+
+// Convert the RGB channels to linear space(x^gamma). The alpha channel isn't
+// touched.
+void applyGamma(float* pixels, size_t pixelCount, float gamma);
+// 2x2 box filter, the last row/column is repeated for odd sizes.
+void downsample(const float* src, uint32_t width, uint32_t height, float* dst);
+
+// Fill the staging buffer with the layers, the gamma correction and the
+// mipmap levels. Mipmaps are only generated for single layer textures.
+void convertTexture(const float* const* layers, uint32_t layerCount,
+                    uint32_t width, uint32_t height, float gamma,
+                    uint32_t levels, float* staging);
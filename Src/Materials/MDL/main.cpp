@@ -1,6 +1,8 @@
+#include "../../Shared/CommandAPI.hpp"
 #include "../../Shared/ConfigAPI.hpp"
 #include "../../Shared/MaterialAPI.hpp"
 #include "../../Shared/TextureSamplerAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
 #pragma warning(push, 0)
 #include "MDLShared.hpp"
 #include <optix_function_table_definition.h>
@@ -24,22 +26,26 @@ static std::string loadPTX(const fs::path& path) {
 }
 
 Context getContext(Bus::ModuleInstance& inst);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getTextureBench(Bus::ModuleInstance& instance);
 
 class MDLCUDAHelper : private Unmoveable {
 public:
     virtual std::string genPTX() = 0;
     virtual DataDesc getData() = 0;
     virtual mi::Uint32 getUsage() = 0;
+    virtual ProgramGroup& getGroup() = 0;
 };
 
-std::shared_ptr<MDLCUDAHelper>
-getHelper(Context& context, const std::string& module, const std::string& mat);
+std::shared_ptr<MDLCUDAHelper> getHelper(Context& context,
+                                         const std::string& module,
+                                         const std::string& mat, bool useCache,
+                                         std::shared_ptr<Config> arguments);
 
 // TODO:EDF
 // TODO:Automatic derivatives Support
 class MDLMaterial final : public Material {
 private:
-    ProgramGroup mGroup;
     MaterialData mData;
     std::shared_ptr<MDLCUDAHelper> mHelper;
 
@@ -52,8 +58,11 @@ public:
             materialName = moduleName + "::" + materialName;
             auto context = getContext(mInstance);
             BUS_TRACE_POINT();
-            // TODO:arguments
-            mHelper = getHelper(context, moduleName, materialName);
+            mHelper = getHelper(context, moduleName, materialName,
+                                config->getBool("Cache", true),
+                                config->hasAttr("Arguments") ?
+                                    config->attribute("Arguments") :
+                                    nullptr);
 
             // TODO:render state usage
             {
@@ -81,49 +90,56 @@ public:
                                  BUS_DEFSRCLOC());
             }
 
-            OptixProgramGroupDesc desc = {};
-            desc.flags = 0;
-            desc.kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
-            BUS_TRACE_POINT();
-            // TODO:link PTX
-            auto samplePTX = loadPTX(modulePath().parent_path() / "Kernel.ptx");
-            std::string mdlPTX = mHelper->genPTX();
-            // remove .extern
-            while(true) {
-                size_t pos = mdlPTX.find(".extern .func");
-                if(pos == mdlPTX.npos)
-                    break;
-                size_t end = mdlPTX.find(';', pos);
-                mdlPTX = mdlPTX.substr(0, pos) + mdlPTX.substr(end + 1);
-            }
-            mdlPTX = mdlPTX.substr(mdlPTX.find(".address_size") + 16);
-            auto header =
-                samplePTX.substr(0, samplePTX.find(".address_size") + 16);
-            auto funcDef = samplePTX.substr(
-                samplePTX.find(".extern .const .align 8 .b8 launchParam[16];"));
-            size_t cutPos =
-                funcDef.find(".visible .func __continuation_callable__sample");
-            auto texFunc = funcDef.substr(0, cutPos);
-            auto kernel = funcDef.substr(cutPos);
-            // BUG:doesn't support printf
-            auto finalPTX = header + '\n' + texFunc + mdlPTX + kernel;
-            // reporter().apply(ReportLevel::Debug, finalPTX, BUS_DEFSRCLOC());
-            std::hash<std::string> hasher;
-            const ModuleDesc& mod = helper->getModuleManager()->getModule(
-                BUS_DEFAULT_MODULE_NAME + std::to_string(hasher(finalPTX)),
-                [&] { return finalPTX; });
-            desc.callables.moduleCC = mod.handle.get();
-            desc.callables.entryFunctionNameCC =
-                mod.map("__continuation_callable__sample");
+            // The program group is shared by the materials of the same class.
+            ProgramGroup& sharedGroup = mHelper->getGroup();
+            if(!sharedGroup) {
+                OptixProgramGroupDesc desc = {};
+                desc.flags = 0;
+                desc.kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+                BUS_TRACE_POINT();
+                // TODO:link PTX
+                auto samplePTX =
+                    loadPTX(modulePath().parent_path() / "Kernel.ptx");
+                std::string mdlPTX = mHelper->genPTX();
+                // remove .extern
+                while(true) {
+                    size_t pos = mdlPTX.find(".extern .func");
+                    if(pos == mdlPTX.npos)
+                        break;
+                    size_t end = mdlPTX.find(';', pos);
+                    mdlPTX = mdlPTX.substr(0, pos) + mdlPTX.substr(end + 1);
+                }
+                mdlPTX = mdlPTX.substr(mdlPTX.find(".address_size") + 16);
+                auto header =
+                    samplePTX.substr(0, samplePTX.find(".address_size") + 16);
+                auto funcDef = samplePTX.substr(samplePTX.find(
+                    ".extern .const .align 8 .b8 launchParam[16];"));
+                size_t cutPos = funcDef.find(
+                    ".visible .func __continuation_callable__sample");
+                auto texFunc = funcDef.substr(0, cutPos);
+                auto kernel = funcDef.substr(cutPos);
+                // BUG:doesn't support printf
+                auto finalPTX = header + '\n' + texFunc + mdlPTX + kernel;
+                // reporter().apply(ReportLevel::Debug, finalPTX,
+                // BUS_DEFSRCLOC());
+                std::hash<std::string> hasher;
+                const ModuleDesc& mod = helper->getModuleManager()->getModule(
+                    BUS_DEFAULT_MODULE_NAME + std::to_string(hasher(finalPTX)),
+                    [&] { return finalPTX; });
+                desc.callables.moduleCC = mod.handle.get();
+                desc.callables.entryFunctionNameCC =
+                    mod.map("__continuation_callable__sample");
 
-            BUS_TRACE_POINT();
+                BUS_TRACE_POINT();
 
-            OptixProgramGroupOptions opt = {};
-            OptixProgramGroup group;
-            checkOptixError(optixProgramGroupCreate(helper->getContext(), &desc,
-                                                    1, &opt, nullptr, nullptr,
-                                                    &group));
-            mGroup.reset(group);
+                OptixProgramGroupOptions opt = {};
+                OptixProgramGroup group;
+                checkOptixError(optixProgramGroupCreate(
+                    helper->getContext(), &desc, 1, &opt, nullptr, nullptr,
+                    &group));
+                sharedGroup.reset(group);
+            }
+            OptixProgramGroup group = sharedGroup.get();
             DataDesc data = mHelper->getData();
             mData.group = group;
             mData.maxSampleDim = 4;
@@ -151,6 +167,8 @@ private:
     Handle<MDL::IScope> mScope;
     Handle<MDL::ITransaction> mTransaction;
     Handle<MDL::IMdl_factory> mFactory;
+    std::map<std::string, std::weak_ptr<MDLClass>> mClasses;
+    ThreadPool mPool;
 
 public:
     Instance(const fs::path& path, Bus::ModuleSystem& sys)
@@ -229,17 +247,22 @@ public:
     std::vector<Bus::Name> list(Bus::Name api) const override {
         if(api == Material::getInterface())
             return { "MDLMaterial" };
+        if(api == Command::getInterface())
+            return { "MDLTextureBench" };
         return {};
     }
     std::shared_ptr<Bus::ModuleFunctionBase> instantiate(Name name) override {
         if(name == "MDLMaterial")
             return std::make_shared<MDLMaterial>(*this);
+        if(name == "MDLTextureBench")
+            return getTextureBench(*this);
         return nullptr;
     }
     Context getContext() {
         return Context(getSystem().getReporter(), mNeuray.get(),
                        mCompiler.get(), mTransaction.get(), mFactory.get(),
-                       mFactory->create_execution_context());
+                       mFactory->create_execution_context(),
+                       fs::path("Cache") / "MDL", mClasses, mPool);
     }
 };
 
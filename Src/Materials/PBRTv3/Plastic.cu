@@ -33,7 +33,12 @@ DEVICE void __continuation_callable__sample(Payload* payload, Vec3 dir,
     if(lpdf >= eps)
         payload->rad =
             ls.rad * (lr.f(wo, wi) + mr.f(wo, wi)) * (absCosTheta(wi) / lpdf);
+    payload->lightId = ls.lightId;
     payload->hit = true;
+    if(payload->aov) {
+        payload->aov->albedo = Kd + Ks;
+        payload->aov->normal = ns;
+    }
 }
 
 void check(BuiltinMaterialSampleFunction = __continuation_callable__sample);
\ No newline at end of file
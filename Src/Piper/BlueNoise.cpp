@@ -0,0 +1,197 @@
+#include "BlueNoise.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+constexpr uint32_t blueNoiseMagic = 0x4D4E4250;  // PBNM
+constexpr uint32_t blueNoiseVersion = 1;
+// the neighbourhood of the energy, exp(-16/2.1^2) is negligible
+constexpr int energyRadius = 4;
+constexpr double sigmaI = 2.1, sigmaS = 1.0;
+
+struct BlueNoiseHeader final {
+    uint32_t magic, version, size, channels;
+};
+
+// The energy between the pixel p with the values vp and its neighbours.
+// The pixel q is skipped, its value is moving with p.
+static double pixelEnergy(const std::vector<double>& values, uint32_t size,
+                          uint32_t channels, uint32_t px, uint32_t py,
+                          const double* vp, uint32_t skip) {
+    double res = 0.0;
+    double power = 0.5 * channels;
+    for(int dy = -energyRadius; dy <= energyRadius; ++dy)
+        for(int dx = -energyRadius; dx <= energyRadius; ++dx) {
+            if(dx == 0 && dy == 0)
+                continue;
+            uint32_t qx = (px + size + dx) % size, qy = (py + size + dy) % size;
+            uint32_t q = qy * size + qx;
+            if(q == skip)
+                continue;
+            const double* vq =
+                values.data() + static_cast<size_t>(q) * channels;
+            double dist = 0.0;
+            for(uint32_t c = 0; c < channels; ++c)
+                dist += std::fabs(vp[c] - vq[c]);
+            res += std::exp(-(dx * dx + dy * dy) / (sigmaI * sigmaI) -
+                            std::pow(dist, power) / (sigmaS * sigmaS));
+        }
+    return res;
+}
+
+BlueNoiseMask optimizeBlueNoise(uint32_t size, uint32_t channels,
+                                uint64_t iterations, uint32_t seed) {
+    if(size < 2 * energyRadius + 1 || size > 1024 || channels == 0)
+        throw std::invalid_argument("Need 9<=size<=1024 and channels>0");
+    uint32_t pixels = size * size;
+    std::mt19937 eng(seed);
+    std::vector<double> values(static_cast<size_t>(pixels) * channels);
+    std::vector<uint32_t> order(pixels);
+    for(uint32_t c = 0; c < channels; ++c) {
+        std::iota(order.begin(), order.end(), 0U);
+        std::shuffle(order.begin(), order.end(), eng);
+        for(uint32_t i = 0; i < pixels; ++i)
+            values[static_cast<size_t>(order[i]) * channels + c] =
+                (i + 0.5) / pixels;
+    }
+
+    std::uniform_int_distribution<uint32_t> pick(0, pixels - 1);
+    std::vector<double> tmp(channels);
+    for(uint64_t it = 0; it < iterations; ++it) {
+        uint32_t p = pick(eng), q = pick(eng);
+        if(p == q)
+            continue;
+        double* vp = values.data() + static_cast<size_t>(p) * channels;
+        double* vq = values.data() + static_cast<size_t>(q) * channels;
+        uint32_t px = p % size, py = p / size, qx = q % size, qy = q / size;
+        // The pair term of p and q doesn't change by the swap.
+        double before =
+            pixelEnergy(values, size, channels, px, py, vp, q) +
+            pixelEnergy(values, size, channels, qx, qy, vq, p);
+        double after = pixelEnergy(values, size, channels, px, py, vq, q) +
+            pixelEnergy(values, size, channels, qx, qy, vp, p);
+        if(after < before) {
+            std::copy(vp, vp + channels, tmp.begin());
+            std::copy(vq, vq + channels, vp);
+            std::copy(tmp.begin(), tmp.end(), vq);
+        }
+    }
+
+    BlueNoiseMask res;
+    res.size = size;
+    res.channels = channels;
+    res.keys.resize(values.size());
+    for(size_t i = 0; i < values.size(); ++i)
+        res.keys[i] = static_cast<uint32_t>(
+            std::min(values[i] * 4294967296.0, 4294967295.0));
+    return res;
+}
+
+// The naive DFT of one channel, the tiles are small.
+static std::vector<double> powerSpectrum(const BlueNoiseMask& mask,
+                                         uint32_t channel) {
+    uint32_t size = mask.size;
+    std::vector<std::complex<double>> rows(static_cast<size_t>(size) * size);
+    std::vector<std::complex<double>> twiddle(size);
+    const double pi = 3.14159265358979323846;
+    for(uint32_t k = 0; k < size; ++k)
+        twiddle[k] = std::polar(1.0, -2.0 * pi * k / size);
+    double mean = 0.0;
+    for(uint32_t i = 0; i < size * size; ++i)
+        mean += mask.keys[static_cast<size_t>(i) * mask.channels + channel];
+    mean /= size * size;
+    for(uint32_t y = 0; y < size; ++y)
+        for(uint32_t u = 0; u < size; ++u) {
+            std::complex<double> sum = 0.0;
+            for(uint32_t x = 0; x < size; ++x) {
+                double val =
+                    mask.keys[(static_cast<size_t>(y) * size + x) *
+                                  mask.channels +
+                              channel] -
+                    mean;
+                sum += val * twiddle[(static_cast<size_t>(u) * x) % size];
+            }
+            rows[static_cast<size_t>(y) * size + u] = sum;
+        }
+    std::vector<double> res(static_cast<size_t>(size) * size);
+    for(uint32_t v = 0; v < size; ++v)
+        for(uint32_t u = 0; u < size; ++u) {
+            std::complex<double> sum = 0.0;
+            for(uint32_t y = 0; y < size; ++y)
+                sum += rows[static_cast<size_t>(y) * size + u] *
+                    twiddle[(static_cast<size_t>(v) * y) % size];
+            res[static_cast<size_t>(v) * size + u] = std::norm(sum);
+        }
+    return res;
+}
+
+double lowFrequencyPower(const BlueNoiseMask& mask) {
+    uint32_t size = mask.size;
+    double res = 0.0;
+    for(uint32_t c = 0; c < mask.channels; ++c) {
+        std::vector<double> power = powerSpectrum(mask, c);
+        double low = 0.0, all = 0.0;
+        size_t lowCount = 0, allCount = 0;
+        // the radius of the highest frequency along the axes is size/2
+        double limit = 0.25 * (size / 2);
+        for(uint32_t v = 0; v < size; ++v)
+            for(uint32_t u = 0; u < size; ++u) {
+                if(u == 0 && v == 0)
+                    continue;
+                double fu = std::min(u, size - u), fv = std::min(v, size - v);
+                double val = power[static_cast<size_t>(v) * size + u];
+                all += val;
+                ++allCount;
+                if(std::sqrt(fu * fu + fv * fv) <= limit) {
+                    low += val;
+                    ++lowCount;
+                }
+            }
+        if(lowCount && all > 0.0)
+            res += (low / lowCount) / (all / allCount);
+    }
+    return res / mask.channels;
+}
+
+void saveBlueNoise(const std::filesystem::path& path,
+                   const BlueNoiseMask& mask) {
+    std::ofstream out(path, std::ios::binary);
+    BlueNoiseHeader header{ blueNoiseMagic, blueNoiseVersion, mask.size,
+                            mask.channels };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(mask.keys.data()),
+              static_cast<std::streamsize>(mask.keys.size() *
+                                           sizeof(uint32_t)));
+    if(!out)
+        throw std::runtime_error("Failed to write " + path.string());
+}
+
+BlueNoiseMask loadBlueNoise(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in)
+        throw std::runtime_error("Failed to open " + path.string());
+    BlueNoiseHeader header;
+    if(!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       header.magic != blueNoiseMagic)
+        throw std::runtime_error("Not a blue noise mask");
+    if(header.version != blueNoiseVersion)
+        throw std::runtime_error("Unsupported blue noise mask version " +
+                                 std::to_string(header.version));
+    if(header.size == 0 || header.size > 1024 || header.channels == 0 ||
+       header.channels > 64)
+        throw std::runtime_error("Corrupted blue noise mask");
+    BlueNoiseMask res;
+    res.size = header.size;
+    res.channels = header.channels;
+    res.keys.resize(static_cast<size_t>(header.size) * header.size *
+                    header.channels);
+    if(!in.read(reinterpret_cast<char*>(res.keys.data()),
+                static_cast<std::streamsize>(res.keys.size() *
+                                             sizeof(uint32_t))))
+        throw std::runtime_error("Truncated blue noise mask");
+    return res;
+}
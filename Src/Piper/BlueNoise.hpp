@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// A toroidal tile of per-pixel keys whose neighbouring pixels have distant
+// values, i.e. the keys are blue noise. keys[(y*size+x)*channels+c] is a
+// 0.32 fixed point number. Channel 0 ranks the samples of the pixel and
+// channel 1+d rotates the sample dimension d, see KernelShared.hpp. No CUDA
+// is involved.
+struct BlueNoiseMask final {
+    uint32_t size, channels;
+    std::vector<uint32_t> keys;
+};
+
+// The pixels swap their key vectors to minimize the energy of "Blue-noise
+// Dithered Sampling"(Georgiev and Fajardo 2016). Every channel starts from a
+// stratified permutation, which the swaps keep.
+BlueNoiseMask optimizeBlueNoise(uint32_t size, uint32_t channels,
+                                uint64_t iterations, uint32_t seed);
+
+// The mean power of the lowest quarter of the radial frequencies relative
+// to the mean of the whole spectrum(without DC), averaged over the channels.
+// It is about 1 for white noise and much smaller for blue noise.
+double lowFrequencyPower(const BlueNoiseMask& mask);
+
+// Throw std::runtime_error if the file is broken.
+void saveBlueNoise(const std::filesystem::path& path,
+                   const BlueNoiseMask& mask);
+BlueNoiseMask loadBlueNoise(const std::filesystem::path& path);
@@ -0,0 +1,76 @@
+#include "../Shared/CommandAPI.hpp"
+#include "BlueNoise.hpp"
+#include <chrono>
+#include <sstream>
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <cxxopts.hpp>
+#pragma warning(pop)
+
+BUS_MODULE_NAME("Piper.Builtin.BlueNoiseGen");
+
+// Optimize a blue-noise mask offline for Sampler.BlueNoise and report the
+// low frequency power of the tile against the white noise it starts from.
+static int generate(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("BlueNoiseGen", "Piper::BlueNoiseGen");
+        opt.add_options()("o,output", "output mask",
+                          cxxopts::value<fs::path>())(
+            "s,size", "tile size",
+            cxxopts::value<uint32_t>()->default_value("64"))(
+            "d,dim", "rotated sample dimensions",
+            cxxopts::value<uint32_t>()->default_value("4"))(
+            "i,iterations", "swap attempts, 128 per pixel by default",
+            cxxopts::value<uint64_t>()->default_value("0"))(
+            "seed", "random seed",
+            cxxopts::value<uint32_t>()->default_value("0"));
+        opt.parse_positional({ "output" });
+        auto res = opt.parse(argc, argv);
+        if(!res.count("output")) {
+            reporter.apply(ReportLevel::Error, "Need the output path.",
+                           BUS_DEFSRCLOC());
+            reporter.apply(ReportLevel::Info, opt.help(), BUS_DEFSRCLOC());
+            return EXIT_FAILURE;
+        }
+        uint32_t size = res["size"].as<uint32_t>();
+        // the ranking key and the rotations
+        uint32_t channels = res["dim"].as<uint32_t>() + 1;
+        uint32_t seed = res["seed"].as<uint32_t>();
+        uint64_t iterations = res["iterations"].as<uint64_t>();
+        if(iterations == 0)
+            iterations = 128ULL * size * size;
+
+        double white =
+            lowFrequencyPower(optimizeBlueNoise(size, channels, 0, seed));
+        auto beg = std::chrono::steady_clock::now();
+        BlueNoiseMask mask =
+            optimizeBlueNoise(size, channels, iterations, seed);
+        double time = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - beg)
+                          .count();
+        double blue = lowFrequencyPower(mask);
+        saveBlueNoise(res["output"].as<fs::path>(), mask);
+
+        std::stringstream ss;
+        ss << size << "x" << size << "x" << channels << " mask in " << time
+           << " s, low frequency power " << white << " -> " << blue;
+        bool ok = blue < white;
+        reporter.apply(ok ? ReportLevel::Info : ReportLevel::Error, ss.str(),
+                       BUS_DEFSRCLOC());
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    BUS_TRACE_END();
+}
+
+class BlueNoiseGen final : public Command {
+public:
+    explicit BlueNoiseGen(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return generate(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+makeBlueNoiseGen(Bus::ModuleInstance& instance) {
+    return std::make_shared<BlueNoiseGen>(instance);
+}
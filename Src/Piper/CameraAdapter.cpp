@@ -1,5 +1,6 @@
 #include "../Shared/ConfigAPI.hpp"
 #include "../Shared/PhotographerAPI.hpp"
+#include <algorithm>
 
 BUS_MODULE_NAME("Piper.Builtin.CameraAdapter");
 
@@ -7,10 +8,67 @@ BUS_MODULE_NAME("Piper.Builtin.CameraAdapter");
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/3d-viewing-pinhole-camera/how-pinhole-camera-works-part-2
 class CameraAdapter final : public Photographer {
 private:
+    struct Pose final {
+        Vec3 pos;
+        Quat posture;
+        float focalLength, fStop, focalDistance;
+    };
+
     std::shared_ptr<Camera> mImpl;
-    Vec3 mPos;
-    Quat mPosture;
-    float mFocalLength, mFStop, mFocalDistance;
+    // The keyframes are sorted by the frame index. A still camera has one
+    // keyframe at frame 0.
+    std::vector<std::pair<unsigned, Pose>> mKeyframes;
+
+    // The missing attributes are inherited from def.
+    static Pose parsePose(const std::shared_ptr<Config>& config,
+                          const Pose& def) {
+        BUS_TRACE_BEG() {
+            Pose res = def;
+            res.pos = config->getVec3("Position", def.pos);
+            res.focalLength = config->getFloat("FocalLength", def.focalLength);
+            res.fStop = config->getFloat("FStop", def.fStop);
+            res.focalDistance =
+                config->getFloat("FocalDistance", def.focalDistance);
+            if(!config->hasAttr("Posture"))
+                return res;
+            auto posture = config->attribute("Posture");
+            if(posture->getType() == DataType::Array) {
+                Vec4 q = posture->asVec4();
+                res.posture = Quat(q.x, q.y, q.z, q.w);
+            } else {
+                Vec3 lookAt = posture->attribute("LookAt")->asVec3();
+                Vec3 up = posture->attribute("Up")->asVec3();
+                res.posture = glm::quatLookAtRH(lookAt - res.pos, up);
+                res.focalDistance = config->getFloat("FocalDistance",
+                                                     length(lookAt - res.pos));
+            }
+            return res;
+        }
+        BUS_TRACE_END();
+    }
+
+    Pose interpolate(unsigned frame) const {
+        auto next = std::upper_bound(
+            mKeyframes.cbegin(), mKeyframes.cend(), frame,
+            [](unsigned lhs, const std::pair<unsigned, Pose>& rhs) {
+                return lhs < rhs.first;
+            });
+        if(next == mKeyframes.cbegin())
+            return next->second;
+        auto prev = next - 1;
+        if(next == mKeyframes.cend() || prev->first == frame)
+            return prev->second;
+        const Pose &a = prev->second, &b = next->second;
+        float t = static_cast<float>(frame - prev->first) /
+            static_cast<float>(next->first - prev->first);
+        Pose res;
+        res.pos = glm::mix(a.pos, b.pos, t);
+        res.posture = glm::slerp(a.posture, b.posture, t);
+        res.focalLength = glm::mix(a.focalLength, b.focalLength, t);
+        res.fStop = glm::mix(a.fStop, b.fStop, t);
+        res.focalDistance = glm::mix(a.focalDistance, b.focalDistance, t);
+        return res;
+    }
 
 public:
     explicit CameraAdapter(Bus::ModuleInstance& instance)
@@ -26,29 +84,47 @@ public:
                 BUS_TRACE_THROW(
                     std::runtime_error("Failed to load camera plugin " + name));
             auto res = mImpl->init(helper, ccfg);
-            mPos = config->attribute("Position")->asVec3();
-            mFocalLength = config->attribute("FocalLength")->asFloat();
-            mFStop = config->attribute("FStop")->asFloat();
-            auto posture = config->attribute("Posture");
-            if(posture->getType() == DataType::Array) {
-                Vec4 q = posture->asVec4();
-                mPosture = Quat(q.x, q.y, q.z, q.w);
-                mFocalDistance = config->attribute("FocalDistance")->asFloat();
-            } else {
-                Vec3 lookAt = posture->attribute("LookAt")->asVec3();
-                Vec3 up = posture->attribute("Up")->asVec3();
-                mPosture = glm::quatLookAtRH(lookAt - mPos, up);
-                mFocalDistance =
-                    config->getFloat("FocalDistance", length(lookAt - mPos));
+            Pose base;
+            base.pos = config->attribute("Position")->asVec3();
+            base.focalLength = config->attribute("FocalLength")->asFloat();
+            base.fStop = config->attribute("FStop")->asFloat();
+            // required by the quaternion posture only
+            base.focalDistance = 0.0f;
+            if(config->attribute("Posture")->getType() == DataType::Array)
+                base.focalDistance =
+                    config->attribute("FocalDistance")->asFloat();
+            base = parsePose(config, base);
+            mKeyframes.clear();
+            mKeyframes.emplace_back(0, base);
+            // Keyframes:[{Frame,Position,Posture,...}], a keyframe inherits
+            // the missing attributes from the previous one. The frames in
+            // between are interpolated.
+            if(config->hasAttr("Keyframes")) {
+                for(auto&& key : config->attribute("Keyframes")->expand()) {
+                    unsigned frame = key->attribute("Frame")->asUint();
+                    Pose pose = parsePose(key, mKeyframes.back().second);
+                    if(frame == 0 && mKeyframes.size() == 1)
+                        mKeyframes.front().second = pose;
+                    else if(frame <= mKeyframes.back().first)
+                        BUS_TRACE_THROW(std::logic_error(
+                            "The keyframes must be in ascending order"));
+                    else
+                        mKeyframes.emplace_back(frame, pose);
+                }
             }
             return res;
         }
         BUS_TRACE_END();
     }
 
-    Data prepareFrame(Uint2 filmSize) {
-        return mImpl->setArgs(mFocalLength, mFStop, mFocalDistance, filmSize,
-                              mPos, mPosture);
+    unsigned frameCount() const {
+        return mKeyframes.back().first + 1;
+    }
+
+    Data prepareFrame(Uint2 filmSize, unsigned frame) {
+        Pose pose = interpolate(frame);
+        return mImpl->setArgs(pose.focalLength, pose.fStop, pose.focalDistance,
+                              filmSize, pose.pos, pose.posture);
     }
 };
 
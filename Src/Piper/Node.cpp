@@ -11,6 +11,7 @@ BUS_MODULE_NAME("Piper.BuiltinGeometry.Node");
 class Node final : public Geometry {
 private:
     std::vector<std::shared_ptr<Geometry>> mChildren;
+    Mat4 mTransform;
     GeometryData mData;
     Buffer mAccelBuffer, mInstance;
 
@@ -18,8 +19,8 @@ public:
     explicit Node(Bus::ModuleInstance& instance) : Geometry(instance) {}
     void init(PluginHelper helper, std::shared_ptr<Config> cfg) override {
         BUS_TRACE_BEG() {
-            SRT transform = cfg->getTransform("Transform");
-            // TODO:pass transform to light
+            Mat4 transform = cfg->getTransform("Transform").getPointTrans();
+            mTransform = transform;
             mData = {};
             auto children = cfg->attribute("Children");
             unsigned maxH = 0;
@@ -58,7 +59,7 @@ public:
                     inst.flags = OPTIX_INSTANCE_FLAG_NONE;
                     inst.sbtOffset = 0;
                     *reinterpret_cast<glm::mat3x4*>(inst.transform) =
-                        transform.getPointTrans();
+                        transform;
                     inst.traversableHandle = child->getData().handle;
                     if(inst.traversableHandle)
                         insts.emplace_back(inst);
@@ -98,6 +99,18 @@ public:
     GeometryData getData() override {
         return mData;
     }
+    void addLights(PluginHelper helper) override {
+        BUS_TRACE_BEG() {
+            // The points are transformed as row vectors, so the inner
+            // transform is on the left.
+            Mat4 parent = helper->getTransform();
+            helper->setTransform(mTransform * parent);
+            for(auto&& child : mChildren)
+                child->addLights(helper);
+            helper->setTransform(parent);
+        }
+        BUS_TRACE_END();
+    }
 };
 
 std::shared_ptr<Bus::ModuleFunctionBase>
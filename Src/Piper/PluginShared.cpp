@@ -1,5 +1,6 @@
 #include "../Shared/PluginShared.hpp"
 #include "../Shared/ConfigAPI.hpp"
+#include "../Shared/Hash.hpp"
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
@@ -133,7 +134,12 @@ public:
     }
     const ModuleDesc& getModuleFromFile(const fs::path& file) override {
         BUS_TRACE_BEG() {
-            return getModule(file.string(), [file] { return loadStr(file); });
+            // Keyed by the content, the file may be rebuilt between the jobs
+            // of the render server.
+            std::string ptx = loadStr(file);
+            return getModule(file.string() + "@" +
+                                 std::to_string(hashString(ptx)),
+                             [&ptx] { return std::move(ptx); });
         }
         BUS_TRACE_END();
     }
@@ -152,7 +158,7 @@ class PluginHelperImpl final : public PluginHelperAPI {
 private:
     OptixDeviceContext mContext;
     Bus::ModuleSystem& mSys;
-    fs::path mScenePath;
+    fs::path mScenePath, mOutputDir;
     bool mDebug;
     std::vector<Data>& mCData;
     std::vector<Data>& mHData;
@@ -160,7 +166,8 @@ private:
     std::vector<std::shared_ptr<Light>>& mLights;
     std::unordered_map<std::string, std::shared_ptr<Asset>> mAssets;
     std::unordered_map<std::string, std::shared_ptr<Config>> mAssetConfig;
-    std::unique_ptr<ModuleManagerImpl> mModuleManager;
+    ModuleManager mModuleManager;
+    Mat4 mTransform;
 
     std::shared_ptr<Asset>
     instantiateAssetImpl(Name api, std::shared_ptr<Config> cfg) override {
@@ -195,20 +202,21 @@ private:
 public:
     PluginHelperImpl(OptixDeviceContext context, Bus::ModuleSystem& sys,
                      std::shared_ptr<Config> assCfg, const fs::path& scenePath,
-                     bool debug, const OptixModuleCompileOptions& MCO,
-                     const OptixPipelineCompileOptions& PCO,
-                     std::vector<Data>& cdata, std::vector<Data>& hdata,
+                     const fs::path& outputDir, bool debug,
+                     ModuleManager modules, std::vector<Data>& cdata,
+                     std::vector<Data>& hdata,
                      std::vector<std::shared_ptr<Light>>& lights,
                      std::set<OptixProgramGroup>& group)
-        : mContext(context), mSys(sys), mScenePath(scenePath), mDebug(debug),
-          mCData(cdata), mHData(hdata), mLights(lights), mGroups(group) {
+        : mContext(context), mSys(sys), mScenePath(scenePath),
+          mOutputDir(outputDir), mDebug(debug),
+          mCData(cdata), mHData(hdata), mLights(lights), mGroups(group),
+          mModuleManager(modules), mTransform(glm::identity<Mat4>()) {
         for(auto&& asset : assCfg->expand()) {
             mAssetConfig[asset->attribute("Name")->asString()] = asset;
         }
-        mModuleManager = std::make_unique<ModuleManagerImpl>(context, MCO, PCO);
     }
     ModuleManager getModuleManager() override {
-        return mModuleManager.get();
+        return mModuleManager;
     }
     unsigned addCallable(OptixProgramGroup group,
                          const Data& sbtData) override {
@@ -231,28 +239,43 @@ public:
     void addLight(std::shared_ptr<Light> light) override {
         mLights.push_back(light);
     }
+    Mat4 getTransform() const override {
+        return mTransform;
+    }
+    void setTransform(const Mat4& transform) override {
+        mTransform = transform;
+    }
     OptixDeviceContext getContext() const override {
         return mContext;
     }
     fs::path scenePath() const override {
         return mScenePath;
     }
+    fs::path outputPath(const fs::path& path) const override {
+        return mOutputDir / path;
+    }
     bool isDebug() const override {
         return mDebug;
     }
 };
 
+std::shared_ptr<ModuleManagerAPI>
+buildModuleManager(OptixDeviceContext context,
+                   const OptixModuleCompileOptions& MCO,
+                   const OptixPipelineCompileOptions& PCO) {
+    return std::make_shared<ModuleManagerImpl>(context, MCO, PCO);
+}
+
 std::unique_ptr<PluginHelperAPI>
 buildPluginHelper(OptixDeviceContext context, Bus::ModuleSystem& sys,
                   std::shared_ptr<Config> assCfg, const fs::path& scenePath,
-                  bool debug, const OptixModuleCompileOptions& MCO,
-                  const OptixPipelineCompileOptions& PCO,
+                  const fs::path& outputDir, bool debug, ModuleManager modules,
                   std::vector<Data>& cdata, std::vector<Data>& hdata,
                   std::vector<std::shared_ptr<Light>>& lights,
                   std::set<OptixProgramGroup>& group) {
-    return std::make_unique<PluginHelperImpl>(context, sys, assCfg, scenePath,
-                                              debug, MCO, PCO, cdata, hdata,
-                                              lights, group);
+    return std::make_unique<PluginHelperImpl>(
+        context, sys, assCfg, scenePath, outputDir, debug, modules, cdata,
+        hdata, lights, group);
 }
 
 #pragma warning(push, 0)
@@ -2,24 +2,31 @@
 #include "../Shared/ConfigAPI.hpp"
 #include "../Shared/DriverAPI.hpp"
 #include "../Shared/GeometryAPI.hpp"
+#include "../Shared/Hash.hpp"
 #include "../Shared/IntegratorAPI.hpp"
 #include "../Shared/LightAPI.hpp"
 #include "../Shared/LightSamplerAPI.hpp"
 #include "../Shared/SamplerAPI.hpp"
+#include "BlueNoise.hpp"
 #include <chrono>
+#include <fstream>
 #include <sstream>
 #pragma warning(push, 0)
 #define NOMINMAX
+#include <cxxopts.hpp>
 #include <optix_function_table_definition.h>
 #include <optix_stack_size.h>
 #include <optix_stubs.h>
 #pragma warning(pop)
 
+std::shared_ptr<ModuleManagerAPI>
+buildModuleManager(OptixDeviceContext context,
+                   const OptixModuleCompileOptions& MCO,
+                   const OptixPipelineCompileOptions& PCO);
 std::unique_ptr<PluginHelperAPI>
 buildPluginHelper(OptixDeviceContext context, Bus::ModuleSystem& sys,
                   std::shared_ptr<Config> assCfg, const fs::path& scenePath,
-                  bool debug, const OptixModuleCompileOptions& MCO,
-                  const OptixPipelineCompileOptions& PCO,
+                  const fs::path& outputDir, bool debug, ModuleManager modules,
                   std::vector<Data>& cdata, std::vector<Data>& hdata,
                   std::vector<std::shared_ptr<Light>>& lights,
                   std::set<OptixProgramGroup>& group);
@@ -93,12 +100,11 @@ struct ContextDeleter final {
 using Context = std::unique_ptr<OptixDeviceContext_t, ContextDeleter>;
 
 Context createContext(CUcontext ctx, Bus::Reporter& reporter,
-                      std::shared_ptr<Config> config) {
+                      unsigned logLevel) {
     BUS_TRACE_BEG() {
         checkOptixError(optixInit());
         OptixDeviceContextOptions opt = {};
-        opt.logCallbackLevel =
-            static_cast<int>(config->attribute("LogLevel")->asUint());
+        opt.logCallbackLevel = static_cast<int>(logLevel);
         opt.logCallbackFunction = logCallBack;
         opt.logCallbackData = &reporter;
         OptixDeviceContext context;
@@ -157,16 +163,16 @@ std::shared_ptr<Driver> loadDriver(std::shared_ptr<Config> config,
     return driver;
 }
 
-std::shared_ptr<LightSampler> loadLightSampler(std::shared_ptr<Config> config,
-                                               PluginHelper helper,
-                                               Bus::ModuleSystem& sys,
-                                               size_t lightNum,
-                                               LightSamplerData& data) {
+std::shared_ptr<LightSampler>
+loadLightSampler(std::shared_ptr<Config> config, PluginHelper helper,
+                 Bus::ModuleSystem& sys,
+                 const std::vector<std::shared_ptr<Light>>& lights,
+                 LightSamplerData& data) {
     sys.getReporter().apply(Bus::ReportLevel::Info, "Loading light sampler",
                             BUS_DEFSRCLOC());
     auto sampler = sys.instantiateByName<LightSampler>(
         config->attribute("Plugin")->asString());
-    data = sampler->init(helper, config, lightNum);
+    data = sampler->init(helper, config, lights);
     return sampler;
 }
 
@@ -182,18 +188,110 @@ std::shared_ptr<Sampler> loadSampler(std::shared_ptr<Config> config,
     return sampler;
 }
 
+// Fold the files named by the strings of the config into the key in the
+// order of the description, every file once.
+static void hashAssets(const Config& config, std::set<fs::path>& visited,
+                       uint64_t& key) {
+    switch(config.getType()) {
+        case DataType::Object:
+        case DataType::Array: {
+            for(auto&& child : config.expand())
+                hashAssets(*child, visited, key);
+        } break;
+        case DataType::String: {
+            fs::path path = config.asString();
+            std::error_code ec;
+            if(path.empty() || !fs::is_regular_file(path, ec) ||
+               !visited.insert(fs::absolute(path, ec)).second)
+                break;
+            // An unreadable asset fails the render later.
+            if(!hashFile(path, key))
+                key = hashString(path.string(), key);
+        } break;
+        default:
+            break;
+    }
+}
+
+// The description and the assets of the scene. The driver is skipped, its
+// outputs are written by the render.
+uint64_t sceneFingerprint(const fs::path& path,
+                          const std::shared_ptr<Config>& scene) {
+    std::ifstream in(path, std::ios::binary);
+    std::string data{ std::istreambuf_iterator<char>(in),
+                      std::istreambuf_iterator<char>() };
+    uint64_t key = hashString(data);
+    std::set<fs::path> visited;
+    for(auto&& attr : { "Assets", "Scene" })
+        if(scene->hasAttr(attr))
+            hashAssets(*scene->attribute(attr), visited, key);
+    return key;
+}
+
+// The contexts and the compiled modules which are kept warm between the
+// jobs of the render server. The printf FIFO can't be resized after the first
+// launch, so a change of Core.Debug rebuilds everything.
+class RenderCache final : private Unmoveable {
+private:
+    // destroyed in the reverse order
+    CUDAContext mCtx;
+    Context mContext;
+    std::shared_ptr<ModuleManagerAPI> mModules;
+    unsigned mLogLevel = 0;
+    bool mDebug = false;
+
+public:
+    void reset() {
+        mModules.reset();
+        mContext.reset();
+        mCtx.reset();
+    }
+    void prepare(Bus::Reporter& reporter, unsigned logLevel, bool debug,
+                 const OptixModuleCompileOptions& MCO,
+                 const OptixPipelineCompileOptions& PCO) {
+        BUS_TRACE_BEG() {
+            if(mCtx && mLogLevel == logLevel && mDebug == debug) {
+                checkCudaError(cuCtxSetCurrent(mCtx.get()));
+                reporter.apply(ReportLevel::Info, "Reuse the warm contexts",
+                               BUS_DEFSRCLOC());
+                return;
+            }
+            reset();
+            mCtx = createCUDAContext(reporter);
+            mContext = createContext(mCtx.get(), reporter, logLevel);
+            if(!debug) {
+                checkCudaError(cuCtxSetLimit(CU_LIMIT_PRINTF_FIFO_SIZE, 0));
+            }
+            mModules = buildModuleManager(mContext.get(), MCO, PCO);
+            mLogLevel = logLevel;
+            mDebug = debug;
+        }
+        BUS_TRACE_END();
+    }
+    OptixDeviceContext context() const {
+        return mContext.get();
+    }
+    ModuleManager modules() const {
+        return mModules.get();
+    }
+};
+
+std::shared_ptr<RenderCache> makeRenderCache() {
+    return std::make_shared<RenderCache>();
+}
+
+void resetRenderCache(RenderCache& cache) {
+    cache.reset();
+}
+
 void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
-                Bus::ModuleSystem& sys) {
+                const fs::path& outputDir, uint64_t fingerprint, bool resume,
+                Uint2 shard, Bus::ModuleSystem& sys, RenderCache& cache) {
     BUS_TRACE_BEG() {
         using Clock = std::chrono::high_resolution_clock;
         auto initTs = Clock::now();
-        CUDAContext ctx = createCUDAContext(sys.getReporter());
         auto global = config->attribute("Core");
-        Context context = createContext(ctx.get(), sys.getReporter(), global);
         bool debug = global->attribute("Debug")->asBool();
-        if(!debug) {
-            checkCudaError(cuCtxSetLimit(CU_LIMIT_PRINTF_FIFO_SIZE, 0));
-        }
 
         OptixModuleCompileOptions MCO = {};
         MCO.debugLevel = (debug ? OPTIX_COMPILE_DEBUG_LEVEL_FULL :
@@ -214,12 +312,16 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
         // TODO:customizable attribute
         PCO.numAttributeValues = 2;
         PCO.numPayloadValues = 2;
+        cache.prepare(sys.getReporter(),
+                      global->attribute("LogLevel")->asUint(), debug, MCO, PCO);
+        OptixDeviceContext context = cache.context();
         std::set<OptixProgramGroup> groups;
         std::vector<Data> callableData, hitGroupData;
         std::vector<std::shared_ptr<Light>> lights;
         std::shared_ptr<PluginHelperAPI> helper = buildPluginHelper(
-            context.get(), sys, config->attribute("Assets"), scenePath, debug,
-            MCO, PCO, callableData, hitGroupData, lights, groups);
+            context, sys, config->attribute("Assets"), scenePath, outputDir,
+            debug, cache.modules(), callableData, hitGroupData, lights,
+            groups);
 
         BUS_TRACE_POINT();
 
@@ -238,6 +340,7 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
         };
         std::shared_ptr<Geometry> root = sys.instantiate<Geometry>(nodeClass);
         root->init(helper.get(), config->attribute("Scene"));
+        root->addLights(helper.get());
         GeometryData gdata = root->getData();
         // TODO:camera space accel/light space accel for motion blur
 
@@ -252,7 +355,7 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
         LightSamplerData lsdata;
         std::shared_ptr<LightSampler> lightSampler =
             loadLightSampler(config->attribute("LightSampler"), helper.get(),
-                             sys, lights.size(), lsdata);
+                             sys, lights, lsdata);
         groups.insert(lsdata.group);
 
         // TODO:for other algorithms
@@ -264,10 +367,17 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
                        BUS_DEFSRCLOC());
         reporter.apply(ReportLevel::Info, "maxSampleDim=" + std::to_string(msd),
                        BUS_DEFSRCLOC());
+        // The dimensions beyond MaxDim are padded by hashing instead of a
+        // direct callable per dimension.
+        std::shared_ptr<Config> samplerConfig = config->attribute("Sampler");
+        unsigned ldsd = std::min(msd, samplerConfig->getUint("MaxDim", 64U));
+        if(ldsd < msd)
+            reporter.apply(ReportLevel::Info,
+                           "paddedSampleDim=" + std::to_string(msd - ldsd),
+                           BUS_DEFSRCLOC());
         SamplerData sdata;
-        std::shared_ptr<Sampler> sampler =
-            loadSampler(config->attribute("Sampler"), helper.get(), sys,
-                        ddata.size, msd, sdata);
+        std::shared_ptr<Sampler> sampler = loadSampler(
+            samplerConfig, helper.get(), sys, ddata.size, ldsd, sdata);
         groups.insert(sdata.group.begin(), sdata.group.end());
         reporter.apply(ReportLevel::Info,
                        "maxSamplePerPixel=" + std::to_string(sdata.maxSPP),
@@ -289,7 +399,7 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
         PLO.debugLevel = MCO.debugLevel;
         PLO.maxTraceDepth = 2;
         checkOptixError(
-            optixPipelineCreate(context.get(), &PCO, &PLO, linearGroup.data(),
+            optixPipelineCreate(context, &PCO, &PLO, linearGroup.data(),
                                 static_cast<unsigned>(linearGroup.size()),
                                 nullptr, nullptr, &pipe));
         Pipeline pipeline{ pipe };
@@ -345,8 +455,28 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
         LaunchParam launchParam;
         launchParam.sampleOffset = static_cast<unsigned>(SBTSlot::userOffset) +
             static_cast<unsigned>(callableData.size());
-        launchParam.lightSbtOffset = launchParam.sampleOffset + msd;
+        launchParam.sampleDims =
+            static_cast<unsigned>(sdata.sbtData.size()) - 1;
+        launchParam.lightSbtOffset =
+            launchParam.sampleOffset + launchParam.sampleDims;
         launchParam.root = gdata.handle;
+        launchParam.blueNoise = {};
+        // The blue-noise mask generated by BlueNoiseGen.
+        Buffer blueNoiseBuf;
+        std::string blueNoisePath = samplerConfig->getString("BlueNoise", "");
+        if(!blueNoisePath.empty()) {
+            BlueNoiseMask mask = loadBlueNoise(blueNoisePath);
+            blueNoiseBuf = uploadData(0, mask.keys.data(), mask.keys.size());
+            launchParam.blueNoise.keys =
+                static_cast<const unsigned*>(blueNoiseBuf.get());
+            launchParam.blueNoise.size = mask.size;
+            launchParam.blueNoise.channels = mask.channels;
+            reporter.apply(ReportLevel::Info,
+                           "Blue noise mask " + std::to_string(mask.size) +
+                               "x" + std::to_string(mask.size) + "x" +
+                               std::to_string(mask.channels),
+                           BUS_DEFSRCLOC());
+        }
 
         OptixShaderBindingTable sbt = {};
         Buffer hgBuf = uploadSBTRecords(0, hitGroupData, sbt.hitgroupRecordBase,
@@ -361,27 +491,73 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
             OptixPipeline mPipeline;
             CUdeviceptr mParam;
             Uint2 mSize;
+            uint64_t mFingerprint;
+            bool mResume;
+            Uint2 mShard;
+            Sampler& mSampler;
+            unsigned mSampleDims;
 
         public:
             DriverHelperImpl(OptixShaderBindingTable& sbt, OptixPipeline& pipe,
-                             CUdeviceptr param, Uint2 size)
-                : mSBT(sbt), mPipeline(pipe), mParam(param), mSize(size) {}
+                             CUdeviceptr param, Uint2 size,
+                             uint64_t fingerprint, bool resume, Uint2 shard,
+                             Sampler& sampler, unsigned sampleDims)
+                : mSBT(sbt), mPipeline(pipe), mParam(param), mSize(size),
+                  mFingerprint(fingerprint), mResume(resume), mShard(shard),
+                  mSampler(sampler), mSampleDims(sampleDims) {}
             void doRender(const std::function<void(OptixShaderBindingTable&)>&
                               callBack) override {
+                doRender(callBack, mSize);
+            }
+            void doRender(const std::function<void(OptixShaderBindingTable&)>&
+                              callBack,
+                          Uint2 launchSize) override {
                 BUS_TRACE_BEG() {
+                    if(launchSize.x == 0 || launchSize.y == 0)
+                        return;
                     callBack(mSBT);
                     checkCudaError(cuStreamSynchronize(0));
                     // TODO:depth dim+atomicAdd/multiAccBuffer
                     checkOptixError(optixLaunch(mPipeline, 0, mParam,
                                                 sizeof(LaunchParam), &mSBT,
-                                                mSize.x, mSize.y, 1));
+                                                launchSize.x, launchSize.y, 1));
                     checkCudaError(cuStreamSynchronize(0));
                 }
                 BUS_TRACE_END();
             }
+            void updateCallable(unsigned id, const Data& sbtData) override {
+                BUS_TRACE_BEG() {
+                    if(id >= mSBT.callablesRecordCount ||
+                       sbtData.size() > mSBT.callablesRecordStrideInBytes)
+                        BUS_TRACE_THROW(
+                            std::logic_error("Bad callable SBT record"));
+                    // The launches are synchronous, no one reads the record.
+                    checkCudaError(cuMemcpyHtoD(
+                        mSBT.callablesRecordBase +
+                            id * mSBT.callablesRecordStrideInBytes,
+                        sbtData.data(), sbtData.size()));
+                }
+                BUS_TRACE_END();
+            }
             CUstream getStream() const override {
                 return 0;
             }
+            unsigned sampleDims() const override {
+                return mSampleDims;
+            }
+            bool generateSamples(unsigned beg, unsigned end,
+                                 float* dst) override {
+                return mSampler.generateBlock(beg, end, mSampleDims, dst);
+            }
+            uint64_t fingerprint() const override {
+                return mFingerprint;
+            }
+            bool resume() const override {
+                return mResume;
+            }
+            Uint2 shard() const override {
+                return mShard;
+            }
         };
         std::vector<Data> callables(static_cast<unsigned>(SBTSlot::userOffset));
         callables[static_cast<unsigned>(SBTSlot::sampleOneLight)] =
@@ -400,7 +576,8 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
         Buffer param = uploadParam(0, launchParam);
         checkCudaError(cuStreamSynchronize(0));
         auto dHelper = std::make_unique<DriverHelperImpl>(
-            sbt, pipe, asPtr(param), ddata.size);
+            sbt, pipe, asPtr(param), ddata.size, fingerprint, resume, shard,
+            *sampler, launchParam.sampleDims);
 
         BUS_TRACE_POINT();
         reporter.apply(ReportLevel::Info, "Everything is ready.",
@@ -445,19 +622,57 @@ void renderImpl(std::shared_ptr<Config> config, const fs::path& scenePath,
     BUS_TRACE_END();
 }
 
+int renderJob(int argc, char** argv, Bus::ModuleSystem& sys,
+              RenderCache& cache) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("Renderer", "Piper::Renderer");
+        opt.add_options()("scene", "scene file", cxxopts::value<fs::path>())(
+            "resume", "continue from the last checkpoint")(
+            "shard", "render the sample range [beg,end) only",
+            cxxopts::value<std::vector<unsigned>>())(
+            "output-dir", "directory of the relative outputs",
+            cxxopts::value<fs::path>());
+        opt.parse_positional({ "scene" });
+        auto res = opt.parse(argc, argv);
+        if(!res.count("scene")) {
+            sys.getReporter().apply(ReportLevel::Error,
+                                    "Need the scene file.", BUS_DEFSRCLOC());
+            sys.getReporter().apply(ReportLevel::Info, opt.help(),
+                                    BUS_DEFSRCLOC());
+            return EXIT_FAILURE;
+        }
+        Uint2 shard{ 0, 0 };
+        if(res.count("shard")) {
+            auto range = res["shard"].as<std::vector<unsigned>>();
+            if(range.size() != 2 || range[0] >= range[1])
+                BUS_TRACE_THROW(std::invalid_argument("Need --shard beg,end"));
+            shard = Uint2{ range[0], range[1] };
+        }
+        fs::path in = res["scene"].as<fs::path>();
+        auto scene = loadScene(sys, in);
+        if(!scene)
+            BUS_TRACE_THROW(
+                std::runtime_error("Failed to load scene " + in.string()));
+        fs::path outputDir;
+        if(res.count("output-dir")) {
+            // Absolute, so that the resolved outputs are kept as they are.
+            outputDir = fs::absolute(res["output-dir"].as<fs::path>());
+            fs::create_directories(outputDir);
+        }
+        renderImpl(scene, in.parent_path(), outputDir,
+                   sceneFingerprint(in, scene), res.count("resume") != 0,
+                   shard, sys, cache);
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
 class Renderer final : public Command {
 public:
     explicit Renderer(Bus::ModuleInstance& instance) : Command(instance) {}
     int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
-        if(argc == 2) {
-            fs::path in = argv[1];
-            auto scene = loadScene(sys, in);
-            renderImpl(scene, in.parent_path(), sys);
-            return EXIT_SUCCESS;
-        }
-        sys.getReporter().apply(ReportLevel::Error, "Need two arguments.",
-                                BUS_DEFSRCLOC());
-        return EXIT_FAILURE;
+        RenderCache cache;
+        return renderJob(argc, argv, sys, cache);
     }
 };
 
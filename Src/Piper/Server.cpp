@@ -0,0 +1,253 @@
+#include "../Shared/CommandAPI.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <cxxopts.hpp>
+#pragma warning(pop)
+
+class RenderCache;
+std::shared_ptr<RenderCache> makeRenderCache();
+void resetRenderCache(RenderCache& cache);
+int renderJob(int argc, char** argv, Bus::ModuleSystem& sys,
+              RenderCache& cache);
+
+BUS_MODULE_NAME("Piper.Builtin.Server");
+
+// The message chain of a nested exception thrown by BUS_TRACE_*.
+static void describe(std::ostream& out, std::exception_ptr exc) {
+    try {
+        std::rethrow_exception(exc);
+    } catch(const std::exception& ex) {
+        out << ex.what() << std::endl;
+        try {
+            std::rethrow_if_nested(ex);
+        } catch(...) {
+            describe(out, std::current_exception());
+        }
+    } catch(const Bus::SourceLocation& src) {
+        out << src.functionName << " at " << src.srcFile << " line "
+            << src.line << " in module " << src.module << std::endl;
+        try {
+            std::rethrow_if_nested(src);
+        } catch(...) {
+            describe(out, std::current_exception());
+        }
+    } catch(...) {
+        out << "Unknown Error" << std::endl;
+    }
+}
+
+// The reporter outputs of the running job are copied into its log.
+struct JobLog final {
+    std::mutex mutex;
+    std::ofstream out;
+};
+
+static void addJobLog(Bus::Reporter& reporter, std::shared_ptr<JobLog> log) {
+    auto sink = [log](const char* pre) {
+        return [log, pre](Bus::ReportLevel, const std::string& message,
+                          const Bus::SourceLocation& srcLoc) {
+            std::lock_guard<std::mutex> guard(log->mutex);
+            if(log->out.is_open())
+                log->out << pre << "[" << srcLoc.module << "]:" << message
+                         << std::endl;
+        };
+    };
+    reporter.addAction(ReportLevel::Debug, sink("Debug"));
+    reporter.addAction(ReportLevel::Info, sink("Info"));
+    reporter.addAction(ReportLevel::Warning, sink("Warning"));
+    reporter.addAction(ReportLevel::Error, sink("Error"));
+}
+
+// Rename <name>.running to <name><ext>, the error goes to <name>.error.
+static void setStatus(const fs::path& running, const char* ext,
+                      const std::string& error) {
+    fs::path status = running;
+    if(!error.empty()) {
+        status.replace_extension(".error");
+        std::ofstream out(status);
+        out << error;
+    }
+    status.replace_extension(ext);
+    std::error_code ec;
+    fs::rename(running, status, ec);
+}
+
+// A job is a text file <name>.job in the spool directory which holds the
+// arguments of the Renderer command one per line, e.g. "scene.json" and
+// "--resume". The relative outputs and the checkpoints of the job are
+// placed in the directory <name> of the spool directory and the reporter
+// outputs go to <name>/job.log. The server claims the job by renaming it to
+// <name>.running and leaves <name>.done or <name>.failed with the error in
+// <name>.error. Creating the file "stop" in the spool directory shuts the
+// server down.
+static bool runJob(const fs::path& job, Bus::ModuleSystem& sys,
+                   RenderCache& cache, JobLog& log) {
+    BUS_TRACE_BEG() {
+        auto& reporter = sys.getReporter();
+        fs::path running = job;
+        running.replace_extension(".running");
+        std::error_code ec;
+        // Another server may share the spool directory.
+        fs::rename(job, running, ec);
+        if(ec)
+            return false;
+        reporter.apply(ReportLevel::Info, "Start job " + job.string(),
+                       BUS_DEFSRCLOC());
+
+        fs::path dir = job.parent_path() / job.stem();
+        std::vector<std::string> args{ "Renderer", "--output-dir",
+                                       dir.string() };
+        {
+            std::ifstream in(running);
+            std::string arg;
+            while(std::getline(in, arg)) {
+                if(!arg.empty() && arg.back() == '\r')
+                    arg.pop_back();
+                if(!arg.empty())
+                    args.push_back(arg);
+            }
+        }
+        std::vector<char*> argv;
+        for(auto&& arg : args)
+            argv.push_back(arg.data());
+
+        int res = EXIT_FAILURE;
+        std::stringstream error;
+        try {
+            fs::create_directories(dir);
+            {
+                std::lock_guard<std::mutex> guard(log.mutex);
+                log.out.open(dir / "job.log");
+            }
+            res = renderJob(static_cast<int>(argv.size()), argv.data(), sys,
+                            cache);
+            if(res != EXIT_SUCCESS)
+                error << "Exit code " << res << std::endl;
+        } catch(...) {
+            describe(error, std::current_exception());
+        }
+        {
+            std::lock_guard<std::mutex> guard(log.mutex);
+            log.out.close();
+        }
+
+        if(res == EXIT_SUCCESS) {
+            reporter.apply(ReportLevel::Info, "Finish job " + job.string(),
+                           BUS_DEFSRCLOC());
+            setStatus(running, ".done", "");
+        } else {
+            reporter.apply(ReportLevel::Error,
+                           "Job " + job.string() + " failed:\n" + error.str(),
+                           BUS_DEFSRCLOC());
+            setStatus(running, ".failed", error.str());
+            // The CUDA context may be broken by the failed job, the next
+            // one starts cold.
+            resetRenderCache(cache);
+        }
+        return true;
+    }
+    BUS_TRACE_END();
+}
+
+static int serve(int argc, char** argv, Bus::ModuleSystem& sys) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("Server", "Piper::Server");
+        opt.add_options()("spool", "spool directory",
+                          cxxopts::value<fs::path>())(
+            "interval", "poll interval(ms)",
+            cxxopts::value<unsigned>()->default_value("500"))(
+            "once", "exit when the spool directory is empty")(
+            "keep-running",
+            "don't fail the jobs left running, the spool directory is "
+            "shared with the running servers");
+        opt.parse_positional({ "spool" });
+        auto res = opt.parse(argc, argv);
+        if(!res.count("spool")) {
+            sys.getReporter().apply(ReportLevel::Error,
+                                    "Need the spool directory.",
+                                    BUS_DEFSRCLOC());
+            sys.getReporter().apply(ReportLevel::Info, opt.help(),
+                                    BUS_DEFSRCLOC());
+            return EXIT_FAILURE;
+        }
+        fs::path spool = res["spool"].as<fs::path>();
+        fs::create_directories(spool);
+        std::chrono::milliseconds interval{ res["interval"].as<unsigned>() };
+        bool once = res.count("once") != 0;
+        sys.getReporter().apply(ReportLevel::Info,
+                                "Serving " + spool.string(), BUS_DEFSRCLOC());
+
+        // The jobs left running by a crashed server are failed instead of
+        // requeued, they may crash the server again.
+        if(!res.count("keep-running")) {
+            std::vector<fs::path> lost;
+            for(auto&& entry : fs::directory_iterator(spool))
+                if(entry.is_regular_file() &&
+                   entry.path().extension() == ".running")
+                    lost.push_back(entry.path());
+            for(auto&& running : lost) {
+                sys.getReporter().apply(ReportLevel::Warning,
+                                        "Fail the interrupted job " +
+                                            running.string(),
+                                        BUS_DEFSRCLOC());
+                setStatus(running, ".failed",
+                          "The server stopped during the job.\n");
+            }
+        }
+
+        // The reporter can't remove the actions, so the sink outlives the
+        // command and only writes while a job is running.
+        auto log = std::make_shared<JobLog>();
+        addJobLog(sys.getReporter(), log);
+        std::shared_ptr<RenderCache> cache = makeRenderCache();
+        unsigned done = 0;
+        while(true) {
+            if(fs::exists(spool / "stop")) {
+                fs::remove(spool / "stop");
+                break;
+            }
+            std::vector<fs::path> jobs;
+            for(auto&& entry : fs::directory_iterator(spool))
+                if(entry.is_regular_file() &&
+                   entry.path().extension() == ".job")
+                    jobs.push_back(entry.path());
+            // first in, first out if the names are numbered
+            std::sort(jobs.begin(), jobs.end());
+            if(jobs.empty()) {
+                if(once)
+                    break;
+                std::this_thread::sleep_for(interval);
+                continue;
+            }
+            // Rescan after every job to pick up the stop request.
+            if(runJob(jobs.front(), sys, *cache, *log))
+                ++done;
+            else
+                std::this_thread::sleep_for(interval);
+        }
+        sys.getReporter().apply(ReportLevel::Info,
+                                std::to_string(done) + " jobs are processed",
+                                BUS_DEFSRCLOC());
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
+class Server final : public Command {
+public:
+    explicit Server(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return serve(argc, argv, sys);
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+makeServer(Bus::ModuleInstance& instance) {
+    return std::make_shared<Server>(instance);
+}
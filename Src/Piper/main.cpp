@@ -94,6 +94,10 @@ makeJsonConfig(Bus::ModuleInstance& instance);
 std::shared_ptr<Bus::ModuleFunctionBase>
 makeRenderer(Bus::ModuleInstance& instance);
 std::shared_ptr<Bus::ModuleFunctionBase>
+makeServer(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+makeBlueNoiseGen(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
 makeNode(Bus::ModuleInstance& instance);
 std::shared_ptr<Bus::ModuleFunctionBase>
 makeCameraAdapter(Bus::ModuleInstance& instance);
@@ -116,7 +120,7 @@ public:
         if(api == Config::getInterface())
             return { "JsonConfig" };
         if(api == Command::getInterface())
-            return { "Renderer" };
+            return { "Renderer", "Server", "BlueNoiseGen" };
         if(api == Geometry::getInterface())
             return { "Node" };
         if(api == Photographer::getInterface())
@@ -128,6 +132,10 @@ public:
             return makeJsonConfig(*this);
         if(name == "Renderer")
             return makeRenderer(*this);
+        if(name == "Server")
+            return makeServer(*this);
+        if(name == "BlueNoiseGen")
+            return makeBlueNoiseGen(*this);
         if(name == "Node")
             return makeNode(*this);
         if(name == "CameraAdapter")
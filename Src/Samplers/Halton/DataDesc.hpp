@@ -0,0 +1,22 @@
+#pragma once
+
+// The mapping from the pixel to the sample index. There's exactly one sample
+// per pixel in each increment.
+struct PixelMapping final {
+    unsigned p2, p3, x, y, increment;
+    float scaleX, scaleY;
+};
+
+// One dimension of HaltonTable. The scrambled radical inverse is evaluated
+// as terms lookups of lut, each of which maps the digits of powBase. lut is
+// unused for base 2, which reverses the bits.
+struct HaltonDimDesc final {
+    const unsigned* lut;
+    unsigned base, powBase, terms;
+    float scale;
+};
+
+struct HaltonInitDesc final {
+    PixelMapping mapping;
+    HaltonDimDesc dim3;
+};
@@ -0,0 +1,89 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplerBench.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "Tables.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinSampler.Halton.HaltonBench");
+
+// Evaluate the scrambled Halton sequence of HaltonTable on the host, which is
+// the same as the generated kernel(see HaltonCheck). The sample dimensions
+// start at base 5 like the SBT records, the pixel mapping isn't included.
+static int bench(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("HaltonBench", "Halton::HaltonBench");
+        opt.add_options()("d,dim", "sample dimensions",
+                          cxxopts::value<unsigned>()->default_value("8"))(
+            "n,samples", "max sample count",
+            cxxopts::value<unsigned>()->default_value("4096"))(
+            "r,replicas", "randomly rotated replicas",
+            cxxopts::value<unsigned>()->default_value("64"))(
+            "throughput", "samples for the throughput",
+            cxxopts::value<unsigned>()->default_value("262144"))(
+            "t,type", "permutation type",
+            cxxopts::value<std::string>()->default_value("Faure"))(
+            "table", "max permutation table size",
+            cxxopts::value<unsigned>()->default_value("500"))(
+            "f,format", "csv or json",
+            cxxopts::value<std::string>()->default_value("csv"))(
+            "o,output", "output file, - for the standard output",
+            cxxopts::value<std::string>()->default_value("-"));
+        auto res = opt.parse(argc, argv);
+        SamplerBenchOptions bench;
+        bench.dims = res["dim"].as<unsigned>();
+        bench.samples = res["samples"].as<unsigned>();
+        bench.replicas = res["replicas"].as<unsigned>();
+        bench.throughputSamples = res["throughput"].as<unsigned>();
+        if(bench.dims < 2 || bench.dims > 256)
+            BUS_TRACE_THROW(std::invalid_argument("Need 2<=dim<=256"));
+        unsigned maxTableSize = res["table"].as<unsigned>();
+        std::string type = res["type"].as<std::string>();
+        if(type != "Faure" && type.find(' ') == std::string::npos)
+            BUS_TRACE_THROW(std::invalid_argument(
+                "Need a seed for the random permutations"));
+
+        std::vector<unsigned> primeTable = getPrimeTable(bench.dims + 2);
+        Permutations perms = initPermutations(type, primeTable.back());
+        std::vector<unsigned> bases(primeTable.begin() + 2, primeTable.end());
+        std::vector<RadicalInverseTable> tables;
+        {
+            ThreadPool pool;
+            tables = buildTables(bases, perms, maxTableSize, &pool);
+        }
+        HostSampler sampler = [&](unsigned beg, unsigned end, unsigned dims,
+                                  float* dst) {
+            for(unsigned i = beg; i < end; ++i)
+                for(unsigned d = 0; d < dims; ++d)
+                    *dst++ = radicalInverse(tables[d], i);
+        };
+        std::vector<SamplerBenchRecord> records =
+            runSamplerBench(sampler, bench);
+
+        std::stringstream name;
+        name << "Halton/" << type << "/" << maxTableSize;
+        saveSamplerBench(res["output"].as<std::string>(),
+                         res["format"].as<std::string>(), name.str(), records);
+        reporter.apply(ReportLevel::Info,
+                       std::to_string(records.size()) + " records of " +
+                           name.str(),
+                       BUS_DEFSRCLOC());
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
+class HaltonBench final : public Command {
+public:
+    explicit HaltonBench(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return bench(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getHaltonBench(Bus::ModuleInstance& instance) {
+    return std::make_shared<HaltonBench>(instance);
+}
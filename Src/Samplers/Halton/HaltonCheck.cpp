@@ -0,0 +1,112 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplingCheck.hpp"
+#include "Tables.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <cmath>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinSampler.Halton.HaltonCheck");
+
+// The expression emitted by genCode: the LUT of the lowest digits is scaled
+// by the largest power.
+static float generatedInverse(unsigned base, const std::vector<unsigned>& perm,
+                              unsigned maxTableSize, unsigned idx) {
+    unsigned digits = 1, powBase = base;
+    while(powBase * base <= maxTableSize)
+        powBase *= base, ++digits;
+    uint64_t maxPower = powBase;
+    while(maxPower * powBase < (1ULL << 32))
+        maxPower *= powBase;
+    uint64_t power = maxPower / powBase;
+    unsigned sum = invert(base, digits, idx % powBase, perm) *
+        static_cast<unsigned>(power);
+    unsigned div = 1;
+    while(power > powBase) {
+        div *= powBase;
+        power /= powBase;
+        sum += invert(base, digits, (idx / div) % powBase, perm) *
+            static_cast<unsigned>(power);
+    }
+    sum += invert(base, digits, (idx / (div * powBase)) % powBase, perm);
+    return static_cast<float>(sum) *
+        static_cast<float>(0x1.fffffcp-1 / maxPower);
+}
+
+// Compare the tables of HaltonTable with the values of the generated Halton
+// kernel, and the parallel tables with the serial ones.
+static int check(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("HaltonCheck", "Halton::HaltonCheck");
+        opt.add_options()("d,dim", "sample dimensions",
+                          cxxopts::value<unsigned>()->default_value("256"))(
+            "t,type", "permutation type",
+            cxxopts::value<std::string>()->default_value("Faure"))(
+            "table", "max permutation table size",
+            cxxopts::value<unsigned>()->default_value("500"))(
+            "n,count", "indices per dimension",
+            cxxopts::value<unsigned>()->default_value("65536"));
+        auto res = opt.parse(argc, argv);
+        unsigned maxDim = res["dim"].as<unsigned>();
+        unsigned maxTableSize = res["table"].as<unsigned>();
+        unsigned count = res["count"].as<unsigned>();
+        std::string type = res["type"].as<std::string>();
+        if(type != "Faure" && type.find(' ') == std::string::npos)
+            BUS_TRACE_THROW(std::invalid_argument(
+                "Need a seed for the random permutations"));
+
+        std::vector<unsigned> primeTable = getPrimeTable(maxDim + 2);
+        Permutations perms = initPermutations(type, primeTable.back());
+        std::vector<unsigned> bases(primeTable.begin(), primeTable.end());
+
+        CheckLog log(reporter, BUS_DEFSRCLOC());
+        ThreadPool pool;
+        auto builds = buildSerialParallel(pool, [&](ThreadPool* p) {
+            return buildTables(bases, perms, maxTableSize, p);
+        });
+        const auto &serial = builds.serial, &parallel = builds.parallel;
+
+        for(size_t i = 0; i < bases.size(); ++i) {
+            const RadicalInverseTable &lhs = serial[i], &rhs = parallel[i];
+            if(lhs.powBase != rhs.powBase || lhs.terms != rhs.terms ||
+               lhs.scale != rhs.scale || lhs.lut != rhs.lut)
+                log.fail("The parallel table of base " +
+                         std::to_string(bases[i]) + " differs");
+        }
+        // The bit reversal of base 2 is the same code in both kernels.
+        for(size_t i = 1; i < bases.size(); ++i) {
+            unsigned base = bases[i];
+            for(unsigned idx = 0; idx < count; ++idx) {
+                // cover the high digits too
+                unsigned x = idx * 2654435761U;
+                float ref =
+                    generatedInverse(base, perms[base], maxTableSize, x);
+                float val = radicalInverse(parallel[i], x);
+                if(ref != val) {
+                    std::stringstream ss;
+                    ss << "base " << base << " index " << x << ": generated "
+                       << ref << ", table " << val;
+                    log.fail(ss.str());
+                    break;
+                }
+            }
+        }
+        return log.finish(std::to_string(bases.size()) + " bases, " +
+                          builds.summary());
+    }
+    BUS_TRACE_END();
+}
+
+class HaltonCheck final : public Command {
+public:
+    explicit HaltonCheck(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return check(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getHaltonCheck(Bus::ModuleInstance& instance) {
+    return std::make_shared<HaltonCheck>(instance);
+}
@@ -0,0 +1,130 @@
+#include "../../Shared/ConfigAPI.hpp"
+#include "../../Shared/SamplerAPI.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include "Tables.hpp"
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <optix_stubs.h>
+#pragma warning(pop)
+
+BUS_MODULE_NAME("Piper.BuiltinSampler.Halton.HaltonTable");
+
+// The Halton sampler whose kernel(Kernel.ptx) doesn't depend on the scene.
+// The permutation tables are uploaded to a device buffer and every dimension
+// is an SBT record of the same program group.
+class HaltonTable final : public Sampler {
+private:
+    ProgramGroup mInit, mSample;
+    Buffer mLUT;
+    // the host copy for the block mode, mTables[0] is base 3
+    std::vector<RadicalInverseTable> mTables;
+
+public:
+    explicit HaltonTable(Bus::ModuleInstance& instance) : Sampler(instance) {}
+    SamplerData init(PluginHelper helper, std::shared_ptr<Config> config,
+                     Uint2 size, unsigned maxDim) override {
+        BUS_TRACE_BEG() {
+            if(maxDim > 256)
+                BUS_TRACE_THROW(std::runtime_error("Need MaxDim<=256"));
+            unsigned maxTableSize = config->getUint("MaxPermTableSize", 500U);
+            if(maxTableSize > 65536)
+                BUS_TRACE_THROW(
+                    std::runtime_error("Need MaxPermTableSize<=65536"));
+            std::vector<unsigned> primeTable = getPrimeTable(maxDim + 2);
+            Permutations perms = initPermutations(
+                config->getString("Type", "Faure"), primeTable.back());
+            // base 3 is used by the pixel mapping
+            std::vector<unsigned> bases(primeTable.begin() + 1,
+                                        primeTable.end());
+            std::vector<RadicalInverseTable> tables;
+            {
+                ThreadPool pool;
+                tables = buildTables(bases, perms, maxTableSize, &pool);
+            }
+
+            std::vector<unsigned> lut;
+            std::vector<size_t> offsets;
+            for(auto&& table : tables) {
+                offsets.push_back(lut.size());
+                lut.insert(lut.end(), table.lut.begin(), table.lut.end());
+            }
+            // keep the pointers valid for the empty tables
+            lut.push_back(0);
+            mLUT = uploadData(0, lut.data(), lut.size());
+            const unsigned* base = static_cast<const unsigned*>(mLUT.get());
+            std::vector<HaltonDimDesc> dims;
+            for(size_t i = 0; i < tables.size(); ++i) {
+                HaltonDimDesc dim;
+                dim.lut = base + offsets[i];
+                dim.base = tables[i].base;
+                dim.powBase = tables[i].powBase;
+                dim.terms = tables[i].terms;
+                dim.scale = tables[i].scale;
+                dims.push_back(dim);
+            }
+
+            HaltonInitDesc data;
+            data.dim3 = dims.front();
+            SamplerData res;
+            res.maxSPP = initPixelMapping(size.x, size.y, data.mapping);
+            reporter().apply(ReportLevel::Debug,
+                             "maxSPP=" + std::to_string(res.maxSPP),
+                             BUS_DEFSRCLOC());
+
+            const ModuleDesc& mod =
+                helper->getModuleManager()->getModuleFromFile(
+                    modulePath().parent_path() / "Kernel.ptx");
+            OptixProgramGroupDesc desc[2] = {};
+            desc[0].flags = 0;
+            desc[0].kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+            desc[0].callables.moduleDC = mod.handle.get();
+            desc[0].callables.entryFunctionNameDC =
+                mod.map("__direct_callable__init");
+            desc[1].flags = 0;
+            desc[1].kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+            desc[1].callables.moduleDC = mod.handle.get();
+            desc[1].callables.entryFunctionNameDC =
+                mod.map("__direct_callable__sample");
+            OptixProgramGroup groups[2] = {};
+            OptixProgramGroupOptions opt = {};
+            checkOptixError(optixProgramGroupCreate(
+                helper->getContext(), desc, 2, &opt, nullptr, nullptr, groups));
+            mInit.reset(groups[0]);
+            mSample.reset(groups[1]);
+
+            res.sbtData.emplace_back(packSBTRecord(mInit.get(), data));
+            // dims[0] is base 3, the sample dimensions start at base 5
+            for(unsigned i = 0; i < maxDim; ++i)
+                res.sbtData.emplace_back(
+                    packSBTRecord(mSample.get(), dims[i + 1]));
+            res.group.assign(groups, groups + 2);
+            OptixStackSizes stack;
+            checkOptixError(optixProgramGroupGetStackSize(mInit.get(), &stack));
+            res.dssInit = stack.dssDC;
+            checkOptixError(
+                optixProgramGroupGetStackSize(mSample.get(), &stack));
+            res.dssSample = stack.dssDC;
+            mTables = std::move(tables);
+            return res;
+        }
+        BUS_TRACE_END();
+    }
+    bool generateBlock(unsigned beg, unsigned end, unsigned dims,
+                       float* dst) override {
+        BUS_TRACE_BEG() {
+            if(dims + 1 > mTables.size() || beg > end)
+                BUS_TRACE_THROW(std::logic_error("Bad sample block"));
+            // the raw index shared by all pixels
+            for(unsigned i = beg; i < end; ++i)
+                for(unsigned d = 0; d < dims; ++d)
+                    *dst++ = radicalInverse(mTables[d + 1], i);
+            return true;
+        }
+        BUS_TRACE_END();
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getHaltonTable(Bus::ModuleInstance& instance) {
+    return std::make_shared<HaltonTable>(instance);
+}
@@ -0,0 +1,60 @@
+#include "../../Shared/KernelShared.hpp"
+#include "DataDesc.hpp"
+
+// HaltonTable: the same sequence as the generated Halton kernel, but the
+// tables are read from the SBT records, so the module is compiled once.
+
+INLINEDEVICE float sampleBase2(unsigned idx) {
+    union Result {
+        unsigned u;
+        float f;
+    } res;
+    res.u = 0x3f800000u | (__brev(idx) >> 9);
+    return res.f - 1.0f;
+}
+
+INLINEDEVICE float sampleDim(const HaltonDimDesc& dim, unsigned idx) {
+    if(dim.base == 2)
+        return sampleBase2(idx);
+    unsigned res = 0;
+    for(unsigned i = 0; i < dim.terms; ++i) {
+        res = res * dim.powBase + dim.lut[idx % dim.powBase];
+        idx /= dim.powBase;
+    }
+    return static_cast<float>(res) * dim.scale;
+}
+
+INLINEDEVICE unsigned inverse2(unsigned index, const unsigned digits) {
+    return digits ? __brev(index) >> (32 - digits) : 0;
+}
+
+INLINEDEVICE unsigned inverse3(unsigned index, const unsigned digits) {
+    unsigned result = 0;
+    for(unsigned d = 0; d < digits; ++d) {
+        result = result * 3 + index % 3;
+        index /= 3;
+    }
+    return result;
+}
+
+DEVICE SamplerInitResult __direct_callable__init(const unsigned i,
+                                                 const unsigned x,
+                                                 const unsigned y) {
+    const HaltonInitDesc* data = getSBTData<HaltonInitDesc>();
+    const PixelMapping& mapping = data->mapping;
+    // Promote to 64 bits to avoid overflow.
+    const unsigned long long hx = inverse2(x, mapping.p2);
+    const unsigned long long hy = inverse3(y, mapping.p3);
+    // Apply Chinese remainder theorem.
+    const unsigned offset = static_cast<unsigned>(
+        (hx * mapping.x + hy * mapping.y) % mapping.increment);
+    SamplerInitResult res;
+    res.index = offset + i * mapping.increment;
+    res.px = sampleBase2(res.index) * mapping.scaleX;
+    res.py = sampleDim(data->dim3, res.index) * mapping.scaleY;
+    return res;
+}
+
+DEVICE float __direct_callable__sample(unsigned idx) {
+    return sampleDim(*getSBTData<HaltonDimDesc>(), idx);
+}
@@ -0,0 +1,222 @@
+#include "Tables.hpp"
+#include "../../Shared/ThreadPool.hpp"
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+// http://gruenschloss.org/halton/halton.zip
+// Enumerating Quasi-Monte Carlo Point Sequences in Elementary Intervals
+// http://gruenschloss.org/sample-enum/sample-enum.pdf
+
+// Copyright (c) 2012 Leonhard Gruenschloss (leonhard@gruenschloss.org)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+std::vector<unsigned> getPrimeTable(unsigned count) {
+    std::vector<unsigned> res;
+    for(unsigned i = 2; static_cast<unsigned>(res.size()) < count; ++i) {
+        bool flag = true;
+        for(auto x : res)
+            if(i % x == 0) {
+                flag = false;
+                break;
+            }
+        if(flag)
+            res.emplace_back(i);
+    }
+    return res;
+}
+
+Permutations initFaure(unsigned maxBase) {
+    Permutations perms(maxBase + 1);
+    // Keep identity permutations for base 1, 2, 3.
+    for(unsigned k = 1; k <= 3; ++k) {
+        perms[k].resize(k);
+        for(unsigned i = 0; i < k; ++i)
+            perms[k][i] = i;
+    }
+    for(unsigned base = 4; base <= maxBase; ++base) {
+        perms[base].resize(base);
+        const unsigned b = base / 2;
+        if(base & 1)  // odd
+        {
+            for(unsigned i = 0; i < base - 1; ++i)
+                perms[base][i + (i >= b)] =
+                    perms[base - 1][i] + (perms[base - 1][i] >= b);
+            perms[base][b] = b;
+        } else  // even
+        {
+            for(unsigned i = 0; i < b; ++i) {
+                perms[base][i] = 2 * perms[b][i];
+                perms[base][b + i] = 2 * perms[b][i] + 1;
+            }
+        }
+    }
+    return perms;
+}
+
+Permutations initPermutations(const std::string& type, unsigned maxBase) {
+    if(type == "Faure")
+        return initFaure(maxBase);
+    std::stringstream ss;
+    ss << type;
+    std::string engine;
+    uint64_t seed = -1;
+    ss >> engine >> seed;
+    if(seed == -1)
+        seed = std::chrono::high_resolution_clock::now()
+                   .time_since_epoch()
+                   .count();
+
+    if(engine == "LinearCongruential") {
+        std::minstd_rand rng(static_cast<unsigned>(seed));
+        return initRandom(maxBase, rng);
+    }
+    if(engine == "MersenneTwister") {
+        std::mt19937_64 rng(seed);
+        return initRandom(maxBase, rng);
+    }
+    if(engine == "SubtractWithCarry") {
+        std::ranlux48 rng(seed);
+        return initRandom(maxBase, rng);
+    }
+    if(engine == "Device") {
+        std::random_device dev;
+        if(dev.entropy() == 0.0)
+            throw std::runtime_error("Random Device is not available.");
+        return initRandom(maxBase, dev);
+    }
+    throw std::invalid_argument("Unknown permutation type " + type);
+}
+
+unsigned invert(unsigned base, unsigned digits, unsigned index,
+                const std::vector<unsigned>& perm) {
+    unsigned result = 0;
+    for(unsigned i = 0; i < digits; ++i) {
+        result = result * base + perm[index % base];
+        index /= base;
+    }
+    return result;
+}
+
+RadicalInverseTable buildTable(unsigned base, const std::vector<unsigned>& perm,
+                               unsigned maxTableSize) {
+    RadicalInverseTable res;
+    res.base = base;
+    // base 2 reverses the bits
+    if(base == 2) {
+        res.powBase = 2;
+        res.terms = 0;
+        res.scale = 0.0f;
+        return res;
+    }
+    unsigned digits = 1, powBase = base;
+    while(powBase * base <= maxTableSize)
+        powBase *= base, ++digits;
+    uint64_t maxPower = powBase;
+    unsigned terms = 1;
+    while(maxPower * powBase < (1ULL << 32))  // 32-bit unsigned precision
+        maxPower *= powBase, ++terms;
+    res.powBase = powBase;
+    res.terms = terms;
+    res.scale = static_cast<float>(0x1.fffffcp-1 / maxPower);
+    res.lut.resize(powBase);
+    for(unsigned i = 0; i < powBase; ++i)
+        res.lut[i] = invert(base, digits, i, perm);
+    return res;
+}
+
+std::vector<RadicalInverseTable> buildTables(const std::vector<unsigned>& bases,
+                                             const Permutations& perms,
+                                             unsigned maxTableSize,
+                                             ThreadPool* pool) {
+    std::vector<RadicalInverseTable> res(bases.size());
+    auto build = [&](size_t i) {
+        res[i] = buildTable(bases[i], perms[bases[i]], maxTableSize);
+    };
+    if(pool)
+        parallelFor(*pool, bases.size(), build);
+    else
+        for(size_t i = 0; i < bases.size(); ++i)
+            build(i);
+    return res;
+}
+
+float radicalInverse(const RadicalInverseTable& table, unsigned idx) {
+    if(table.base == 2) {
+        idx = (idx << 16) | (idx >> 16);
+        idx = ((idx & 0x00ff00ff) << 8) | ((idx & 0xff00ff00) >> 8);
+        idx = ((idx & 0x0f0f0f0f) << 4) | ((idx & 0xf0f0f0f0) >> 4);
+        idx = ((idx & 0x33333333) << 2) | ((idx & 0xcccccccc) >> 2);
+        idx = ((idx & 0x55555555) << 1) | ((idx & 0xaaaaaaaa) >> 1);
+        // [1,2) with the top 23 bits as the mantissa
+        uint32_t bits = 0x3f800000u | (idx >> 9);
+        float res;
+        memcpy(&res, &bits, sizeof(res));
+        return res - 1.0f;
+    }
+    unsigned res = 0;
+    for(unsigned i = 0; i < table.terms; ++i) {
+        res = res * table.powBase + table.lut[idx % table.powBase];
+        idx /= table.powBase;
+    }
+    return static_cast<float>(res) * table.scale;
+}
+
+static inline std::pair<int, int> extendedEuclid(const int a, const int b) {
+    if(!b)
+        return std::make_pair(1u, 0u);
+    const int q = a / b;
+    const int r = a % b;
+    const std::pair<int, int> st = extendedEuclid(b, r);
+    return std::make_pair(st.second, st.first - q * st.second);
+}
+
+unsigned initPixelMapping(unsigned width, unsigned height,
+                          PixelMapping& mapping) {
+    mapping.p2 = 0;
+    // Find 2^p2 >= width.
+    unsigned w = 1;
+    while(w < width) {
+        ++mapping.p2;
+        w *= 2;
+    }
+    mapping.scaleX = static_cast<float>(w);
+
+    mapping.p3 = 0;
+    // Find 3^p3 >= height.
+    unsigned h = 1;
+    while(h < height) {
+        ++mapping.p3;
+        h *= 3;
+    }
+    mapping.scaleY = static_cast<float>(h);
+    mapping.increment = w * h;  // There's exactly one sample per pixel.
+
+    // Determine the multiplicative inverses.
+    const std::pair<int, int> inv = extendedEuclid(h, w);
+    const unsigned inv2 = (inv.first < 0) ? (inv.first + w) : (inv.first % w);
+    const unsigned inv3 =
+        (inv.second < 0) ? (inv.second + h) : (inv.second % h);
+    mapping.x = h * inv2;
+    mapping.y = w * inv3;
+    return ~0u / mapping.increment;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "DataDesc.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// The host side tables of the scrambled Halton sequence. No CUDA is involved.
+
+class ThreadPool;
+
+std::vector<unsigned> getPrimeTable(unsigned count);
+
+// perms[base] is the digit permutation of base for base in [1,maxBase].
+using Permutations = std::vector<std::vector<unsigned>>;
+
+Permutations initFaure(unsigned maxBase);
+
+template <typename RNG>
+Permutations initRandom(unsigned maxBase, RNG& eng) {
+    Permutations perms(maxBase + 1);
+    // Keep identity permutations for base 1, 2, 3.
+    for(unsigned k = 1; k <= 3; ++k) {
+        perms[k].resize(k);
+        for(unsigned i = 0; i < k; ++i)
+            perms[k][i] = i;
+    }
+    for(unsigned base = 4; base <= maxBase; ++base) {
+        perms[base].resize(base);
+        for(unsigned i = 0; i < base; ++i)
+            perms[base][i] = i;
+        std::shuffle(perms[base].begin(), perms[base].end(), eng);
+    }
+    return perms;
+}
+
+// type is "Faure" or "<Engine> [seed]", the seed is the time by default.
+Permutations initPermutations(const std::string& type, unsigned maxBase);
+
+unsigned invert(unsigned base, unsigned digits, unsigned index,
+                const std::vector<unsigned>& perm);
+
+// The host copy of HaltonDimDesc.
+struct RadicalInverseTable final {
+    unsigned base, powBase, terms;
+    float scale;
+    std::vector<unsigned> lut;
+};
+
+// The LUT covers the most digits whose powBase<=maxTableSize.
+RadicalInverseTable buildTable(unsigned base, const std::vector<unsigned>& perm,
+                               unsigned maxTableSize);
+// Build the tables of the bases in parallel, in serial if pool is nullptr.
+std::vector<RadicalInverseTable> buildTables(const std::vector<unsigned>& bases,
+                                             const Permutations& perms,
+                                             unsigned maxTableSize,
+                                             ThreadPool* pool);
+// Evaluate the table like the device does.
+float radicalInverse(const RadicalInverseTable& table, unsigned idx);
+
+// Return maxSPP.
+unsigned initPixelMapping(unsigned width, unsigned height,
+                          PixelMapping& mapping);
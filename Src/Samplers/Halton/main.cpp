@@ -1,8 +1,7 @@
+#include "../../Shared/CommandAPI.hpp"
 #include "../../Shared/ConfigAPI.hpp"
 #include "../../Shared/SamplerAPI.hpp"
-#include <algorithm>
-#include <chrono>
-#include <random>
+#include "Tables.hpp"
 #include <sstream>
 #pragma warning(push, 0)
 #define NOMINMAX
@@ -36,77 +35,6 @@
 
 BUS_MODULE_NAME("Piper.BuiltinSampler.Halton");
 
-std::vector<unsigned> getPrimeTable(unsigned count) {
-    std::vector<unsigned> res;
-    for(unsigned i = 2; static_cast<unsigned>(res.size()) < count; ++i) {
-        bool flag = true;
-        for(auto x : res)
-            if(i % x == 0) {
-                flag = false;
-                break;
-            }
-        if(flag)
-            res.emplace_back(i);
-    }
-    return res;
-}
-
-std::vector<std::vector<unsigned>> initFaure(unsigned maxBase) {
-    std::vector<std::vector<unsigned>> perms(maxBase + 1);
-    // Keep identity permutations for base 1, 2, 3.
-    for(unsigned k = 1; k <= 3; ++k) {
-        perms[k].resize(k);
-        for(unsigned i = 0; i < k; ++i)
-            perms[k][i] = i;
-    }
-    for(unsigned base = 4; base <= maxBase; ++base) {
-        perms[base].resize(base);
-        const unsigned b = base / 2;
-        if(base & 1)  // odd
-        {
-            for(unsigned i = 0; i < base - 1; ++i)
-                perms[base][i + (i >= b)] =
-                    perms[base - 1][i] + (perms[base - 1][i] >= b);
-            perms[base][b] = b;
-        } else  // even
-        {
-            for(unsigned i = 0; i < b; ++i) {
-                perms[base][i] = 2 * perms[b][i];
-                perms[base][b + i] = 2 * perms[b][i] + 1;
-            }
-        }
-    }
-    return perms;
-}
-
-template <typename RNG>
-std::vector<std::vector<unsigned>> initRandom(unsigned maxBase, RNG& eng) {
-    std::vector<std::vector<unsigned>> perms(maxBase + 1);
-    // Keep identity permutations for base 1, 2, 3.
-    for(unsigned k = 1; k <= 3; ++k) {
-        perms[k].resize(k);
-        for(unsigned i = 0; i < k; ++i)
-            perms[k][i] = i;
-    }
-    for(unsigned base = 4; base <= maxBase; ++base) {
-        perms[base].resize(base);
-        for(unsigned i = 0; i < base; ++i)
-            perms[base][i] = i;
-        std::shuffle(perms[base].begin(), perms[base].end(), eng);
-    }
-    return perms;
-}
-
-unsigned invert(unsigned base, unsigned digits, unsigned index,
-                const std::vector<unsigned>& perm) {
-    unsigned result = 0;
-    for(unsigned i = 0; i < digits; ++i) {
-        result = result * base + perm[index % base];
-        index /= base;
-    }
-    return result;
-}
-
 void genCode(std::stringstream& ss, const std::vector<unsigned>& perms,
              unsigned base, unsigned maxTableSize) {
     // Special case: radical inverse in base 2, with direct bit reversal.
@@ -162,42 +90,11 @@ void generateSample(std::stringstream& out, unsigned maxDim,
                     std::shared_ptr<Config> config, Bus::Reporter& reporter,
                     const std::vector<unsigned>& primeTable) {
     BUS_TRACE_BEG() {
-        std::string initType = config->getString("Type", "Faure");
         unsigned maxTableSize = config->getUint("MaxPermTableSize", 500U);
         if(maxTableSize > 65536)
             BUS_TRACE_THROW(std::runtime_error("Need MaxPermTableSize<=65536"));
-        std::vector<std::vector<unsigned>> perms;
-        if(initType == "Faure")
-            perms = initFaure(primeTable.back());
-        else {
-            std::stringstream ss;
-            ss << initType;
-            std::string type;
-            uint64_t seed = -1;
-            ss >> type >> seed;
-            if(seed == -1)
-                seed = std::chrono::high_resolution_clock::now()
-                           .time_since_epoch()
-                           .count();
-
-            if(type == "LinearCongruential") {
-                std::minstd_rand rng(static_cast<unsigned>(seed));
-                perms = initRandom(primeTable.back(), rng);
-            } else if(type == "MersenneTwister") {
-                std::mt19937_64 rng(seed);
-                perms = initRandom(primeTable.back(), rng);
-            } else if(type == "SubtractWithCarry") {
-                std::ranlux48 rng(seed);
-                perms = initRandom(primeTable.back(), rng);
-            } else if(type == "Device") {
-                std::random_device dev;
-                if(dev.entropy() == 0.0)
-                    BUS_TRACE_THROW(
-                        std::runtime_error("Random Device is not available."));
-                else
-                    perms = initRandom(primeTable.back(), dev);
-            }
-        }
+        Permutations perms = initPermutations(
+            config->getString("Type", "Faure"), primeTable.back());
         out.precision(15);
         for(unsigned i = 0; i < maxDim; ++i) {
             unsigned base = primeTable[i];
@@ -207,47 +104,8 @@ void generateSample(std::stringstream& out, unsigned maxDim,
     BUS_TRACE_END();
 }
 
-struct DataDesc final {
-    unsigned p2, p3, x, y, increment;
-    float scaleX, scaleY;
-};
-
-static inline std::pair<int, int> extendedEuclid(const int a, const int b) {
-    if(!b)
-        return std::make_pair(1u, 0u);
-    const int q = a / b;
-    const int r = a % b;
-    const std::pair<int, int> st = extendedEuclid(b, r);
-    return std::make_pair(st.second, st.first - q * st.second);
-}
-
-unsigned generateInit(std::stringstream& ss, Uint2 size, DataDesc& desc) {
-    desc.p2 = 0;
-    // Find 2^p2 >= width.
-    unsigned w = 1;
-    while(w < size.x) {
-        ++desc.p2;
-        w *= 2;
-    }
-    desc.scaleX = static_cast<float>(w);
-
-    desc.p3 = 0;
-    // Find 3^p3 >= height.
-    unsigned h = 1;
-    while(h < size.y) {
-        ++desc.p3;
-        h *= 3;
-    }
-    desc.scaleY = static_cast<float>(h);
-    desc.increment = w * h;  // There's exactly one sample per pixel.
-
-    // Determine the multiplicative inverses.
-    const std::pair<int, int> inv = extendedEuclid(h, w);
-    const unsigned inv2 = (inv.first < 0) ? (inv.first + w) : (inv.first % w);
-    const unsigned inv3 =
-        (inv.second < 0) ? (inv.second + h) : (inv.second % h);
-    desc.x = h * inv2;
-    desc.y = w * inv3;
+unsigned generateInit(std::stringstream& ss, Uint2 size, PixelMapping& desc) {
+    unsigned maxSPP = initPixelMapping(size.x, size.y, desc);
     ss << R"#(static __device__  inline unsigned inverse2(unsigned index, const unsigned digits) {
     index = (index << 16) | (index >> 16);
     index = ((index & 0x00ff00ff) << 8) | ((index & 0xff00ff00) >> 8);
@@ -284,7 +142,7 @@ extern "C" __device__ SamplerInitResult __direct_callable__init(const unsigned i
     return res;
 }
 )#";
-    return ~0u / desc.increment;
+    return maxSPP;
 }
 
 // TODO:ptx caching
@@ -303,7 +161,7 @@ public:
             std::stringstream ss;
             ss << "#include <KernelInclude.hpp>" << std::endl;
             generateSample(ss, maxDim + 2, config, reporter(), primeTable);
-            DataDesc data;
+            PixelMapping data;
             SamplerData res;
             res.maxSPP = generateInit(ss, size, data);
             reporter().apply(ReportLevel::Debug,
@@ -371,6 +229,13 @@ public:
     }
 };
 
+std::shared_ptr<Bus::ModuleFunctionBase>
+getHaltonTable(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getHaltonCheck(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getHaltonBench(Bus::ModuleInstance& instance);
+
 class Instance final : public Bus::ModuleInstance {
 public:
     Instance(const fs::path& path, Bus::ModuleSystem& sys)
@@ -390,12 +255,20 @@ public:
     }
     std::vector<Bus::Name> list(Bus::Name api) const override {
         if(api == Sampler::getInterface())
-            return { "Halton" };
+            return { "Halton", "HaltonTable" };
+        if(api == Command::getInterface())
+            return { "HaltonCheck", "HaltonBench" };
         return {};
     }
     std::shared_ptr<Bus::ModuleFunctionBase> instantiate(Name name) override {
         if(name == "Halton")
             return std::make_shared<Halton>(*this);
+        if(name == "HaltonTable")
+            return getHaltonTable(*this);
+        if(name == "HaltonCheck")
+            return getHaltonCheck(*this);
+        if(name == "HaltonBench")
+            return getHaltonBench(*this);
         return nullptr;
     }
 };
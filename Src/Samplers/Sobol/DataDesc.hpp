@@ -0,0 +1,14 @@
+#pragma once
+
+// directions holds 32 direction numbers per dimension. The sample index
+// passed to the dimensions is i|key<<indexBits, where i is the index in the
+// pixel and key is the hash of the pixel.
+struct SobolInitDesc final {
+    const unsigned* directions;
+    unsigned indexBits;
+};
+
+struct SobolDimDesc final {
+    const unsigned* directions;
+    unsigned dim, indexBits;
+};
@@ -0,0 +1,55 @@
+#include "../../Shared/KernelShared.hpp"
+#include "DataDesc.hpp"
+
+// Owen-scrambled Sobol sequence, the same bits as the host reference in
+// Sobol.cpp. hashUint is shared with the padded dimensions.
+
+INLINEDEVICE unsigned hashCombine(unsigned seed, unsigned x) {
+    return hashUint(seed ^ (x + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+INLINEDEVICE unsigned nestedUniformScramble(unsigned x, unsigned seed) {
+    x = __brev(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return __brev(x);
+}
+
+INLINEDEVICE float sampleDim(const unsigned* directions, unsigned dim,
+                             unsigned index, unsigned indexBits) {
+    const unsigned seed = hashUint(index >> indexBits);
+    unsigned i =
+        nestedUniformScramble(index & ((1u << indexBits) - 1u), seed);
+    const unsigned* dir = directions + dim * 32;
+    unsigned bits = 0;
+    for(; i; i >>= 1, ++dir)
+        if(i & 1)
+            bits ^= *dir;
+    bits = nestedUniformScramble(bits, hashCombine(seed, dim));
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// The pixel key is kept in the high bits of the index, so the dimensions
+// are decorrelated between the pixels without an extra parameter.
+DEVICE SamplerInitResult __direct_callable__init(const unsigned i,
+                                                 const unsigned x,
+                                                 const unsigned y) {
+    const SobolInitDesc* data = getSBTData<SobolInitDesc>();
+    const unsigned bits = data->indexBits;
+    const unsigned key = hashCombine(hashUint(x), y) >> bits;
+    SamplerInitResult res;
+    res.index = i | key << bits;
+    res.px = static_cast<float>(x) +
+        sampleDim(data->directions, 0, res.index, bits);
+    res.py = static_cast<float>(y) +
+        sampleDim(data->directions, 1, res.index, bits);
+    return res;
+}
+
+DEVICE float __direct_callable__sample(unsigned idx) {
+    const SobolDimDesc* data = getSBTData<SobolDimDesc>();
+    return sampleDim(data->directions, data->dim, idx, data->indexBits);
+}
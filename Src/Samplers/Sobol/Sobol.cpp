@@ -0,0 +1,275 @@
+#include "Sobol.hpp"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+// x^e mod p over GF(2), p has the degree deg.
+static uint64_t powMod(uint64_t e, uint64_t p, unsigned deg) {
+    uint64_t res = 1, base = 2;
+    auto mulMod = [p, deg](uint64_t a, uint64_t b) {
+        uint64_t res = 0;
+        for(; b; b >>= 1) {
+            if(b & 1)
+                res ^= a;
+            a <<= 1;
+            if(a >> deg & 1)
+                a ^= p;
+        }
+        return res;
+    };
+    // x mod p, x+1 is the only polynomial of degree 1
+    if(base >> deg & 1)
+        base ^= p;
+    for(; e; e >>= 1) {
+        if(e & 1)
+            res = mulMod(res, base);
+        base = mulMod(base, base);
+    }
+    return res;
+}
+
+// The order of x mod p must be 2^deg-1.
+static bool isPrimitive(uint64_t p, unsigned deg,
+                        const std::vector<uint64_t>& factors) {
+    uint64_t order = (1ULL << deg) - 1;
+    if(powMod(order, p, deg) != 1)
+        return false;
+    for(auto factor : factors)
+        if(powMod(order / factor, p, deg) == 1)
+            return false;
+    return true;
+}
+
+std::vector<uint32_t> primitivePolynomials(unsigned count) {
+    std::vector<uint32_t> res;
+    for(unsigned deg = 1; res.size() < count; ++deg) {
+        if(deg > 31)
+            throw std::out_of_range("Too many Sobol dimensions");
+        std::vector<uint64_t> factors;
+        uint64_t rem = (1ULL << deg) - 1;
+        for(uint64_t f = 2; f * f <= rem; ++f)
+            if(rem % f == 0) {
+                factors.push_back(f);
+                while(rem % f == 0)
+                    rem /= f;
+            }
+        if(rem > 1)
+            factors.push_back(rem);
+        // x^deg+...+1
+        for(uint64_t inner = 0; inner < (1ULL << deg) / 2; ++inner) {
+            uint64_t p = (1ULL << deg) | inner << 1 | 1;
+            if(isPrimitive(p, deg, factors)) {
+                res.push_back(static_cast<uint32_t>(p));
+                if(res.size() == count)
+                    break;
+            }
+        }
+    }
+    return res;
+}
+
+// The direction numbers from the initial m[0,deg) by the recurrence of the
+// polynomial p.
+static void expandDirections(uint32_t p, unsigned deg, const uint64_t* init,
+                             uint32_t* dst) {
+    // m[k] is odd and less than 2^(k+1)
+    uint64_t m[32];
+    for(unsigned k = 0; k < 32; ++k) {
+        if(k < deg)
+            m[k] = init[k];
+        else {
+            m[k] = m[k - deg] ^ (m[k - deg] << deg);
+            for(unsigned j = 1; j < deg; ++j)
+                if(p >> (deg - j) & 1)
+                    m[k] ^= m[k - j] << j;
+        }
+    }
+    for(unsigned k = 0; k < 32; ++k)
+        dst[k] = static_cast<uint32_t>(m[k] << (31 - k));
+}
+
+// Reduce v by the basis over GF(2), the lowest bits of the basis vectors are
+// distinct and cleared from the later ones.
+static uint32_t reduce(uint32_t v, const uint32_t* basis, unsigned size) {
+    for(unsigned i = 0; i < size; ++i)
+        if(v & basis[i] & (~basis[i] + 1))
+            v ^= basis[i];
+    return v;
+}
+
+unsigned tValue(const uint32_t* lhs, const uint32_t* rhs, unsigned m) {
+    // Row i of a generator matrix holds the digit i of the first m
+    // direction numbers.
+    uint32_t rows[2][32] = {};
+    for(unsigned i = 0; i < m; ++i)
+        for(unsigned k = 0; k < m; ++k) {
+            rows[0][i] |= (lhs[k] >> (31 - i) & 1) << k;
+            rows[1][i] |= (rhs[k] >> (31 - i) & 1) << k;
+        }
+    // The points are a (t,m,2)-net iff the first bx rows of lhs and the
+    // first m-t-bx rows of rhs are independent for every bx. q[bx] is bx
+    // plus the number of the rows of rhs which can be added.
+    int q[33];
+    uint32_t lhsBasis[32];
+    unsigned lhsSize = 0;
+    bool dependent = false;
+    for(unsigned bx = 0; bx <= m; ++bx) {
+        if(bx && !dependent) {
+            uint32_t v = reduce(rows[0][bx - 1], lhsBasis, lhsSize);
+            if(v)
+                lhsBasis[lhsSize++] = v;
+            else
+                dependent = true;
+        }
+        if(dependent) {
+            q[bx] = static_cast<int>(bx) - 1;
+            continue;
+        }
+        uint32_t basis[32];
+        std::copy(lhsBasis, lhsBasis + lhsSize, basis);
+        unsigned size = lhsSize, by = 0;
+        for(; bx + by < m; ++by) {
+            uint32_t v = reduce(rows[1][by], basis, size);
+            if(!v)
+                break;
+            basis[size++] = v;
+        }
+        q[bx] = static_cast<int>(bx + by);
+    }
+    for(unsigned t = 0; t < m; ++t) {
+        int minQ = q[0];
+        for(unsigned bx = 1; bx <= m - t; ++bx)
+            minQ = std::min(minQ, q[bx]);
+        if(minQ >= static_cast<int>(m - t))
+            return t;
+    }
+    return m;
+}
+
+std::vector<uint32_t> sobolDirections(unsigned dims) {
+    std::vector<uint32_t> res(static_cast<size_t>(dims) * 32);
+    if(dims == 0)
+        return res;
+    for(unsigned k = 0; k < 32; ++k)
+        res[k] = 1U << (31 - k);
+    std::vector<uint32_t> polys = primitivePolynomials(dims - 1);
+    // The candidates are scored by the t-values of the first 2^m points for
+    // m in [1,maxLog2].
+    constexpr unsigned candidates = 16, maxLog2 = 16;
+    std::mt19937 eng(0);
+    for(unsigned d = 1; d < dims; ++d) {
+        uint32_t p = polys[d - 1];
+        unsigned deg = 0;
+        while(p >> (deg + 1))
+            ++deg;
+        const uint32_t* prev = res.data() + static_cast<size_t>(d - 1) * 32;
+        uint32_t* dst = res.data() + static_cast<size_t>(d) * 32;
+        uint64_t init[32], best[32];
+        unsigned bestScore = std::numeric_limits<unsigned>::max();
+        for(unsigned c = 0; c < candidates; ++c) {
+            for(unsigned k = 0; k < deg; ++k)
+                init[k] = (eng() & ((1ULL << k) - 1)) << 1 | 1;
+            expandDirections(p, deg, init, dst);
+            unsigned score = 0;
+            for(unsigned m = 1; m <= maxLog2 && score < bestScore; ++m)
+                score += tValue(prev, dst, m);
+            if(score < bestScore) {
+                bestScore = score;
+                std::copy(init, init + deg, best);
+            }
+        }
+        expandDirections(p, deg, best, dst);
+    }
+    return res;
+}
+
+uint32_t hashUint(uint32_t x) {
+    // lowbias32 by Chris Wellons
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+uint32_t hashCombine(uint32_t seed, uint32_t x) {
+    return hashUint(seed ^ (x + 0x9e3779b9U + (seed << 6) + (seed >> 2)));
+}
+
+static uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffU) << 8) | ((x & 0xff00ff00U) >> 8);
+    x = ((x & 0x0f0f0f0fU) << 4) | ((x & 0xf0f0f0f0U) >> 4);
+    x = ((x & 0x33333333U) << 2) | ((x & 0xccccccccU) >> 2);
+    x = ((x & 0x55555555U) << 1) | ((x & 0xaaaaaaaaU) >> 1);
+    return x;
+}
+
+uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    // Every bit is flipped by a hash of the lower bits of the reversed value,
+    // i.e. the higher bits of x.
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return reverseBits(x);
+}
+
+uint32_t sobolBits(const uint32_t* directions, uint32_t index) {
+    uint32_t res = 0;
+    for(; index; index >>= 1, ++directions)
+        if(index & 1)
+            res ^= *directions;
+    return res;
+}
+
+uint32_t pixelKey(uint32_t x, uint32_t y, uint32_t indexBits) {
+    return hashCombine(hashUint(x), y) >> indexBits;
+}
+
+float sobolSample(const uint32_t* directions, uint32_t dim, uint32_t index,
+                  uint32_t indexBits) {
+    uint32_t seed = hashUint(index >> indexBits);
+    // Shuffle the samples of the pixel, the aligned blocks of 2^m samples
+    // are kept, so are the nets of all dimensions.
+    uint32_t i = nestedUniformScramble(index & ((1U << indexBits) - 1), seed);
+    uint32_t bits = sobolBits(directions + static_cast<size_t>(dim) * 32, i);
+    bits = nestedUniformScramble(bits, hashCombine(seed, dim));
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+std::vector<uint32_t> directionRows(const std::vector<uint32_t>& directions,
+                                    unsigned firstDim, unsigned dims) {
+    std::vector<uint32_t> res(static_cast<size_t>(dims) * 32);
+    for(unsigned d = 0; d < dims; ++d)
+        for(unsigned k = 0; k < 32; ++k)
+            res[static_cast<size_t>(k) * dims + d] =
+                directions[(static_cast<size_t>(firstDim) + d) * 32 + k];
+    return res;
+}
+
+void sobolBlock(const uint32_t* rows, unsigned firstDim, unsigned dims,
+                uint32_t beg, uint32_t end, uint32_t indexBits, float* dst) {
+    uint32_t seed = hashUint(0);
+    std::vector<uint32_t> seeds(dims), bits(dims);
+    for(unsigned d = 0; d < dims; ++d)
+        seeds[d] = hashCombine(seed, firstDim + d);
+    uint32_t mask = (1U << indexBits) - 1;
+    for(uint32_t i = beg; i < end; ++i) {
+        std::fill(bits.begin(), bits.end(), 0U);
+        uint32_t idx = nestedUniformScramble(i & mask, seed);
+        for(const uint32_t* row = rows; idx; idx >>= 1, row += dims)
+            if(idx & 1)
+                for(unsigned d = 0; d < dims; ++d)
+                    bits[d] ^= row[d];
+        float* out = dst + static_cast<size_t>(i - beg) * dims;
+        for(unsigned d = 0; d < dims; ++d)
+            out[d] = static_cast<float>(
+                         nestedUniformScramble(bits[d], seeds[d]) >> 8) *
+                (1.0f / 16777216.0f);
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// The host reference of the Owen-scrambled Sobol sampler. Kernel.cu mirrors
+// the sampling functions bit by bit. No CUDA is involved.
+
+// The primitive polynomials over GF(2) in the order of the degree. Bit k is
+// the coefficient of x^k.
+std::vector<uint32_t> primitivePolynomials(unsigned count);
+
+// 32 direction numbers per dimension. Dimension 0 is the van der Corput
+// sequence, the others use the primitive polynomials. The Joe-Kuo tables
+// aren't shipped, the initial direction numbers are searched among a few
+// candidates drawn by a fixed seed instead, like Joe and Kuo did: the ones
+// with the lowest t-values of the 2D projection with the previous dimension
+// are kept. SobolCheck compares the projections with Halton.
+std::vector<uint32_t> sobolDirections(unsigned dims);
+// The t-value of the first 2^m points of the 2D projection of two
+// dimensions, i.e. they are a (t,m,2)-net. m<=31.
+unsigned tValue(const uint32_t* lhs, const uint32_t* rhs, unsigned m);
+
+uint32_t hashUint(uint32_t x);
+uint32_t hashCombine(uint32_t seed, uint32_t x);
+// Owen scrambling of the bits from the highest one, see "Practical
+// Hash-based Owen Scrambling"(Burley 2020).
+uint32_t nestedUniformScramble(uint32_t x, uint32_t seed);
+// The unscrambled Sobol sequence.
+uint32_t sobolBits(const uint32_t* directions, uint32_t index);
+
+uint32_t pixelKey(uint32_t x, uint32_t y, uint32_t indexBits);
+// index is the one returned by the init callable.
+float sobolSample(const uint32_t* directions, uint32_t dim, uint32_t index,
+                  uint32_t indexBits);
+
+// The direction numbers of the dimensions [firstDim,firstDim+dims) as 32
+// rows of dims numbers, the layout used by sobolBlock.
+std::vector<uint32_t> directionRows(const std::vector<uint32_t>& directions,
+                                    unsigned firstDim, unsigned dims);
+// sobolSample of the indices [beg,end) without the pixel key, written to
+// dst[(i-beg)*dims+d] for the dimension firstDim+d. The inner loops run over
+// the dimensions, so they are vectorized by the compiler.
+void sobolBlock(const uint32_t* rows, unsigned firstDim, unsigned dims,
+                uint32_t beg, uint32_t end, uint32_t indexBits, float* dst);
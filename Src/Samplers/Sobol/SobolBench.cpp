@@ -0,0 +1,78 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplerBench.hpp"
+#include "Sobol.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinSampler.Sobol.SobolBench");
+
+// Evaluate the block mode of the Sobol sampler on the host, the samples of
+// the other pixels differ by the scrambling seeds only. The sample
+// dimensions start at 2 like the SBT records.
+static int bench(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("SobolBench", "Sobol::SobolBench");
+        opt.add_options()("d,dim", "sample dimensions",
+                          cxxopts::value<unsigned>()->default_value("8"))(
+            "n,samples", "max sample count",
+            cxxopts::value<unsigned>()->default_value("4096"))(
+            "r,replicas", "randomly rotated replicas",
+            cxxopts::value<unsigned>()->default_value("64"))(
+            "throughput", "samples for the throughput",
+            cxxopts::value<unsigned>()->default_value("65536"))(
+            "b,bits", "index bits",
+            cxxopts::value<unsigned>()->default_value("16"))(
+            "f,format", "csv or json",
+            cxxopts::value<std::string>()->default_value("csv"))(
+            "o,output", "output file, - for the standard output",
+            cxxopts::value<std::string>()->default_value("-"));
+        auto res = opt.parse(argc, argv);
+        SamplerBenchOptions bench;
+        bench.dims = res["dim"].as<unsigned>();
+        bench.samples = res["samples"].as<unsigned>();
+        bench.replicas = res["replicas"].as<unsigned>();
+        bench.throughputSamples = res["throughput"].as<unsigned>();
+        unsigned bits = res["bits"].as<unsigned>();
+        if(bench.dims < 2 || bench.dims > 4096)
+            BUS_TRACE_THROW(std::invalid_argument("Need 2<=dim<=4096"));
+        if(bits < 1 || bits > 31 ||
+           std::max(bench.samples, bench.throughputSamples) > (1ULL << bits))
+            BUS_TRACE_THROW(
+                std::invalid_argument("Need samples<=2^bits, bits<=31"));
+
+        std::vector<uint32_t> rows =
+            directionRows(sobolDirections(bench.dims + 2), 2, bench.dims);
+        HostSampler sampler = [&](unsigned beg, unsigned end, unsigned dims,
+                                  float* dst) {
+            sobolBlock(rows.data(), 2, dims, beg, end, bits, dst);
+        };
+        std::vector<SamplerBenchRecord> records =
+            runSamplerBench(sampler, bench);
+
+        std::stringstream name;
+        name << "Sobol/" << bits;
+        saveSamplerBench(res["output"].as<std::string>(),
+                         res["format"].as<std::string>(), name.str(), records);
+        reporter.apply(ReportLevel::Info,
+                       std::to_string(records.size()) + " records of " +
+                           name.str(),
+                       BUS_DEFSRCLOC());
+        return EXIT_SUCCESS;
+    }
+    BUS_TRACE_END();
+}
+
+class SobolBench final : public Command {
+public:
+    explicit SobolBench(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return bench(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getSobolBench(Bus::ModuleInstance& instance) {
+    return std::make_shared<SobolBench>(instance);
+}
@@ -0,0 +1,278 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/SamplingCheck.hpp"
+#include "Sobol.hpp"
+#pragma warning(push, 0)
+#include <cxxopts.hpp>
+#pragma warning(pop)
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+BUS_MODULE_NAME("Piper.BuiltinSampler.Sobol.SobolCheck");
+
+// Every elementary interval of volume 2^-m holds one of the first 2^m
+// points, i.e. the points are a (0,m,2)-net.
+template <typename Sample>
+static bool isNet(unsigned m, const Sample& sample) {
+    for(unsigned bx = 0; bx <= m; ++bx) {
+        unsigned by = m - bx;
+        std::vector<unsigned> count(1ULL << m);
+        for(unsigned i = 0; i < (1U << m); ++i) {
+            float x, y;
+            sample(i, x, y);
+            unsigned cx = static_cast<unsigned>(std::ldexp(x, bx));
+            unsigned cy = static_cast<unsigned>(std::ldexp(y, by));
+            if(++count[cx << by | cy] > 1)
+                return false;
+        }
+    }
+    return true;
+}
+
+// The first 2^m points of a dimension are stratified.
+template <typename Sample>
+static bool isStratified(unsigned m, const Sample& sample) {
+    std::vector<unsigned> count(1ULL << m);
+    for(unsigned i = 0; i < (1U << m); ++i)
+        if(++count[static_cast<unsigned>(std::ldexp(sample(i), m))] > 1)
+            return false;
+    return true;
+}
+
+// The fraction of the empty cells of a 2^(m/2)x2^(m-m/2) grid with the
+// first 2^m points. It is about 1/e for the random points.
+template <typename Sample>
+static double emptyCells(unsigned m, const Sample& sample) {
+    unsigned bx = m / 2, by = m - bx;
+    std::vector<unsigned char> hit(1ULL << m);
+    for(unsigned i = 0; i < (1U << m); ++i) {
+        float x, y;
+        sample(i, x, y);
+        unsigned cx = static_cast<unsigned>(std::ldexp(x, bx));
+        unsigned cy = static_cast<unsigned>(std::ldexp(y, by));
+        hit[cx << by | cy] = 1;
+    }
+    return 1.0 - std::accumulate(hit.begin(), hit.end(), 0.0) / hit.size();
+}
+
+// The radical inverse of i with the digits permuted, perm[0]=0.
+static float radicalInverse(const std::vector<unsigned>& perm, unsigned i) {
+    const double invBase = 1.0 / perm.size();
+    double res = 0.0, scale = invBase;
+    for(; i; i /= static_cast<unsigned>(perm.size()), scale *= invBase)
+        res += perm[i % perm.size()] * scale;
+    return std::min(static_cast<float>(res), 0x1.fffffep-1f);
+}
+
+// The empty cells of the projections of the neighbouring dimensions of the
+// Halton sequence with the random digit permutations.
+static double haltonEmptyCells(unsigned dims, unsigned m) {
+    std::mt19937 eng(0);
+    std::vector<unsigned> primes;
+    for(unsigned p = 2; primes.size() < dims; ++p) {
+        bool isPrime = true;
+        for(auto q : primes) {
+            if(q * q > p)
+                break;
+            if(p % q == 0) {
+                isPrime = false;
+                break;
+            }
+        }
+        if(isPrime)
+            primes.push_back(p);
+    }
+    auto permutation = [&](unsigned base) {
+        std::vector<unsigned> perm(base);
+        std::iota(perm.begin(), perm.end(), 0U);
+        std::shuffle(perm.begin() + 1, perm.end(), eng);
+        return perm;
+    };
+    double sum = 0.0;
+    std::vector<unsigned> lhs = permutation(primes[0]);
+    for(unsigned d = 1; d < dims; ++d) {
+        std::vector<unsigned> rhs = permutation(primes[d]);
+        sum += emptyCells(m, [&](unsigned i, float& x, float& y) {
+            x = radicalInverse(lhs, i);
+            y = radicalInverse(rhs, i);
+        });
+        lhs.swap(rhs);
+    }
+    return sum / (dims - 1);
+}
+
+// Check the properties of the Sobol sampler on the host reference: the
+// primitive polynomials, the stratification of every dimension with and
+// without scrambling, the 2D projections of the neighbouring dimensions
+// against Halton, the nets of the pixel dimensions, the decorrelation
+// between the pixels, the block mode and the integration error.
+static int check(int argc, char** argv, Bus::Reporter& reporter) {
+    BUS_TRACE_BEG() {
+        cxxopts::Options opt("SobolCheck", "Sobol::SobolCheck");
+        opt.add_options()("d,dim", "sample dimensions",
+                          cxxopts::value<unsigned>()->default_value("4098"))(
+            "m,log2", "log2 of the checked sample count",
+            cxxopts::value<unsigned>()->default_value("10"))(
+            "p,pixels", "checked pixels",
+            cxxopts::value<unsigned>()->default_value("64"))(
+            "b,bits", "index bits",
+            cxxopts::value<unsigned>()->default_value("16"));
+        auto res = opt.parse(argc, argv);
+        unsigned dims = std::max(res["dim"].as<unsigned>(), 2U);
+        unsigned m = res["log2"].as<unsigned>();
+        unsigned pixels = res["pixels"].as<unsigned>();
+        unsigned bits = res["bits"].as<unsigned>();
+        if(bits < 1 || bits > 31 || m > bits || m > 20)
+            BUS_TRACE_THROW(
+                std::invalid_argument("Need log2<=min(bits,20), bits<=31"));
+
+        CheckLog log(reporter, BUS_DEFSRCLOC());
+
+        // the number of primitive polynomials of degree 1..5
+        const unsigned expected[] = { 1, 1, 2, 2, 6 };
+        std::vector<uint32_t> polys = primitivePolynomials(12);
+        std::vector<unsigned> degrees(6);
+        for(auto p : polys) {
+            unsigned deg = 0;
+            while(p >> (deg + 1))
+                ++deg;
+            if(deg <= 5)
+                ++degrees[deg];
+        }
+        for(unsigned deg = 1; deg <= 5; ++deg)
+            if(degrees[deg] != expected[deg - 1])
+                log.fail("Wrong primitive polynomials of degree " +
+                         std::to_string(deg));
+
+        std::vector<uint32_t> directions = sobolDirections(dims);
+        auto sample = [&](unsigned d, unsigned i, unsigned key) {
+            return sobolSample(directions.data(), d, i | key << bits, bits);
+        };
+        for(unsigned d = 0; d < dims; ++d) {
+            const uint32_t* dir = directions.data() + d * 32;
+            if(!isStratified(m, [&](unsigned i) {
+                   return static_cast<float>(sobolBits(dir, i) >> 8) *
+                       (1.0f / 16777216.0f);
+               }))
+                log.fail("Dimension " + std::to_string(d) +
+                         " isn't stratified");
+            // a different pixel for every dimension
+            unsigned key = pixelKey(d, d * 7 + 3, bits);
+            if(!isStratified(m,
+                             [&](unsigned i) { return sample(d, i, key); }))
+                log.fail("Scrambled dimension " + std::to_string(d) +
+                         " isn't stratified");
+        }
+
+        // The direction numbers are searched by the t-values of the
+        // neighbouring dimensions, their projections should fill more cells
+        // than Halton's.
+        double sobolEmpty = 0.0;
+        unsigned maxT = 0;
+        for(unsigned d = 1; d < dims; ++d) {
+            const uint32_t* lhs = directions.data() + (d - 1) * 32;
+            const uint32_t* rhs = directions.data() + d * 32;
+            maxT = std::max(maxT, tValue(lhs, rhs, m));
+            sobolEmpty += emptyCells(m, [&](unsigned i, float& x, float& y) {
+                x = static_cast<float>(sobolBits(lhs, i) >> 8) *
+                    (1.0f / 16777216.0f);
+                y = static_cast<float>(sobolBits(rhs, i) >> 8) *
+                    (1.0f / 16777216.0f);
+            });
+        }
+        sobolEmpty /= dims - 1;
+        double haltonEmpty = haltonEmptyCells(dims, m);
+        if(sobolEmpty > haltonEmpty)
+            log.fail("The 2D projections are worse than Halton: " +
+                     std::to_string(sobolEmpty) + " empty cells vs " +
+                     std::to_string(haltonEmpty));
+
+        for(unsigned p = 0; p < pixels; ++p) {
+            unsigned key = pixelKey(p, 0, bits);
+            if(!isNet(m, [&](unsigned i, float& x, float& y) {
+                   x = sample(0, i, key);
+                   y = sample(1, i, key);
+               })) {
+                log.fail("The pixel dimensions aren't a (0,m,2)-net");
+                break;
+            }
+        }
+
+        // The same dimension of the neighbouring pixels should be
+        // uncorrelated, the normalized covariance is about N(0,1/n).
+        unsigned n = 1U << m;
+        double worst = 0.0;
+        for(unsigned p = 0; p < pixels; ++p) {
+            unsigned lhs = pixelKey(p, 0, bits), rhs = pixelKey(p + 1, 0, bits);
+            unsigned d = p % dims;
+            double cov = 0.0;
+            for(unsigned i = 0; i < n; ++i)
+                cov += (sample(d, i, lhs) - 0.5) * (sample(d, i, rhs) - 0.5);
+            worst = std::max(worst, std::fabs(12.0 * cov / n));
+        }
+        if(worst > 5.0 / std::sqrt(static_cast<double>(n)))
+            log.fail("The pixels are correlated: " + std::to_string(worst));
+
+        // The vectorized block of the block mode is the scalar sampler
+        // without the pixel key.
+        double blockTime = 0.0;
+        {
+            unsigned blockDims = dims - 2;
+            std::vector<uint32_t> rows =
+                directionRows(directions, 2, blockDims);
+            std::vector<float> block(static_cast<size_t>(n) * blockDims);
+            blockTime = elapsedMs([&] {
+                sobolBlock(rows.data(), 2, blockDims, 0, n, bits,
+                           block.data());
+            });
+            size_t diff = 0;
+            for(unsigned i = 0; i < n; ++i)
+                for(unsigned d = 0; d < blockDims; ++d)
+                    if(block[static_cast<size_t>(i) * blockDims + d] !=
+                       sample(d + 2, i, 0))
+                        ++diff;
+            if(diff)
+                log.fail(std::to_string(diff) +
+                         " samples of the block differ");
+        }
+
+        // exp(-x-y) over the last two dimensions
+        const double exact = (1.0 - std::exp(-1.0)) * (1.0 - std::exp(-1.0));
+        double mse = 0.0;
+        for(unsigned p = 0; p < pixels; ++p) {
+            unsigned key = pixelKey(p, 1, bits);
+            double sum = 0.0;
+            for(unsigned i = 0; i < n; ++i) {
+                double x = sample(dims - 2, i, key);
+                double y = sample(dims - 1, i, key);
+                sum += std::exp(-x - y);
+            }
+            double err = sum / n - exact;
+            mse += err * err;
+        }
+
+        std::stringstream ss;
+        ss << dims << " dimensions, " << n << " samples, " << pixels
+           << " pixels, empty cells " << sobolEmpty << "(Halton "
+           << haltonEmpty << "), max t " << maxT << ", max covariance "
+           << worst << ", RMSE "
+           << std::sqrt(mse / std::max(pixels, 1U)) << ", block " << blockTime
+           << " ms";
+        return log.finish(ss.str());
+    }
+    BUS_TRACE_END();
+}
+
+class SobolCheck final : public Command {
+public:
+    explicit SobolCheck(Bus::ModuleInstance& instance) : Command(instance) {}
+    int doCommand(int argc, char** argv, Bus::ModuleSystem& sys) override {
+        return check(argc, argv, sys.getReporter());
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getSobolCheck(Bus::ModuleInstance& instance) {
+    return std::make_shared<SobolCheck>(instance);
+}
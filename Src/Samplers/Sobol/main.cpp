@@ -0,0 +1,150 @@
+#include "../../Shared/CommandAPI.hpp"
+#include "../../Shared/ConfigAPI.hpp"
+#include "../../Shared/SamplerAPI.hpp"
+#include "DataDesc.hpp"
+#include "Sobol.hpp"
+#pragma warning(push, 0)
+#define NOMINMAX
+#include <optix_function_table_definition.h>
+#include <optix_stubs.h>
+#pragma warning(pop)
+
+BUS_MODULE_NAME("Piper.BuiltinSampler.Sobol");
+
+// Owen-scrambled Sobol sampler. The direction numbers are uploaded to a
+// device buffer and every dimension is an SBT record of the same program
+// group, so Kernel.ptx doesn't depend on the scene.
+class Sobol final : public Sampler {
+private:
+    ProgramGroup mInit, mSample;
+    Buffer mDirections;
+    // the host copy for the block mode
+    std::vector<uint32_t> mRows;
+    unsigned mDims, mIndexBits;
+
+public:
+    explicit Sobol(Bus::ModuleInstance& instance) : Sampler(instance) {}
+    SamplerData init(PluginHelper helper, std::shared_ptr<Config> config,
+                     Uint2, unsigned maxDim) override {
+        BUS_TRACE_BEG() {
+            if(maxDim > 4096)
+                BUS_TRACE_THROW(std::runtime_error("Need MaxDim<=4096"));
+            // The other bits of the index hold the pixel key.
+            unsigned indexBits = config->getUint("IndexBits", 16U);
+            if(indexBits < 1 || indexBits > 31)
+                BUS_TRACE_THROW(
+                    std::runtime_error("Need 1<=IndexBits<=31"));
+            // dimension 0 and 1 are used by the pixel position
+            std::vector<uint32_t> directions = sobolDirections(maxDim + 2);
+            mDirections = uploadData(0, directions.data(), directions.size());
+            mRows = directionRows(directions, 2, maxDim);
+            mDims = maxDim;
+            mIndexBits = indexBits;
+            const unsigned* base =
+                static_cast<const unsigned*>(mDirections.get());
+
+            SamplerData res;
+            res.maxSPP = 1U << indexBits;
+            reporter().apply(ReportLevel::Debug,
+                             "maxSPP=" + std::to_string(res.maxSPP),
+                             BUS_DEFSRCLOC());
+
+            const ModuleDesc& mod =
+                helper->getModuleManager()->getModuleFromFile(
+                    modulePath().parent_path() / "Kernel.ptx");
+            OptixProgramGroupDesc desc[2] = {};
+            desc[0].flags = 0;
+            desc[0].kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+            desc[0].callables.moduleDC = mod.handle.get();
+            desc[0].callables.entryFunctionNameDC =
+                mod.map("__direct_callable__init");
+            desc[1].flags = 0;
+            desc[1].kind = OPTIX_PROGRAM_GROUP_KIND_CALLABLES;
+            desc[1].callables.moduleDC = mod.handle.get();
+            desc[1].callables.entryFunctionNameDC =
+                mod.map("__direct_callable__sample");
+            OptixProgramGroup groups[2] = {};
+            OptixProgramGroupOptions opt = {};
+            checkOptixError(optixProgramGroupCreate(
+                helper->getContext(), desc, 2, &opt, nullptr, nullptr, groups));
+            mInit.reset(groups[0]);
+            mSample.reset(groups[1]);
+
+            SobolInitDesc data;
+            data.directions = base;
+            data.indexBits = indexBits;
+            res.sbtData.emplace_back(packSBTRecord(mInit.get(), data));
+            for(unsigned i = 0; i < maxDim; ++i) {
+                SobolDimDesc dim;
+                dim.directions = base;
+                dim.dim = i + 2;
+                dim.indexBits = indexBits;
+                res.sbtData.emplace_back(packSBTRecord(mSample.get(), dim));
+            }
+            res.group.assign(groups, groups + 2);
+            OptixStackSizes stack;
+            checkOptixError(optixProgramGroupGetStackSize(mInit.get(), &stack));
+            res.dssInit = stack.dssDC;
+            checkOptixError(
+                optixProgramGroupGetStackSize(mSample.get(), &stack));
+            res.dssSample = stack.dssDC;
+            return res;
+        }
+        BUS_TRACE_END();
+    }
+    bool generateBlock(unsigned beg, unsigned end, unsigned dims,
+                       float* dst) override {
+        BUS_TRACE_BEG() {
+            if(dims != mDims || beg > end || end > (1ULL << mIndexBits))
+                BUS_TRACE_THROW(std::logic_error("Bad sample block"));
+            sobolBlock(mRows.data(), 2, dims, beg, end, mIndexBits, dst);
+            return true;
+        }
+        BUS_TRACE_END();
+    }
+};
+
+std::shared_ptr<Bus::ModuleFunctionBase>
+getSobolCheck(Bus::ModuleInstance& instance);
+std::shared_ptr<Bus::ModuleFunctionBase>
+getSobolBench(Bus::ModuleInstance& instance);
+
+class Instance final : public Bus::ModuleInstance {
+public:
+    Instance(const fs::path& path, Bus::ModuleSystem& sys)
+        : Bus::ModuleInstance(path, sys) {
+        optixInit();
+    }
+    Bus::ModuleInfo info() const override {
+        Bus::ModuleInfo res;
+        res.name = "Piper.BuiltinSampler.Sobol";
+        res.guid = Bus::str2GUID("{7C1E4B52-93A6-4D0F-B8E2-5F61A0D3C9E7}");
+        res.busVersion = BUS_VERSION;
+        res.version = "0.0.1";
+        res.description = "Owen-scrambled Sobol Sequence Sampler";
+        res.copyright = "Copyright (c) 2019 Zheng Yingwei";
+        res.modulePath = getModulePath();
+        return res;
+    }
+    std::vector<Bus::Name> list(Bus::Name api) const override {
+        if(api == Sampler::getInterface())
+            return { "Sobol" };
+        if(api == Command::getInterface())
+            return { "SobolCheck", "SobolBench" };
+        return {};
+    }
+    std::shared_ptr<Bus::ModuleFunctionBase> instantiate(Name name) override {
+        if(name == "Sobol")
+            return std::make_shared<Sobol>(*this);
+        if(name == "SobolCheck")
+            return getSobolCheck(*this);
+        if(name == "SobolBench")
+            return getSobolBench(*this);
+        return nullptr;
+    }
+};
+
+BUS_API void busInitModule(const Bus::fs::path& path, Bus::ModuleSystem& system,
+                           std::shared_ptr<Bus::ModuleInstance>& instance) {
+    instance = std::make_shared<Instance>(path, system);
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "Shared.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The host side of the alias tables, e.g. the light samplers and the
+// emissive meshes. The kernels mirror sampleAliasTable.
+
+// The weights are scaled to the mean 1 and paired in double, so the error
+// of the float probabilities doesn't accumulate.
+struct AliasWorklist final {
+    std::vector<unsigned> small, large;
+};
+
+inline void pairAliasEntries(std::vector<AliasEntry>& table,
+                             std::vector<double>& scaled, AliasWorklist& list) {
+    while(!list.small.empty() && !list.large.empty()) {
+        unsigned s = list.small.back();
+        list.small.pop_back();
+        unsigned l = list.large.back();
+        table[s].prob = static_cast<float>(scaled[s]);
+        table[s].alias = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if(scaled[l] < 1.0) {
+            list.large.pop_back();
+            list.small.push_back(l);
+        }
+    }
+}
+
+template <typename Func>
+void forEachAliasBlock(size_t blocks, ThreadPool* pool, Func&& func) {
+    if(pool)
+        parallelFor(*pool, blocks, func);
+    else
+        for(size_t i = 0; i < blocks; ++i)
+            func(i);
+}
+
+// Build the alias table of the non-negative weights by the method of Vose.
+// The blocks of the weights are paired in parallel and the leftovers of all
+// blocks are paired in serial, in serial if pool is nullptr. The entries are
+// picked uniformly if all weights are zero.
+inline std::vector<AliasEntry>
+buildAliasTable(const std::vector<float>& weights, ThreadPool* pool) {
+    size_t n = weights.size();
+    std::vector<AliasEntry> table(n);
+    if(n == 0)
+        return table;
+    // The blocks don't depend on the thread count, so the table is the same
+    // in serial and in parallel.
+    constexpr size_t blockSize = 1 << 16;
+    size_t blocks = (n + blockSize - 1) / blockSize;
+    auto weight = [&](size_t i) {
+        float w = weights[i];
+        return w > 0.0f && std::isfinite(w) ? static_cast<double>(w) : 0.0;
+    };
+
+    std::vector<double> sums(blocks);
+    forEachAliasBlock(blocks, pool, [&](size_t b) {
+        size_t end = std::min(n, (b + 1) * blockSize);
+        double sum = 0.0;
+        for(size_t i = b * blockSize; i < end; ++i)
+            sum += weight(i);
+        sums[b] = sum;
+    });
+    double total = 0.0;
+    for(double sum : sums)
+        total += sum;
+    if(total <= 0.0) {
+        for(size_t i = 0; i < n; ++i)
+            table[i] = { 1.0f, static_cast<unsigned>(i),
+                         static_cast<float>(n) };
+        return table;
+    }
+
+    double mean = total / static_cast<double>(n);
+    std::vector<double> scaled(n);
+    std::vector<AliasWorklist> lists(blocks);
+    forEachAliasBlock(blocks, pool, [&](size_t b) {
+        size_t end = std::min(n, (b + 1) * blockSize);
+        AliasWorklist& list = lists[b];
+        for(size_t i = b * blockSize; i < end; ++i) {
+            double w = weight(i);
+            scaled[i] = w / mean;
+            table[i].invPdf = w > 0.0 ? static_cast<float>(total / w) : 0.0f;
+            (scaled[i] < 1.0 ? list.small : list.large)
+                .push_back(static_cast<unsigned>(i));
+        }
+        pairAliasEntries(table, scaled, list);
+    });
+
+    // Every block leaves either the small or the large entries.
+    AliasWorklist rest;
+    for(auto&& list : lists) {
+        rest.small.insert(rest.small.end(), list.small.begin(),
+                          list.small.end());
+        rest.large.insert(rest.large.end(), list.large.begin(),
+                          list.large.end());
+    }
+    pairAliasEntries(table, scaled, rest);
+    // The scaled weights of the leftovers are 1 up to the rounding error.
+    for(auto&& entries : { &rest.small, &rest.large })
+        for(unsigned i : *entries) {
+            table[i].prob = 1.0f;
+            table[i].alias = i;
+        }
+    return table;
+}
+
+// u and v are uniform in [0,1).
+inline unsigned sampleAliasTable(const std::vector<AliasEntry>& table,
+                                 float u, float v) {
+    unsigned n = static_cast<unsigned>(table.size());
+    unsigned id = std::min(static_cast<unsigned>(u * n), n - 1U);
+    return v < table[id].prob ? id : table[id].alias;
+}
@@ -6,7 +6,27 @@ class DriverHelperAPI : private Unmoveable {
 public:
     virtual void
     doRender(const std::function<void(OptixShaderBindingTable&)>& callBack) = 0;
+    // Launch with the given size instead of the film size.
+    virtual void
+    doRender(const std::function<void(OptixShaderBindingTable&)>& callBack,
+             Uint2 launchSize) = 0;
+    // Replace the SBT data of a callable returned by addCallable, e.g. the
+    // camera of the next frame. Call it between the launches.
+    virtual void updateCallable(unsigned id, const Data& sbtData) = 0;
     virtual CUstream getStream() const = 0;
+    // The dimensions provided by the sampler, i.e. the stride of a sample
+    // in the block mode.
+    virtual unsigned sampleDims() const = 0;
+    // Generate the samples [beg,end) on the host, see Sampler::generateBlock.
+    // It may be called from a worker thread.
+    virtual bool generateSamples(unsigned beg, unsigned end, float* dst) = 0;
+    // The hash of the scene description, for validating the saved states.
+    virtual uint64_t fingerprint() const = 0;
+    // Whether the render should continue from the last checkpoint(--resume).
+    virtual bool resume() const = 0;
+    // The sample range [x,y) of this shard in a distributed render(--shard).
+    // x==y means the whole render.
+    virtual Uint2 shard() const = 0;
 };
 using DriverHelper = DriverHelperAPI*;
 
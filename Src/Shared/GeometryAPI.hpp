@@ -17,4 +17,8 @@ public:
     }
 
     virtual GeometryData getData() = 0;
+    // Add the lights of an instance with the transform helper->getTransform().
+    // A shared asset is initialized once, but its lights are added for every
+    // instance.
+    virtual void addLights(PluginHelper helper) {}
 };
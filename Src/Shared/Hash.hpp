@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+// Stable 64-bit FNV-1a, std::hash is not guaranteed to be the same across
+// builds.
+inline uint64_t hashBytes(const void* data, size_t size,
+                          uint64_t seed = 14695981039346656037ULL) {
+    const unsigned char* ptr = static_cast<const unsigned char*>(data);
+    uint64_t res = seed;
+    for(size_t i = 0; i < size; ++i) {
+        res ^= ptr[i];
+        res *= 1099511628211ULL;
+    }
+    return res;
+}
+
+inline uint64_t hashString(const std::string& str,
+                           uint64_t seed = 14695981039346656037ULL) {
+    return hashBytes(str.data(), str.size(), seed);
+}
+
+// Fold the content of the file into key. Return false if the file can't be
+// read, e.g. it has been removed meanwhile.
+inline bool hashFile(const std::filesystem::path& path, uint64_t& key) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    if(ec)
+        return false;
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    std::string data(static_cast<size_t>(size), '\0');
+    if(!in.read(data.data(), data.size()))
+        return false;
+    key = hashString(data, key);
+    return true;
+}
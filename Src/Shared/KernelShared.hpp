@@ -22,14 +22,81 @@ using uint32 = unsigned int;
 
 extern "C" __constant__ LaunchParam launchParam;
 
+// lowbias32 by Chris Wellons
+INLINEDEVICE unsigned hashUint(unsigned x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// The dimensions beyond the sampler are uniform random numbers keyed on the
+// sample index and the dimension, so the deep bounces don't need SBT records.
+INLINEDEVICE float paddedSample(unsigned index, unsigned dim) {
+    const unsigned bits = hashUint(hashUint(index) ^ (dim * 0x9e3779b9u));
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// block points to the pregenerated sample shared by all pixels in the block
+// mode, whose stride is sampleDims. It is decorrelated between the pixels by
+// a Cranley-Patterson rotation keyed on seed, or on the blue-noise keys of
+// the pixel for the dimensions covered by the mask.
 struct SamplerContext final {
     unsigned index, dim;
+    const float* block;
+    unsigned seed;
+    const unsigned* keys;
     __inline__ __device__ float operator()() {
-        return optixDirectCall<float, unsigned>(
-            launchParam.sampleOffset + (dim++), index);
+        const unsigned cur = dim++;
+        if(cur >= launchParam.sampleDims)
+            return paddedSample(index, cur);
+        const float res = block ? block[cur] :
+                                  optixDirectCall<float, unsigned>(
+                                      launchParam.sampleOffset + cur, index);
+        float shift;
+        if(keys && cur + 1 < launchParam.blueNoise.channels)
+            shift = static_cast<float>(keys[cur + 1] >> 8) *
+                (1.0f / 16777216.0f);
+        else if(block)
+            shift = paddedSample(seed, cur);
+        else
+            return res;
+        const float rotated = res + shift;
+        return rotated < 1.0f ? rotated : rotated - 1.0f;
     }
 };
 
+// The keys of the pixel in the blue-noise mask, nullptr without a mask.
+INLINEDEVICE const unsigned* blueNoiseKeys(unsigned x, unsigned y) {
+    const BlueNoiseDesc& mask = launchParam.blueNoise;
+    if(!mask.keys)
+        return nullptr;
+    return mask.keys +
+        ((y % mask.size) * mask.size + x % mask.size) * mask.channels;
+}
+
+// Permute the samples [beg,end) of a render by the ranking key of the pixel,
+// so the neighbouring pixels take different subsets of the range until it is
+// finished. The key is XORed into the bits of id below the largest aligned
+// power of two block which holds id and fits in [beg,end), so the index
+// stays in the range and a prefix of the block is an aligned block too.
+INLINEDEVICE unsigned rankSample(unsigned id, unsigned beg, unsigned end,
+                                 const unsigned* keys) {
+    if(!keys)
+        return id;
+    unsigned bits = 0;
+    while(bits < 31) {
+        const unsigned size = 2U << bits;
+        const unsigned base = id & ~(size - 1U);
+        if(base < beg || end - base < size)
+            break;
+        ++bits;
+    }
+    return bits ? id ^ (keys[0] >> (32 - bits)) : id;
+}
+
 struct SamplerInitResult final {
     unsigned index;
     float px, py;
@@ -56,18 +123,22 @@ INLINEDEVICE RaySample generateRay(unsigned id, float px, float py,
                                                                      sampler);
 }
 
-using PixelSampleFunction = Spectrum (*)(RaySample ray,
-                                         SamplerContext* sampler);
+// aov is nullptr if the driver doesn't record the AOVs.
+using PixelSampleFunction = Spectrum (*)(RaySample ray, SamplerContext* sampler,
+                                         AOVSample* aov);
 
 INLINEDEVICE Spectrum sampleOnePixel(unsigned id, RaySample ray,
-                                     SamplerContext* sampler) {
-    return optixContinuationCall<Spectrum, RaySample, SamplerContext*>(id, ray,
-                                                                       sampler);
+                                     SamplerContext* sampler, AOVSample* aov) {
+    return optixContinuationCall<Spectrum, RaySample, SamplerContext*,
+                                 AOVSample*>(id, ray, sampler, aov);
 }
 
+constexpr unsigned invalidLightId = ~0U;
+
 struct LightSample final {
     Vec3 wi;
     Spectrum rad;
+    unsigned lightId;
 };
 
 using LightSampleFunction = LightSample (*)(const Vec3& pos, float rayTime,
@@ -183,6 +254,17 @@ struct Payload final {
     Vec3 ori, wi;
     Spectrum f, rad;
     SamplerContext* sampler;
+    // Only valid for the primary hit, materials fill the albedo and the
+    // normal.
+    AOVSample* aov;
+    // The light which rad comes from
+    unsigned lightId;
+    // Set by the integrator: the emitter hit by the ray adds its emission.
+    // True for the camera rays and after the specular bounces.
+    bool emission;
+    // Set by the material: the sampled direction isn't covered by its light
+    // sampling, e.g. a specular lobe, so the emitter it hits is counted.
+    bool specular;
     bool hit;
 };
 
@@ -17,6 +17,11 @@ public:
     }
 
     virtual LightData getData() = 0;
+    // An estimate of the emitted power(luminance) for the light samplers.
+    virtual float power() const = 0;
+    // Return false if the light has no finite bounds, e.g. the directional
+    // lights.
+    virtual bool bounds(LightBounds& res) const = 0;
 };
 
 class EnvironmentLight : public Bus::ModuleFunctionBase {
@@ -1,5 +1,5 @@
 #pragma once
-#include "PluginShared.hpp"
+#include "LightAPI.hpp"
 
 struct LightSamplerData final {
     Data sbtData;
@@ -20,5 +20,6 @@ public:
 
     virtual LightSamplerData init(PluginHelper helper,
                                   std::shared_ptr<Config> config,
-                                  size_t lightNum) = 0;
+                                  const std::vector<std::shared_ptr<Light>>&
+                                      lights) = 0;
 };
@@ -14,5 +14,8 @@ public:
     virtual CameraData init(PluginHelper helper,
                             std::shared_ptr<Config> config) = 0;
 
-    virtual Data prepareFrame(Uint2 filmSize) = 0;
+    // The number of frames of the camera animation, 1 for a still camera.
+    virtual unsigned frameCount() const = 0;
+    // The SBT data of the ray generation callable at the given frame.
+    virtual Data prepareFrame(Uint2 filmSize, unsigned frame) = 0;
 };
@@ -61,6 +61,8 @@ private:
 
 public:
     virtual fs::path scenePath() const = 0;
+    // The relative output files are placed in the output directory.
+    virtual fs::path outputPath(const fs::path& path) const = 0;
     virtual OptixDeviceContext getContext() const = 0;
     virtual bool isDebug() const = 0;
     virtual ModuleManager getModuleManager() = 0;
@@ -70,6 +72,11 @@ public:
                                  OptixProgramGroup occGroup,
                                  const Data& occ) = 0;
     virtual void addLight(std::shared_ptr<Light> light) = 0;
+    // The transform from the geometries being instantiated to the world
+    // space, in the layout of SRT::getPointTrans. The nodes compose their
+    // transforms while instantiating the children.
+    virtual Mat4 getTransform() const = 0;
+    virtual void setTransform(const Mat4& transform) = 0;
     template <typename T>
     std::shared_ptr<T> instantiateAsset(std::shared_ptr<Config> cfg) {
         return std::dynamic_pointer_cast<T>(
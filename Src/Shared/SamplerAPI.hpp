@@ -20,4 +20,11 @@ public:
     virtual SamplerData init(PluginHelper helper,
                              std::shared_ptr<Config> config, Uint2 size,
                              unsigned maxDim) = 0;
+    // The block mode: fill dst[(i-beg)*dims+d] with the dimension d of the
+    // sample i, which is shared by all pixels. Return false if the sampler
+    // only supports the callables.
+    virtual bool generateBlock(unsigned beg, unsigned end, unsigned dims,
+                               float* dst) {
+        return false;
+    }
 };
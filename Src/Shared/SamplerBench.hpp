@@ -0,0 +1,198 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The host benchmark of the samplers used by the <Sampler>Bench commands.
+// No CUDA is involved, so it runs in CI without a GPU.
+
+// Fill dst[(i-beg)*dims+d] with the dimension d of the sample i, the same
+// as Sampler::generateBlock.
+using HostSampler = std::function<void(unsigned beg, unsigned end,
+                                       unsigned dims, float* dst)>;
+
+struct SamplerBenchOptions final {
+    // The dimension pairs of [0,dims) are evaluated at the sample counts
+    // 16,64,...,samples.
+    unsigned dims, samples;
+    // The integration error is the RMSE over the randomly rotated replicas,
+    // i.e. the pixels of the block mode.
+    unsigned replicas;
+    // The samples generated for the throughput.
+    unsigned throughputSamples;
+};
+
+struct SamplerBenchRecord final {
+    std::string metric;
+    unsigned dimX, dimY, samples;
+    double value;
+};
+
+// The exact L-infinity star discrepancy of 2D points in O(n^2). The supremum
+// is reached at the corners made of the point coordinates and 1.
+inline double starDiscrepancy(std::vector<std::pair<double, double>> points) {
+    size_t n = points.size();
+    if(n == 0)
+        return 1.0;
+    std::sort(points.begin(), points.end());
+    std::vector<double> ys(n);
+    for(size_t i = 0; i < n; ++i)
+        ys[i] = points[i].second;
+    std::sort(ys.begin(), ys.end());
+    std::vector<unsigned> count(n);
+    // The open boxes right of nothing or below nothing are empty.
+    double res = std::max(points.front().first, ys.front());
+    for(size_t i = 0; i < n; ++i) {
+        size_t rank = std::lower_bound(ys.begin(), ys.end(), points[i].second) -
+            ys.begin();
+        ++count[rank];
+        double x = points[i].first;
+        double nextX = i + 1 < n ? points[i + 1].first : 1.0;
+        // the first i+1 points by x with the y ranks <= j
+        unsigned inside = 0;
+        for(size_t j = 0; j < n; ++j) {
+            inside += count[j];
+            double nextY = j + 1 < n ? ys[j + 1] : 1.0;
+            double frac = static_cast<double>(inside) / n;
+            // the closed box [0,x]x[0,ys[j]]
+            res = std::max(res, frac - x * ys[j]);
+            // the open box [0,nextX)x[0,nextY)
+            res = std::max(res, nextX * nextY - frac);
+        }
+    }
+    return res;
+}
+
+struct SamplerBenchIntegrand final {
+    const char* name;
+    double (*func)(double x, double y);
+    double exact;
+};
+
+// The analytic integrands over [0,1)^2: smooth, separable, with a
+// discontinuity along a diagonal and along a curve.
+inline const std::vector<SamplerBenchIntegrand>& samplerBenchIntegrands() {
+    static const std::vector<SamplerBenchIntegrand> res = {
+        { "Gaussian",
+          [](double x, double y) { return std::exp(-(x * x + y * y)); },
+          // (sqrt(pi)/2*erf(1))^2
+          0.557746285351034 },
+        { "Bilinear", [](double x, double y) { return x * y; }, 0.25 },
+        { "Step", [](double x, double y) { return x + y < 1.0 ? 1.0 : 0.0; },
+          0.5 },
+        { "Disk",
+          [](double x, double y) { return x * x + y * y < 1.0 ? 1.0 : 0.0; },
+          0.785398163397448 },
+    };
+    return res;
+}
+
+inline std::vector<SamplerBenchRecord>
+runSamplerBench(const HostSampler& sampler, const SamplerBenchOptions& opt) {
+    std::vector<SamplerBenchRecord> res;
+    unsigned dims = std::max(opt.dims, 2U);
+    std::vector<float> block(static_cast<size_t>(opt.samples) * dims);
+    sampler(0, opt.samples, dims, block.data());
+    auto value = [&](unsigned i, unsigned d) {
+        return static_cast<double>(block[static_cast<size_t>(i) * dims + d]);
+    };
+
+    std::mt19937 eng(0);
+    std::uniform_real_distribution<double> dis;
+    std::vector<double> shifts(static_cast<size_t>(opt.replicas) * dims);
+    for(auto& shift : shifts)
+        shift = dis(eng);
+    auto rotate = [](double val, double shift) {
+        val += shift;
+        return val < 1.0 ? val : val - 1.0;
+    };
+
+    for(unsigned n = 16; n <= opt.samples; n *= 4)
+        for(unsigned dx = 0; dx < dims; ++dx)
+            for(unsigned dy = dx + 1; dy < dims; ++dy) {
+                std::vector<std::pair<double, double>> points(n);
+                for(unsigned i = 0; i < n; ++i)
+                    points[i] = { value(i, dx), value(i, dy) };
+                res.push_back(
+                    { "StarDiscrepancy", dx, dy, n, starDiscrepancy(points) });
+                for(auto&& integrand : samplerBenchIntegrands()) {
+                    double mse = 0.0;
+                    for(unsigned r = 0; r < opt.replicas; ++r) {
+                        const double* shift = shifts.data() +
+                            static_cast<size_t>(r) * dims;
+                        double sum = 0.0;
+                        for(unsigned i = 0; i < n; ++i)
+                            sum += integrand.func(
+                                rotate(points[i].first, shift[dx]),
+                                rotate(points[i].second, shift[dy]));
+                        double err = sum / n - integrand.exact;
+                        mse += err * err;
+                    }
+                    res.push_back({ std::string("RMSE.") + integrand.name, dx,
+                                    dy, n,
+                                    std::sqrt(mse / std::max(opt.replicas,
+                                                             1U)) });
+                }
+            }
+
+    std::vector<float> tmp(static_cast<size_t>(opt.throughputSamples) * dims);
+    using Clock = std::chrono::high_resolution_clock;
+    auto beg = Clock::now();
+    sampler(0, opt.throughputSamples, dims, tmp.data());
+    double time = std::chrono::duration<double>(Clock::now() - beg).count();
+    res.push_back({ "SamplesPerSecond", 0, dims - 1, opt.throughputSamples,
+                    time > 0.0 ? opt.throughputSamples / time : 0.0 });
+    return res;
+}
+
+// One record per line: sampler,metric,dimX,dimY,samples,value.
+inline void writeSamplerBenchCSV(std::ostream& out, const std::string& name,
+                                 const std::vector<SamplerBenchRecord>& rec,
+                                 bool header) {
+    if(header)
+        out << "sampler,metric,dimX,dimY,samples,value\n";
+    out.precision(9);
+    for(auto&& r : rec)
+        out << name << ',' << r.metric << ',' << r.dimX << ',' << r.dimY << ','
+            << r.samples << ',' << r.value << '\n';
+}
+
+inline void writeSamplerBenchJSON(std::ostream& out, const std::string& name,
+                                  const std::vector<SamplerBenchRecord>& rec) {
+    out.precision(9);
+    out << "{\"sampler\":\"" << name << "\",\"records\":[";
+    for(size_t i = 0; i < rec.size(); ++i) {
+        const SamplerBenchRecord& r = rec[i];
+        out << (i ? "," : "") << "\n{\"metric\":\"" << r.metric
+            << "\",\"dimX\":" << r.dimX << ",\"dimY\":" << r.dimY
+            << ",\"samples\":" << r.samples << ",\"value\":" << r.value
+            << "}";
+    }
+    out << "\n]}\n";
+}
+
+// Write the records as "csv" or "json" to path, "-" is the standard output.
+inline void saveSamplerBench(const std::string& path, const std::string& format,
+                             const std::string& name,
+                             const std::vector<SamplerBenchRecord>& rec) {
+    if(format != "csv" && format != "json")
+        throw std::invalid_argument("Unknown format " + format);
+    std::ofstream file;
+    if(path != "-")
+        file.open(path);
+    std::ostream& out = path == "-" ? std::cout : file;
+    if(format == "csv")
+        writeSamplerBenchCSV(out, name, rec, true);
+    else
+        writeSamplerBenchJSON(out, name, rec);
+    if(!out.flush())
+        throw std::runtime_error("Failed to write " + path);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "PluginShared.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The scaffold of the host checks used by the <Name>Check commands.
+
+// Count the failures and report them at the location of the check.
+class CheckLog final {
+private:
+    Bus::Reporter& mReporter;
+    Bus::SourceLocation mSrcLoc;
+    unsigned mFailed;
+
+public:
+    CheckLog(Bus::Reporter& reporter, const Bus::SourceLocation& srcLoc)
+        : mReporter(reporter), mSrcLoc(srcLoc), mFailed(0) {}
+    void fail(const std::string& msg) {
+        ++mFailed;
+        mReporter.apply(ReportLevel::Error, msg, mSrcLoc);
+    }
+    unsigned failed() const {
+        return mFailed;
+    }
+    // Report the summary with the failure count and return the exit code.
+    int finish(const std::string& summary) {
+        std::stringstream ss;
+        ss << summary << ", " << mFailed << " failures";
+        mReporter.apply(mFailed ? ReportLevel::Error : ReportLevel::Info,
+                        ss.str(), mSrcLoc);
+        return mFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+};
+
+template <typename Func>
+double elapsedMs(Func&& func) {
+    using Clock = std::chrono::high_resolution_clock;
+    auto beg = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - beg)
+        .count();
+}
+
+// The builds with build(nullptr) and build(&pool). The results don't depend
+// on the thread count, the caller compares them.
+template <typename T>
+struct BuildPair final {
+    T serial, parallel;
+    double serialMs, parallelMs;
+    unsigned threads;
+
+    std::string summary() const {
+        std::stringstream ss;
+        ss << "build " << serialMs << " ms(serial) " << parallelMs << " ms("
+           << threads << " threads)";
+        return ss.str();
+    }
+};
+
+template <typename Build>
+auto buildSerialParallel(ThreadPool& pool, Build&& build)
+    -> BuildPair<decltype(build(nullptr))> {
+    BuildPair<decltype(build(nullptr))> res;
+    res.serialMs = elapsedMs([&] { res.serial = build(nullptr); });
+    res.parallelMs = elapsedMs([&] { res.parallel = build(&pool); });
+    res.threads = static_cast<unsigned>(pool.size());
+    return res;
+}
+
+// The sampled count of a bin is about N(e,e) for the expected count e. Only
+// the bins with e>=100 are measured, the deviation is in sigmas.
+template <typename Expected>
+double maxDeviation(const std::vector<unsigned>& count, Expected&& expected) {
+    double worst = 0.0;
+    for(size_t i = 0; i < count.size(); ++i) {
+        double e = expected(i);
+        if(e >= 100.0)
+            worst = std::max(worst, std::fabs(count[i] - e) / std::sqrt(e));
+    }
+    return worst;
+}
+
+// A correct sampler exceeds 6 sigmas with a negligible probability.
+inline void checkDeviation(CheckLog& log, double worst,
+                           const std::string& what) {
+    if(worst > 6.0)
+        log.fail("The frequencies deviate from the " + what + ": " +
+                 std::to_string(worst));
+}
@@ -35,7 +35,47 @@ enum class BxDFType {
 
 enum class SBTSlot : unsigned { sampleOneLight, initSampler, userOffset };
 
+// Per-light contributions are kept for the first maxLightAOV lights.
+constexpr unsigned maxLightAOV = 4;
+
+// The bounds of the emission of the lights in the box [pMin,pMax]. The
+// intensity is at most phi/(4pi) within the angle thetaO of dir and falls
+// off to zero at thetaO+thetaE, see "Importance Sampling of Many Lights with
+// Adaptive Tree Splitting"(Conty Estevez and Kulla 2018).
+struct LightBounds final {
+    Vec3 pMin, pMax, dir;
+    float phi, cosThetaO, cosThetaE;
+};
+
+// Bucket i of the alias table returns the entry i with the probability prob
+// and the entry alias otherwise. invPdf belongs to the entry i.
+struct AliasEntry final {
+    float prob;
+    unsigned alias;
+    float invPdf;
+};
+
+// Extra output channels of one sample, all zero for a miss.
+struct AOVSample final {
+    Spectrum albedo;
+    Vec3 normal;
+    float depth;
+    Spectrum light[maxLightAOV];
+    // The squared luminance of the beauty, filled by the driver.
+    float sqrLum;
+};
+
+// The blue-noise mask of Sampler.BlueNoise tiled over the film, keys is
+// nullptr without a mask. See Piper/BlueNoise.hpp for the layout.
+struct BlueNoiseDesc final {
+    const unsigned* keys;
+    unsigned size, channels;
+};
+
 struct LaunchParam final {
-    unsigned sampleOffset, lightSbtOffset;
+    // sampleDims dimensions are provided by the sampler, the others are
+    // padded by hashing.
+    unsigned sampleOffset, sampleDims, lightSbtOffset;
     OptixTraversableHandle root;
+    BlueNoiseDesc blueNoise;
 };
@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed number of worker threads which execute the submitted tasks in FIFO
+// order. The destructor waits for all submitted tasks.
+class ThreadPool final {
+private:
+    std::vector<std::thread> mWorkers;
+    std::queue<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mStop;
+
+public:
+    explicit ThreadPool(unsigned threadNum = 0) : mStop(false) {
+        if(threadNum == 0)
+            threadNum = std::max(1U, std::thread::hardware_concurrency());
+        for(unsigned i = 0; i < threadNum; ++i)
+            mWorkers.emplace_back([this] {
+                while(true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> guard(mMutex);
+                        mCond.wait(guard,
+                                   [this] { return mStop || !mTasks.empty(); });
+                        if(mTasks.empty())
+                            return;
+                        task = std::move(mTasks.front());
+                        mTasks.pop();
+                    }
+                    task();
+                }
+            });
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(mMutex);
+            mStop = true;
+        }
+        mCond.notify_all();
+        for(auto&& worker : mWorkers)
+            worker.join();
+    }
+    unsigned size() const {
+        return static_cast<unsigned>(mWorkers.size());
+    }
+    // The exception thrown by the task is rethrown by std::future::get.
+    template <typename Func>
+    auto submit(Func&& func) -> std::future<decltype(func())> {
+        using Ret = decltype(func());
+        auto task = std::make_shared<std::packaged_task<Ret()>>(
+            std::forward<Func>(func));
+        std::future<Ret> res = task->get_future();
+        {
+            std::lock_guard<std::mutex> guard(mMutex);
+            mTasks.emplace([task] { (*task)(); });
+        }
+        mCond.notify_one();
+        return res;
+    }
+};
+
+// Call func(i) for i in [0,size) on the worker threads of the pool. Indices
+// are handed out in chunks to keep the scheduling overhead low.
+template <typename Func>
+void parallelFor(ThreadPool& pool, size_t size, Func&& func,
+                 size_t chunk = 1) {
+    std::atomic_size_t next{ 0 };
+    size_t taskNum = std::min<size_t>(pool.size(), (size + chunk - 1) / chunk);
+    std::vector<std::future<void>> tasks;
+    for(size_t i = 0; i < taskNum; ++i)
+        tasks.emplace_back(pool.submit([&] {
+            while(true) {
+                size_t beg = next.fetch_add(chunk);
+                if(beg >= size)
+                    return;
+                size_t end = std::min(size, beg + chunk);
+                for(size_t j = beg; j < end; ++j)
+                    func(j);
+            }
+        }));
+    // Wait for all tasks before rethrowing, they reference the locals.
+    for(auto&& task : tasks)
+        task.wait();
+    for(auto&& task : tasks)
+        task.get();
+}